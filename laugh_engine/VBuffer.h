@@ -1,6 +1,6 @@
 #pragma once
 
-#include "VDevice.h"
+#include "VMemoryAllocator.h"
 
 
 namespace rj
@@ -8,20 +8,27 @@ namespace rj
 	class VBuffer
 	{
 	public:
-		VBuffer(const VDevice &device)
+		VBuffer(const VDevice &device, VMemoryAllocator &allocator)
 			:
 			m_device(device),
-			m_buffer{ m_device, vkDestroyBuffer },
-			m_bufferMemory{ m_device, vkFreeMemory }
+			m_memory{ allocator },
+			m_buffer{ m_device, vkDestroyBuffer }
 		{}
 
 		void init(VkDeviceSize sizeInBytes, VkBufferUsageFlags usage, VkMemoryPropertyFlags memProps)
 		{
-			createBuffer(m_buffer, m_bufferMemory, m_device, m_device, sizeInBytes, usage, memProps);
+			createBuffer(m_buffer, m_device, sizeInBytes, usage);
+			m_memory.allocateForBuffer(m_buffer, memProps);
 
 			m_sizeInBytes = sizeInBytes;
 			m_usage = usage;
 			m_memoryProperties = memProps;
+			m_persistentlyMapped = nullptr;
+
+			// the memory type picked may have more properties than asked for,
+			// e.g. host visible memory is often coherent as well
+			m_hostCoherent = (m_memory.allocation().memoryProperties & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+			m_nonCoherentAtomSize = m_memory.allocator().getNonCoherentAtomSize();
 		}
 
 		void *mapBuffer(VkDeviceSize offset = 0, VkDeviceSize sizeInBytes = 0) const
@@ -29,16 +36,48 @@ namespace rj
 			assert((m_memoryProperties & (VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT))
 				== (VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT));
 			assert(offset < m_sizeInBytes && offset + sizeInBytes <= m_sizeInBytes);
+			assert(!m_persistentlyMapped);
 
-			sizeInBytes = sizeInBytes == 0 ? m_sizeInBytes : sizeInBytes;
-			void *mapped = nullptr;
-			vkMapMemory(m_device, m_bufferMemory, offset, sizeInBytes, 0, &mapped);
-			return mapped;
+			// host visible memory is mapped by the allocator for as long as it lives
+			return m_memory.allocation().mapped + offset;
 		}
 
+		// Nothing to unmap, kept so that mapBuffer calls stay paired
 		void unmapBuffer() const
 		{
-			vkUnmapMemory(m_device, m_bufferMemory);
+		}
+
+		// mapBuffer/unmapBuffer can't be used on the buffer afterwards.
+		// Writes to memory that isn't host coherent only become visible to the device after flushMappedRange
+		void *mapBufferPersistently()
+		{
+			assert(m_memoryProperties & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+
+			m_persistentlyMapped = m_memory.allocation().mapped;
+			return m_persistentlyMapped;
+		}
+
+		// No-op for host coherent memory. Otherwise the range is widened to multiples of nonCoherentAtomSize,
+		// the allocator aligns non coherent allocations to those so the widened range stays within this buffer
+		void flushMappedRange(VkDeviceSize offset, VkDeviceSize sizeInBytes) const
+		{
+			assert(m_persistentlyMapped && offset + sizeInBytes <= m_sizeInBytes);
+			if (m_hostCoherent || sizeInBytes == 0) return;
+
+			const VMemoryAllocation &allocation = m_memory.allocation();
+			offset += allocation.offset;
+
+			VkMappedMemoryRange range = {};
+			range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+			range.memory = allocation.memory;
+			range.offset = offset / m_nonCoherentAtomSize * m_nonCoherentAtomSize;
+			VkDeviceSize end = (offset + sizeInBytes + m_nonCoherentAtomSize - 1) / m_nonCoherentAtomSize * m_nonCoherentAtomSize;
+			range.size = end >= allocation.memorySize ? VK_WHOLE_SIZE : end - range.offset;
+
+			if (vkFlushMappedMemoryRanges(m_device, 1, &range) != VK_SUCCESS)
+			{
+				throw std::runtime_error("failed to flush mapped buffer memory!");
+			}
 		}
 
 		operator VkBuffer() const { return m_buffer; }
@@ -46,15 +85,20 @@ namespace rj
 		VkDeviceSize size() const { return m_sizeInBytes; }
 		VkBufferUsageFlags usage() const { return m_usage; }
 		VkMemoryPropertyFlags memoryProperties() const { return m_memoryProperties; }
+		bool isHostCoherent() const { return m_hostCoherent; }
 
 	protected:
 		const VDevice &m_device;
 
+		VMemory m_memory; // declared first so the buffer is destroyed before its memory is freed
 		VDeleter<VkBuffer> m_buffer;
-		VDeleter<VkDeviceMemory> m_bufferMemory;
 
 		VkDeviceSize m_sizeInBytes;
 		VkBufferUsageFlags m_usage;
 		VkMemoryPropertyFlags m_memoryProperties;
+
+		bool m_hostCoherent = false;
+		VkDeviceSize m_nonCoherentAtomSize = 1;
+		void *m_persistentlyMapped = nullptr;
 	};
 }
\ No newline at end of file
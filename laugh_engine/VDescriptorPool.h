@@ -14,12 +14,13 @@ namespace rj
 			m_descriptorPool{ device, vkDestroyDescriptorPool }
 		{}
 
-		void init(uint32_t maxNumSets, const std::vector<VkDescriptorPoolSize> &poolSizes)
+		void init(uint32_t maxNumSets, const std::vector<VkDescriptorPoolSize> &poolSizes, VkDescriptorPoolCreateFlags flags = 0)
 		{
 			assert(!poolSizes.empty());
 
 			VkDescriptorPoolCreateInfo poolInfo = {};
 			poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+			poolInfo.flags = flags;
 			poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
 			poolInfo.pPoolSizes = poolSizes.data();
 			poolInfo.maxSets = maxNumSets;
@@ -2,6 +2,7 @@
 
 #include <vector>
 #include <set>
+#include <cstring>
 
 #include "vk_helpers.h"
 #include "VDeleter.h"
@@ -26,13 +27,17 @@ namespace rj
 			const VDeleter<VkInstance> &instance,
 			const VDeleter<VkSurfaceKHR> &surface,
 			const std::vector<const char *> &deviceExtensions,
-			const VkPhysicalDeviceFeatures &enabledFeatures = {})
+			const VkPhysicalDeviceFeatures &enabledFeatures = {},
+			const void *enabledFeaturesNext = nullptr,
+			const std::vector<const char *> &optionalDeviceExtensions = {})
 			:
 			m_enableValidationLayers(enableValidationLayers), m_validationLayers(layerNames),
 			m_instance(instance), m_surface(surface),
-			m_deviceExtensions(deviceExtensions), m_enabledDeviceFeatures(enabledFeatures)
+			m_deviceExtensions(deviceExtensions), m_optionalDeviceExtensions(optionalDeviceExtensions),
+			m_enabledDeviceFeatures(enabledFeatures), m_enabledFeaturesNext(enabledFeaturesNext)
 		{
 			pickPhysicalDevice();
+			enableOptionalExtensions();
 			createLogicalDevice();
 		}
 
@@ -60,6 +65,19 @@ namespace rj
 		VkQueue getComputeQueue() const { assert(m_computeQueue); return m_computeQueue; }
 		VkQueue getPresentQueue() const { assert(m_presentQueue); return m_presentQueue; }
 
+		// Required extensions and the optional ones the device supports
+		bool isExtensionEnabled(const char *extensionName) const
+		{
+			for (const char *extension : m_deviceExtensions)
+			{
+				if (strcmp(extension, extensionName) == 0) return true;
+			}
+			return false;
+		}
+
+		// VK_KHR_present_id and VK_KHR_present_wait, both extensions with their features
+		bool isPresentWaitEnabled() const { return m_presentWaitEnabled; }
+
 	protected:
 		void pickPhysicalDevice()
 		{
@@ -86,6 +104,39 @@ namespace rj
 			throw std::runtime_error("failed to find a suitable GPU!");
 		}
 
+		void enableOptionalExtensions()
+		{
+			for (const char *extension : m_optionalDeviceExtensions)
+			{
+				if (checkDeviceExtensionSupport(m_physicalDevice, { extension })) m_deviceExtensions.push_back(extension);
+			}
+
+#ifdef VK_KHR_present_wait
+			// an extension may be there without its feature, so present wait is only used when both features are
+			if (isExtensionEnabled(VK_KHR_PRESENT_ID_EXTENSION_NAME) && isExtensionEnabled(VK_KHR_PRESENT_WAIT_EXTENSION_NAME))
+			{
+				m_presentIdFeatures = {};
+				m_presentIdFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+				m_presentWaitFeatures = {};
+				m_presentWaitFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+				m_presentWaitFeatures.pNext = &m_presentIdFeatures;
+
+				VkPhysicalDeviceFeatures2 features = {};
+				features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+				features.pNext = &m_presentWaitFeatures;
+				vkGetPhysicalDeviceFeatures2(m_physicalDevice, &features);
+
+				m_presentWaitEnabled = m_presentIdFeatures.presentId && m_presentWaitFeatures.presentWait;
+				if (m_presentWaitEnabled)
+				{
+					// enabled in front of the app's feature structs
+					m_presentIdFeatures.pNext = const_cast<void *>(m_enabledFeaturesNext);
+					m_enabledFeaturesNext = &m_presentWaitFeatures;
+				}
+			}
+#endif
+		}
+
 		bool isDeviceSuitable(VkPhysicalDevice physicalDevice)
 		{
 			m_queueFamilyIndices.clear();
@@ -134,6 +185,7 @@ namespace rj
 
 			VkDeviceCreateInfo createInfo = {};
 			createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+			createInfo.pNext = m_enabledFeaturesNext; // feature structs of extensions
 			createInfo.pQueueCreateInfos = queueCreateInfos.data();
 			createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
 			createInfo.pEnabledFeatures = &m_enabledDeviceFeatures;
@@ -167,7 +219,15 @@ namespace rj
 		const VDeleter<VkInstance> &m_instance;
 		const VDeleter<VkSurfaceKHR> &m_surface;
 		std::vector<const char *> m_deviceExtensions;
+		std::vector<const char *> m_optionalDeviceExtensions;
 		VkPhysicalDeviceFeatures m_enabledDeviceFeatures;
+		const void *m_enabledFeaturesNext;
+
+		bool m_presentWaitEnabled = false;
+#ifdef VK_KHR_present_wait
+		VkPhysicalDevicePresentIdFeaturesKHR m_presentIdFeatures;
+		VkPhysicalDevicePresentWaitFeaturesKHR m_presentWaitFeatures;
+#endif
 
 		VkPhysicalDevice m_physicalDevice = VK_NULL_HANDLE; // implicitly destroyed when the instance is destroyed
 		VDeleter<VkDevice> m_device{ vkDestroyDevice }; // support only one logical device right now
@@ -1,6 +1,6 @@
 #pragma once
 
-#include "VDevice.h"
+#include "VMemoryAllocator.h"
 
 
 namespace rj
@@ -8,19 +8,20 @@ namespace rj
 	class VImage
 	{
 	public:
-		VImage(const VDevice &device)
+		VImage(const VDevice &device, VMemoryAllocator &allocator)
 			:
 			m_device(device),
-			m_image{ m_device, vkDestroyImage },
-			m_imageMemory{ m_device, vkFreeMemory }
+			m_memory{ allocator },
+			m_image{ m_device, vkDestroyImage }
 		{}
 
 		void initAs2DImage(uint32_t width, uint32_t height, VkFormat format, VkImageUsageFlags usage, VkMemoryPropertyFlags memProps,
 			uint32_t mipLevels = 1, uint32_t arrayLayers = 1, VkSampleCountFlagBits sampleCount = VK_SAMPLE_COUNT_1_BIT,
 			VkImageLayout initialLayout = VK_IMAGE_LAYOUT_PREINITIALIZED, VkImageTiling tiling = VK_IMAGE_TILING_OPTIMAL)
 		{
-			createImage(m_image, m_imageMemory, m_device, m_device, format, VK_IMAGE_TYPE_2D, tiling, usage, memProps, width, height, 1,
+			createImage(m_image, m_device, format, VK_IMAGE_TYPE_2D, tiling, usage, width, height, 1,
 				mipLevels, arrayLayers, 0, sampleCount, initialLayout);
+			m_memory.allocateForImage(m_image, memProps, tiling, usage);
 
 			m_isCubeImage = false;
 			m_extent = { width, height, 1 };
@@ -38,8 +39,9 @@ namespace rj
 		void initAsCubeImage(uint32_t width, uint32_t height, VkFormat format, VkImageUsageFlags usage, VkMemoryPropertyFlags memProps,
 			uint32_t mipLevels = 1, VkImageLayout initialLayout = VK_IMAGE_LAYOUT_PREINITIALIZED, VkImageTiling tiling = VK_IMAGE_TILING_OPTIMAL)
 		{
-			createImage(m_image, m_imageMemory, m_device, m_device, format, VK_IMAGE_TYPE_2D, tiling, usage, memProps, width, height, 1,
+			createImage(m_image, m_device, format, VK_IMAGE_TYPE_2D, tiling, usage, width, height, 1,
 				mipLevels, 6, VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT, VK_SAMPLE_COUNT_1_BIT, initialLayout);
+			m_memory.allocateForImage(m_image, memProps, tiling, usage);
 
 			m_isCubeImage = true;
 			m_extent = { width, height, 1 };
@@ -86,8 +88,8 @@ namespace rj
 	protected:
 		const VDevice &m_device;
 		
+		VMemory m_memory; // declared first so the image is destroyed before its memory is freed
 		VDeleter<VkImage> m_image;
-		VDeleter<VkDeviceMemory> m_imageMemory;
 
 		bool m_isCubeImage;
 		VkExtent3D m_extent;
@@ -15,6 +15,7 @@
 #include "VFramebuffer.h"
 #include "VDescriptorPool.h"
 #include "VQueryPool.h"
+#include "array_ref.h"
 
 
 namespace rj
@@ -42,6 +43,7 @@ namespace rj
 		{
 			std::vector<std::vector<VkSampler>> immutableSamplers;
 			std::vector<VkDescriptorSetLayoutBinding> bindings;
+			std::vector<VkDescriptorBindingFlagsEXT> bindingFlags;
 		};
 
 		struct PipelineLayoutCreateInfo
@@ -184,9 +186,16 @@ namespace rj
 		struct DescriptorPoolCreateInfo
 		{
 			uint32_t maxSetCount;
+			VkDescriptorPoolCreateFlags flags;
 			std::vector<VkDescriptorPoolSize> poolSizes;
 		};
 
+		struct DescriptorUpdateTemplateCreateInfo
+		{
+			uint32_t setLayoutName;
+			std::vector<VkDescriptorUpdateTemplateEntry> entries;
+		};
+
 		struct DescriptorSetUpdateInfo
 		{
 			std::unordered_map<uint32_t, std::vector<VkDescriptorBufferInfo>> bufferInfos;
@@ -199,8 +208,37 @@ namespace rj
 			std::vector<VkCommandBuffer> cmdBuffers;
 			std::vector<VkPipelineStageFlags> waitStages;
 			std::vector<VkSemaphore> waitSemaphores;
+			std::vector<uint64_t> waitValues; // 0 for binary semaphores
 			std::vector<VkSemaphore> signalSemaphores;
+			std::vector<uint64_t> signalValues;
+		};
+
+		// One timeline semaphore per queue, every submit to the queue signals the next value. The completed value
+		// is what the host has last seen, so checks for values up to it don't go to the driver
+		struct QueueTimeline
+		{
+			uint32_t semaphoreName = std::numeric_limits<uint32_t>::max();
+			uint64_t submittedValue = 0;
+			uint64_t completedValue = 0;
 		};
+
+		// Makes a submit wait until the timeline of @queueType reached @value
+		struct TimelineWait
+		{
+			VkQueueFlags queueType;
+			uint64_t value;
+			VkPipelineStageFlags stageMask;
+		};
+
+		// Per-thread storage for translating names into Vulkan handles. It keeps its capacity, so recording
+		// a frame stops allocating once the largest array has been seen. Valid until the next call for the same type
+		template <typename T>
+		T *getScratchArray(size_t count)
+		{
+			thread_local std::vector<T> scratch;
+			if (scratch.size() < count) scratch.resize(count);
+			return scratch.data();
+		}
 	}
 
 	using namespace helper_functions;
@@ -226,15 +264,20 @@ namespace rj
 			GLFWkeyfun keyfun = nullptr, GLFWmousebuttonfun mousebuttonfun = nullptr,
 			GLFWcursorposfun cursorposfun = nullptr, GLFWscrollfun scrollfun = nullptr, GLFWwindowsizefun windowsizefun = nullptr,
 			uint32_t winWidth = 1920, uint32_t winHeight = 1080, const std::string &winTitle = "",
-			const VkPhysicalDeviceFeatures &enabledFeatures = {})
+			const VkPhysicalDeviceFeatures &enabledFeatures = {},
+			const std::vector<const char *> &deviceExtensions = {}, const void *enabledFeaturesNext = nullptr,
+			const std::vector<const char *> &optionalDeviceExtensions = {})
 			:
 			m_instance{ m_enableValidationLayers,{ "VK_LAYER_LUNARG_standard_validation" }, VWindow::getRequiredExtensions() },
 			m_window{ m_instance, winWidth, winHeight, winTitle, app, keyfun, mousebuttonfun, cursorposfun, scrollfun, windowsizefun },
-			m_device{ m_enableValidationLayers,{ "VK_LAYER_LUNARG_standard_validation" }, m_instance, m_window,{ VK_KHR_SWAPCHAIN_EXTENSION_NAME }, enabledFeatures },
+			m_device{ m_enableValidationLayers,{ "VK_LAYER_LUNARG_standard_validation" }, m_instance, m_window,
+				withSwapChainExtension(deviceExtensions), enabledFeatures, enabledFeaturesNext, optionalDeviceExtensions },
 			m_swapChain{ m_device, m_window }
 		{
 			createPipelineCache();
 			createSingleSubmitCommandPool();
+			loadDeviceFunctions();
+			createQueueTimelines();
 		}
 
 		virtual ~VManager() {}
@@ -421,9 +464,11 @@ namespace rj
 			m_descriptorSetLayouts[m_curSetLayoutName] = VDeleter<VkDescriptorSetLayout>{ m_device, vkDestroyDescriptorSetLayout };
 		}
 
+		// @bindingFlags (e.g. partially bound, update after bind) need VK_EXT_descriptor_indexing
 		void setLayoutAddBinding(uint32_t bindingPoint, VkDescriptorType type, VkShaderStageFlags shaderStages,
-			uint32_t count = 1, const std::vector<uint32_t> &immutableSamplerNames = {})
+			uint32_t count = 1, const std::vector<uint32_t> &immutableSamplerNames = {}, VkDescriptorBindingFlagsEXT bindingFlags = 0)
 		{
+			m_curSetLayoutInfo.bindingFlags.push_back(bindingFlags);
 			m_curSetLayoutInfo.bindings.push_back({});
 			VkDescriptorSetLayoutBinding &binding = m_curSetLayoutInfo.bindings.back();
 			m_curSetLayoutInfo.immutableSamplers.push_back({});
@@ -456,13 +501,24 @@ namespace rj
 			}
 		}
 
-		uint32_t endCreateDescriptorSetLayout()
+		uint32_t endCreateDescriptorSetLayout(VkDescriptorSetLayoutCreateFlags flags = 0)
 		{
 			VkDescriptorSetLayoutCreateInfo layoutInfo = {};
 			layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+			layoutInfo.flags = flags;
 			layoutInfo.bindingCount = static_cast<uint32_t>(m_curSetLayoutInfo.bindings.size());
 			layoutInfo.pBindings = m_curSetLayoutInfo.bindings.data();
 
+			// only chained if some binding has flags, so that layouts work without the extension
+			VkDescriptorSetLayoutBindingFlagsCreateInfoEXT bindingFlagsInfo = {};
+			bindingFlagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT;
+			bindingFlagsInfo.bindingCount = layoutInfo.bindingCount;
+			bindingFlagsInfo.pBindingFlags = m_curSetLayoutInfo.bindingFlags.data();
+			for (auto bindingFlags : m_curSetLayoutInfo.bindingFlags)
+			{
+				if (bindingFlags != 0) layoutInfo.pNext = &bindingFlagsInfo;
+			}
+
 			if (vkCreateDescriptorSetLayout(m_device, &layoutInfo, nullptr, m_descriptorSetLayouts[m_curSetLayoutName].replace()) != VK_SUCCESS)
 			{
 				throw std::runtime_error("failed to create descriptor set layout!");
@@ -1080,7 +1136,7 @@ namespace rj
 			else
 			{
 				imageName = static_cast<uint32_t>(m_images.size());
-				m_images.emplace_back(m_device);
+				m_images.emplace_back(m_device, m_memoryAllocator);
 			}
 
 			m_images.at(imageName).initAs2DImage(width, height, format, usage, memProps, mipLevels, arrayLayers, sampleCount, initialLayout, tiling);
@@ -1101,7 +1157,7 @@ namespace rj
 			else
 			{
 				imageName = static_cast<uint32_t>(m_images.size());
-				m_images.emplace_back(m_device);
+				m_images.emplace_back(m_device, m_memoryAllocator);
 			}
 
 			m_images.at(imageName).initAsCubeImage(width, height, format, usage, memProps, mipLevels, initialLayout, tiling);
@@ -1190,7 +1246,7 @@ namespace rj
 
 			transitionImageLayout(imageName, currentLayout, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
 
-			VBuffer stagingBuffer{ m_device };
+			VBuffer stagingBuffer{ m_device, m_memoryAllocator };
 			stagingBuffer.init(sizeInBytes, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
 				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
 
@@ -1246,7 +1302,7 @@ namespace rj
 
 			const VkDeviceSize sizeInBytes = offset;
 
-			VBuffer stagingBuffer{ m_device };
+			VBuffer stagingBuffer{ m_device, m_memoryAllocator };
 			stagingBuffer.init(sizeInBytes, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
 				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
 
@@ -1276,7 +1332,7 @@ namespace rj
 			else
 			{
 				bufferName = static_cast<uint32_t>(m_buffers.size());
-				m_buffers.emplace_back(m_device);
+				m_buffers.emplace_back(m_device, m_memoryAllocator);
 			}
 
 			m_buffers.at(bufferName).init(sizeInBytes, usage, memProps);
@@ -1297,7 +1353,7 @@ namespace rj
 
 			auto &dstBuffer = m_buffers.at(bufferName);
 
-			VBuffer stagingBuffer{ m_device };
+			VBuffer stagingBuffer{ m_device, m_memoryAllocator };
 			stagingBuffer.init(sizeInBytes, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
 				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
 
@@ -1322,8 +1378,33 @@ namespace rj
 			auto &buffer = m_buffers.at(bufferName);
 			buffer.unmapBuffer();
 		}
+
+		// Stays mapped, mapBuffer/unmapBuffer can't be used on the buffer anymore
+		void *mapBufferPersistently(uint32_t bufferName)
+		{
+			auto &buffer = m_buffers.at(bufferName);
+			return buffer.mapBufferPersistently();
+		}
+
+		// Makes host writes to a persistently mapped buffer visible to the device, no-op if its memory is host coherent
+		void flushMappedBufferRange(uint32_t bufferName, VkDeviceSize offset, VkDeviceSize sizeInBytes) const
+		{
+			const auto &buffer = m_buffers.at(bufferName);
+			buffer.flushMappedRange(offset, sizeInBytes);
+		}
+
+		bool isBufferHostCoherent(uint32_t bufferName) const
+		{
+			return m_buffers.at(bufferName).isHostCoherent();
+		}
 		// --- Buffer related ---
 
+		// Buffers and images are sub-allocated from shared blocks, see VMemoryAllocator
+		VMemoryAllocator::Stats getDeviceMemoryStats() const
+		{
+			return m_memoryAllocator.getStats();
+		}
+
 		// --- Sampler related ---
 		uint32_t createSampler(VkFilter magFilter, VkFilter minFilter, VkSamplerMipmapMode mipmapMode,
 			VkSamplerAddressMode addressModeU, VkSamplerAddressMode addressModeV, VkSamplerAddressMode addressModeW,
@@ -1502,10 +1583,11 @@ namespace rj
 		// --- GPU Queries ---
 
 		// --- Descriptor pool related ---
-		void beginCreateDescriptorPool(uint32_t maxNumSets)
+		void beginCreateDescriptorPool(uint32_t maxNumSets, VkDescriptorPoolCreateFlags flags = 0)
 		{
 			m_curDescriptorPoolInfo = {};
 			m_curDescriptorPoolInfo.maxSetCount = maxNumSets;
+			m_curDescriptorPoolInfo.flags = flags;
 			m_curDescriptorPoolName = static_cast<uint32_t>(m_descriptorPools.size());
 			m_descriptorPools.emplace(std::piecewise_construct, std::forward_as_tuple(m_curDescriptorPoolName),
 				std::forward_as_tuple(m_device));
@@ -1525,7 +1607,7 @@ namespace rj
 		{
 			uint32_t maxSet = m_curDescriptorPoolInfo.maxSetCount;
 			auto &poolSizes = m_curDescriptorPoolInfo.poolSizes;
-			m_descriptorPools.at(m_curDescriptorPoolName).init(maxSet, poolSizes);
+			m_descriptorPools.at(m_curDescriptorPoolName).init(maxSet, poolSizes, m_curDescriptorPoolInfo.flags);
 			
 			m_poolSetTable[m_curDescriptorPoolName] = {};
 
@@ -1679,6 +1761,97 @@ namespace rj
 		}
 		// --- Descriptor sets ---
 
+		// --- Descriptor update templates ---
+		// A template is created once per set layout and updates whole sets from a packed struct that holds
+		// VkDescriptorBufferInfo / VkDescriptorImageInfo at the offsets given to descriptorUpdateTemplateAddEntry(),
+		// so updates build no intermediate VkWriteDescriptorSet arrays
+		void beginCreateDescriptorUpdateTemplate(uint32_t setLayoutName)
+		{
+			m_curDescriptorUpdateTemplateInfo = {};
+			m_curDescriptorUpdateTemplateInfo.setLayoutName = setLayoutName;
+		}
+
+		// @count descriptors starting at @baseArrayElement are read from @offset in the struct, @stride bytes apart
+		// (0 means tightly packed)
+		void descriptorUpdateTemplateAddEntry(uint32_t binding, VkDescriptorType type, size_t offset,
+			uint32_t count = 1, size_t stride = 0, uint32_t baseArrayElement = 0)
+		{
+			const bool isBuffer = type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER || type == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER ||
+				type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC || type == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+			assert(type != VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER && type != VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER);
+
+			VkDescriptorUpdateTemplateEntry entry = {};
+			entry.dstBinding = binding;
+			entry.dstArrayElement = baseArrayElement;
+			entry.descriptorCount = count;
+			entry.descriptorType = type;
+			entry.offset = offset;
+			entry.stride = stride != 0 ? stride : (isBuffer ? sizeof(VkDescriptorBufferInfo) : sizeof(VkDescriptorImageInfo));
+			m_curDescriptorUpdateTemplateInfo.entries.push_back(entry);
+		}
+
+		uint32_t endCreateDescriptorUpdateTemplate()
+		{
+			const auto &entries = m_curDescriptorUpdateTemplateInfo.entries;
+			assert(!entries.empty());
+
+			VkDescriptorUpdateTemplateCreateInfo templateInfo = {};
+			templateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO;
+			templateInfo.descriptorUpdateEntryCount = static_cast<uint32_t>(entries.size());
+			templateInfo.pDescriptorUpdateEntries = entries.data();
+			templateInfo.templateType = VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET;
+			templateInfo.descriptorSetLayout = m_descriptorSetLayouts.at(m_curDescriptorUpdateTemplateInfo.setLayoutName);
+
+			const uint32_t templateName = static_cast<uint32_t>(m_descriptorUpdateTemplates.size());
+			m_descriptorUpdateTemplates.emplace_back(m_device, vkDestroyDescriptorUpdateTemplate);
+
+			if (vkCreateDescriptorUpdateTemplate(m_device, &templateInfo, nullptr, m_descriptorUpdateTemplates.back().replace()) != VK_SUCCESS)
+			{
+				throw std::runtime_error("failed to create descriptor update template");
+			}
+
+			m_curDescriptorUpdateTemplateInfo = {};
+			return templateName;
+		}
+
+		// Fill the packed structs of templates
+		VkDescriptorBufferInfo getDescriptorBufferInfo(uint32_t bufferName, VkDeviceSize offset, VkDeviceSize sizeInBytes)
+		{
+			VkDescriptorBufferInfo info = {};
+			info.buffer = m_buffers.at(bufferName);
+			info.offset = offset;
+			info.range = sizeInBytes;
+			return info;
+		}
+
+		VkDescriptorImageInfo getDescriptorImageInfo(VkImageLayout layout, uint32_t imageViewName,
+			uint32_t samplerName = std::numeric_limits<uint32_t>::max())
+		{
+			VkDescriptorImageInfo info = {};
+			info.sampler = samplerName == std::numeric_limits<uint32_t>::max() ? VK_NULL_HANDLE : VkSampler(m_samplers.at(samplerName));
+			info.imageView = m_imageViews.at(imageViewName);
+			info.imageLayout = layout;
+			return info;
+		}
+
+		void updateDescriptorSetWithTemplate(uint32_t setName, uint32_t templateName, const void *pData)
+		{
+			vkUpdateDescriptorSetWithTemplate(m_device, m_descriptorSets[setName], m_descriptorUpdateTemplates[templateName], pData);
+		}
+
+		// Updates @setCount sets in one call, set i from the struct at @pData + i * @dataStride
+		void updateDescriptorSetsWithTemplate(const uint32_t *setNames, uint32_t setCount, uint32_t templateName,
+			const void *pData, size_t dataStride)
+		{
+			const VkDescriptorUpdateTemplate updateTemplate = m_descriptorUpdateTemplates[templateName];
+			const char *data = reinterpret_cast<const char *>(pData);
+			for (uint32_t i = 0; i < setCount; ++i)
+			{
+				vkUpdateDescriptorSetWithTemplate(m_device, m_descriptorSets[setNames[i]], updateTemplate, data + i * dataStride);
+			}
+		}
+		// --- Descriptor update templates ---
+
 		// --- Command pool related ---
 		uint32_t createCommandPool(VkQueueFlagBits submitQueueType, VkCommandPoolCreateFlags flags = 0)
 		{
@@ -1827,7 +2000,8 @@ namespace rj
 			return commandBufferNames;
 		}
 
-		// TODO: support secondary command buffer
+		// Holds a shared lock on the command buffer table until endCommandBuffer(), so a thread
+		// records one command buffer at a time
 		void beginCommandBuffer(uint32_t commandBufferName, VkCommandBufferUsageFlags flags = 0) const
 		{
 			g_commandBufferMutex.lock_shared(); // some command buffer(s) are in-use
@@ -1844,6 +2018,33 @@ namespace rj
 			}
 		}
 
+		// For a secondary command buffer executed inside @subpass of @renderPassName. @framebufferName is optional.
+		// Several threads may record at once as long as no two of them use command buffers from the same pool
+		void beginSecondaryCommandBuffer(uint32_t commandBufferName, uint32_t renderPassName, uint32_t subpass,
+			uint32_t framebufferName = std::numeric_limits<uint32_t>::max(), VkCommandBufferUsageFlags flags = 0) const
+		{
+			g_commandBufferMutex.lock_shared(); // some command buffer(s) are in-use
+
+			const auto &commandBuffer = m_commandBuffers.at(commandBufferName);
+
+			VkCommandBufferInheritanceInfo inheritanceInfo = {};
+			inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+			inheritanceInfo.renderPass = m_renderPasses.at(renderPassName);
+			inheritanceInfo.subpass = subpass;
+			inheritanceInfo.framebuffer = framebufferName == std::numeric_limits<uint32_t>::max() ?
+				VK_NULL_HANDLE : static_cast<VkFramebuffer>(m_framebuffers.at(framebufferName));
+
+			VkCommandBufferBeginInfo info = {};
+			info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+			info.flags = flags | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+			info.pInheritanceInfo = &inheritanceInfo;
+
+			if (vkBeginCommandBuffer(commandBuffer, &info) != VK_SUCCESS)
+			{
+				throw std::runtime_error("Unable to begin secondary command buffer");
+			}
+		}
+
 		void endCommandBuffer(uint32_t commandBufferName) const
 		{
 			const auto &commandBuffer = m_commandBuffers.at(commandBufferName);
@@ -1858,20 +2059,20 @@ namespace rj
 			g_commandBufferMutex.unlock_shared();
 		}
 
-		void cmdBindVertexBuffers(uint32_t cmdBufferName, const std::vector<uint32_t> &bufferNames,
-			const std::vector<VkDeviceSize> &offsets, uint32_t firstBinding = 0) const
+		void cmdBindVertexBuffers(uint32_t cmdBufferName, ArrayRef<uint32_t> bufferNames,
+			ArrayRef<VkDeviceSize> offsets, uint32_t firstBinding = 0) const
 		{
 			const auto &cmdBuffer = m_commandBuffers.at(cmdBufferName);
+			assert(offsets.size() == bufferNames.size());
 
 			uint32_t numVertBuffers = static_cast<uint32_t>(bufferNames.size());
-			std::vector<VkBuffer> vertBuffers;
-			vertBuffers.reserve(numVertBuffers);
-			for (auto name : bufferNames)
+			VkBuffer *vertBuffers = getScratchArray<VkBuffer>(numVertBuffers);
+			for (uint32_t i = 0; i < numVertBuffers; ++i)
 			{
-				vertBuffers.push_back(m_buffers.at(name));
+				vertBuffers[i] = m_buffers.at(bufferNames[i]);
 			}
 
-			vkCmdBindVertexBuffers(cmdBuffer, firstBinding, numVertBuffers, vertBuffers.data(), offsets.data());
+			vkCmdBindVertexBuffers(cmdBuffer, firstBinding, numVertBuffers, vertBuffers, offsets.data());
 		}
 
 		void cmdBindIndexBuffer(uint32_t cmdBufferName, uint32_t indexBufferName, VkIndexType type, VkDeviceSize offset = 0) const
@@ -1883,7 +2084,7 @@ namespace rj
 		}
 
 		void cmdBeginRenderPass(uint32_t cmdBufferName, uint32_t renderPassName, uint32_t frameBufferName,
-			const std::vector<VkClearValue> &clearValues, VkRect2D renderArea = {}, VkSubpassContents subpassContents = VK_SUBPASS_CONTENTS_INLINE) const
+			ArrayRef<VkClearValue> clearValues, VkRect2D renderArea = {}, VkSubpassContents subpassContents = VK_SUBPASS_CONTENTS_INLINE) const
 		{
 			const auto &cmdBuffer = m_commandBuffers.at(cmdBufferName);
 			const auto &renderPass = m_renderPasses.at(renderPassName);
@@ -1898,7 +2099,7 @@ namespace rj
 			info.framebuffer = framebuffer;
 			info.renderArea = renderArea;
 			info.clearValueCount = static_cast<uint32_t>(clearValues.size());
-			info.pClearValues = clearValues.size() == 0 ? nullptr : clearValues.data();
+			info.pClearValues = clearValues.data();
 
 			vkCmdBeginRenderPass(cmdBuffer, &info, subpassContents);
 		}
@@ -1917,6 +2118,20 @@ namespace rj
 			vkCmdNextSubpass(cmdBuffer, subpassContents);
 		}
 
+		void cmdExecuteCommands(uint32_t cmdBufferName, ArrayRef<uint32_t> secondaryCmdBufferNames) const
+		{
+			const auto &cmdBuffer = m_commandBuffers.at(cmdBufferName);
+
+			uint32_t numSecondaryCmdBuffers = static_cast<uint32_t>(secondaryCmdBufferNames.size());
+			VkCommandBuffer *secondaryCmdBuffers = getScratchArray<VkCommandBuffer>(numSecondaryCmdBuffers);
+			for (uint32_t i = 0; i < numSecondaryCmdBuffers; ++i)
+			{
+				secondaryCmdBuffers[i] = m_commandBuffers.at(secondaryCmdBufferNames[i]);
+			}
+
+			vkCmdExecuteCommands(cmdBuffer, numSecondaryCmdBuffers, secondaryCmdBuffers);
+		}
+
 		void cmdBindPipeline(uint32_t cmdBufferName, VkPipelineBindPoint pipelineBindPoint, uint32_t pipelineName) const
 		{
 			const auto &cmdBuffer = m_commandBuffers.at(cmdBufferName);
@@ -1926,23 +2141,22 @@ namespace rj
 		}
 
 		void cmdBindDescriptorSets(uint32_t cmdBufferName, VkPipelineBindPoint pipelineBindPoint, uint32_t pipelineLayoutName,
-			const std::vector<uint32_t> &descriptorSetNames, uint32_t firstSet = 0, const std::vector<uint32_t> &dynamicOffsets = {}) const
+			ArrayRef<uint32_t> descriptorSetNames, uint32_t firstSet = 0, ArrayRef<uint32_t> dynamicOffsets = {}) const
 		{
 			const auto &cmdBuffer = m_commandBuffers.at(cmdBufferName);
 			const auto &pipelineLayout = m_pipelineLayouts.at(pipelineLayoutName);
 
 			uint32_t numSets = static_cast<uint32_t>(descriptorSetNames.size());
-			std::vector<VkDescriptorSet> sets;
-			sets.reserve(numSets);
-			for (auto name : descriptorSetNames)
+			VkDescriptorSet *sets = getScratchArray<VkDescriptorSet>(numSets);
+			for (uint32_t i = 0; i < numSets; ++i)
 			{
-				sets.push_back(m_descriptorSets.at(name));
+				sets[i] = m_descriptorSets.at(descriptorSetNames[i]);
 			}
 
 			uint32_t numDynamicOffsets = static_cast<uint32_t>(dynamicOffsets.size());
 
-			vkCmdBindDescriptorSets(cmdBuffer, pipelineBindPoint, pipelineLayout, firstSet, numSets, sets.data(),
-				numDynamicOffsets, numDynamicOffsets == 0 ? nullptr : dynamicOffsets.data());
+			vkCmdBindDescriptorSets(cmdBuffer, pipelineBindPoint, pipelineLayout, firstSet, numSets, sets,
+				numDynamicOffsets, dynamicOffsets.data());
 		}
 
 		void cmdSetViewport(uint32_t cmdBufferName, uint32_t framebufferName, float topLeftU = 0.f, float topLeftV = 0.f,
@@ -2029,6 +2243,15 @@ namespace rj
 			vkCmdDraw(cmdBuffer, vertexCount, instanceCount, firstVertex, firstInstance);
 		}
 
+		void cmdDrawIndexedIndirect(uint32_t cmdBufferName, uint32_t bufferName, VkDeviceSize offset = 0,
+			uint32_t drawCount = 1, uint32_t stride = sizeof(VkDrawIndexedIndirectCommand)) const
+		{
+			const auto &cmdBuffer = m_commandBuffers.at(cmdBufferName);
+			const auto &buffer = m_buffers.at(bufferName);
+
+			vkCmdDrawIndexedIndirect(cmdBuffer, buffer, offset, drawCount, stride);
+		}
+
 		void cmdPushConstants(uint32_t cmdBufferName, uint32_t pipelineLayoutName, VkShaderStageFlags shaderStages,
 			uint32_t offset, uint32_t sizeInBytes, const void *pValues) const
 		{
@@ -2045,6 +2268,39 @@ namespace rj
 			vkCmdDispatch(cmdBuffer, numBlocksX, numBlocksY, numBlocksZ);
 		}
 
+		// @sizeInBytes of VK_WHOLE_SIZE fills to the end of the buffer
+		void cmdFillBuffer(uint32_t cmdBufferName, uint32_t bufferName, VkDeviceSize offset, VkDeviceSize sizeInBytes, uint32_t data) const
+		{
+			const auto &cmdBuffer = m_commandBuffers.at(cmdBufferName);
+			const auto &buffer = m_buffers.at(bufferName);
+
+			vkCmdFillBuffer(cmdBuffer, buffer, offset, sizeInBytes, data);
+		}
+
+		void cmdCopyBuffer(uint32_t cmdBufferName, uint32_t srcBufferName, uint32_t dstBufferName, VkDeviceSize sizeInBytes,
+			VkDeviceSize srcOffset = 0, VkDeviceSize dstOffset = 0) const
+		{
+			const auto &cmdBuffer = m_commandBuffers.at(cmdBufferName);
+			const auto &srcBuffer = m_buffers.at(srcBufferName);
+			const auto &dstBuffer = m_buffers.at(dstBufferName);
+
+			recordCopyBufferToBufferCommands(cmdBuffer, srcBuffer, dstBuffer, sizeInBytes, srcOffset, dstOffset);
+		}
+
+		// Global memory barrier, enough for buffers and for images that stay in the same layout
+		void cmdPipelineBarrier(uint32_t cmdBufferName, VkPipelineStageFlags srcStages, VkPipelineStageFlags dstStages,
+			VkAccessFlags srcAccess, VkAccessFlags dstAccess, VkDependencyFlags dependencyFlags = 0) const
+		{
+			const auto &cmdBuffer = m_commandBuffers.at(cmdBufferName);
+
+			VkMemoryBarrier barrier = {};
+			barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+			barrier.srcAccessMask = srcAccess;
+			barrier.dstAccessMask = dstAccess;
+
+			vkCmdPipelineBarrier(cmdBuffer, srcStages, dstStages, dependencyFlags, 1, &barrier, 0, nullptr, 0, nullptr);
+		}
+
 		void cmdResetQueryPool(uint32_t cmdBufferName, uint32_t queryPoolName,
 			uint32_t firstQuery = 0, uint32_t queryCount = std::numeric_limits<uint32_t>::max())
 		{
@@ -2095,7 +2351,7 @@ namespace rj
 
 		void beginQueueSubmit(VkQueueFlags queueType)
 		{
-			m_curQueueSubmitInfos.clear();
+			m_curQueueSubmitCount = 0;
 
 			switch (queueType)
 			{
@@ -2106,21 +2362,26 @@ namespace rj
 				m_curSubmitQueue = m_device.getGraphicsQueue();
 				break;
 			}
+			m_curSubmitTimeline = &getQueueTimeline(queueType);
 		}
 
-		void queueSubmitNewSubmit(const std::vector<uint32_t> &cmdBufferNames,
-			const std::vector<uint32_t> &waitSemaphoreNames = {},
-			const std::vector<VkPipelineStageFlags> &waitStageMasks = {},
-			const std::vector<uint32_t> &signalSemaphoreNames = {})
+		// Returns the value the submit signals on its queue's timeline. The value counts as submitted right away,
+		// so the host must not wait for it before endQueueSubmit()
+		uint64_t queueSubmitNewSubmit(ArrayRef<uint32_t> cmdBufferNames,
+			ArrayRef<uint32_t> waitSemaphoreNames = {},
+			ArrayRef<VkPipelineStageFlags> waitStageMasks = {},
+			ArrayRef<uint32_t> signalSemaphoreNames = {},
+			ArrayRef<TimelineWait> timelineWaits = {})
 		{
 			assert(!cmdBufferNames.empty());
 			assert(waitSemaphoreNames.size() == waitStageMasks.size());
 
-			m_curQueueSubmitInfos.push_back({});
-			auto &info = m_curQueueSubmitInfos.back();
+			// submit infos of earlier queue submissions are reused, so that their arrays keep their capacity
+			if (m_curQueueSubmitCount == m_curQueueSubmitInfos.size()) m_curQueueSubmitInfos.emplace_back();
+			auto &info = m_curQueueSubmitInfos[m_curQueueSubmitCount++];
 
 			auto &cmdBuffers = info.cmdBuffers;
-			cmdBuffers.reserve(cmdBufferNames.size());
+			cmdBuffers.clear();
 			for (auto name : cmdBufferNames)
 			{
 				cmdBuffers.push_back(m_commandBuffers.at(name));
@@ -2129,32 +2390,60 @@ namespace rj
 			info.waitStages.assign(waitStageMasks.begin(), waitStageMasks.end());
 
 			auto &waitSemaphores = info.waitSemaphores;
-			waitSemaphores.reserve(waitSemaphoreNames.size());
+			waitSemaphores.clear();
 			for (auto name : waitSemaphoreNames)
 			{
 				waitSemaphores.push_back(m_semaphores[name]);
 			}
+			info.waitValues.assign(waitSemaphoreNames.size(), 0);
+
+			for (const auto &wait : timelineWaits)
+			{
+				waitSemaphores.push_back(m_semaphores[getQueueTimeline(wait.queueType).semaphoreName]);
+				info.waitStages.push_back(wait.stageMask);
+				info.waitValues.push_back(wait.value);
+			}
 
 			auto &signalSemaphores = info.signalSemaphores;
-			signalSemaphores.reserve(signalSemaphoreNames.size());
+			signalSemaphores.clear();
 			for (auto name : signalSemaphoreNames)
 			{
 				signalSemaphores.push_back(m_semaphores[name]);
 			}
+			info.signalValues.assign(signalSemaphoreNames.size(), 0);
+
+			assert(m_curSubmitTimeline);
+			const uint64_t value = ++m_curSubmitTimeline->submittedValue;
+			signalSemaphores.push_back(m_semaphores[m_curSubmitTimeline->semaphoreName]);
+			info.signalValues.push_back(value);
+
+			return value;
 		}
 
-		void endQueueSubmit(uint32_t fenceName = std::numeric_limits<uint32_t>::max(), bool waitForFence = true)
+		// Returns the timeline value of the last submit
+		uint64_t endQueueSubmit(uint32_t fenceName = std::numeric_limits<uint32_t>::max(), bool waitForFence = true)
 		{
-			uint32_t numSubmits = static_cast<uint32_t>(m_curQueueSubmitInfos.size());
+			uint32_t numSubmits = m_curQueueSubmitCount;
 			assert(numSubmits > 0);
-			std::vector<VkSubmitInfo> infos(numSubmits, {});
+			m_curSubmitInfos.resize(numSubmits);
+			m_curTimelineSubmitInfos.resize(numSubmits);
 
 			for (uint32_t i = 0; i < numSubmits; ++i)
 			{
 				const auto &src = m_curQueueSubmitInfos[i];
-				auto &info = infos[i];
+				auto &timelineInfo = m_curTimelineSubmitInfos[i];
+				auto &info = m_curSubmitInfos[i];
+
+				timelineInfo = {};
+				timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR;
+				timelineInfo.waitSemaphoreValueCount = static_cast<uint32_t>(src.waitValues.size());
+				timelineInfo.pWaitSemaphoreValues = src.waitValues.data();
+				timelineInfo.signalSemaphoreValueCount = static_cast<uint32_t>(src.signalValues.size());
+				timelineInfo.pSignalSemaphoreValues = src.signalValues.data();
 
+				info = {};
 				info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+				info.pNext = &timelineInfo;
 				info.commandBufferCount = static_cast<uint32_t>(src.cmdBuffers.size());
 				info.pCommandBuffers = src.cmdBuffers.data();
 				info.waitSemaphoreCount = static_cast<uint32_t>(src.waitSemaphores.size());
@@ -2166,7 +2455,7 @@ namespace rj
 
 			assert(m_curSubmitQueue);
 			VkFence fence = fenceName == std::numeric_limits<uint32_t>::max() ? VK_NULL_HANDLE : VkFence(m_fences[fenceName]);
-			if (vkQueueSubmit(m_curSubmitQueue, numSubmits, infos.data(), fence) != VK_SUCCESS)
+			if (vkQueueSubmit(m_curSubmitQueue, numSubmits, m_curSubmitInfos.data(), fence) != VK_SUCCESS)
 			{
 				throw std::runtime_error("failed to submit");
 			}
@@ -2176,13 +2465,18 @@ namespace rj
 				vkWaitForFences(m_device, 1, &fence, VK_TRUE, std::numeric_limits<uint64_t>::max());
 			}
 
-			m_curQueueSubmitInfos.clear();
+			m_curQueueSubmitCount = 0;
 			m_curSubmitQueue = VK_NULL_HANDLE;
+
+			const uint64_t value = m_curSubmitTimeline->submittedValue;
+			m_curSubmitTimeline = nullptr;
+			return value;
 		}
 		// --- Command buffer related ---
 
 		// --- Synchronization objects ---
-		uint32_t createSemaphore(VkSemaphoreCreateFlags flags = 0)
+		// @pNext chains e.g. a VkSemaphoreTypeCreateInfoKHR
+		uint32_t createSemaphore(VkSemaphoreCreateFlags flags = 0, const void *pNext = nullptr)
 		{
 			uint32_t semaphoreName;
 			if (!m_availableSemaphoreNames.empty())
@@ -2198,6 +2492,7 @@ namespace rj
 
 			VkSemaphoreCreateInfo info = {};
 			info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+			info.pNext = pNext;
 			info.flags = flags;
 
 			if (vkCreateSemaphore(m_device, &info, nullptr, m_semaphores[semaphoreName].replace()) != VK_SUCCESS)
@@ -2234,34 +2529,69 @@ namespace rj
 			return fenceName;
 		}
 
-		void waitForFences(const std::vector<uint32_t> &fenceNames, VkBool32 waitAll = VK_TRUE,
+		void waitForFences(ArrayRef<uint32_t> fenceNames, VkBool32 waitAll = VK_TRUE,
 			uint64_t timeout = std::numeric_limits<uint64_t>::max())
 		{
 			uint32_t fenceCount = static_cast<uint32_t>(fenceNames.size());
-			std::vector<VkFence> fences;
-			fences.reserve(fenceCount);
-			for (auto name : fenceNames)
+			VkFence *fences = getScratchArray<VkFence>(fenceCount);
+			for (uint32_t i = 0; i < fenceCount; ++i)
 			{
-				fences.push_back(m_fences.at(name));
+				fences[i] = m_fences.at(fenceNames[i]);
 			}
 
-			if (vkWaitForFences(m_device, fenceCount, fences.data(), waitAll, timeout) != VK_SUCCESS)
+			if (vkWaitForFences(m_device, fenceCount, fences, waitAll, timeout) != VK_SUCCESS)
 			{
 				throw std::runtime_error("failed to wait for fences");
 			}
 		}
 
-		void resetFences(const std::vector<uint32_t> &fenceNames)
+		// Timeline value of the last submit to the queue
+		uint64_t getQueueSubmittedValue(VkQueueFlags queueType)
+		{
+			return getQueueTimeline(queueType).submittedValue;
+		}
+
+		// Whether the GPU is done with everything up to @value on the queue, without waiting
+		bool isQueueValueCompleted(VkQueueFlags queueType, uint64_t value)
+		{
+			auto &timeline = getQueueTimeline(queueType);
+			if (value > timeline.completedValue)
+			{
+				m_vkGetSemaphoreCounterValueKHR(m_device, m_semaphores[timeline.semaphoreName], &timeline.completedValue);
+			}
+			return value <= timeline.completedValue;
+		}
+
+		void waitForQueueValue(VkQueueFlags queueType, uint64_t value,
+			uint64_t timeout = std::numeric_limits<uint64_t>::max())
+		{
+			auto &timeline = getQueueTimeline(queueType);
+			if (value <= timeline.completedValue) return;
+
+			VkSemaphore semaphore = m_semaphores[timeline.semaphoreName];
+			VkSemaphoreWaitInfoKHR info = {};
+			info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR;
+			info.semaphoreCount = 1;
+			info.pSemaphores = &semaphore;
+			info.pValues = &value;
+
+			if (m_vkWaitSemaphoresKHR(m_device, &info, timeout) != VK_SUCCESS)
+			{
+				throw std::runtime_error("failed to wait for queue timeline");
+			}
+			timeline.completedValue = value;
+		}
+
+		void resetFences(ArrayRef<uint32_t> fenceNames)
 		{
 			uint32_t fenceCount = static_cast<uint32_t>(fenceNames.size());
-			std::vector<VkFence> fences;
-			fences.reserve(fenceCount);
-			for (auto name : fenceNames)
+			VkFence *fences = getScratchArray<VkFence>(fenceCount);
+			for (uint32_t i = 0; i < fenceCount; ++i)
 			{
-				fences.push_back(m_fences.at(name));
+				fences[i] = m_fences.at(fenceNames[i]);
 			}
 
-			if (vkResetFences(m_device, fenceCount, fences.data()) != VK_SUCCESS)
+			if (vkResetFences(m_device, fenceCount, fences) != VK_SUCCESS)
 			{
 				throw std::runtime_error("failed to reset fences");
 			}
@@ -2274,6 +2604,17 @@ namespace rj
 			m_swapChain.recreateSwapChain();
 		}
 
+		// Takes effect with the next recreateSwapChain(), falls back to FIFO if the surface doesn't support @mode
+		void setSwapChainPresentMode(VkPresentModeKHR mode)
+		{
+			m_swapChain.setPreferredPresentMode(mode);
+		}
+
+		VkPresentModeKHR getSwapChainPresentMode() const
+		{
+			return m_swapChain.presentMode();
+		}
+
 		VkExtent2D getSwapChainExtent() const
 		{
 			return m_swapChain.extent();
@@ -2284,7 +2625,7 @@ namespace rj
 			return m_swapChain.format();
 		}
 
-		std::vector<uint32_t> getSwapChainFramebuffers() const
+		const std::vector<uint32_t> &getSwapChainFramebuffers() const
 		{
 			return m_swapChainFramebufferNames;
 		}
@@ -2303,27 +2644,55 @@ namespace rj
 			return vkAcquireNextImageKHR(m_device, m_swapChain, timeout, semaphore, fence, pIdx);
 		}
 
-		VkResult queuePresent(const std::vector<uint32_t> &waitSemaphoreNames, uint32_t imageIdx)
+		// @presentId identifies the present for waitForPresent(), ids must increase with every present to the same
+		// swap chain. It is ignored without present wait, as is 0
+		VkResult queuePresent(ArrayRef<uint32_t> waitSemaphoreNames, uint32_t imageIdx, uint64_t presentId = 0)
 		{
 			VkSwapchainKHR swapChain = m_swapChain;
-			std::vector<VkSemaphore> waitSemaphores;
-			waitSemaphores.reserve(waitSemaphoreNames.size());
-			for (auto name : waitSemaphoreNames)
+			uint32_t waitSemaphoreCount = static_cast<uint32_t>(waitSemaphoreNames.size());
+			VkSemaphore *waitSemaphores = getScratchArray<VkSemaphore>(waitSemaphoreCount);
+			for (uint32_t i = 0; i < waitSemaphoreCount; ++i)
 			{
-				waitSemaphores.push_back(m_semaphores[name]);
+				waitSemaphores[i] = m_semaphores[waitSemaphoreNames[i]];
 			}
 
 			VkPresentInfoKHR info = {};
 			info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
-			info.waitSemaphoreCount = static_cast<uint32_t>(waitSemaphoreNames.size());
-			info.pWaitSemaphores = waitSemaphores.data();
+			info.waitSemaphoreCount = waitSemaphoreCount;
+			info.pWaitSemaphores = waitSemaphores;
 			info.swapchainCount = 1;
 			info.pSwapchains = &swapChain;
 			info.pImageIndices = &imageIdx;
 
+#ifdef VK_KHR_present_wait
+			VkPresentIdKHR presentIdInfo = {};
+			if (presentId != 0 && isPresentWaitEnabled())
+			{
+				presentIdInfo.sType = VK_STRUCTURE_TYPE_PRESENT_ID_KHR;
+				presentIdInfo.swapchainCount = 1;
+				presentIdInfo.pPresentIds = &presentId;
+				info.pNext = &presentIdInfo;
+			}
+#endif
+
 			return vkQueuePresentKHR(m_device.getPresentQueue(), &info);
 		}
 
+		bool isPresentWaitEnabled() const
+		{
+			return m_device.isPresentWaitEnabled();
+		}
+
+		// Waits until the present with @presentId, or a later one, is on screen. VK_TIMEOUT after @timeout ns,
+		// a timeout of 0 just checks
+		VkResult waitForPresent(uint64_t presentId, uint64_t timeout)
+		{
+#ifdef VK_KHR_present_wait
+			if (m_vkWaitForPresentKHR) return m_vkWaitForPresentKHR(m_device, m_swapChain, presentId, timeout);
+#endif
+			return VK_ERROR_EXTENSION_NOT_PRESENT;
+		}
+
 		int windowShouldClose() const
 		{
 			return glfwWindowShouldClose(m_window.getWindow());
@@ -2363,6 +2732,49 @@ namespace rj
 			}
 		}
 
+		// entry points of device extensions, the loader doesn't export them
+		void loadDeviceFunctions()
+		{
+			m_vkWaitSemaphoresKHR = reinterpret_cast<PFN_vkWaitSemaphoresKHR>(vkGetDeviceProcAddr(m_device, "vkWaitSemaphoresKHR"));
+			m_vkGetSemaphoreCounterValueKHR = reinterpret_cast<PFN_vkGetSemaphoreCounterValueKHR>(vkGetDeviceProcAddr(m_device, "vkGetSemaphoreCounterValueKHR"));
+			if (!m_vkWaitSemaphoresKHR || !m_vkGetSemaphoreCounterValueKHR)
+			{
+				throw std::runtime_error("VK_KHR_timeline_semaphore is not enabled");
+			}
+
+#ifdef VK_KHR_present_wait
+			if (isPresentWaitEnabled())
+			{
+				m_vkWaitForPresentKHR = reinterpret_cast<PFN_vkWaitForPresentKHR>(vkGetDeviceProcAddr(m_device, "vkWaitForPresentKHR"));
+			}
+#endif
+		}
+
+		void createQueueTimelines()
+		{
+			VkSemaphoreTypeCreateInfoKHR typeInfo = {};
+			typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO_KHR;
+			typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE_KHR;
+			typeInfo.initialValue = 0;
+
+			for (auto &timeline : m_queueTimelines)
+			{
+				timeline.semaphoreName = createSemaphore(0, &typeInfo);
+			}
+		}
+
+		// same queue selection as beginQueueSubmit()
+		QueueTimeline &getQueueTimeline(VkQueueFlags queueType)
+		{
+			return m_queueTimelines[queueType == VK_QUEUE_COMPUTE_BIT ? 1 : 0];
+		}
+
+		static std::vector<const char *> withSwapChainExtension(std::vector<const char *> extensions)
+		{
+			extensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+			return extensions;
+		}
+
 		void createSingleSubmitCommandPool()
 		{
 			createCommandPool(VK_QUEUE_GRAPHICS_BIT, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
@@ -2380,6 +2792,12 @@ namespace rj
 		VDevice m_device;
 		VSwapChain m_swapChain;
 		VDeleter<VkPipelineCache> m_pipelineCache{ m_device, vkDestroyPipelineCache };
+		VMemoryAllocator m_memoryAllocator{ m_device }; // outlives every buffer and image below
+		PFN_vkWaitSemaphoresKHR m_vkWaitSemaphoresKHR = nullptr;
+		PFN_vkGetSemaphoreCounterValueKHR m_vkGetSemaphoreCounterValueKHR = nullptr;
+#ifdef VK_KHR_present_wait
+		PFN_vkWaitForPresentKHR m_vkWaitForPresentKHR = nullptr;
+#endif
 
 		RenderPassCreateInfo m_curRenderPassInfo;
 		uint32_t m_curRenderPassName;
@@ -2441,13 +2859,21 @@ namespace rj
 		std::unordered_map<uint32_t, std::vector<uint32_t>> m_poolSetTable; // sets from each pool
 		std::vector<VkDescriptorSet> m_descriptorSets;
 
+		DescriptorUpdateTemplateCreateInfo m_curDescriptorUpdateTemplateInfo;
+		std::vector<VDeleter<VkDescriptorUpdateTemplate>> m_descriptorUpdateTemplates;
+
 		std::vector<uint32_t> m_availableSemaphoreNames;
 		std::vector<VDeleter<VkSemaphore>> m_semaphores;
 
 		std::vector<uint32_t> m_availableFenceNames;
 		std::vector<VDeleter<VkFence>> m_fences;
 
-		std::vector<QueueSubmitInfo> m_curQueueSubmitInfos;
+		std::vector<QueueSubmitInfo> m_curQueueSubmitInfos; // only the first m_curQueueSubmitCount are in use
+		uint32_t m_curQueueSubmitCount = 0;
+		std::vector<VkSubmitInfo> m_curSubmitInfos;
 		VkQueue m_curSubmitQueue;
+		QueueTimeline *m_curSubmitTimeline = nullptr;
+		QueueTimeline m_queueTimelines[2]; // graphics, compute
+		std::vector<VkTimelineSemaphoreSubmitInfoKHR> m_curTimelineSubmitInfos;
 	};
 }
\ No newline at end of file
@@ -0,0 +1,262 @@
+#include <algorithm>
+#include "VMemoryAllocator.h"
+
+
+namespace rj
+{
+	// attachments at least this large get their own memory, they come and go with the swap chain and would fragment blocks
+	static const VkDeviceSize g_dedicatedAttachmentMinSize = 8ull << 20;
+
+	VMemoryAllocator::VMemoryAllocator(const VDevice &device, VkDeviceSize preferredBlockSize) :
+		m_device(device), m_preferredBlockSize(preferredBlockSize)
+	{
+		vkGetPhysicalDeviceMemoryProperties(m_device, &m_memoryProperties);
+
+		VkPhysicalDeviceProperties deviceProps;
+		vkGetPhysicalDeviceProperties(m_device, &deviceProps);
+		m_nonCoherentAtomSize = deviceProps.limits.nonCoherentAtomSize;
+		m_maxDeviceMemoryCount = deviceProps.limits.maxMemoryAllocationCount;
+	}
+
+	VMemoryAllocator::~VMemoryAllocator()
+	{
+		// every resource should be gone by now, what is left are the blocks kept around empty
+		for (auto &pool : m_pools)
+		{
+			for (auto &block : pool)
+			{
+				assert(block->allocationCount == 0);
+				freeDeviceMemory(block->memory);
+			}
+		}
+		assert(m_dedicatedCount == 0);
+	}
+
+	VMemoryAllocation VMemoryAllocator::allocateForBuffer(VkBuffer buffer, VkMemoryPropertyFlags properties)
+	{
+		VkMemoryDedicatedRequirements dedicatedRequirements = {};
+		dedicatedRequirements.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS;
+		VkMemoryRequirements2 requirements = {};
+		requirements.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+		requirements.pNext = &dedicatedRequirements;
+		VkBufferMemoryRequirementsInfo2 requirementsInfo = {};
+		requirementsInfo.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_REQUIREMENTS_INFO_2;
+		requirementsInfo.buffer = buffer;
+		vkGetBufferMemoryRequirements2(m_device, &requirementsInfo, &requirements);
+
+		VkMemoryDedicatedAllocateInfo dedicatedInfo = {};
+		dedicatedInfo.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO;
+		dedicatedInfo.buffer = buffer;
+
+		bool dedicated = dedicatedRequirements.prefersDedicatedAllocation || dedicatedRequirements.requiresDedicatedAllocation;
+		VMemoryAllocation allocation = allocate(requirements.memoryRequirements, properties, true, dedicated, dedicatedInfo);
+
+		if (vkBindBufferMemory(m_device, buffer, allocation.memory, allocation.offset) != VK_SUCCESS)
+		{
+			free(allocation);
+			throw std::runtime_error("failed to bind buffer memory!");
+		}
+		return allocation;
+	}
+
+	VMemoryAllocation VMemoryAllocator::allocateForImage(VkImage image, VkMemoryPropertyFlags properties, VkImageTiling tiling, VkImageUsageFlags usage)
+	{
+		VkMemoryDedicatedRequirements dedicatedRequirements = {};
+		dedicatedRequirements.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS;
+		VkMemoryRequirements2 requirements = {};
+		requirements.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+		requirements.pNext = &dedicatedRequirements;
+		VkImageMemoryRequirementsInfo2 requirementsInfo = {};
+		requirementsInfo.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_REQUIREMENTS_INFO_2;
+		requirementsInfo.image = image;
+		vkGetImageMemoryRequirements2(m_device, &requirementsInfo, &requirements);
+
+		VkMemoryDedicatedAllocateInfo dedicatedInfo = {};
+		dedicatedInfo.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO;
+		dedicatedInfo.image = image;
+
+		const bool attachment = (usage & (VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT)) != 0;
+		bool dedicated = dedicatedRequirements.prefersDedicatedAllocation || dedicatedRequirements.requiresDedicatedAllocation ||
+			(attachment && requirements.memoryRequirements.size >= g_dedicatedAttachmentMinSize);
+		VMemoryAllocation allocation = allocate(requirements.memoryRequirements, properties, tiling == VK_IMAGE_TILING_LINEAR,
+			dedicated, dedicatedInfo);
+
+		if (vkBindImageMemory(m_device, image, allocation.memory, allocation.offset) != VK_SUCCESS)
+		{
+			free(allocation);
+			throw std::runtime_error("failed to bind image memory!");
+		}
+		return allocation;
+	}
+
+	void VMemoryAllocator::free(const VMemoryAllocation &allocation)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		if (allocation.dedicated)
+		{
+			freeDeviceMemory(allocation.memory);
+			--m_dedicatedCount;
+			m_dedicatedBytes -= allocation.size;
+			return;
+		}
+
+		auto &pool = m_pools[allocation.poolIdx];
+		auto it = std::find_if(pool.begin(), pool.end(),
+			[&allocation](const std::unique_ptr<Block> &block) { return block->memory == allocation.memory; });
+		assert(it != pool.end());
+
+		Block &block = **it;
+		block.ranges.free(allocation.offset, allocation.size);
+		--block.allocationCount;
+
+		// one empty block is kept per pool so that short lived resources, like staging buffers, don't allocate every time
+		if (block.allocationCount == 0 && pool.size() > 1)
+		{
+			freeDeviceMemory(block.memory);
+			pool.erase(it);
+		}
+	}
+
+	VMemoryAllocator::Stats VMemoryAllocator::getStats() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		Stats stats;
+		stats.deviceMemoryCount = m_deviceMemoryCount;
+		stats.dedicatedCount = m_dedicatedCount;
+		stats.dedicatedBytes = m_dedicatedBytes;
+
+		VkDeviceSize freeBytes = 0;
+		for (const auto &pool : m_pools)
+		{
+			for (const auto &block : pool)
+			{
+				++stats.blockCount;
+				stats.subAllocationCount += block->allocationCount;
+				stats.blockBytes += block->ranges.getCapacity();
+				stats.blockUsedBytes += block->ranges.getUsedSize();
+				stats.largestFreeRange = std::max<VkDeviceSize>(stats.largestFreeRange, block->ranges.getLargestFreeBlockSize());
+				freeBytes += block->ranges.getCapacity() - block->ranges.getUsedSize();
+			}
+		}
+
+		if (freeBytes > 0)
+		{
+			stats.fragmentation = 1.f - static_cast<float>(static_cast<double>(stats.largestFreeRange) / freeBytes);
+		}
+		return stats;
+	}
+
+	VMemoryAllocation VMemoryAllocator::allocate(const VkMemoryRequirements &requirements, VkMemoryPropertyFlags properties,
+		bool linearResource, bool dedicated, const VkMemoryDedicatedAllocateInfo &dedicatedInfo)
+	{
+		VMemoryAllocation allocation;
+		const uint32_t memoryTypeIdx = findMemoryType(m_device, requirements.memoryTypeBits, properties);
+		allocation.memoryProperties = m_memoryProperties.memoryTypes[memoryTypeIdx].propertyFlags;
+		allocation.poolIdx = 2 * memoryTypeIdx + (linearResource ? 0 : 1);
+
+		// flushes of non coherent memory are widened to whole atoms, which must not reach into a neighbour
+		VkDeviceSize alignment = requirements.alignment;
+		VkDeviceSize size = requirements.size;
+		if ((allocation.memoryProperties & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) &&
+			!(allocation.memoryProperties & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT))
+		{
+			alignment = std::max(alignment, m_nonCoherentAtomSize);
+			size = (size + alignment - 1) / alignment * alignment;
+		}
+
+		const VkDeviceSize blockSize = getBlockSize(memoryTypeIdx);
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		if (dedicated || size > blockSize / 2)
+		{
+			// a dedicated allocation has to be exactly as large as the resource
+			allocation.memory = allocateDeviceMemory(requirements.size, memoryTypeIdx, &dedicatedInfo, &allocation.mapped);
+			allocation.size = requirements.size;
+			allocation.memorySize = requirements.size;
+			allocation.dedicated = true;
+			++m_dedicatedCount;
+			m_dedicatedBytes += requirements.size;
+			return allocation;
+		}
+
+		auto &pool = m_pools[allocation.poolIdx];
+		for (auto &block : pool)
+		{
+			const uint64_t offset = block->ranges.allocate(size, alignment);
+			if (offset != FreeListAllocator::invalidOffset)
+			{
+				++block->allocationCount;
+				allocation.memory = block->memory;
+				allocation.offset = offset;
+				allocation.size = size;
+				allocation.memorySize = block->ranges.getCapacity();
+				allocation.mapped = block->mapped ? block->mapped + offset : nullptr;
+				return allocation;
+			}
+		}
+
+		std::unique_ptr<Block> block(new Block);
+		block->memory = allocateDeviceMemory(blockSize, memoryTypeIdx, nullptr, &block->mapped);
+		block->ranges.reset(blockSize);
+		block->allocationCount = 1;
+		allocation.memory = block->memory;
+		allocation.offset = block->ranges.allocate(size, alignment);
+		allocation.size = size;
+		allocation.memorySize = blockSize;
+		allocation.mapped = block->mapped ? block->mapped + allocation.offset : nullptr;
+		assert(allocation.offset == 0);
+		pool.push_back(std::move(block));
+		return allocation;
+	}
+
+	VkDeviceMemory VMemoryAllocator::allocateDeviceMemory(VkDeviceSize size, uint32_t memoryTypeIdx, const void *pNext, char **mapped)
+	{
+		if (m_deviceMemoryCount >= m_maxDeviceMemoryCount)
+		{
+			throw std::runtime_error("too many device memory allocations!");
+		}
+
+		VkMemoryAllocateInfo allocInfo = {};
+		allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+		allocInfo.pNext = pNext;
+		allocInfo.allocationSize = size;
+		allocInfo.memoryTypeIndex = memoryTypeIdx;
+
+		VkDeviceMemory memory;
+		if (vkAllocateMemory(m_device, &allocInfo, nullptr, &memory) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to allocate device memory!");
+		}
+		++m_deviceMemoryCount;
+
+		// memory can be mapped only once, so it is mapped whole up front and every resource in it gets its part of that
+		*mapped = nullptr;
+		if (m_memoryProperties.memoryTypes[memoryTypeIdx].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+		{
+			void *data = nullptr;
+			if (vkMapMemory(m_device, memory, 0, VK_WHOLE_SIZE, 0, &data) != VK_SUCCESS)
+			{
+				freeDeviceMemory(memory);
+				throw std::runtime_error("failed to map device memory!");
+			}
+			*mapped = static_cast<char *>(data);
+		}
+		return memory;
+	}
+
+	void VMemoryAllocator::freeDeviceMemory(VkDeviceMemory memory)
+	{
+		// freeing unmaps as well
+		vkFreeMemory(m_device, memory, nullptr);
+		--m_deviceMemoryCount;
+	}
+
+	VkDeviceSize VMemoryAllocator::getBlockSize(uint32_t memoryTypeIdx) const
+	{
+		// small heaps, like the host visible part of VRAM without resizable BAR, are not filled by a couple of blocks
+		const VkDeviceSize heapSize = m_memoryProperties.memoryHeaps[m_memoryProperties.memoryTypes[memoryTypeIdx].heapIndex].size;
+		return heapSize <= (1ull << 30) ? std::min(m_preferredBlockSize, heapSize / 8) : m_preferredBlockSize;
+	}
+}
\ No newline at end of file
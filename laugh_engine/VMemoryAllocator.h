@@ -0,0 +1,151 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <mutex>
+
+#include "VDevice.h"
+#include "free_list_allocator.h"
+
+
+namespace rj
+{
+	// Device memory bound to one buffer or image. Either a range of a block shared with other resources
+	// or, for large resources, a VkDeviceMemory of its own. Host visible memory stays mapped as long as it lives
+	struct VMemoryAllocation
+	{
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		VkDeviceSize offset = 0;
+		VkDeviceSize size = 0;
+		VkDeviceSize memorySize = 0; // of the whole VkDeviceMemory
+		VkMemoryPropertyFlags memoryProperties = 0; // of the memory type picked, may be more than asked for
+		char *mapped = nullptr; // host address of offset, null unless host visible
+		uint32_t poolIdx = 0;
+		bool dedicated = false;
+	};
+
+	// Sub-allocates buffers and images from large blocks, one list of blocks per memory type,
+	// instead of calling vkAllocateMemory for every resource. Ranges within a block come from a FreeListAllocator.
+	// Buffers and linear images go to other blocks than optimal images, so neighbours never have to be
+	// bufferImageGranularity apart. Resources larger than half a block, large attachments and whatever the driver
+	// asks a dedicated allocation for get their own VkDeviceMemory. Thread safe
+	class VMemoryAllocator
+	{
+	public:
+		struct Stats
+		{
+			uint32_t deviceMemoryCount = 0; // live vkAllocateMemory allocations, blocks and dedicated ones
+			uint32_t blockCount = 0;
+			uint32_t dedicatedCount = 0;
+			uint32_t subAllocationCount = 0;
+			VkDeviceSize blockBytes = 0;
+			VkDeviceSize blockUsedBytes = 0;
+			VkDeviceSize dedicatedBytes = 0;
+			VkDeviceSize largestFreeRange = 0; // over all blocks
+			float fragmentation = 0.f; // 1 - largestFreeRange / free bytes in blocks, 0 if the free space is in one piece
+		};
+
+		static const VkDeviceSize defaultBlockSize = 64ull << 20;
+
+		explicit VMemoryAllocator(const VDevice &device, VkDeviceSize preferredBlockSize = defaultBlockSize);
+		~VMemoryAllocator();
+
+		VMemoryAllocator(const VMemoryAllocator &) = delete;
+		VMemoryAllocator &operator=(const VMemoryAllocator &) = delete;
+
+		// Both also bind the memory to the resource
+		VMemoryAllocation allocateForBuffer(VkBuffer buffer, VkMemoryPropertyFlags properties);
+		VMemoryAllocation allocateForImage(VkImage image, VkMemoryPropertyFlags properties, VkImageTiling tiling, VkImageUsageFlags usage);
+
+		// The resource must not be in use anymore
+		void free(const VMemoryAllocation &allocation);
+
+		Stats getStats() const;
+		VkDeviceSize getNonCoherentAtomSize() const { return m_nonCoherentAtomSize; }
+
+	protected:
+		struct Block
+		{
+			VkDeviceMemory memory = VK_NULL_HANDLE;
+			FreeListAllocator ranges;
+			char *mapped = nullptr;
+			uint32_t allocationCount = 0;
+		};
+
+		VMemoryAllocation allocate(const VkMemoryRequirements &requirements, VkMemoryPropertyFlags properties,
+			bool linearResource, bool dedicated, const VkMemoryDedicatedAllocateInfo &dedicatedInfo);
+		VkDeviceMemory allocateDeviceMemory(VkDeviceSize size, uint32_t memoryTypeIdx, const void *pNext, char **mapped);
+		void freeDeviceMemory(VkDeviceMemory memory);
+		VkDeviceSize getBlockSize(uint32_t memoryTypeIdx) const;
+
+		const VDevice &m_device;
+		VkDeviceSize m_preferredBlockSize;
+		VkDeviceSize m_nonCoherentAtomSize = 1;
+		uint32_t m_maxDeviceMemoryCount = 0;
+		VkPhysicalDeviceMemoryProperties m_memoryProperties;
+
+		mutable std::mutex m_mutex;
+		std::vector<std::unique_ptr<Block>> m_pools[2 * VK_MAX_MEMORY_TYPES]; // [2 * memory type + optimal image]
+		uint32_t m_deviceMemoryCount = 0;
+		uint32_t m_dedicatedCount = 0;
+		VkDeviceSize m_dedicatedBytes = 0;
+	};
+
+	// Owns one allocation and gives it back on destruction. Only movable, like VDeleter,
+	// so that resources holding it can live in STL containers
+	class VMemory
+	{
+	public:
+		explicit VMemory(VMemoryAllocator &allocator) : m_allocator(&allocator) {}
+		~VMemory() { release(); }
+
+		VMemory(const VMemory &) = delete;
+		VMemory &operator=(const VMemory &) = delete;
+
+		VMemory(VMemory &&other) : m_allocator(other.m_allocator), m_allocation(other.m_allocation)
+		{
+			other.m_allocation = {};
+		}
+
+		VMemory &operator=(VMemory &&other)
+		{
+			if (this != &other)
+			{
+				release();
+				m_allocator = other.m_allocator;
+				m_allocation = other.m_allocation;
+				other.m_allocation = {};
+			}
+			return *this;
+		}
+
+		// Whatever was held before is freed first
+		void allocateForBuffer(VkBuffer buffer, VkMemoryPropertyFlags properties)
+		{
+			release();
+			m_allocation = m_allocator->allocateForBuffer(buffer, properties);
+		}
+
+		void allocateForImage(VkImage image, VkMemoryPropertyFlags properties, VkImageTiling tiling, VkImageUsageFlags usage)
+		{
+			release();
+			m_allocation = m_allocator->allocateForImage(image, properties, tiling, usage);
+		}
+
+		void release()
+		{
+			if (m_allocation.memory != VK_NULL_HANDLE)
+			{
+				m_allocator->free(m_allocation);
+				m_allocation = {};
+			}
+		}
+
+		const VMemoryAllocation &allocation() const { return m_allocation; }
+		const VMemoryAllocator &allocator() const { return *m_allocator; }
+
+	protected:
+		VMemoryAllocator *m_allocator;
+		VMemoryAllocation m_allocation;
+	};
+}
\ No newline at end of file
@@ -41,6 +41,17 @@ namespace rj
 			return m_swapChainImageFormat;
 		}
 
+		// Used by the next recreateSwapChain() if the surface supports it, FIFO otherwise
+		void setPreferredPresentMode(VkPresentModeKHR mode)
+		{
+			m_preferredPresentMode = mode;
+		}
+
+		VkPresentModeKHR presentMode() const
+		{
+			return m_presentMode;
+		}
+
 		// Return number of swap chain images
 		uint32_t size() const
 		{
@@ -110,6 +121,7 @@ namespace rj
 
 			m_swapChainImageFormat = surfaceFormat.format;
 			m_swapChainExtent = extent;
+			m_presentMode = presentMode;
 		}
 
 		VkSurfaceFormatKHR chooseSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR>& availableFormats)
@@ -134,7 +146,7 @@ namespace rj
 		{
 			for (const auto& availablePresentMode : availablePresentModes)
 			{
-				if (availablePresentMode == VK_PRESENT_MODE_MAILBOX_KHR)
+				if (availablePresentMode == m_preferredPresentMode)
 				{
 					return availablePresentMode;
 				}
@@ -184,5 +196,7 @@ namespace rj
 		std::vector<VDeleter<VkImageView>> m_swapChainImageViews;
 		VkFormat m_swapChainImageFormat;
 		VkExtent2D m_swapChainExtent;
+		VkPresentModeKHR m_preferredPresentMode = VK_PRESENT_MODE_MAILBOX_KHR;
+		VkPresentModeKHR m_presentMode;
 	};
 }
\ No newline at end of file
@@ -0,0 +1,53 @@
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include "allocation_counter.h"
+
+
+static std::atomic<uint64_t> g_heapAllocationCount{ 0 };
+
+uint64_t getHeapAllocationCount()
+{
+	return g_heapAllocationCount.load(std::memory_order_relaxed);
+}
+
+void *operator new(size_t size)
+{
+	g_heapAllocationCount.fetch_add(1, std::memory_order_relaxed);
+
+	if (size == 0) size = 1;
+	while (true)
+	{
+		void *p = std::malloc(size);
+		if (p) return p;
+
+		std::new_handler handler = std::get_new_handler();
+		if (!handler) throw std::bad_alloc();
+		handler();
+	}
+}
+
+void *operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete(void *p) noexcept
+{
+	std::free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+	std::free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+	std::free(p);
+}
+
+void operator delete[](void *p, size_t) noexcept
+{
+	std::free(p);
+}
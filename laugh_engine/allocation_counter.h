@@ -0,0 +1,8 @@
+#pragma once
+
+#include <cstdint>
+
+
+// Number of calls to the global operator new so far, from any thread. allocation_counter.cpp replaces
+// operator new/delete to count them. Allocations that go to malloc directly, like those of the driver or GLFW, are not seen
+uint64_t getHeapAllocationCount();
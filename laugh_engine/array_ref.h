@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+#include <cassert>
+#include <vector>
+#include <initializer_list>
+
+
+namespace rj
+{
+	// Non-owning view of a contiguous array, so that callers can pass braced lists, vectors with any
+	// allocator or plain arrays without building a std::vector first. It must not outlive the data it views,
+	// which for a braced list is the end of the full expression, so only ever use it as a parameter
+	template <typename T>
+	class ArrayRef
+	{
+	public:
+		ArrayRef() = default;
+		ArrayRef(const T *data, size_t count) : ptr(data), count(count) {}
+		ArrayRef(std::initializer_list<T> list) : ptr(list.begin()), count(list.size()) {}
+
+		template <typename Allocator>
+		ArrayRef(const std::vector<T, Allocator> &vec) : ptr(vec.data()), count(vec.size()) {}
+
+		template <size_t N>
+		ArrayRef(const T (&arr)[N]) : ptr(arr), count(N) {}
+
+		const T *data() const { return count == 0 ? nullptr : ptr; }
+		size_t size() const { return count; }
+		bool empty() const { return count == 0; }
+
+		const T &operator[](size_t idx) const { assert(idx < count); return ptr[idx]; }
+
+		const T *begin() const { return ptr; }
+		const T *end() const { return ptr + count; }
+
+	private:
+		const T *ptr = nullptr;
+		size_t count = 0;
+	};
+}
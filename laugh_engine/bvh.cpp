@@ -0,0 +1,512 @@
+#include <cassert>
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <random>
+#include "glm/gtc/matrix_transform.hpp"
+#include "bvh.h"
+
+#define BVH_INVALID_INDEX std::numeric_limits<uint32_t>::max()
+
+
+static float surfaceArea(const glm::vec3 &minPos, const glm::vec3 &maxPos)
+{
+	glm::vec3 d = glm::max(maxPos - minPos, glm::vec3(0.f));
+	return 2.f * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+enum FrustumTestResult
+{
+	FRUSTUM_OUTSIDE = 0,
+	FRUSTUM_INTERSECT,
+	FRUSTUM_INSIDE
+};
+
+static FrustumTestResult testFrustum(const Frustum &frustum, const glm::vec3 &minPos, const glm::vec3 &maxPos)
+{
+	glm::vec3 c = 0.5f * (maxPos + minPos);
+	glm::vec3 e = 0.5f * (maxPos - minPos);
+	FrustumTestResult result = FRUSTUM_INSIDE;
+
+	for (uint32_t p = 0; p < Frustum::planeCount; ++p)
+	{
+		const glm::vec4 &plane = frustum.planes[p];
+		float dist = glm::dot(glm::vec3(plane), c) + plane.w;
+		float radius = glm::dot(glm::abs(glm::vec3(plane)), e);
+		if (dist + radius < 0.f) return FRUSTUM_OUTSIDE;
+		if (dist - radius < 0.f) result = FRUSTUM_INTERSECT;
+	}
+
+	return result;
+}
+
+static bool overlapsSphere(const glm::vec3 &center, float radius2, const glm::vec3 &minPos, const glm::vec3 &maxPos)
+{
+	glm::vec3 d = center - glm::clamp(center, minPos, maxPos);
+	return glm::dot(d, d) <= radius2;
+}
+
+// Slab test. Returns the entry distance or a negative number on a miss
+static float intersectRay(const glm::vec3 &origin, const glm::vec3 &invDir, float tMax,
+	const glm::vec3 &minPos, const glm::vec3 &maxPos)
+{
+	glm::vec3 t0 = (minPos - origin) * invDir;
+	glm::vec3 t1 = (maxPos - origin) * invDir;
+	glm::vec3 tNear = glm::min(t0, t1);
+	glm::vec3 tFar = glm::max(t0, t1);
+
+	float tEnter = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.f));
+	float tExit = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, tMax));
+
+	return tEnter <= tExit ? tEnter : -1.f;
+}
+
+void BVH::build(const std::vector<BBox> &bounds)
+{
+	objectBounds = bounds;
+
+	const uint32_t objectCount = static_cast<uint32_t>(objectBounds.size());
+	nodes.clear();
+	parents.clear();
+	primIndices.clear();
+	objectToLeaf.assign(objectCount, BVH_INVALID_INDEX);
+
+	std::vector<glm::vec3> centroids(objectCount);
+	for (uint32_t i = 0; i < objectCount; ++i)
+	{
+		if (objectBounds[i].isEmpty()) continue;
+
+		primIndices.push_back(i);
+		centroids[i] = 0.5f * (objectBounds[i].min + objectBounds[i].max);
+	}
+
+	const uint32_t primCount = static_cast<uint32_t>(primIndices.size());
+	if (primCount == 0) return;
+
+	nodes.reserve(2 * primCount);
+	parents.reserve(2 * primCount);
+
+	buildRecursive(0, primCount, BVH_INVALID_INDEX, centroids);
+	fixEscapeIndices(0, static_cast<uint32_t>(nodes.size()));
+}
+
+uint32_t BVH::buildRecursive(uint32_t begin, uint32_t end, uint32_t parentIdx,
+	const std::vector<glm::vec3> &centroids)
+{
+	const uint32_t nodeIdx = static_cast<uint32_t>(nodes.size());
+	nodes.emplace_back();
+	parents.push_back(parentIdx);
+
+	const uint32_t count = end - begin;
+
+	if (count <= maxLeafSize)
+	{
+		Node &leaf = nodes[nodeIdx];
+		leaf.packed = (begin << 3) | count;
+		computeLeafBounds(leaf);
+
+		for (uint32_t i = begin; i < end; ++i)
+		{
+			objectToLeaf[primIndices[i]] = nodeIdx;
+		}
+
+		return nodeIdx;
+	}
+
+	// Split along the axis with the largest centroid extent
+	glm::vec3 centroidMin(std::numeric_limits<float>::max());
+	glm::vec3 centroidMax(-std::numeric_limits<float>::max());
+	for (uint32_t i = begin; i < end; ++i)
+	{
+		centroidMin = glm::min(centroidMin, centroids[primIndices[i]]);
+		centroidMax = glm::max(centroidMax, centroids[primIndices[i]]);
+	}
+
+	glm::vec3 centroidExtent = centroidMax - centroidMin;
+	uint32_t axis = 0;
+	if (centroidExtent.y > centroidExtent[axis]) axis = 1;
+	if (centroidExtent.z > centroidExtent[axis]) axis = 2;
+
+	uint32_t mid = begin + (count >> 1);
+
+	if (centroidExtent[axis] > 0.f)
+	{
+		struct Bin
+		{
+			BBox bounds;
+			uint32_t count = 0;
+		} bins[binCount];
+
+		const float binScale = static_cast<float>(binCount) / centroidExtent[axis];
+		auto binIndexOf = [&](uint32_t prim)
+		{
+			uint32_t b = static_cast<uint32_t>((centroids[prim][axis] - centroidMin[axis]) * binScale);
+			return std::min(b, binCount - 1);
+		};
+
+		for (uint32_t i = begin; i < end; ++i)
+		{
+			uint32_t prim = primIndices[i];
+			Bin &bin = bins[binIndexOf(prim)];
+			bin.bounds.min = glm::min(bin.bounds.min, objectBounds[prim].min);
+			bin.bounds.max = glm::max(bin.bounds.max, objectBounds[prim].max);
+			++bin.count;
+		}
+
+		// Sweep from the right to get the cost of every right hand side, then from the left
+		float rightCosts[binCount];
+		BBox accum;
+		uint32_t accumCount = 0;
+		for (uint32_t b = binCount - 1; b > 0; --b)
+		{
+			accum.min = glm::min(accum.min, bins[b].bounds.min);
+			accum.max = glm::max(accum.max, bins[b].bounds.max);
+			accumCount += bins[b].count;
+			rightCosts[b] = accumCount * surfaceArea(accum.min, accum.max);
+		}
+
+		float bestCost = std::numeric_limits<float>::max();
+		uint32_t bestSplit = 0;
+		accum = BBox();
+		accumCount = 0;
+		for (uint32_t b = 1; b < binCount; ++b)
+		{
+			accum.min = glm::min(accum.min, bins[b - 1].bounds.min);
+			accum.max = glm::max(accum.max, bins[b - 1].bounds.max);
+			accumCount += bins[b - 1].count;
+
+			if (accumCount == 0 || accumCount == count) continue;
+
+			float cost = accumCount * surfaceArea(accum.min, accum.max) + rightCosts[b];
+			if (cost < bestCost)
+			{
+				bestCost = cost;
+				bestSplit = b;
+			}
+		}
+
+		if (bestSplit > 0)
+		{
+			auto it = std::partition(primIndices.begin() + begin, primIndices.begin() + end,
+				[&](uint32_t prim) { return binIndexOf(prim) < bestSplit; });
+			mid = static_cast<uint32_t>(it - primIndices.begin());
+		}
+		else
+		{
+			// Every centroid fell into the same bin, fall back to a median split
+			std::nth_element(primIndices.begin() + begin, primIndices.begin() + mid, primIndices.begin() + end,
+				[&](uint32_t a, uint32_t b) { return centroids[a][axis] < centroids[b][axis]; });
+		}
+	}
+
+	buildRecursive(begin, mid, nodeIdx, centroids);
+	uint32_t rightIdx = buildRecursive(mid, end, nodeIdx, centroids);
+
+	// @nodes may have been reallocated by the recursive calls
+	Node &node = nodes[nodeIdx];
+	const Node &left = nodes[nodeIdx + 1];
+	const Node &right = nodes[rightIdx];
+	node.packed = rightIdx << 3;
+	node.min = glm::min(left.min, right.min);
+	node.max = glm::max(left.max, right.max);
+
+	return nodeIdx;
+}
+
+void BVH::fixEscapeIndices(uint32_t nodeIdx, uint32_t escapeIdx)
+{
+	Node &node = nodes[nodeIdx];
+	node.escapeIdx = escapeIdx;
+
+	if (!node.isLeaf())
+	{
+		uint32_t rightIdx = node.rightChild();
+		fixEscapeIndices(nodeIdx + 1, rightIdx);
+		fixEscapeIndices(rightIdx, escapeIdx);
+	}
+}
+
+void BVH::computeLeafBounds(Node &node) const
+{
+	node.min = glm::vec3(std::numeric_limits<float>::max());
+	node.max = glm::vec3(-std::numeric_limits<float>::max());
+
+	for (uint32_t i = 0; i < node.primCount(); ++i)
+	{
+		const BBox &b = objectBounds[primIndices[node.firstPrim() + i]];
+		node.min = glm::min(node.min, b.min);
+		node.max = glm::max(node.max, b.max);
+	}
+}
+
+void BVH::refit(uint32_t objectIdx, const BBox &newBounds)
+{
+	assert(objectIdx < objectBounds.size());
+
+	objectBounds[objectIdx] = newBounds;
+
+	uint32_t nodeIdx = objectToLeaf[objectIdx];
+	if (nodeIdx == BVH_INVALID_INDEX) return;
+
+	computeLeafBounds(nodes[nodeIdx]);
+	nodeIdx = parents[nodeIdx];
+
+	while (nodeIdx != BVH_INVALID_INDEX)
+	{
+		Node &node = nodes[nodeIdx];
+		const Node &left = nodes[nodeIdx + 1];
+		const Node &right = nodes[node.rightChild()];
+
+		glm::vec3 newMin = glm::min(left.min, right.min);
+		glm::vec3 newMax = glm::max(left.max, right.max);
+		if (newMin == node.min && newMax == node.max) break;
+
+		node.min = newMin;
+		node.max = newMax;
+		nodeIdx = parents[nodeIdx];
+	}
+}
+
+void BVH::queryFrustum(const Frustum &frustum, std::vector<uint32_t> &objects) const
+{
+	objects.clear();
+
+	const uint32_t nodeCount = static_cast<uint32_t>(nodes.size());
+	uint32_t nodeIdx = 0;
+
+	while (nodeIdx < nodeCount)
+	{
+		const Node &node = nodes[nodeIdx];
+		FrustumTestResult result = testFrustum(frustum, node.min, node.max);
+
+		if (result == FRUSTUM_OUTSIDE)
+		{
+			nodeIdx = node.escapeIdx;
+			continue;
+		}
+
+		if (result == FRUSTUM_INSIDE)
+		{
+			// The whole subtree is visible. Its nodes are [nodeIdx, escapeIdx) so collect
+			// leaf contents without further plane tests
+			for (uint32_t i = nodeIdx; i < node.escapeIdx; ++i)
+			{
+				const Node &n = nodes[i];
+				for (uint32_t j = 0; j < n.primCount(); ++j) objects.push_back(primIndices[n.firstPrim() + j]);
+			}
+			nodeIdx = node.escapeIdx;
+		}
+		else if (node.isLeaf())
+		{
+			for (uint32_t i = 0; i < node.primCount(); ++i)
+			{
+				uint32_t obj = primIndices[node.firstPrim() + i];
+				if (testFrustum(frustum, objectBounds[obj].min, objectBounds[obj].max) != FRUSTUM_OUTSIDE) objects.push_back(obj);
+			}
+			nodeIdx = node.escapeIdx;
+		}
+		else
+		{
+			++nodeIdx;
+		}
+	}
+}
+
+void BVH::querySphere(const glm::vec3 &center, float radius, std::vector<uint32_t> &objects) const
+{
+	objects.clear();
+
+	const float radius2 = radius * radius;
+	const uint32_t nodeCount = static_cast<uint32_t>(nodes.size());
+	uint32_t nodeIdx = 0;
+
+	while (nodeIdx < nodeCount)
+	{
+		const Node &node = nodes[nodeIdx];
+
+		if (!overlapsSphere(center, radius2, node.min, node.max))
+		{
+			nodeIdx = node.escapeIdx;
+			continue;
+		}
+
+		if (node.isLeaf())
+		{
+			for (uint32_t i = 0; i < node.primCount(); ++i)
+			{
+				uint32_t obj = primIndices[node.firstPrim() + i];
+				if (overlapsSphere(center, radius2, objectBounds[obj].min, objectBounds[obj].max)) objects.push_back(obj);
+			}
+			nodeIdx = node.escapeIdx;
+		}
+		else
+		{
+			++nodeIdx;
+		}
+	}
+}
+
+bool BVH::raycast(const glm::vec3 &origin, const glm::vec3 &dir, float tMax, uint32_t *objectIdx, float *tHit) const
+{
+	const glm::vec3 invDir = 1.f / dir;
+	const uint32_t nodeCount = static_cast<uint32_t>(nodes.size());
+	uint32_t nodeIdx = 0;
+	bool hit = false;
+
+	while (nodeIdx < nodeCount)
+	{
+		const Node &node = nodes[nodeIdx];
+
+		// @tMax shrinks with every hit so subtrees behind the closest hit are skipped
+		if (intersectRay(origin, invDir, tMax, node.min, node.max) < 0.f)
+		{
+			nodeIdx = node.escapeIdx;
+			continue;
+		}
+
+		if (node.isLeaf())
+		{
+			for (uint32_t i = 0; i < node.primCount(); ++i)
+			{
+				uint32_t obj = primIndices[node.firstPrim() + i];
+				float t = intersectRay(origin, invDir, tMax, objectBounds[obj].min, objectBounds[obj].max);
+				if (t >= 0.f)
+				{
+					tMax = t;
+					if (objectIdx) *objectIdx = obj;
+					if (tHit) *tHit = t;
+					hit = true;
+				}
+			}
+			nodeIdx = node.escapeIdx;
+		}
+		else
+		{
+			++nodeIdx;
+		}
+	}
+
+	return hit;
+}
+
+BBox BVH::getRootBounds() const
+{
+	return nodes.empty() ? BBox() : BBox(nodes[0].min, nodes[0].max);
+}
+
+void runBVHBenchmark(std::ostream &os)
+{
+	typedef std::chrono::high_resolution_clock Clock;
+	auto elapsedMS = [](Clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	};
+
+	const uint32_t objectCounts[] = { 1000, 10000, 100000 };
+	const uint32_t frustumQueryCount = 100;
+	const uint32_t sphereQueryCount = 1000;
+	const uint32_t rayQueryCount = 1000;
+
+	os << std::fixed << std::setprecision(3);
+
+	for (uint32_t objectCount : objectCounts)
+	{
+		std::mt19937 rng(1234);
+
+		// Keep density constant so query result sizes stay comparable across object counts
+		const float worldSize = 4.f * std::cbrt(static_cast<float>(objectCount));
+		std::uniform_real_distribution<float> posDist(0.f, worldSize);
+		std::uniform_real_distribution<float> sizeDist(0.25f, 1.f);
+		std::uniform_real_distribution<float> unitDist(-1.f, 1.f);
+
+		std::vector<BBox> bounds(objectCount);
+		for (auto &b : bounds)
+		{
+			glm::vec3 c(posDist(rng), posDist(rng), posDist(rng));
+			glm::vec3 e(sizeDist(rng), sizeDist(rng), sizeDist(rng));
+			b = BBox(c - e, c + e);
+		}
+
+		BVH bvh;
+		auto start = Clock::now();
+		bvh.build(bounds);
+		double buildMS = elapsedMS(start);
+
+		// Move 10% of the objects a little and refit
+		const uint32_t movedCount = objectCount / 10;
+		start = Clock::now();
+		for (uint32_t i = 0; i < movedCount; ++i)
+		{
+			uint32_t obj = (i * 7919) % objectCount;
+			glm::vec3 d(unitDist(rng), unitDist(rng), unitDist(rng));
+			bounds[obj] = BBox(bounds[obj].min + d * 0.1f, bounds[obj].max + d * 0.1f);
+			bvh.refit(obj, bounds[obj]);
+		}
+		double refitMS = elapsedMS(start);
+
+		// Frustum queries from cameras orbiting the scene, compared against a linear SIMD scan
+		PackedBounds packed;
+		packed.resize(objectCount);
+		for (uint32_t i = 0; i < objectCount; ++i) packed.set(i, bounds[i].min, bounds[i].max);
+
+		std::vector<Frustum> frustums(frustumQueryCount);
+		const glm::vec3 sceneCenter(0.5f * worldSize);
+		for (uint32_t i = 0; i < frustumQueryCount; ++i)
+		{
+			float angle = 6.2831853f * static_cast<float>(i) / static_cast<float>(frustumQueryCount);
+			glm::vec3 eye = sceneCenter + glm::vec3(std::cos(angle), 0.3f, std::sin(angle)) * worldSize;
+			glm::mat4 V = glm::lookAt(eye, sceneCenter, glm::vec3(0.f, 1.f, 0.f));
+			glm::mat4 P = glm::perspective(glm::radians(30.f), 16.f / 9.f, 1.f, 2.f * worldSize);
+			frustums[i] = Frustum(P * V);
+		}
+
+		std::vector<uint32_t> results;
+		size_t bvhVisible = 0;
+		start = Clock::now();
+		for (const auto &f : frustums)
+		{
+			bvh.queryFrustum(f, results);
+			bvhVisible += results.size();
+		}
+		double frustumMS = elapsedMS(start) / frustumQueryCount;
+
+		std::vector<uint8_t> visibility;
+		size_t linearVisible = 0;
+		start = Clock::now();
+		for (const auto &f : frustums)
+		{
+			linearVisible += packed.cullAgainstFrustum(f, visibility);
+		}
+		double linearFrustumMS = elapsedMS(start) / frustumQueryCount;
+
+		size_t sphereHits = 0;
+		start = Clock::now();
+		for (uint32_t i = 0; i < sphereQueryCount; ++i)
+		{
+			glm::vec3 c(posDist(rng), posDist(rng), posDist(rng));
+			bvh.querySphere(c, 4.f, results);
+			sphereHits += results.size();
+		}
+		double sphereUS = elapsedMS(start) * 1000.0 / sphereQueryCount;
+
+		uint32_t rayHits = 0;
+		start = Clock::now();
+		for (uint32_t i = 0; i < rayQueryCount; ++i)
+		{
+			glm::vec3 o(posDist(rng), posDist(rng), posDist(rng));
+			glm::vec3 d = glm::normalize(glm::vec3(unitDist(rng), unitDist(rng), unitDist(rng)) + glm::vec3(1e-3f));
+			uint32_t obj;
+			float t;
+			rayHits += bvh.raycast(o, d, 2.f * worldSize, &obj, &t) ? 1 : 0;
+		}
+		double rayUS = elapsedMS(start) * 1000.0 / rayQueryCount;
+
+		os << "BVH benchmark - " << objectCount << " objects, " << bvh.getNodeCount() << " nodes\n";
+		os << "  build            : " << buildMS << " ms\n";
+		os << "  refit            : " << refitMS << " ms for " << movedCount << " objects\n";
+		os << "  frustum query    : " << frustumMS << " ms (linear SIMD scan " << linearFrustumMS << " ms), "
+			<< bvhVisible / frustumQueryCount << " / " << linearVisible / frustumQueryCount << " visible\n";
+		os << "  sphere query     : " << sphereUS << " us, " << sphereHits / sphereQueryCount << " objects on average\n";
+		os << "  ray query        : " << rayUS << " us, " << rayHits << " / " << rayQueryCount << " hit\n";
+	}
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <ostream>
+#include "culling.h"
+
+
+// Binary BVH over world space object bounds, built top-down with a binned SAH.
+// Nodes are stored in depth-first order so that the left child of node i is node i + 1.
+// Every node also stores the index of the node to continue at once its subtree is done or skipped,
+// which lets all queries walk the array front to back without a stack.
+class BVH
+{
+public:
+	static const uint32_t maxLeafSize = 4;
+	static const uint32_t binCount = 12;
+
+	struct Node
+	{
+		glm::vec3 min;
+		uint32_t escapeIdx;
+		glm::vec3 max;
+		uint32_t packed; // leaf: (first primitive << 3) | primitive count, inner: right child << 3
+
+		bool isLeaf() const { return (packed & 7) != 0; }
+		uint32_t primCount() const { return packed & 7; }
+		uint32_t firstPrim() const { return packed >> 3; }
+		uint32_t rightChild() const { return packed >> 3; }
+	};
+
+	// Objects with empty bounds (e.g. unused object slots) are left out of the tree
+	void build(const std::vector<BBox> &objectBounds);
+
+	// Updates the bounds of one object and refits its ancestors. Stops early once a node's
+	// bounds are unchanged. Tree topology is kept, so quality degrades if objects move far.
+	// Objects left out of the tree only get their bounds stored until the next build
+	void refit(uint32_t objectIdx, const BBox &newBounds);
+
+	void queryFrustum(const Frustum &frustum, std::vector<uint32_t> &objects) const;
+	void querySphere(const glm::vec3 &center, float radius, std::vector<uint32_t> &objects) const;
+	// Returns the closest object whose bounds are hit by the ray within [0, @tMax]
+	bool raycast(const glm::vec3 &origin, const glm::vec3 &dir, float tMax, uint32_t *objectIdx, float *tHit) const;
+
+	BBox getRootBounds() const;
+	uint32_t getObjectCount() const { return static_cast<uint32_t>(objectBounds.size()); }
+	uint32_t getNodeCount() const { return static_cast<uint32_t>(nodes.size()); }
+
+protected:
+	std::vector<Node> nodes;
+	std::vector<uint32_t> parents;
+	std::vector<uint32_t> primIndices; // object indices in leaf order
+	std::vector<uint32_t> objectToLeaf;
+	std::vector<BBox> objectBounds;
+
+	uint32_t buildRecursive(uint32_t begin, uint32_t end, uint32_t parentIdx, const std::vector<glm::vec3> &centroids);
+	void fixEscapeIndices(uint32_t nodeIdx, uint32_t escapeIdx);
+	void computeLeafBounds(Node &node) const;
+};
+
+// Times build, refit and queries at 1k, 10k and 100k objects and prints the results
+void runBVHBenchmark(std::ostream &os);
@@ -62,19 +62,18 @@ inline void bboxUnion(const glm::vec3 &p, glm::vec3 *pMin, glm::vec3 *pMax)
 	*pMax = glm::max(*pMax, p);
 }
 
-void Camera::getSegmentDepths(std::vector<float> *segDepths) const
+void Camera::getSegmentDepths(float *segDepths) const
 {
 	assert(segDepths);
-	segDepths->resize(segmentCount);
 	for (int i = 0; i < segmentCount; ++i)
 	{
 		float nearClip = i == 0 ? zNear : -farPlaneZs[i - 1];
 		float farClip = -farPlaneZs[i];
-		(*segDepths)[i] = farClip - nearClip;
+		segDepths[i] = farClip - nearClip;
 	}
 }
 
-void Camera::getCornersWorldSpace(std::vector<glm::vec3> *corners) const
+void Camera::getCornersWorldSpace(glm::vec3 *corners) const
 {
 	assert(corners);
 	const auto f = glm::normalize(lookAtPos - position);
@@ -82,8 +81,6 @@ void Camera::getCornersWorldSpace(std::vector<glm::vec3> *corners) const
 	const auto u = glm::cross(r, f);
 	const float tanHalfFovy = tanf(fovy * 0.5f);
 
-	corners->resize(segmentCount * 4 + 4);
-
 	for (uint32_t i = 0; i <= segmentCount; ++i)
 	{
 		float depth = i == 0 ? zNear : -farPlaneZs[i - 1];
@@ -91,10 +88,10 @@ void Camera::getCornersWorldSpace(std::vector<glm::vec3> *corners) const
 		auto du = depth * tanHalfFovy * u;
 		auto dr = depth * tanHalfFovy * aspectRatio * r;
 
-		(*corners)[4 * i] = position + df + du + dr;
-		(*corners)[4 * i + 1] = position + df + du - dr;
-		(*corners)[4 * i + 2] = position + df - du - dr;
-		(*corners)[4 * i + 3] = position + df - du + dr;
+		corners[4 * i] = position + df + du + dr;
+		corners[4 * i + 1] = position + df + du - dr;
+		corners[4 * i + 2] = position + df - du - dr;
+		corners[4 * i + 3] = position + df - du + dr;
 	}
 }
 
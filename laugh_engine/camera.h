@@ -24,10 +24,12 @@ public:
 	const glm::vec3 &getPosition() const { return position; }
 	uint32_t getSegmentCount() const { return segmentCount; }
 	float getNormFarPlaneZ(uint32_t segIdx) const { return normFarPlaneZs[segIdx]; }
-	void getSegmentDepths(std::vector<float> *segDepths) const;
-	// On return, @corners contain (segmentCount * 4 + 4) points because
+	// @segDepths must have room for segmentCount values
+	void getSegmentDepths(float *segDepths) const;
+	uint32_t getCornerCount() const { return segmentCount * 4 + 4; }
+	// @corners must have room for getCornerCount() points, there are (segmentCount * 4 + 4) because
 	// near plane corners are the far plane corners of the previous segment
-	void getCornersWorldSpace(std::vector<glm::vec3> *corners) const;
+	void getCornersWorldSpace(glm::vec3 *corners) const;
 
 	void addRotation(float phi, float theta);
 	void addPan(float x, float y);
@@ -36,8 +38,9 @@ public:
 	void setAspectRatio(float aspect) { aspectRatio = aspect; }
 
 protected:
-	const float thetaLimit;
-	const float minDistance;
+	// not const, so that cameras can be copied to the update thread
+	float thetaLimit;
+	float minDistance;
 
 	float fovy;
 	float aspectRatio;
@@ -0,0 +1,180 @@
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include <xmmintrin.h>
+#include "culling.h"
+
+
+BBox BBox::getTransformedAABB(const glm::mat4 & T) const
+{
+	glm::vec4 corners[8] =
+	{
+		glm::vec4(max.x, max.y, min.z, 1.f),
+		glm::vec4(min.x, max.y, min.z, 1.f),
+		glm::vec4(min.x, min.y, min.z, 1.f),
+		glm::vec4(max.x, min.y, min.z, 1.f),
+		glm::vec4(max.x, max.y, max.z, 1.f),
+		glm::vec4(min.x, max.y, max.z, 1.f),
+		glm::vec4(min.x, min.y, max.z, 1.f),
+		glm::vec4(max.x, min.y, max.z, 1.f)
+	};
+	
+	BBox result;
+	for (uint32_t i = 0; i < 8; ++i)
+	{
+		auto c = glm::vec3(T * corners[i]);
+		result.min = glm::min(result.min, c);
+		result.max = glm::max(result.max, c);
+	}
+
+	return result;
+}
+
+Frustum::Frustum(const glm::mat4 &VP)
+{
+	// glm is column major, so row i of VP is (VP[0][i], VP[1][i], VP[2][i], VP[3][i])
+	glm::vec4 rows[4];
+	for (uint32_t i = 0; i < 4; ++i)
+	{
+		rows[i] = glm::vec4(VP[0][i], VP[1][i], VP[2][i], VP[3][i]);
+	}
+
+	planes[0] = rows[3] + rows[0]; // left
+	planes[1] = rows[3] - rows[0]; // right
+	planes[2] = rows[3] + rows[1]; // bottom
+	planes[3] = rows[3] - rows[1]; // top
+	planes[4] = rows[2];           // near (depth is in [0, 1])
+	planes[5] = rows[3] - rows[2]; // far
+
+	for (uint32_t i = 0; i < planeCount; ++i)
+	{
+		planes[i] /= glm::length(glm::vec3(planes[i]));
+	}
+}
+
+void PackedBounds::resize(uint32_t newCount)
+{
+	count = newCount;
+
+	size_t paddedCount = (static_cast<size_t>(newCount) + 3) & ~static_cast<size_t>(3);
+	centerX.assign(paddedCount, 0.f);
+	centerY.assign(paddedCount, 0.f);
+	centerZ.assign(paddedCount, 0.f);
+	extentX.assign(paddedCount, 0.f);
+	extentY.assign(paddedCount, 0.f);
+	extentZ.assign(paddedCount, 0.f);
+}
+
+void PackedBounds::set(uint32_t idx, const glm::vec3 &minPos, const glm::vec3 &maxPos)
+{
+	assert(idx < count);
+
+	glm::vec3 c = 0.5f * (maxPos + minPos);
+	glm::vec3 e = 0.5f * (maxPos - minPos);
+
+	centerX[idx] = c.x;
+	centerY[idx] = c.y;
+	centerZ[idx] = c.z;
+	extentX[idx] = e.x;
+	extentY[idx] = e.y;
+	extentZ[idx] = e.z;
+}
+
+uint32_t PackedBounds::cullAgainstFrustum(const Frustum &frustum, std::vector<uint8_t> &visible) const
+{
+	return cullAgainstPlanes(frustum.planes, Frustum::planeCount, visible);
+}
+
+uint32_t PackedBounds::cullAgainstPlanes(const glm::vec4 *planes, uint32_t planeCount, std::vector<uint8_t> &visible) const
+{
+	assert(planeCount <= maxPlaneCount);
+
+	visible.resize(count);
+	if (count == 0) return 0;
+
+	// Broadcast plane coefficients once. Extents are projected onto the absolute normal
+	// to get the box's effective radius along that normal
+	__m128 nx[maxPlaneCount], ny[maxPlaneCount], nz[maxPlaneCount], nd[maxPlaneCount];
+	__m128 ax[maxPlaneCount], ay[maxPlaneCount], az[maxPlaneCount];
+	for (uint32_t p = 0; p < planeCount; ++p)
+	{
+		const glm::vec4 &plane = planes[p];
+		nx[p] = _mm_set1_ps(plane.x);
+		ny[p] = _mm_set1_ps(plane.y);
+		nz[p] = _mm_set1_ps(plane.z);
+		nd[p] = _mm_set1_ps(plane.w);
+		ax[p] = _mm_set1_ps(fabsf(plane.x));
+		ay[p] = _mm_set1_ps(fabsf(plane.y));
+		az[p] = _mm_set1_ps(fabsf(plane.z));
+	}
+
+	const __m128 zero = _mm_setzero_ps();
+	uint32_t visibleCount = 0;
+
+	for (uint32_t i = 0; i < count; i += 4)
+	{
+		__m128 cx = _mm_loadu_ps(&centerX[i]);
+		__m128 cy = _mm_loadu_ps(&centerY[i]);
+		__m128 cz = _mm_loadu_ps(&centerZ[i]);
+		__m128 ex = _mm_loadu_ps(&extentX[i]);
+		__m128 ey = _mm_loadu_ps(&extentY[i]);
+		__m128 ez = _mm_loadu_ps(&extentZ[i]);
+
+		__m128 inside = _mm_cmpeq_ps(zero, zero); // all bits set
+
+		for (uint32_t p = 0; p < planeCount; ++p)
+		{
+			__m128 dist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx[p], cx), _mm_mul_ps(ny[p], cy)),
+				_mm_add_ps(_mm_mul_ps(nz[p], cz), nd[p]));
+			__m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax[p], ex), _mm_mul_ps(ay[p], ey)), _mm_mul_ps(az[p], ez));
+
+			// a box is outside once its center is further than its radius behind any plane
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(dist, radius), zero));
+		}
+
+		int mask = _mm_movemask_ps(inside);
+		uint32_t laneCount = count - i < 4 ? count - i : 4;
+		for (uint32_t k = 0; k < laneCount; ++k)
+		{
+			uint8_t v = static_cast<uint8_t>((mask >> k) & 1);
+			visible[i + k] = v;
+			visibleCount += v;
+		}
+	}
+
+	return visibleCount;
+}
+
+float PackedBounds::maxSignedDistance(const glm::vec4 &plane, const std::vector<uint8_t> &mask) const
+{
+	assert(mask.size() >= count);
+
+	const __m128 nx = _mm_set1_ps(plane.x);
+	const __m128 ny = _mm_set1_ps(plane.y);
+	const __m128 nz = _mm_set1_ps(plane.z);
+	const __m128 nd = _mm_set1_ps(plane.w);
+	const __m128 ax = _mm_set1_ps(fabsf(plane.x));
+	const __m128 ay = _mm_set1_ps(fabsf(plane.y));
+	const __m128 az = _mm_set1_ps(fabsf(plane.z));
+
+	float result = -std::numeric_limits<float>::max();
+
+	for (uint32_t i = 0; i < count; i += 4)
+	{
+		__m128 dist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, _mm_loadu_ps(&centerX[i])), _mm_mul_ps(ny, _mm_loadu_ps(&centerY[i]))),
+			_mm_add_ps(_mm_mul_ps(nz, _mm_loadu_ps(&centerZ[i])), nd));
+		__m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, _mm_loadu_ps(&extentX[i])), _mm_mul_ps(ay, _mm_loadu_ps(&extentY[i]))),
+			_mm_mul_ps(az, _mm_loadu_ps(&extentZ[i])));
+
+		float farthest[4];
+		_mm_storeu_ps(farthest, _mm_add_ps(dist, radius));
+
+		uint32_t laneCount = count - i < 4 ? count - i : 4;
+		for (uint32_t k = 0; k < laneCount; ++k)
+		{
+			if (mask[i + k]) result = fmaxf(result, farthest[k]);
+		}
+	}
+
+	return result;
+}
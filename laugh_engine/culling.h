@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <vector>
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include "glm/glm.hpp"
+
+
+// Actually AABB
+struct BBox
+{
+	glm::vec3 min;
+	glm::vec3 max;
+
+	BBox() : min(std::numeric_limits<float>::max()), max(-std::numeric_limits<float>::max()) {}
+
+	BBox(const glm::vec3 &_min, const glm::vec3 &_max)
+		: min(_min), max(_max) {}
+
+	BBox getTransformedAABB(const glm::mat4 &T) const;
+
+	// True for a default constructed box
+	bool isEmpty() const { return min.x > max.x || min.y > max.y || min.z > max.z; }
+};
+
+// Planes are stored as (inward normal, distance) so that a point p is inside when dot(n, p) + d >= 0
+struct Frustum
+{
+	static const uint32_t planeCount = 6;
+
+	glm::vec4 planes[planeCount];
+
+	Frustum() {}
+
+	// Works for any projection that maps depth to [0, 1], perspective or orthographic
+	explicit Frustum(const glm::mat4 &VP);
+};
+
+// World space AABBs of a set of objects in SoA layout (centers and half extents).
+// Storage is padded to a multiple of 4 so that 4 boxes can be tested against a plane at once
+class PackedBounds
+{
+public:
+	void resize(uint32_t count);
+	uint32_t size() const { return count; }
+
+	// An empty box (see BBox()) never intersects anything, which keeps unused slots out of every query
+	void set(uint32_t idx, const glm::vec3 &minPos, const glm::vec3 &maxPos);
+
+	// On return, @visible[i] is 1 if box i intersects @frustum and 0 otherwise
+	// Returns the number of visible boxes
+	uint32_t cullAgainstFrustum(const Frustum &frustum, std::vector<uint8_t> &visible) const;
+
+	// Same as above for an arbitrary convex volume of at most @maxPlaneCount planes
+	uint32_t cullAgainstPlanes(const glm::vec4 *planes, uint32_t planeCount, std::vector<uint8_t> &visible) const;
+
+	// Largest signed distance from @plane reached by any box flagged in @mask.
+	// Returns -FLT_MAX if no box is flagged
+	float maxSignedDistance(const glm::vec4 &plane, const std::vector<uint8_t> &mask) const;
+
+	static const uint32_t maxPlaneCount = 8;
+
+protected:
+	uint32_t count = 0;
+
+	std::vector<float> centerX, centerY, centerZ;
+	std::vector<float> extentX, extentY, extentZ;
+};
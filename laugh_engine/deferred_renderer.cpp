@@ -1,7 +1,8 @@
 #include "deferred_renderer.h"
 
 
-DeferredRenderer::DeferredRenderer()
+DeferredRenderer::DeferredRenderer(uint32_t stressSceneDroneCount)
+	: m_stressSceneDroneCount(stressSceneDroneCount)
 {
 	m_verNumMajor = 0;
 	m_verNumMinor = 1;
@@ -13,6 +14,8 @@ DeferredRenderer::DeferredRenderer()
 	m_vulkanManager.getPhysicalDeviceProperties(&props);
 	m_oneTimeUniformHostData.setAlignment(props.limits.minUniformBufferOffsetAlignment);
 	m_perFrameUniformHostData.setAlignment(props.limits.minUniformBufferOffsetAlignment);
+
+	m_softwareOcclusionCuller.setThreadPool(&m_updateThreadPool);
 }
 
 void DeferredRenderer::run()
@@ -24,22 +27,105 @@ void DeferredRenderer::run()
 	savePrecomputationResults();
 }
 
+void DeferredRenderer::runDescriptorUpdateBenchmark(std::ostream &os)
+{
+	initVulkan();
+
+	typedef std::chrono::high_resolution_clock Clock;
+	auto elapsedMS = [](Clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	};
+
+	const uint32_t setCounts[] = { 1000, 10000, 100000 };
+
+	os << std::fixed << std::setprecision(3);
+
+	// every set gets the resources of frame 0's geometry pass set
+	const GeomPassDescriptors descriptors = getGeomPassDescriptors(0);
+
+	for (uint32_t setCount : setCounts)
+	{
+		m_vulkanManager.beginCreateDescriptorPool(setCount);
+		m_vulkanManager.descriptorPoolAddDescriptors(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, setCount);
+		m_vulkanManager.descriptorPoolAddDescriptors(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3 * setCount);
+		const uint32_t pool = m_vulkanManager.endCreateDescriptorPool();
+		const std::vector<uint32_t> sets = m_vulkanManager.allocateDescriptorSets(pool, std::vector<uint32_t>(setCount, m_geomDescriptorSetLayout));
+
+		// what the geometry pass sets were written with before templates
+		std::vector<rj::DescriptorSetUpdateBufferInfo> bufferInfos(1);
+		auto start = Clock::now();
+		for (uint32_t set : sets)
+		{
+			m_vulkanManager.beginUpdateDescriptorSet(set);
+
+			bufferInfos[0].bufferName = m_perFrameUniformDeviceData[0].buffer;
+			bufferInfos[0].offset = descriptors.cameraVP.offset;
+			bufferInfos[0].sizeInBytes = descriptors.cameraVP.range;
+			m_vulkanManager.descriptorSetAddBufferDescriptor(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, bufferInfos);
+
+			bufferInfos[0].bufferName = m_perFrameObjectTransformDeviceData[0].buffer;
+			bufferInfos[0].offset = 0;
+			bufferInfos[0].sizeInBytes = m_perFrameObjectTransformDeviceData[0].size;
+			m_vulkanManager.descriptorSetAddBufferDescriptor(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, bufferInfos);
+
+			bufferInfos[0].bufferName = m_instanceObjectDeviceData.buffer;
+			bufferInfos[0].sizeInBytes = m_instanceObjectDeviceData.size;
+			m_vulkanManager.descriptorSetAddBufferDescriptor(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, bufferInfos);
+
+			bufferInfos[0].bufferName = m_objectMeshDeviceData.buffer;
+			bufferInfos[0].sizeInBytes = m_objectMeshDeviceData.size;
+			m_vulkanManager.descriptorSetAddBufferDescriptor(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, bufferInfos);
+
+			m_vulkanManager.endUpdateDescriptorSet();
+		}
+		double writeMS = elapsedMS(start);
+
+		start = Clock::now();
+		for (uint32_t set : sets)
+		{
+			m_vulkanManager.updateDescriptorSetWithTemplate(set, m_geomDescriptorUpdateTemplate, &descriptors);
+		}
+		double templateMS = elapsedMS(start);
+
+		// packed structs are usually built per set anyway, so that is part of the timing
+		start = Clock::now();
+		std::vector<GeomPassDescriptors> packed(setCount, descriptors);
+		m_vulkanManager.updateDescriptorSetsWithTemplate(sets.data(), setCount, m_geomDescriptorUpdateTemplate,
+			packed.data(), sizeof(GeomPassDescriptors));
+		double batchedMS = elapsedMS(start);
+
+		// the set names go back to the manager, the pool stays around until exit
+		m_vulkanManager.resetDescriptorPool(pool);
+
+		os << "Descriptor update benchmark - " << setCount << " sets, 1 uniform + 3 storage buffers each\n";
+		os << "  write descriptor sets : " << writeMS << " ms\n";
+		os << "  template, per set     : " << templateMS << " ms\n";
+		os << "  template, all sets    : " << batchedMS << " ms\n";
+	}
+}
+
 void DeferredRenderer::updateUniformHostData()
 {
+	typedef std::chrono::high_resolution_clock Clock;
+	const auto start = Clock::now();
+
+	const auto &input = getUpdateInput();
+
 	// update final output pass info
 	*m_uDisplayInfo =
 	{
-		m_displayMode
+		input.displayMode
 	};
 
 	// update transformation matrices
 	glm::mat4 V, P;
-	m_camera.getViewProjMatrix(V, P);
+	input.camera.getViewProjMatrix(V, P);
 
 	m_uCameraVP->VP = P * V;
 
 	// update lighting info
-	m_uLightInfo->eyeWorldPos = m_camera.getPosition();
+	m_uLightInfo->eyeWorldPos = input.camera.getPosition();
 	m_uLightInfo->emissiveStrength = 5.f;
 	for (uint32_t i = 0; i < 9; ++i)
 	{
@@ -54,82 +140,347 @@ void DeferredRenderer::updateUniformHostData()
 		0.f
 	};
 
-	// update per model information
-	for (auto &model : m_scene.meshes)
+	// transforms and world space bounds of the objects that moved
+	m_scene.updateSceneGraph();
+	auto &transforms = m_scene.transforms;
+	transforms.update(&m_updateThreadPool);
+	transforms.forEachDirty([this, &transforms](uint32_t i)
 	{
-		model.updateHostUniformBuffer();
-	}
+		if (!m_scene.isInstanceAlive(i)) return;
+
+		BBox bounds = m_scene.instances[i].getMeshBounds().getTransformedAABB(transforms.getTransforms()[i].M);
+		m_objectWorldBounds[i] = bounds;
+		m_objectBounds.set(i, bounds.min, bounds.max);
+		m_objectBoundsHostData[2 * i] = glm::vec4(bounds.min, 1.f);
+		m_objectBoundsHostData[2 * i + 1] = glm::vec4(bounds.max, 1.f);
+	});
+	transforms.clearDirty();
 
 	// shadow light information
-	std::vector<glm::vec3> frustumCornersWS;
-	std::vector<float> frustumSegmentDepths;
-	m_camera.getCornersWorldSpace(&frustumCornersWS);
-	m_camera.getSegmentDepths(&frustumSegmentDepths);
+	ArenaVector<glm::vec3> frustumCornersWS(input.camera.getCornerCount(), ArenaAllocator<glm::vec3>(&m_frameArena));
+	ArenaVector<float> frustumSegmentDepths(input.camera.getSegmentCount(), ArenaAllocator<float>(&m_frameArena));
+	input.camera.getCornersWorldSpace(frustumCornersWS.data());
+	input.camera.getSegmentDepths(frustumSegmentDepths.data());
 	m_scene.shadowLight.computeCascadeScalesAndOffsets(frustumCornersWS, frustumSegmentDepths,
-		m_scene.aabbWorldSpace.min, m_scene.aabbWorldSpace.max, SHADOW_MAP_SIZE);
+		m_objectBounds, SHADOW_MAP_SIZE);
 	
 	m_uLightInfo->normFarPlaneZs = glm::vec4(0.f);
 
-	for (uint32_t i = 0; i < m_camera.getSegmentCount(); ++i)
+	for (uint32_t i = 0; i < input.camera.getSegmentCount(); ++i)
 	{
 		glm::mat4 VP;
 		m_scene.shadowLight.getCascadeViewProjMatrix(i, &VP);
 
 		m_uShadowLightInfos[i]->cascadeVP = VP;
-		m_uLightInfo->normFarPlaneZs[i] = m_camera.getNormFarPlaneZ(i);
+		m_uDrawCullInfo->cascadeVPs[i] = VP;
+		m_uLightInfo->normFarPlaneZs[i] = input.camera.getNormFarPlaneZ(i);
 		m_uLightInfo->cascadeVPs[i] = VP;
 	}
+
+	updateDrawCommands(m_uCameraVP->VP);
+
+	m_updateTimeCalculator.addFrameTime(static_cast<float>(std::chrono::duration<double, std::milli>(Clock::now() - start).count()));
+
+	// hand the results over to the render thread, the vectors keep their capacity across updates
+	auto &snapshot = m_frameSnapshots.getBack();
+	const char *hostData = &m_perFrameUniformHostData;
+	snapshot.uniformHostData.assign(hostData, hostData + m_perFrameUniformHostData.size());
+	snapshot.objectBoundsHostData = m_objectBoundsHostData;
+	snapshot.objectTransforms.assign(transforms.getTransforms(), transforms.getTransforms() + transforms.size());
+	snapshot.geomDrawOrder = m_geomDrawOrder;
+	snapshot.drawnObjectCount = m_drawnObjectCount;
+	snapshot.culledObjectCount = m_culledObjectCount;
+	snapshot.softwareOccludedObjectCount = m_softwareOccludedObjectCount;
+	snapshot.softwareOcclusionStats = m_softwareOcclusionCuller.getStats();
+	snapshot.updateTimeMS = m_updateTimeCalculator.getAverageTimeMS();
+	snapshot.frameArenaUsedSize = m_frameArena.getUsedSize();
+	snapshot.frameArenaCapacity = m_frameArena.getCapacity();
+	m_frameSnapshots.publish();
 }
 
-void DeferredRenderer::updateUniformDeviceData(uint32_t imgIdx)
+void DeferredRenderer::updateUniformDeviceData(uint32_t frameIdx)
 {
-	void* data = m_vulkanManager.mapBuffer(m_perFrameUniformDeviceData[imgIdx].buffer);
-	memcpy(data, &m_perFrameUniformHostData, m_perFrameUniformDeviceData[imgIdx].size);
-	m_vulkanManager.unmapBuffer(m_perFrameUniformDeviceData[imgIdx].buffer);
+	typedef std::chrono::high_resolution_clock Clock;
+	const auto start = Clock::now();
+
+	const auto &snapshot = m_frameSnapshots.getFront();
+
+	// find the uniform blocks that changed since the last update
+	++m_uniformUpdateCount;
+	const char *hostData = snapshot.uniformHostData.data();
+	const auto &allocations = m_perFrameUniformHostData.getAllocations();
+	for (size_t i = 0; i < allocations.size(); ++i)
+	{
+		const size_t offset = allocations[i].first, size = allocations[i].second;
+		if (memcmp(hostData + offset, &m_perFrameUniformLastHostData[offset], size) != 0)
+		{
+			memcpy(&m_perFrameUniformLastHostData[offset], hostData + offset, size);
+			m_perFrameUniformChangedUpdates[i] = m_uniformUpdateCount;
+		}
+	}
+
+	// The frame's region was last written MAX_FRAMES_IN_FLIGHT updates ago, so it needs every block that
+	// changed since then. The written blocks are close together and flushed at once
+	const auto &region = m_perFrameUniformDeviceData[frameIdx];
+	char *mapped = reinterpret_cast<char *>(m_vulkanManager.mapBufferPersistently(region.buffer)) + region.offset;
+	size_t dirtyBegin = region.size, dirtyEnd = 0;
+	m_uniformUploadBytes = 0;
+	for (size_t i = 0; i < allocations.size(); ++i)
+	{
+		if (m_perFrameUniformChangedUpdates[i] <= m_perFrameUniformWrittenUpdates[frameIdx]) continue;
+
+		const size_t offset = allocations[i].first, size = allocations[i].second;
+		memcpy(mapped + offset, hostData + offset, size);
+		dirtyBegin = std::min(dirtyBegin, offset);
+		dirtyEnd = std::max(dirtyEnd, offset + size);
+		m_uniformUploadBytes += size;
+	}
+	m_perFrameUniformWrittenUpdates[frameIdx] = m_uniformUpdateCount;
+	if (dirtyEnd > dirtyBegin)
+	{
+		m_vulkanManager.flushMappedBufferRange(region.buffer, region.offset + dirtyBegin, dirtyEnd - dirtyBegin);
+	}
+
+	// bounds carry the CPU culling result and transforms follow every moving object, so both are copied
+	// as a whole. Their memory is host coherent
+	void *data = m_vulkanManager.mapBufferPersistently(m_perFrameObjectBoundsDeviceData[frameIdx].buffer);
+	memcpy(data, snapshot.objectBoundsHostData.data(), m_perFrameObjectBoundsDeviceData[frameIdx].size);
+	m_bufferUploadBytes = m_perFrameObjectBoundsDeviceData[frameIdx].size;
+
+	data = m_vulkanManager.mapBufferPersistently(m_perFrameObjectTransformDeviceData[frameIdx].buffer);
+	memcpy(data, snapshot.objectTransforms.data(), sizeof(ObjectTransform) * snapshot.objectTransforms.size());
+	m_bufferUploadBytes += sizeof(ObjectTransform) * snapshot.objectTransforms.size();
+
+	m_uploadTimeCalculator.addFrameTime(static_cast<float>(std::chrono::duration<double, std::milli>(Clock::now() - start).count()));
 }
 
-void DeferredRenderer::updateText(uint32_t imageIdx)
+void DeferredRenderer::updateDrawCommands(const glm::mat4 &VP)
 {
-	m_textOverlay.beginTextUpdate();
+	const auto &input = getUpdateInput();
+	const uint32_t objectCount = static_cast<uint32_t>(m_scene.instances.size());
 
-	std::stringstream ss;
-	ss << m_windowTitle << " - ver" << m_verNumMajor << "." << m_verNumMinor;
-	m_textOverlay.addText(ss.str(), 5.0f, 5.0f, VTextOverlay::alignLeft);
+	// geometry pass. The camera usually sees a large part of the scene, where a linear SIMD scan is faster than
+	// walking a BVH (see --bvh_benchmark)
+	m_objectBounds.cullAgainstFrustum(Frustum(VP), m_objectVisibility);
+	m_visibleObjects.clear();
+	for (uint32_t i = 0; i < objectCount; ++i)
+	{
+		if (m_objectVisibility[i]) m_visibleObjects.push_back(i);
+	}
 
-	ss = std::stringstream();
-	ss << std::fixed << std::setprecision(2) << "Frame Time : " << m_frameTimeCalculator.getAverageTimeMS() << " ms";
-	m_textOverlay.addText(ss.str(), 5.f, 25.f, VTextOverlay::alignLeft);
+	m_softwareOccludedObjectCount = 0;
+	if (input.softwareOcclusionCulling)
+	{
+		// only occluders inside the frustum can hide anything
+		m_occluders.clear();
+		for (uint32_t i : m_occluderObjects)
+		{
+			if (!m_objectVisibility[i]) continue;
+
+			const auto &mesh = m_scene.meshes[m_scene.instances[i].meshIdx];
+			SoftwareOcclusionCuller::Occluder occluder;
+			occluder.positions = mesh.occluderPositions.data();
+			occluder.indices = mesh.occluderIndices.data();
+			occluder.indexCount = static_cast<uint32_t>(mesh.occluderIndices.size());
+			occluder.M = m_scene.transforms.getTransforms()[i].M;
+			m_occluders.push_back(occluder);
+		}
+
+		m_softwareOcclusionCuller.renderOccluders(VP, m_occluders);
+		m_softwareOcclusionCuller.cullObjects(m_objectWorldBounds, m_visibleObjects);
+		m_softwareOccludedObjectCount = m_softwareOcclusionCuller.getStats().occludedCount;
+	}
 
-	ss = std::stringstream();
-	ss << std::fixed << std::setprecision(2) << "Geom Pass Time : " << m_geomPassTimeCalculator.getAverageTimeMS() << " ms";
-	m_textOverlay.addText(ss.str(), 5.f, 45.f, VTextOverlay::alignLeft);
+	m_drawnObjectCount = static_cast<uint32_t>(m_visibleObjects.size());
+	m_culledObjectCount = m_scene.getAliveInstanceCount() - m_drawnObjectCount;
 
-	ss = std::stringstream();
-	ss << std::fixed << std::setprecision(2) << "Shadow Pass Time : " << m_shadowPassTimeCalculator.getAverageTimeMS() << " ms";
-	m_textOverlay.addText(ss.str(), 5.f, 65.f, VTextOverlay::alignLeft);
+	// the occlusion culling shader only considers the objects that survived CPU culling and
+	// appends their instances to the geometry pass draws
+	for (uint32_t i = 0; i < objectCount; ++i) m_objectBoundsHostData[2 * i].w = 0.f;
+	for (uint32_t i : m_visibleObjects) m_objectBoundsHostData[2 * i].w = 1.f;
 
-	ss = std::stringstream();
-	ss << std::fixed << std::setprecision(2) << "Lighting Pass Time : " << m_lightingPassTimeCalculator.getAverageTimeMS() << " ms";
-	m_textOverlay.addText(ss.str(), 5.f, 85.f, VTextOverlay::alignLeft);
+	// shadow pass draws are generated per cascade on the GPU, see draw_cull.comp
+
+	// geometry pass draw order, front to back by each mesh's nearest visible instance.
+	// Meshes without visible instances go last
+	const uint32_t meshCount = static_cast<uint32_t>(m_scene.meshes.size());
+	if (!input.sortDraws)
+	{
+		m_geomDrawOrder.clear();
+		for (uint32_t i = 0; i < meshCount; ++i)
+		{
+			if (m_scene.isMeshAlive(i)) m_geomDrawOrder.push_back(i);
+		}
+		return;
+	}
 
-	ss = std::stringstream();
-	ss << std::fixed << std::setprecision(2) << "Bloom Pass Time : " << m_bloomPassTimeCalculator.getAverageTimeMS() << " ms";
-	m_textOverlay.addText(ss.str(), 5.f, 105.f, VTextOverlay::alignLeft);
+	const glm::vec3 eyePos = input.camera.getPosition();
+	m_meshViewDepths.assign(meshCount, std::numeric_limits<float>::max());
+	for (uint32_t i : m_visibleObjects)
+	{
+		const BBox &bounds = m_objectWorldBounds[i];
+		float &depth = m_meshViewDepths[m_scene.instances[i].meshIdx];
+		depth = std::min(depth, glm::length(glm::clamp(eyePos, bounds.min, bounds.max) - eyePos));
+	}
 
-	ss = std::stringstream();
-	ss << std::fixed << std::setprecision(2) << "Final Ouput Pass Time : " << m_finalOutputPassTimeCalculator.getAverageTimeMS() << " ms";
-	m_textOverlay.addText(ss.str(), 5.f, 125.f, VTextOverlay::alignLeft);
+	m_geomDrawList.clear();
+	for (uint32_t i = 0; i < meshCount; ++i)
+	{
+		if (!m_scene.isMeshAlive(i)) continue;
+		// materials are looked up in the shader, so only depth is left to sort by
+		m_geomDrawList.add(DrawList::makeKey(DRAW_PASS_GEOMETRY, m_meshViewDepths[i]), i);
+	}
+	m_geomDrawList.sort();
 
-	m_textOverlay.endTextUpdate(imageIdx);
+	m_geomDrawOrder.clear();
+	for (const auto &item : m_geomDrawList.getItems()) m_geomDrawOrder.push_back(item.drawIdx);
+}
+
+void DeferredRenderer::updateText(uint32_t frameIdx, uint32_t imageIdx)
+{
+	const auto &snapshot = m_frameSnapshots.getFront();
+	m_textOverlay.beginTextUpdate(frameIdx);
+
+	// formatted on the stack, the overlay is rebuilt every frame
+	char line[256];
+
+	snprintf(line, sizeof(line), "%s - ver%u.%u", m_windowTitle.c_str(), m_verNumMajor, m_verNumMinor);
+	m_textOverlay.addText(line, 5.0f, 5.0f, VTextOverlay::alignLeft);
+
+	snprintf(line, sizeof(line), "Frame Time : %.2f ms", m_frameTimeCalculator.getAverageTimeMS());
+	m_textOverlay.addText(line, 5.f, 25.f, VTextOverlay::alignLeft);
+
+	snprintf(line, sizeof(line), "Geom Pass Time : %.2f ms", m_geomPassTimeCalculator.getAverageTimeMS());
+	m_textOverlay.addText(line, 5.f, 45.f, VTextOverlay::alignLeft);
+
+	snprintf(line, sizeof(line), "Shadow Pass Time : %.2f ms", m_shadowPassTimeCalculator.getAverageTimeMS());
+	m_textOverlay.addText(line, 5.f, 65.f, VTextOverlay::alignLeft);
+
+	// Vertex data the shadow pass reads per cascade vs. what the interleaved stream would cost
+	VkDeviceSize shadowVertexBytes = 0;
+	VkDeviceSize interleavedVertexBytes = 0;
+	for (uint32_t i = 0; i < m_scene.meshes.size(); ++i)
+	{
+		if (!m_scene.isMeshAlive(i)) continue;
+
+		const auto &mesh = m_scene.meshes[i];
+		shadowVertexBytes += mesh.positionBuffer.size + mesh.positionIndexBuffer.size;
+		interleavedVertexBytes += mesh.vertexBuffer.size + mesh.indexBuffer.size;
+	}
+
+	snprintf(line, sizeof(line), "Shadow Pass Vertex Data : %.2f KB (was %.2f KB)", shadowVertexBytes / 1024.f, interleavedVertexBytes / 1024.f);
+	m_textOverlay.addText(line, 5.f, 85.f, VTextOverlay::alignLeft);
+
+	snprintf(line, sizeof(line), "Lighting Pass Time : %.2f ms", m_lightingPassTimeCalculator.getAverageTimeMS());
+	m_textOverlay.addText(line, 5.f, 105.f, VTextOverlay::alignLeft);
+
+	snprintf(line, sizeof(line), "Bloom Pass Time : %.2f ms", m_bloomPassTimeCalculator.getAverageTimeMS());
+	m_textOverlay.addText(line, 5.f, 125.f, VTextOverlay::alignLeft);
+
+	snprintf(line, sizeof(line), "Final Ouput Pass Time : %.2f ms", m_finalOutputPassTimeCalculator.getAverageTimeMS());
+	m_textOverlay.addText(line, 5.f, 145.f, VTextOverlay::alignLeft);
+
+	snprintf(line, sizeof(line), "Objects Drawn / Culled : %u / %u", snapshot.drawnObjectCount, snapshot.culledObjectCount);
+	m_textOverlay.addText(line, 5.f, 165.f, VTextOverlay::alignLeft);
+
+	int length = snprintf(line, sizeof(line), "Shadow Casters Per Cascade :");
+	for (auto count : m_shadowCasterCounts)
+	{
+		length += snprintf(line + length, sizeof(line) - length, " %u", count);
+	}
+	m_textOverlay.addText(line, 5.f, 185.f, VTextOverlay::alignLeft);
+
+	snprintf(line, sizeof(line), "Objects Occluded (Hi-Z) : %u", m_occludedObjectCount);
+	m_textOverlay.addText(line, 5.f, 205.f, VTextOverlay::alignLeft);
+
+	if (m_softwareOcclusionCulling)
+	{
+		const auto &stats = snapshot.softwareOcclusionStats;
+		snprintf(line, sizeof(line), "Objects Occluded (CPU) : %u in %.2f ms (%u occluder tris)", snapshot.softwareOccludedObjectCount,
+			stats.rasterizeTimeMS + stats.testTimeMS, stats.occluderTriangleCount);
+	}
+	else
+	{
+		snprintf(line, sizeof(line), "Objects Occluded (CPU) : off");
+	}
+	m_textOverlay.addText(line, 5.f, 225.f, VTextOverlay::alignLeft);
+
+	const auto &vertexAllocator = m_scene.geometryPool.getAllocator(GeometryPool::STREAM_VERTEX);
+	const auto &indexAllocator = m_scene.geometryPool.getAllocator(GeometryPool::STREAM_INDEX);
+	snprintf(line, sizeof(line), "Geometry Pool : %llu / %llu verts, %llu / %llu indices",
+		static_cast<unsigned long long>(vertexAllocator.getUsedSize()), static_cast<unsigned long long>(vertexAllocator.getCapacity()),
+		static_cast<unsigned long long>(indexAllocator.getUsedSize()), static_cast<unsigned long long>(indexAllocator.getCapacity()));
+	m_textOverlay.addText(line, 5.f, 245.f, VTextOverlay::alignLeft);
+
+	snprintf(line, sizeof(line), "Geom Pass Draw Sorting (S) : %s", m_sortDraws ? "front to back" : "off");
+	m_textOverlay.addText(line, 5.f, 265.f, VTextOverlay::alignLeft);
+
+	snprintf(line, sizeof(line), "Runtime Mesh (M) : %s, slots used %u / %u meshes, %u / %u objects", m_runtimeMesh != VScene::invalidIdx ? "on" : "off",
+		m_scene.getUsedMeshSlotCount(), m_meshCapacity, m_scene.getUsedInstanceSlotCount(), m_objectCapacity);
+	m_textOverlay.addText(line, 5.f, 285.f, VTextOverlay::alignLeft);
+
+	snprintf(line, sizeof(line), "Command Recording (CPU) : %.2f ms, %zu secondaries on %u threads", m_commandRecordTimeCalculator.getAverageTimeMS(),
+		m_secondaryTaskCommandBuffers.size(), m_threadPool.getThreadCount());
+	m_textOverlay.addText(line, 5.f, 305.f, VTextOverlay::alignLeft);
+
+	snprintf(line, sizeof(line), "Uploads (CPU) : %.3f ms, uniforms %zu / %zu B, buffers %zu KB%s", m_uploadTimeCalculator.getAverageTimeMS(),
+		m_uniformUploadBytes, snapshot.uniformHostData.size(), m_bufferUploadBytes / 1024,
+		m_vulkanManager.isBufferHostCoherent(m_perFrameUniformDeviceData[frameIdx].buffer) ? "" : ", flushed");
+	m_textOverlay.addText(line, 5.f, 325.f, VTextOverlay::alignLeft);
+
+	snprintf(line, sizeof(line), "Heap Allocations : %llu last frame, frame arena %zu / %zu B",
+		static_cast<unsigned long long>(m_frameHeapAllocationCount), snapshot.frameArenaUsedSize, snapshot.frameArenaCapacity);
+	m_textOverlay.addText(line, 5.f, 345.f, VTextOverlay::alignLeft);
+
+	snprintf(line, sizeof(line), "Update (CPU, own thread) : %.2f ms on %u threads", snapshot.updateTimeMS, m_updateThreadPool.getThreadCount());
+	m_textOverlay.addText(line, 5.f, 365.f, VTextOverlay::alignLeft);
+
+	const auto pacingStats = m_framePacer.getStats();
+	length = snprintf(line, sizeof(line), "Frame Pacing (P) : %s, %s, input to present %.2f ms", FramePacer::getModeName(m_framePacer.getMode()),
+		m_vulkanManager.getSwapChainPresentMode() == VK_PRESENT_MODE_MAILBOX_KHR ? "mailbox" : "fifo", pacingStats.inputToPresentMS);
+	if (pacingStats.inputToDisplayMS >= 0.0)
+	{
+		snprintf(line + length, sizeof(line) - length, ", to display %.2f ms", pacingStats.inputToDisplayMS);
+	}
+	m_textOverlay.addText(line, 5.f, 385.f, VTextOverlay::alignLeft);
+
+	const auto memoryStats = m_vulkanManager.getDeviceMemoryStats();
+	snprintf(line, sizeof(line), "Device Memory : %u allocations (%u blocks, %u dedicated), %u sub-allocs, %.1f / %.1f MB, %.0f%% fragmented",
+		memoryStats.deviceMemoryCount, memoryStats.blockCount, memoryStats.dedicatedCount, memoryStats.subAllocationCount,
+		(memoryStats.blockUsedBytes + memoryStats.dedicatedBytes) / (1024.0 * 1024.0),
+		(memoryStats.blockBytes + memoryStats.dedicatedBytes) / (1024.0 * 1024.0), 100.f * memoryStats.fragmentation);
+	m_textOverlay.addText(line, 5.f, 405.f, VTextOverlay::alignLeft);
+
+	m_textOverlay.endTextUpdate(frameIdx, imageIdx);
 }
 
 void DeferredRenderer::drawFrame()
 {
+	// Scene changes touch what the update thread works on, so it is parked while they happen.
+	// The update is rerun right away so that this frame already sees the new scene
+	if (m_showRuntimeMesh != (m_runtimeMesh != VScene::invalidIdx))
+	{
+		pauseUpdateThread();
+		updateRuntimeMesh();
+		runUpdate();
+		resumeUpdateThread();
+	}
+
+	// the latest finished update, the previous one is kept when the update thread is still busy
+	m_frameSnapshots.acquire();
+
+	const uint32_t frameIdx = m_frameIdx;
+	auto &sync = m_perFrameSyncObjects[frameIdx];
+
+	// The CPU runs at most MAX_FRAMES_IN_FLIGHT frames ahead of the GPU. Once the last frame that used this
+	// frame's resources is done, its uniform buffers, command buffers and semaphores can be reused
+	m_vulkanManager.waitForQueueValue(VK_QUEUE_GRAPHICS_BIT, sync.m_renderFinishedValue);
+
 	uint32_t imageIndex;
 
 	// acquired image may not be renderable because the presentation engine is still using it
 	// when @m_imageAvailableSemaphore is signaled, presentation is complete and the image can be used for rendering
-	VkResult result = m_vulkanManager.swapChainNextImageIndex(&imageIndex, m_imageAvailableSemaphore, std::numeric_limits<uint32_t>::max());
+	VkResult result = m_vulkanManager.swapChainNextImageIndex(&imageIndex, sync.m_imageAvailableSemaphore, std::numeric_limits<uint32_t>::max());
 
 	if (result == VK_ERROR_OUT_OF_DATE_KHR)
 	{
@@ -141,19 +492,53 @@ void DeferredRenderer::drawFrame()
 		throw std::runtime_error("failed to acquire swap chain image!");
 	}
 
-	// Swapchain image @imageIndex may still be used by the presentation engine but rendering
-	// is done. So it is safe to update the per-frame data for that swapchain image
-	updateUniformDeviceData(imageIndex);
-	updateText(imageIndex);
+	// Resources of removed meshes can only go and buffers shared by all frames can only follow scene changes
+	// once no frame is in flight anymore. Scene changes are rare, so simply wait for everything submitted so far
+	if (m_sharedSceneDataRevision != m_sceneRevision)
+	{
+		m_vulkanManager.waitForQueueValue(VK_QUEUE_GRAPHICS_BIT, m_vulkanManager.getQueueSubmittedValue(VK_QUEUE_GRAPHICS_BIT));
+
+		releaseRemovedMeshes();
+
+		void *data = m_vulkanManager.mapBuffer(m_objectMeshDeviceData.buffer);
+		memcpy(data, m_objectMeshes.data(), m_objectMeshDeviceData.size);
+		m_vulkanManager.unmapBuffer(m_objectMeshDeviceData.buffer);
+
+		data = m_vulkanManager.mapBuffer(m_drawCommandResetDeviceData.buffer);
+		memcpy(data, m_drawCommands.data(), m_drawCommandResetDeviceData.size);
+		m_vulkanManager.unmapBuffer(m_drawCommandResetDeviceData.buffer);
+
+		data = m_vulkanManager.mapBuffer(m_shadowDrawCommandResetDeviceData.buffer);
+		memcpy(data, m_shadowDrawCommands.data(), m_shadowDrawCommandResetDeviceData.size);
+		m_vulkanManager.unmapBuffer(m_shadowDrawCommandResetDeviceData.buffer);
+
+		m_sharedSceneDataRevision = m_sceneRevision;
+		m_steadyFrameCount = 0;
+	}
+
+	updateUniformDeviceData(frameIdx);
+	updateText(frameIdx, imageIndex);
+	recordFrameCommandBuffers(frameIdx, imageIndex);
 
-	// Prevent overwriting render resources (e.g. G-buffers) when the GPU is still rendering
-	// Could have duplicated the resources for each swapchain image but it takes up too much memory
-	m_vulkanManager.waitForFences({ m_renderFinishedFence });
-	m_vulkanManager.resetFences({ m_renderFinishedFence });
+	// culling results of a recent frame, the other frame in flight may be writing them. They are only shown as
+	// statistics, so that is fine. Visibility 0 means occluded and 2 means outside the frustum
+	{
+		const uint32_t *visibility = reinterpret_cast<const uint32_t *>(m_vulkanManager.mapBuffer(m_objectVisibilityDeviceData.buffer));
+		m_occludedObjectCount = 0;
+		for (uint32_t i = 0; i < m_scene.instances.size(); ++i)
+		{
+			if (m_scene.isInstanceAlive(i) && visibility[i] == 0) ++m_occludedObjectCount;
+		}
+		m_vulkanManager.unmapBuffer(m_objectVisibilityDeviceData.buffer);
 
-	std::vector<uint64_t> timestampsNS(TQI_QUERY_COUNT);
-	if (m_vulkanManager.getQueryPoolResults(m_perFrameQueryPools[imageIndex], TQI_QUERY_COUNT * sizeof(uint64_t),
-		sizeof(uint64_t), &timestampsNS[0], 0, TQI_QUERY_COUNT, VK_QUERY_RESULT_64_BIT) == VK_SUCCESS)
+		const uint32_t *drawCounts = reinterpret_cast<const uint32_t *>(m_vulkanManager.mapBuffer(m_shadowDrawCountDeviceData.buffer));
+		std::copy(drawCounts, drawCounts + m_shadowCasterCounts.size(), m_shadowCasterCounts.begin());
+		m_vulkanManager.unmapBuffer(m_shadowDrawCountDeviceData.buffer);
+	}
+
+	uint64_t timestampsNS[TQI_QUERY_COUNT];
+	if (m_vulkanManager.getQueryPoolResults(m_perFrameQueryPools[frameIdx], sizeof(timestampsNS),
+		sizeof(uint64_t), timestampsNS, 0, TQI_QUERY_COUNT, VK_QUERY_RESULT_64_BIT) == VK_SUCCESS)
 	{
 		double elapsedTime = static_cast<double>(timestampsNS[TQI_FINAL_OUTPUT_END] - timestampsNS[TQI_GEOM_START]) * 1e-6;
 		m_frameTimeCalculator.addFrameTime(elapsedTime);
@@ -174,24 +559,29 @@ void DeferredRenderer::drawFrame()
 		m_finalOutputPassTimeCalculator.addFrameTime(elapsedTime);
 	}
 
+	// every submit signals the next value of the graphics timeline and the one after waits for it
 	m_vulkanManager.beginQueueSubmit(VK_QUEUE_GRAPHICS_BIT);
 
-	m_vulkanManager.queueSubmitNewSubmit({ m_perFrameCommandBuffers[imageIndex].m_geomShadowLightingCommandBuffer },
-		{}, {}, { m_geomAndLightingCompleteSemaphore });
+	const uint64_t geomShadowLightingValue = m_vulkanManager.queueSubmitNewSubmit({ m_perFrameCommandBuffers[frameIdx].m_geomShadowLightingCommandBuffer });
 
-	m_vulkanManager.queueSubmitNewSubmit({ m_perFrameCommandBuffers[imageIndex].m_postEffectCommandBuffer },
-		{ m_geomAndLightingCompleteSemaphore }, { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT }, { m_postEffectSemaphore });
+	const uint64_t postEffectValue = m_vulkanManager.queueSubmitNewSubmit({ m_perFrameCommandBuffers[frameIdx].m_postEffectCommandBuffer },
+		{}, {}, {}, { { VK_QUEUE_GRAPHICS_BIT, geomShadowLightingValue, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT } });
 
-	m_vulkanManager.queueSubmitNewSubmit({ m_perFrameCommandBuffers[imageIndex].m_presentCommandBuffer },
-		{ m_postEffectSemaphore, m_imageAvailableSemaphore },
-		{ VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT }, { m_finalOutputFinishedSemaphore });
+	const uint64_t finalOutputValue = m_vulkanManager.queueSubmitNewSubmit({ m_perFrameCommandBuffers[frameIdx].m_presentCommandBuffer },
+		{ sync.m_imageAvailableSemaphore }, { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT }, {},
+		{ { VK_QUEUE_GRAPHICS_BIT, postEffectValue, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT } });
 
-	m_vulkanManager.endQueueSubmit(m_renderFinishedFence, false);
+	m_vulkanManager.endQueueSubmit();
 
-	m_textOverlay.submit(imageIndex, { m_finalOutputFinishedSemaphore }, { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT },
-		{ m_renderFinishedSemaphore });
+	// the text overlay is the last submission of the frame, its value marks the frame as done
+	sync.m_renderFinishedValue = m_textOverlay.submit(frameIdx, {}, {}, { m_renderFinishedSemaphores[imageIndex] },
+		{ { VK_QUEUE_GRAPHICS_BIT, finalOutputValue, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT } });
+	m_framePacer.markSubmitted();
 
-	result = m_vulkanManager.queuePresent({ m_renderFinishedSemaphore }, imageIndex);
+	m_frameIdx = (m_frameIdx + 1) % MAX_FRAMES_IN_FLIGHT;
+
+	result = m_vulkanManager.queuePresent({ m_renderFinishedSemaphores[imageIndex] }, imageIndex, m_framePacer.getFrameId());
+	if (result == VK_SUCCESS || result == VK_SUBOPTIMAL_KHR) m_framePacer.markPresented();
 
 	if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR)
 	{
@@ -203,6 +593,13 @@ void DeferredRenderer::drawFrame()
 	}
 }
 
+void DeferredRenderer::waitForLastFrame()
+{
+	// a frame that returned before submitting kept the value of an older one
+	const uint32_t lastFrameIdx = (m_frameIdx + MAX_FRAMES_IN_FLIGHT - 1) % MAX_FRAMES_IN_FLIGHT;
+	m_vulkanManager.waitForQueueValue(VK_QUEUE_GRAPHICS_BIT, m_perFrameSyncObjects[lastFrameIdx].m_renderFinishedValue);
+}
+
 void DeferredRenderer::createQueryPools()
 {
 	if (m_initialized)
@@ -213,10 +610,10 @@ void DeferredRenderer::createQueryPools()
 		}
 	}
 	
-	const uint32_t swapChainImageCount = m_vulkanManager.getSwapChainSize();
-	m_perFrameQueryPools.resize(swapChainImageCount);
+	const uint32_t frameCount = MAX_FRAMES_IN_FLIGHT;
+	m_perFrameQueryPools.resize(frameCount);
 
-	for (uint32_t i = 0; i < swapChainImageCount; ++i)
+	for (uint32_t i = 0; i < frameCount; ++i)
 	{
 		m_perFrameQueryPools[i] = m_vulkanManager.createQueryPool(VK_QUERY_TYPE_TIMESTAMP, TQI_QUERY_COUNT);
 	}
@@ -235,6 +632,8 @@ void DeferredRenderer::createRenderPasses()
 void DeferredRenderer::createDescriptorSetLayouts()
 {
 	createBrdfLutDescriptorSetLayout();
+	createHiZDescriptorSetLayouts();
+	createDrawCullDescriptorSetLayout();
 	createSpecEnvPrefilterDescriptorSetLayout();
 	createGeomPassDescriptorSetLayout();
 	createShadowPassDescriptorSetLayout();
@@ -246,6 +645,8 @@ void DeferredRenderer::createDescriptorSetLayouts()
 void DeferredRenderer::createComputePipelines()
 {
 	createBrdfLutPipeline();
+	createHiZPipelines();
+	createDrawCullPipeline();
 }
 
 void DeferredRenderer::createGraphicsPipelines()
@@ -339,6 +740,18 @@ void DeferredRenderer::createDepthResources()
 		{
 			m_vulkanManager.destroySampler(name);
 		}
+
+		m_vulkanManager.destroyImage(m_hizImage.image);
+
+		for (auto name : m_hizImage.imageViews)
+		{
+			m_vulkanManager.destroyImageView(name);
+		}
+
+		for (auto name : m_hizImage.samplers)
+		{
+			m_vulkanManager.destroySampler(name);
+		}
 	}
 
 	VkExtent2D swapChainExtent = m_vulkanManager.getSwapChainExtent();
@@ -394,6 +807,34 @@ void DeferredRenderer::createDepthResources()
 	m_shadowImage.samplers[0] = m_vulkanManager.createSampler(VK_FILTER_LINEAR, VK_FILTER_LINEAR, VK_SAMPLER_MIPMAP_MODE_NEAREST,
 		VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER,
 		0.f, 0.f, 0.f, VK_FALSE, 0.f, VK_TRUE, VK_COMPARE_OP_LESS_OR_EQUAL, VK_BORDER_COLOR_INT_OPAQUE_WHITE);
+
+	// Hi-Z pyramid, level sizes are rounded down
+	m_hizImage.format = VK_FORMAT_R32G32_SFLOAT;
+	m_hizImage.width = swapChainExtent.width;
+	m_hizImage.height = swapChainExtent.height;
+	m_hizImage.depth = 1;
+	m_hizImage.mipLevelCount = static_cast<uint32_t>(std::floor(std::log2(std::max(m_hizImage.width, m_hizImage.height)))) + 1;
+	m_hizImage.layerCount = 1;
+	m_hizImage.sampleCount = VK_SAMPLE_COUNT_1_BIT;
+
+	m_hizImage.image = m_vulkanManager.createImage2D(m_hizImage.width, m_hizImage.height, m_hizImage.format,
+		VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_hizImage.mipLevelCount);
+
+	m_hizImage.imageViews.resize(m_hizImage.mipLevelCount + 1);
+	m_hizImage.imageViews[0] = m_vulkanManager.createImageView2D(m_hizImage.image, VK_IMAGE_ASPECT_COLOR_BIT, 0, m_hizImage.mipLevelCount);
+	for (uint32_t level = 0; level < m_hizImage.mipLevelCount; ++level)
+	{
+		m_hizImage.imageViews[level + 1] = m_vulkanManager.createImageView2D(m_hizImage.image, VK_IMAGE_ASPECT_COLOR_BIT, level, 1);
+	}
+
+	// Stays in general layout since it is written as a storage image and read with texelFetch
+	m_vulkanManager.transitionImageLayout(m_hizImage.image, VK_IMAGE_LAYOUT_PREINITIALIZED, VK_IMAGE_LAYOUT_GENERAL);
+
+	m_hizImage.samplers.resize(1);
+	m_hizImage.samplers[0] = m_vulkanManager.createSampler(VK_FILTER_NEAREST, VK_FILTER_NEAREST, VK_SAMPLER_MIPMAP_MODE_NEAREST,
+		VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+		0.f, static_cast<float>(m_hizImage.mipLevelCount));
 }
 
 void DeferredRenderer::createColorAttachmentResources()
@@ -534,34 +975,66 @@ void DeferredRenderer::loadAndPrepareAssets()
 	m_scene.skybox.load(skyboxFileName, unfilteredProbeFileName, specProbeFileName, diffuseProbeFileName);
 
 	// Models
+	auto &geometryPool = m_scene.geometryPool;
+	geometryPool.initStream(GeometryPool::STREAM_VERTEX, sizeof(Vertex), GEOMETRY_POOL_VERTEX_COUNT, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+	geometryPool.initStream(GeometryPool::STREAM_INDEX, sizeof(uint32_t), GEOMETRY_POOL_INDEX_COUNT, VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
+	geometryPool.initStream(GeometryPool::STREAM_POSITION, sizeof(glm::vec3), GEOMETRY_POOL_VERTEX_COUNT, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+	geometryPool.initStream(GeometryPool::STREAM_POSITION_INDEX, sizeof(uint32_t), GEOMETRY_POOL_INDEX_COUNT, VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
+
 #ifdef USE_GLTF
-	VMesh::loadFromGLTF(m_scene.meshes, &m_vulkanManager, GLTF_NAME, GLTF_VERSION);
+	std::vector<VMeshNode> nodes;
+	VMesh::loadFromGLTF(m_scene.meshes, nodes, &m_vulkanManager, GLTF_NAME, GLTF_VERSION, &geometryPool);
+
+	// node indices carry over since the graph is empty and both are depth first
+	for (const auto &node : nodes)
+	{
+		uint32_t sceneNode = m_scene.sceneGraph.addNode(node.parent, node.position, node.rotation, node.scale);
+		for (uint32_t meshIdx : node.meshes)
+		{
+			m_scene.addInstance(meshIdx, sceneNode);
+		}
+	}
 #else
 	std::vector<std::string> modelNames = MODEL_NAMES;
-	m_scene.meshes.resize(modelNames.size(), { &m_vulkanManager });
+	if (m_stressSceneDroneCount > 0)
+	{
+		modelNames = { "Drone_Body", "Drone_Legs", "Floor" };
+	}
+	for (const auto &name : modelNames)
+	{
+		loadModel(m_scene.meshes[m_scene.addMesh()], name);
+	}
 
-	for (size_t i = 0; i < m_scene.meshes.size(); ++i)
+	if (m_stressSceneDroneCount > 0)
 	{
-		const std::string &name = modelNames[i];
+		// drones on a square grid, body and legs are separate meshes attached to the same node
+		const BBox &droneBounds = m_scene.meshes[0].getBounds();
+		const float spacing = 1.5f * std::max(droneBounds.max.x - droneBounds.min.x, droneBounds.max.z - droneBounds.min.z);
+		const uint32_t gridSize = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<float>(m_stressSceneDroneCount))));
+		const float halfExtent = 0.5f * spacing * static_cast<float>(gridSize - 1);
 
-		std::string modelFileName = "../models/" + name + ".obj";
-		std::string albedoMapName = "../textures/" + name + "/A.dds";
-		std::string normalMapName = "../textures/" + name + "/N.dds";
-		std::string roughnessMapName = "../textures/" + name + "/R.dds";
-		std::string metalnessMapName = "../textures/" + name + "/M.dds";
-		std::string aoMapName = "../textures/" + name + "/AO.dds";
-		if (!fileExist(aoMapName))
+		for (uint32_t i = 0; i < m_stressSceneDroneCount; ++i)
 		{
-			aoMapName = "";
+			glm::vec3 pos(static_cast<float>(i % gridSize) * spacing - halfExtent, 0.f, static_cast<float>(i / gridSize) * spacing - halfExtent);
+			glm::quat rot(glm::vec3(0.f, static_cast<float>(i) * 0.7f, 0.f));
+			uint32_t droneNode = m_scene.sceneGraph.addNode(SceneGraph::invalidNode, pos, rot);
+			m_scene.addInstance(0, droneNode);
+			m_scene.addInstance(1, droneNode);
 		}
-		std::string emissiveMapName = "../textures/" + name + "/E.dds";
-		if (!fileExist(emissiveMapName))
+
+		const BBox &floorBounds = m_scene.meshes[2].getBounds();
+		const float floorScale = (2.f * halfExtent + spacing) / std::min(floorBounds.max.x - floorBounds.min.x, floorBounds.max.z - floorBounds.min.z);
+		auto &floor = m_scene.addInstance(2);
+		floor.setScale(floorScale);
+		// keep the top of the floor where it was, scaling is about the origin
+		floor.setPosition(glm::vec3(0.f, floorBounds.max.y * (1.f - floorScale), 0.f));
+	}
+	else
+	{
+		for (uint32_t i = 0; i < m_scene.meshes.size(); ++i)
 		{
-			emissiveMapName = "";
+			m_scene.addInstance(i).setRotation(glm::quat(glm::vec3(0.f, glm::pi<float>(), 0.f)));
 		}
-
-		m_scene.meshes[i].load(modelFileName, albedoMapName, normalMapName, roughnessMapName, metalnessMapName, aoMapName, emissiveMapName);
-		m_scene.meshes[i].setRotation(glm::quat(glm::vec3(0.f, glm::pi<float>(), 0.f)));
 	}
 #endif
 
@@ -570,7 +1043,218 @@ void DeferredRenderer::loadAndPrepareAssets()
 	m_scene.shadowLight.setColor(glm::vec3(2.f));
 	m_scene.shadowLight.setCastShadow(true);
 
+	m_scene.updateSceneGraph();
+	m_scene.computeAABBWorldSpace();
+	selectOccluders();
+}
+
+void DeferredRenderer::loadModel(VMesh &mesh, const std::string &modelName)
+{
+	using namespace rj::helper_functions;
+
+	std::string modelFileName = "../models/" + modelName + ".obj";
+	std::string albedoMapName = "../textures/" + modelName + "/A.dds";
+	std::string normalMapName = "../textures/" + modelName + "/N.dds";
+	std::string roughnessMapName = "../textures/" + modelName + "/R.dds";
+	std::string metalnessMapName = "../textures/" + modelName + "/M.dds";
+	std::string aoMapName = "../textures/" + modelName + "/AO.dds";
+	if (!fileExist(aoMapName))
+	{
+		aoMapName = "";
+	}
+	std::string emissiveMapName = "../textures/" + modelName + "/E.dds";
+	if (!fileExist(emissiveMapName))
+	{
+		emissiveMapName = "";
+	}
+
+	mesh.load(modelFileName, albedoMapName, normalMapName, roughnessMapName, metalnessMapName, aoMapName, emissiveMapName);
+}
+
+void DeferredRenderer::selectOccluders()
+{
+	// the largest objects make the best occluders
+	m_occluderObjects.clear();
+	for (uint32_t i = 0; i < m_scene.instances.size(); ++i)
+	{
+		if (m_scene.isInstanceAlive(i)) m_occluderObjects.push_back(i);
+	}
+	auto boundsSize = [this](uint32_t objIdx)
+	{
+		BBox bounds = m_scene.instances[objIdx].getAABBWorldSpace();
+		return glm::length(bounds.max - bounds.min);
+	};
+	std::sort(m_occluderObjects.begin(), m_occluderObjects.end(),
+		[&](uint32_t a, uint32_t b) { return boundsSize(a) > boundsSize(b); });
+	m_occluderObjects.resize(std::min(m_occluderObjects.size(), static_cast<size_t>(MAX_OCCLUDER_COUNT)));
+
+	// room for every occluder being in view, so that culling doesn't allocate as the camera moves
+	uint32_t occluderTriangleCount = 0;
+	for (uint32_t i : m_occluderObjects)
+	{
+		occluderTriangleCount += static_cast<uint32_t>(m_scene.meshes[m_scene.instances[i].meshIdx].occluderIndices.size() / 3);
+	}
+	m_occluders.reserve(m_occluderObjects.size());
+	m_softwareOcclusionCuller.reserve(occluderTriangleCount, static_cast<uint32_t>(m_scene.instances.size()));
+}
+
+void DeferredRenderer::setMeshDrawCommands(uint32_t meshIdx)
+{
+	// dead meshes keep empty draws, no object refers to them
+	VkDrawIndexedIndirectCommand cmd = {};
+	VkDrawIndexedIndirectCommand shadowCmd = {};
+	if (m_scene.isMeshAlive(meshIdx))
+	{
+		const auto &mesh = m_scene.meshes[meshIdx];
+		cmd.indexCount = static_cast<uint32_t>(mesh.indexBuffer.size / sizeof(uint32_t));
+		cmd.firstIndex = static_cast<uint32_t>(mesh.indexBuffer.offset / sizeof(uint32_t));
+		cmd.vertexOffset = static_cast<int32_t>(mesh.vertexBuffer.offset / sizeof(Vertex));
+		cmd.firstInstance = m_meshFirstInstances[meshIdx];
+
+		shadowCmd.indexCount = static_cast<uint32_t>(mesh.positionIndexBuffer.size / sizeof(uint32_t));
+		shadowCmd.firstIndex = static_cast<uint32_t>(mesh.positionIndexBuffer.offset / sizeof(uint32_t));
+		shadowCmd.vertexOffset = static_cast<int32_t>(mesh.positionBuffer.offset / sizeof(glm::vec3));
+		shadowCmd.firstInstance = m_meshFirstInstances[meshIdx];
+	}
+
+	m_drawCommands[meshIdx] = cmd;
+	m_drawCommands[m_meshCapacity + meshIdx] = cmd;
+	m_drawCommands[m_meshCapacity + meshIdx].firstInstance += m_objectCapacity;
+
+	for (uint32_t c = 0; c < m_camera.getSegmentCount(); ++c)
+	{
+		m_shadowDrawCommands[c * m_meshCapacity + meshIdx] = shadowCmd;
+		m_shadowDrawCommands[c * m_meshCapacity + meshIdx].firstInstance += c * m_objectCapacity;
+	}
+}
+
+void DeferredRenderer::updateObjectMeshes()
+{
+	for (uint32_t i = 0; i < m_scene.instances.size(); ++i)
+	{
+		m_objectMeshes[i] = m_scene.instances[i].meshIdx;
+	}
+}
+
+uint32_t DeferredRenderer::insertMesh(const std::string &modelName, const std::vector<uint32_t> &nodes)
+{
+	const uint32_t instanceCount = static_cast<uint32_t>(nodes.size());
+	if (instanceCount == 0)
+	{
+		throw std::invalid_argument("a mesh needs at least one instance");
+	}
+	if (m_scene.getUsedMeshSlotCount() >= m_meshCapacity || m_scene.getUsedInstanceSlotCount() + instanceCount > m_objectCapacity)
+	{
+		throw std::runtime_error("out of mesh or object slots");
+	}
+
+	// instances of a mesh are contiguous in the instance lists
+	const uint64_t firstInstance = m_instanceRangeAllocator.allocate(instanceCount);
+	if (firstInstance == FreeListAllocator::invalidOffset)
+	{
+		throw std::runtime_error("instance lists are too fragmented");
+	}
+
+	const uint32_t meshIdx = m_scene.addMesh();
+	loadModel(m_scene.meshes[meshIdx], modelName);
+	m_meshFirstInstances[meshIdx] = static_cast<uint32_t>(firstInstance);
+	m_meshInstanceCounts[meshIdx] = instanceCount;
+	setMeshDrawCommands(meshIdx);
+
+	for (uint32_t node : nodes) m_scene.addInstance(meshIdx, node);
+	updateObjectMeshes();
+
+	// Slots of the new objects are unused by the frames in flight (their mesh is invalid there), so their
+	// visibility can be reset now. Everything starts visible
+	uint32_t *visibility = reinterpret_cast<uint32_t *>(m_vulkanManager.mapBuffer(m_objectVisibilityDeviceData.buffer));
+	for (uint32_t i = 0; i < m_scene.instances.size(); ++i)
+	{
+		if (m_scene.instances[i].meshIdx == meshIdx) visibility[i] = 1;
+	}
+	m_vulkanManager.unmapBuffer(m_objectVisibilityDeviceData.buffer);
+
+	m_scene.updateSceneGraph();
+	m_scene.computeAABBWorldSpace();
+	selectOccluders();
+
+	// No command buffer recorded since the slot was freed draws it, so its material can be written right away
+	writeMeshMaterial(meshIdx);
+
+	++m_sceneRevision;
+	return meshIdx;
+}
+
+void DeferredRenderer::removeMesh(uint32_t meshIdx)
+{
+	if (meshIdx >= m_scene.meshes.size() || !m_scene.isMeshAlive(meshIdx))
+	{
+		throw std::invalid_argument("no such mesh");
+	}
+
+	const BBox emptyBounds;
+	for (uint32_t i = 0; i < m_scene.instances.size(); ++i)
+	{
+		if (m_scene.instances[i].meshIdx != meshIdx) continue;
+
+		m_objectWorldBounds[i] = emptyBounds;
+		m_objectBounds.set(i, emptyBounds.min, emptyBounds.max);
+		m_objectBoundsHostData[2 * i] = glm::vec4(emptyBounds.min, 0.f);
+		m_objectBoundsHostData[2 * i + 1] = glm::vec4(emptyBounds.max, 1.f);
+	}
+
+	m_scene.removeMesh(meshIdx);
+	m_removedMeshes.push_back(meshIdx);
+	setMeshDrawCommands(meshIdx);
+	updateObjectMeshes();
+
 	m_scene.computeAABBWorldSpace();
+	selectOccluders();
+
+	++m_sceneRevision;
+}
+
+void DeferredRenderer::releaseRemovedMeshes()
+{
+	for (uint32_t meshIdx : m_removedMeshes)
+	{
+		if (m_meshInstanceCounts[meshIdx] > 0)
+		{
+			m_instanceRangeAllocator.free(m_meshFirstInstances[meshIdx], m_meshInstanceCounts[meshIdx]);
+		}
+		m_meshInstanceCounts[meshIdx] = 0;
+	}
+	m_removedMeshes.clear();
+
+	m_scene.releaseRemovedMeshes();
+}
+
+void DeferredRenderer::updateRuntimeMesh()
+{
+	if (m_showRuntimeMesh == (m_runtimeMesh != VScene::invalidIdx)) return;
+
+	if (!m_showRuntimeMesh)
+	{
+		removeMesh(m_runtimeMesh);
+		m_runtimeMesh = VScene::invalidIdx;
+		return;
+	}
+
+	// a row of drone bodies to the side of the scene, hung under one node that is reused every time
+	if (m_runtimeMeshNode == SceneGraph::invalidNode)
+	{
+		m_runtimeMeshNode = m_scene.sceneGraph.addNode(SceneGraph::invalidNode, glm::vec3(2.f, 0.f, 0.f));
+		for (uint32_t i = 0; i < 4; ++i)
+		{
+			m_scene.sceneGraph.addNode(m_runtimeMeshNode, glm::vec3(0.f, 0.f, static_cast<float>(i) - 1.5f));
+		}
+	}
+
+	std::vector<uint32_t> nodes;
+	for (uint32_t node = m_runtimeMeshNode + 1; node < m_scene.sceneGraph.getSubtreeEnd(m_runtimeMeshNode); ++node)
+	{
+		nodes.push_back(node);
+	}
+	m_runtimeMesh = insertMesh("Drone_Body", nodes);
 }
 
 void DeferredRenderer::createUniformBuffers()
@@ -588,10 +1272,72 @@ void DeferredRenderer::createUniformBuffers()
 		{
 			m_uShadowLightInfos[i] = reinterpret_cast<ShadowLightUniformBuffer *>(m_perFrameUniformHostData.alloc(sizeof(ShadowLightUniformBuffer)));
 		}
+		m_uDrawCullInfo = reinterpret_cast<DrawCullUniformBuffer *>(m_perFrameUniformHostData.alloc(sizeof(DrawCullUniformBuffer)));
+
+		// every block counts as changed in the first update
+		m_perFrameUniformLastHostData.assign(m_perFrameUniformHostData.size(), 0);
+		m_perFrameUniformChangedUpdates.assign(m_perFrameUniformHostData.getAllocations().size(), 1);
+
+		// Everything per mesh or per object is sized for the scene plus some headroom, so that meshes
+		// can be inserted at runtime without recreating buffers and descriptor sets
+		m_meshCapacity = static_cast<uint32_t>(m_scene.meshes.size()) + MESH_SLOT_HEADROOM;
+		m_objectCapacity = static_cast<uint32_t>(m_scene.instances.size()) + OBJECT_SLOT_HEADROOM;
+		if (MATERIAL_TEXTURE_COUNT * m_meshCapacity > BINDLESS_TEXTURE_COUNT)
+		{
+			throw std::runtime_error("too many meshes for the material texture array");
+		}
 
-		for (auto &model : m_scene.meshes)
+		// unused slots have empty bounds until an object takes them
+		const BBox emptyBounds;
+		m_objectBounds.resize(m_objectCapacity);
+		m_objectBoundsHostData.resize(2 * m_objectCapacity);
+		m_objectWorldBounds.assign(m_objectCapacity, emptyBounds);
+		for (uint32_t i = 0; i < m_objectCapacity; ++i)
 		{
-			model.uPerModelInfo = reinterpret_cast<PerModelUniformBuffer *>(m_perFrameUniformHostData.alloc(sizeof(PerModelUniformBuffer)));
+			m_objectBounds.set(i, emptyBounds.min, emptyBounds.max);
+			m_objectBoundsHostData[2 * i] = glm::vec4(emptyBounds.min, 0.f);
+			m_objectBoundsHostData[2 * i + 1] = glm::vec4(emptyBounds.max, 1.f);
+		}
+		m_shadowCasterCounts.resize(m_camera.getSegmentCount());
+
+		m_objectMeshes.assign(m_objectCapacity, VScene::invalidIdx);
+		updateObjectMeshes();
+
+		// instance list ranges, each mesh gets room for all of its instances
+		m_meshFirstInstances.assign(m_meshCapacity, 0);
+		m_meshInstanceCounts.assign(m_meshCapacity, 0);
+		for (const auto &instance : m_scene.instances)
+		{
+			++m_meshInstanceCounts[instance.meshIdx];
+		}
+		m_instanceRangeAllocator.reset(m_objectCapacity);
+		for (uint32_t i = 0; i < m_meshCapacity; ++i)
+		{
+			if (m_meshInstanceCounts[i] > 0)
+			{
+				m_meshFirstInstances[i] = static_cast<uint32_t>(m_instanceRangeAllocator.allocate(m_meshInstanceCounts[i]));
+			}
+		}
+
+		m_drawCommands.resize(2 * m_meshCapacity);
+		m_shadowDrawCommands.resize(m_meshCapacity * m_camera.getSegmentCount());
+		for (uint32_t i = 0; i < m_meshCapacity; ++i)
+		{
+			setMeshDrawCommands(i);
+		}
+
+		// per-frame lists only ever hold what fits into the buffers, so they never grow during a frame
+		m_objectVisibility.reserve(m_objectCapacity);
+		m_visibleObjects.reserve(m_objectCapacity);
+		m_meshViewDepths.reserve(m_meshCapacity);
+		m_geomDrawList.reserve(m_meshCapacity);
+		m_geomDrawOrder.reserve(m_meshCapacity);
+
+		// draw order until the first frame sorts the draws
+		m_geomDrawOrder.clear();
+		for (uint32_t i = 0; i < m_scene.meshes.size(); ++i)
+		{
+			if (m_scene.isMeshAlive(i)) m_geomDrawOrder.push_back(i);
 		}
 	}
 
@@ -602,41 +1348,158 @@ void DeferredRenderer::createUniformBuffers()
 		m_oneTimeUniformDeviceData.offset = 0;
 		m_oneTimeUniformDeviceData.buffer = m_vulkanManager.createBuffer(m_oneTimeUniformDeviceData.size,
 			VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+		// Host visible so that occlusion culling results can be shown. Everything starts as visible
+		m_objectVisibilityDeviceData.size = sizeof(uint32_t) * m_objectCapacity;
+		m_objectVisibilityDeviceData.offset = 0;
+		m_objectVisibilityDeviceData.buffer = m_vulkanManager.createBuffer(m_objectVisibilityDeviceData.size,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+		std::vector<uint32_t> initialVisibility(m_objectCapacity, 1);
+		void *data = m_vulkanManager.mapBuffer(m_objectVisibilityDeviceData.buffer);
+		memcpy(data, initialVisibility.data(), m_objectVisibilityDeviceData.size);
+		m_vulkanManager.unmapBuffer(m_objectVisibilityDeviceData.buffer);
+
+		// Instance lists. Host visible so that runtime mesh changes can be written once the frame in flight is done
+		m_objectMeshDeviceData.size = sizeof(uint32_t) * m_objectMeshes.size();
+		m_objectMeshDeviceData.offset = 0;
+		m_objectMeshDeviceData.buffer = m_vulkanManager.createBuffer(m_objectMeshDeviceData.size,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+		data = m_vulkanManager.mapBuffer(m_objectMeshDeviceData.buffer);
+		memcpy(data, m_objectMeshes.data(), m_objectMeshDeviceData.size);
+		m_vulkanManager.unmapBuffer(m_objectMeshDeviceData.buffer);
+
+		// Entries are written by writeMeshMaterial() when a mesh takes the slot, no frame in flight reads them before
+		m_materialTableDeviceData.size = sizeof(MaterialTableEntry) * m_meshCapacity;
+		m_materialTableDeviceData.offset = 0;
+		m_materialTableDeviceData.buffer = m_vulkanManager.createBuffer(m_materialTableDeviceData.size,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+		m_instanceObjectDeviceData.size = sizeof(uint32_t) * 2 * m_objectCapacity;
+		m_instanceObjectDeviceData.offset = 0;
+		m_instanceObjectDeviceData.buffer = m_vulkanManager.createBuffer(m_instanceObjectDeviceData.size,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+		m_shadowInstanceObjectDeviceData.size = sizeof(uint32_t) * m_objectCapacity * m_camera.getSegmentCount();
+		m_shadowInstanceObjectDeviceData.offset = 0;
+		m_shadowInstanceObjectDeviceData.buffer = m_vulkanManager.createBuffer(m_shadowInstanceObjectDeviceData.size,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+		// GPU driven geometry pass draws, all instance counts start at 0
+		m_drawCommandResetDeviceData.size = sizeof(VkDrawIndexedIndirectCommand) * m_drawCommands.size();
+		m_drawCommandResetDeviceData.offset = 0;
+		m_drawCommandResetDeviceData.buffer = m_vulkanManager.createBuffer(m_drawCommandResetDeviceData.size,
+			VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+		data = m_vulkanManager.mapBuffer(m_drawCommandResetDeviceData.buffer);
+		memcpy(data, m_drawCommands.data(), m_drawCommandResetDeviceData.size);
+		m_vulkanManager.unmapBuffer(m_drawCommandResetDeviceData.buffer);
+
+		m_drawCommandDeviceData.size = m_drawCommandResetDeviceData.size;
+		m_drawCommandDeviceData.offset = 0;
+		m_drawCommandDeviceData.buffer = m_vulkanManager.createBuffer(m_drawCommandDeviceData.size,
+			VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+		// GPU driven shadow draws, all instance counts start at 0
+		m_shadowDrawCommandResetDeviceData.size = sizeof(VkDrawIndexedIndirectCommand) * m_shadowDrawCommands.size();
+		m_shadowDrawCommandResetDeviceData.offset = 0;
+		m_shadowDrawCommandResetDeviceData.buffer = m_vulkanManager.createBuffer(m_shadowDrawCommandResetDeviceData.size,
+			VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+		data = m_vulkanManager.mapBuffer(m_shadowDrawCommandResetDeviceData.buffer);
+		memcpy(data, m_shadowDrawCommands.data(), m_shadowDrawCommandResetDeviceData.size);
+		m_vulkanManager.unmapBuffer(m_shadowDrawCommandResetDeviceData.buffer);
+
+		m_shadowDrawCommandDeviceData.size = m_shadowDrawCommandResetDeviceData.size;
+		m_shadowDrawCommandDeviceData.offset = 0;
+		m_shadowDrawCommandDeviceData.buffer = m_vulkanManager.createBuffer(m_shadowDrawCommandDeviceData.size,
+			VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+		m_shadowDrawCountDeviceData.size = sizeof(uint32_t) * m_camera.getSegmentCount();
+		m_shadowDrawCountDeviceData.offset = 0;
+		m_shadowDrawCountDeviceData.buffer = m_vulkanManager.createBuffer(m_shadowDrawCountDeviceData.size,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+	}
+
+	if (m_initialized)
+	{
+		m_vulkanManager.destroyBuffer(m_perFrameUniformDeviceData[0].buffer);
+		for (const auto &b : m_perFrameObjectBoundsDeviceData)
+		{
+			m_vulkanManager.destroyBuffer(b.buffer);
+		}
+		for (const auto &b : m_perFrameObjectTransformDeviceData)
+		{
+			m_vulkanManager.destroyBuffer(b.buffer);
+		}
+	}
+
+	const uint32_t frameCount = MAX_FRAMES_IN_FLIGHT;
+
+	// The blob size is a multiple of minUniformBufferOffsetAlignment, so every region starts aligned.
+	// Coherence isn't required, updateUniformDeviceData flushes what it writes
+	const VkDeviceSize regionSize = m_perFrameUniformHostData.size();
+	const uint32_t uniformRing = m_vulkanManager.createBuffer(frameCount * regionSize,
+		VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+	m_perFrameUniformDeviceData.resize(frameCount);
+	for (uint32_t i = 0; i < frameCount; ++i)
+	{
+		m_perFrameUniformDeviceData[i].buffer = uniformRing;
+		m_perFrameUniformDeviceData[i].offset = i * regionSize;
+		m_perFrameUniformDeviceData[i].size = regionSize;
 	}
+	// new memory, every region has to be written in full
+	m_perFrameUniformWrittenUpdates.assign(frameCount, 0);
 
-	if (m_initialized)
+	// mesh bounds for occlusion culling
+	m_perFrameObjectBoundsDeviceData.resize(frameCount);
+
+	for (uint32_t i = 0; i < frameCount; ++i)
 	{
-		for (const auto &b : m_perFrameUniformDeviceData)
-		{
-			m_vulkanManager.destroyBuffer(b.buffer);
-		}
+		m_perFrameObjectBoundsDeviceData[i].size = sizeof(glm::vec4) * m_objectBoundsHostData.size();
+		m_perFrameObjectBoundsDeviceData[i].offset = 0;
+		m_perFrameObjectBoundsDeviceData[i].buffer = m_vulkanManager.createBuffer(m_perFrameObjectBoundsDeviceData[i].size,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
 	}
 
-	uint32_t swapchainImageCount = m_vulkanManager.getSwapChainSize();
-	m_perFrameUniformDeviceData.resize(swapchainImageCount);
+	// object transforms
+	m_perFrameObjectTransformDeviceData.resize(frameCount);
 
-	for (uint32_t i = 0; i < swapchainImageCount; ++i)
+	for (uint32_t i = 0; i < frameCount; ++i)
 	{
-		m_perFrameUniformDeviceData[i].size = m_perFrameUniformHostData.size();
-		m_perFrameUniformDeviceData[i].offset = 0;
-		m_perFrameUniformDeviceData[i].buffer = m_vulkanManager.createBuffer(m_perFrameUniformDeviceData[i].size,
-			VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+		m_perFrameObjectTransformDeviceData[i].size = sizeof(ObjectTransform) * m_objectCapacity;
+		m_perFrameObjectTransformDeviceData[i].offset = 0;
+		m_perFrameObjectTransformDeviceData[i].buffer = m_vulkanManager.createBuffer(m_perFrameObjectTransformDeviceData[i].size,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
 	}
 }
 
 void DeferredRenderer::createDescriptorPools()
 {
+	// Per-object data lives in storage buffers bound once per frame and materials in the bindless set,
+	// so nothing here scales with the mesh count
 	const uint32_t maxSetCount = 128;
 	const uint32_t maxUBDescCount = 128;
 	const uint32_t maxCISDescCount = 128;
-	const uint32_t maxSIDescCount = 1;
+	const uint32_t maxSIDescCount = 64;
+	const uint32_t maxSBDescCount = 128;
 	m_vulkanManager.beginCreateDescriptorPool(maxSetCount);
 
 	m_vulkanManager.descriptorPoolAddDescriptors(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, maxUBDescCount);
 	m_vulkanManager.descriptorPoolAddDescriptors(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, maxCISDescCount);
 	m_vulkanManager.descriptorPoolAddDescriptors(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, maxSIDescCount);
+	m_vulkanManager.descriptorPoolAddDescriptors(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, maxSBDescCount);
 
 	m_descriptorPool = m_vulkanManager.endCreateDescriptorPool();
+
+	m_vulkanManager.beginCreateDescriptorPool(1, VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT_EXT);
+	m_vulkanManager.descriptorPoolAddDescriptors(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, BINDLESS_TEXTURE_COUNT);
+	m_vulkanManager.descriptorPoolAddDescriptors(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1);
+	m_bindlessDescriptorPool = m_vulkanManager.endCreateDescriptorPool();
 }
 
 void DeferredRenderer::createDescriptorSets()
@@ -647,10 +1510,17 @@ void DeferredRenderer::createDescriptorSets()
 	std::vector<uint32_t> layouts;
 	layouts.push_back(m_brdfLutDescriptorSetLayout);
 	layouts.push_back(m_specEnvPrefilterDescriptorSetLayout);
+	layouts.push_back(m_depthResolveDescriptorSetLayout);
+	for (uint32_t level = 1; level < m_hizImage.mipLevelCount; ++level)
+	{
+		layouts.push_back(m_hizDownsampleDescriptorSetLayout);
+	}
 
-	const uint32_t swapChainImageCount = m_vulkanManager.getSwapChainSize();
-	for (uint32_t imgIdx = 0; imgIdx < swapChainImageCount; ++imgIdx)
+	const uint32_t frameCount = MAX_FRAMES_IN_FLIGHT;
+	for (uint32_t frameIdx = 0; frameIdx < frameCount; ++frameIdx)
 	{
+		layouts.push_back(m_occlusionCullDescriptorSetLayout);
+		layouts.push_back(m_drawCullDescriptorSetLayout);
 		layouts.push_back(m_skyboxDescriptorSetLayout);
 		layouts.push_back(m_lightingDescriptorSetLayout);
 		layouts.push_back(m_finalOutputDescriptorSetLayout);
@@ -658,14 +1528,8 @@ void DeferredRenderer::createDescriptorSets()
 		{
 			layouts.push_back(m_shadowDescriptorSetLayout1);
 		}
-		for (uint32_t i = 0; i < m_scene.meshes.size(); ++i)
-		{
-			layouts.push_back(m_shadowDescriptorSetLayout2);
-		}
-		for (uint32_t i = 0; i < m_scene.meshes.size(); ++i)
-		{
-			layouts.push_back(m_geomDescriptorSetLayout);
-		}
+		layouts.push_back(m_shadowDescriptorSetLayout2);
+		layouts.push_back(m_geomDescriptorSetLayout);
 		for (uint32_t i = 0; i < 3; ++i)
 		{
 			layouts.push_back(m_bloomDescriptorSetLayout);
@@ -677,36 +1541,38 @@ void DeferredRenderer::createDescriptorSets()
 	uint32_t idx = 0;
 	m_brdfLutDescriptorSet = sets[idx++];
 	m_specEnvPrefilterDescriptorSet = sets[idx++];
+	m_depthResolveDescriptorSet = sets[idx++];
+	m_hizDownsampleDescriptorSets.resize(m_hizImage.mipLevelCount - 1);
+	for (uint32_t level = 1; level < m_hizImage.mipLevelCount; ++level)
+	{
+		m_hizDownsampleDescriptorSets[level - 1] = sets[idx++];
+	}
 
-	m_perFrameDescriptorSets.resize(swapChainImageCount);
-	for (uint32_t imgIdx = 0; imgIdx < swapChainImageCount; ++imgIdx)
+	m_perFrameDescriptorSets.resize(frameCount);
+	for (uint32_t frameIdx = 0; frameIdx < frameCount; ++frameIdx)
 	{
-		m_perFrameDescriptorSets[imgIdx].m_skyboxDescriptorSet = sets[idx++];
-		m_perFrameDescriptorSets[imgIdx].m_lightingDescriptorSet = sets[idx++];
-		m_perFrameDescriptorSets[imgIdx].m_finalOutputDescriptorSet = sets[idx++];
-		m_perFrameDescriptorSets[imgIdx].m_shadowDescriptorSets1.resize(m_camera.getSegmentCount());
+		m_perFrameDescriptorSets[frameIdx].m_occlusionCullDescriptorSet = sets[idx++];
+		m_perFrameDescriptorSets[frameIdx].m_drawCullDescriptorSet = sets[idx++];
+		m_perFrameDescriptorSets[frameIdx].m_skyboxDescriptorSet = sets[idx++];
+		m_perFrameDescriptorSets[frameIdx].m_lightingDescriptorSet = sets[idx++];
+		m_perFrameDescriptorSets[frameIdx].m_finalOutputDescriptorSet = sets[idx++];
+		m_perFrameDescriptorSets[frameIdx].m_shadowDescriptorSets1.resize(m_camera.getSegmentCount());
 		for (uint32_t i = 0; i < m_camera.getSegmentCount(); ++i)
 		{
-			m_perFrameDescriptorSets[imgIdx].m_shadowDescriptorSets1[i] = sets[idx++];
-		}
-		m_perFrameDescriptorSets[imgIdx].m_shadowDescriptorSets2.resize(m_scene.meshes.size());
-		for (uint32_t i = 0; i < m_scene.meshes.size(); ++i)
-		{
-			m_perFrameDescriptorSets[imgIdx].m_shadowDescriptorSets2[i] = sets[idx++];
-		}
-		m_perFrameDescriptorSets[imgIdx].m_geomDescriptorSets.resize(m_scene.meshes.size());
-		for (uint32_t i = 0; i < m_scene.meshes.size(); ++i)
-		{
-			m_perFrameDescriptorSets[imgIdx].m_geomDescriptorSets[i] = sets[idx++];
+			m_perFrameDescriptorSets[frameIdx].m_shadowDescriptorSets1[i] = sets[idx++];
 		}
-		m_perFrameDescriptorSets[imgIdx].m_bloomDescriptorSets.resize(3);
+		m_perFrameDescriptorSets[frameIdx].m_shadowDescriptorSet2 = sets[idx++];
+		m_perFrameDescriptorSets[frameIdx].m_geomDescriptorSet = sets[idx++];
+		m_perFrameDescriptorSets[frameIdx].m_bloomDescriptorSets.resize(3);
 		for (uint32_t i = 0; i < 3; ++i)
 		{
-			m_perFrameDescriptorSets[imgIdx].m_bloomDescriptorSets[i] = sets[idx++];
+			m_perFrameDescriptorSets[frameIdx].m_bloomDescriptorSets[i] = sets[idx++];
 		}
 	}
 
 	createBrdfLutDescriptorSet();
+	createHiZDescriptorSets();
+	createDrawCullDescriptorSets();
 	createSpecEnvPrefilterDescriptorSet();
 	createGeomPassDescriptorSets();
 	createShadowPassDescriptorSets();
@@ -793,26 +1659,51 @@ void DeferredRenderer::createCommandBuffers()
 	// Allocate graphics command buffers
 	m_vulkanManager.resetCommandPool(m_graphicsCommandPool, VK_COMMAND_POOL_RESET_RELEASE_RESOURCES_BIT);
 
-	const uint32_t swapChainImageCount = m_vulkanManager.getSwapChainSize();
-	m_perFrameCommandBuffers.resize(swapChainImageCount);
+	const uint32_t frameCount = MAX_FRAMES_IN_FLIGHT;
+	m_perFrameCommandBuffers.resize(frameCount);
 
-	std::vector<uint32_t> commandBuffers = m_vulkanManager.allocateCommandBuffers(m_graphicsCommandPool,
-		static_cast<uint32_t>(m_perFrameCommandBuffers.size() * 3 + 1));
+	std::vector<uint32_t> commandBuffers = m_vulkanManager.allocateCommandBuffers(m_graphicsCommandPool, 1);
+	m_envPrefilterCommandBuffer = commandBuffers[0];
 
-	int idx = 0;
-	for (uint32_t imgIdx = 0; imgIdx < m_perFrameCommandBuffers.size(); ++imgIdx)
+	// Per-frame command buffers are only allocated here, they are recorded by the frame that uses them.
+	// Command pools are externally synchronized, so every recording thread gets its own pool in each frame.
+	// Any thread may run any task, so each thread has a secondary for every task
+	const uint32_t secondaryTaskCount = 2 * getGeomPassSecondaryChunkCount() + m_camera.getSegmentCount();
+	for (auto &frameCommandBuffers : m_perFrameCommandBuffers)
 	{
-		m_perFrameCommandBuffers[imgIdx].m_geomShadowLightingCommandBuffer = commandBuffers[idx++];
-		m_perFrameCommandBuffers[imgIdx].m_postEffectCommandBuffer = commandBuffers[idx++];
-		m_perFrameCommandBuffers[imgIdx].m_presentCommandBuffer = commandBuffers[idx++];
+		if (frameCommandBuffers.m_commandPool == std::numeric_limits<uint32_t>::max())
+		{
+			frameCommandBuffers.m_commandPool = m_vulkanManager.createCommandPool(VK_QUEUE_GRAPHICS_BIT, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
+			frameCommandBuffers.m_threadCommandPools.resize(m_threadPool.getThreadCount());
+			for (auto &pool : frameCommandBuffers.m_threadCommandPools)
+			{
+				pool = m_vulkanManager.createCommandPool(VK_QUEUE_GRAPHICS_BIT, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
+			}
+		}
+		else
+		{
+			m_vulkanManager.resetCommandPool(frameCommandBuffers.m_commandPool, VK_COMMAND_POOL_RESET_RELEASE_RESOURCES_BIT);
+			for (auto pool : frameCommandBuffers.m_threadCommandPools)
+			{
+				m_vulkanManager.resetCommandPool(pool, VK_COMMAND_POOL_RESET_RELEASE_RESOURCES_BIT);
+			}
+		}
+
+		commandBuffers = m_vulkanManager.allocateCommandBuffers(frameCommandBuffers.m_commandPool, 3);
+		frameCommandBuffers.m_geomShadowLightingCommandBuffer = commandBuffers[0];
+		frameCommandBuffers.m_postEffectCommandBuffer = commandBuffers[1];
+		frameCommandBuffers.m_presentCommandBuffer = commandBuffers[2];
+
+		frameCommandBuffers.m_secondaryCommandBuffers.resize(frameCommandBuffers.m_threadCommandPools.size());
+		for (uint32_t thread = 0; thread < frameCommandBuffers.m_threadCommandPools.size(); ++thread)
+		{
+			frameCommandBuffers.m_secondaryCommandBuffers[thread] = m_vulkanManager.allocateCommandBuffers(
+				frameCommandBuffers.m_threadCommandPools[thread], secondaryTaskCount, VK_COMMAND_BUFFER_LEVEL_SECONDARY);
+		}
 	}
-	m_envPrefilterCommandBuffer = commandBuffers[idx++];
 
 	// Create command buffers for different purposes
 	createEnvPrefilterCommandBuffer();
-	createGeomShadowLightingCommandBuffers();
-	createPostEffectCommandBuffers();
-	createPresentCommandBuffers();
 
 	// compute command buffers
 	m_vulkanManager.resetCommandPool(m_computeCommandPool, VK_COMMAND_POOL_RESET_RELEASE_RESOURCES_BIT);
@@ -825,15 +1716,20 @@ void DeferredRenderer::createCommandBuffers()
 
 void DeferredRenderer::createSynchronizationObjects()
 {
-	m_imageAvailableSemaphore = m_vulkanManager.createSemaphore();
-	m_geomAndLightingCompleteSemaphore = m_vulkanManager.createSemaphore();
-	m_postEffectSemaphore = m_vulkanManager.createSemaphore();
-	m_finalOutputFinishedSemaphore = m_vulkanManager.createSemaphore();
-	m_renderFinishedSemaphore = m_vulkanManager.createSemaphore();
+	if (!m_initialized)
+	{
+		m_perFrameSyncObjects.resize(MAX_FRAMES_IN_FLIGHT);
+		for (auto &sync : m_perFrameSyncObjects)
+		{
+			sync.m_imageAvailableSemaphore = m_vulkanManager.createSemaphore();
+		}
+	}
 
-	m_brdfLutFence = m_vulkanManager.createFence();
-	m_envPrefilterFence = m_vulkanManager.createFence();
-	m_renderFinishedFence = m_vulkanManager.createFence(VK_FENCE_CREATE_SIGNALED_BIT);
+	// a recreated swap chain may have more images, semaphores of images it no longer has are left unused
+	while (m_renderFinishedSemaphores.size() < m_vulkanManager.getSwapChainSize())
+	{
+		m_renderFinishedSemaphores.push_back(m_vulkanManager.createSemaphore());
+	}
 }
 
 void DeferredRenderer::createSpecEnvPrefilterRenderPass()
@@ -909,45 +1805,83 @@ void DeferredRenderer::createGeometryRenderPass()
 	if (m_initialized)
 	{
 		m_vulkanManager.destroyRenderPass(m_geomRenderPass);
+		m_vulkanManager.destroyRenderPass(m_geomLoadRenderPass);
 	}
 
-	m_vulkanManager.beginCreateRenderPass();
+	// The second pass draws meshes that the first occlusion culling phase got wrong on top of
+	// what the first pass rendered. It only differs in load ops and initial layouts so both are compatible
+	// with the same framebuffer and pipelines
+	for (uint32_t passIdx = 0; passIdx < 2; ++passIdx)
+	{
+		const bool loadContents = passIdx == 1;
+		const VkImageLayout initLayout = loadContents ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_UNDEFINED;
+		const VkAttachmentLoadOp loadOp = loadContents ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR;
 
-	// --- Attachments used in this render pass
-	// Depth
-	// Clear only happens in the FIRST subpass that uses this attachment
-	// VK_IMAGE_LAYOUT_UNDEFINED as initial layout means that we don't care about the initial layout of this attachment image (content may not be preserved)
-	m_vulkanManager.renderPassAddAttachment(findDepthFormat(), VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, SAMPLE_COUNT);
+		m_vulkanManager.beginCreateRenderPass();
 
-	// World space normal + albedo
-	// Normal has been perturbed by normal mapping
-	m_vulkanManager.renderPassAddAttachment(m_gbufferFormats[0], VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, SAMPLE_COUNT);
+		// --- Attachments used in this render pass
+		// Depth
+		// Clear only happens in the FIRST subpass that uses this attachment
+		// VK_IMAGE_LAYOUT_UNDEFINED as initial layout means that we don't care about the initial layout of this attachment image (content may not be preserved)
+		m_vulkanManager.renderPassAddAttachment(findDepthFormat(), initLayout, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, SAMPLE_COUNT, loadOp);
 
-	// World postion
-	m_vulkanManager.renderPassAddAttachment(m_gbufferFormats[1], VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, SAMPLE_COUNT);
+		// World space normal + albedo
+		// Normal has been perturbed by normal mapping
+		m_vulkanManager.renderPassAddAttachment(m_gbufferFormats[0], initLayout, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, SAMPLE_COUNT, loadOp);
 
-	// RMAI
-	m_vulkanManager.renderPassAddAttachment(m_gbufferFormats[2], VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, SAMPLE_COUNT);
+		// World postion
+		m_vulkanManager.renderPassAddAttachment(m_gbufferFormats[1], initLayout, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, SAMPLE_COUNT, loadOp);
 
-	// --- Reference to render pass attachments used in each subpass
-	// --- Subpasses
-	// Geometry subpass
-	m_vulkanManager.beginDescribeSubpass();
-	m_vulkanManager.subpassAddColorAttachmentReference(1, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
-	m_vulkanManager.subpassAddColorAttachmentReference(2, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
-	m_vulkanManager.subpassAddColorAttachmentReference(3, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
-	m_vulkanManager.subpassAddDepthAttachmentReference(0, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
-	m_vulkanManager.endDescribeSubpass();
+		// RMAI
+		m_vulkanManager.renderPassAddAttachment(m_gbufferFormats[2], initLayout, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, SAMPLE_COUNT, loadOp);
 
-	// --- Subpass dependencies
-	m_vulkanManager.renderPassAddSubpassDependency(VK_SUBPASS_EXTERNAL, 0,
-		VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
-		VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-		0,
-		VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT);
+		// --- Reference to render pass attachments used in each subpass
+		// --- Subpasses
+		// Geometry subpass
+		m_vulkanManager.beginDescribeSubpass();
+		m_vulkanManager.subpassAddColorAttachmentReference(1, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+		m_vulkanManager.subpassAddColorAttachmentReference(2, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+		m_vulkanManager.subpassAddColorAttachmentReference(3, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+		m_vulkanManager.subpassAddDepthAttachmentReference(0, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
+		m_vulkanManager.endDescribeSubpass();
+
+		// --- Subpass dependencies
+		if (loadContents)
+		{
+			// depth was read by the Hi-Z build
+			m_vulkanManager.renderPassAddSubpassDependency(VK_SUBPASS_EXTERNAL, 0,
+				VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+				VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+				0,
+				VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |
+				VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT);
+		}
+		else
+		{
+			m_vulkanManager.renderPassAddSubpassDependency(VK_SUBPASS_EXTERNAL, 0,
+				VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+				VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+				0,
+				VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT);
+		}
 
-	// --- Create render pass
-	m_geomRenderPass = m_vulkanManager.endCreateRenderPass();
+		// Depth is resolved into the Hi-Z pyramid by a compute shader right after this pass
+		m_vulkanManager.renderPassAddSubpassDependency(0, VK_SUBPASS_EXTERNAL,
+			VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+			VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+			VK_ACCESS_SHADER_READ_BIT);
+
+		// --- Create render pass
+		if (loadContents)
+		{
+			m_geomLoadRenderPass = m_vulkanManager.endCreateRenderPass();
+		}
+		else
+		{
+			m_geomRenderPass = m_vulkanManager.endCreateRenderPass();
+		}
+	}
 }
 
 void DeferredRenderer::createLightingRenderPass()
@@ -1054,6 +1988,53 @@ void DeferredRenderer::createBrdfLutDescriptorSetLayout()
 	m_brdfLutDescriptorSetLayout = m_vulkanManager.endCreateDescriptorSetLayout();
 }
 
+void DeferredRenderer::createHiZDescriptorSetLayouts()
+{
+	// MSAA depth -> first pyramid level
+	m_vulkanManager.beginCreateDescriptorSetLayout();
+	m_vulkanManager.setLayoutAddBinding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT);
+	m_vulkanManager.setLayoutAddBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT);
+	m_depthResolveDescriptorSetLayout = m_vulkanManager.endCreateDescriptorSetLayout();
+
+	// pyramid level i -> level i + 1
+	m_vulkanManager.beginCreateDescriptorSetLayout();
+	m_vulkanManager.setLayoutAddBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT);
+	m_vulkanManager.setLayoutAddBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT);
+	m_hizDownsampleDescriptorSetLayout = m_vulkanManager.endCreateDescriptorSetLayout();
+
+	// Occlusion culling
+	m_vulkanManager.beginCreateDescriptorSetLayout();
+	m_vulkanManager.setLayoutAddBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT); // camera VP
+	m_vulkanManager.setLayoutAddBinding(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT); // Hi-Z pyramid
+	m_vulkanManager.setLayoutAddBinding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT); // object bounds
+	m_vulkanManager.setLayoutAddBinding(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT); // object visibility
+	m_vulkanManager.setLayoutAddBinding(4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT); // draw commands
+	m_vulkanManager.setLayoutAddBinding(5, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT); // object meshes
+	m_vulkanManager.setLayoutAddBinding(6, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT); // instance objects
+	m_occlusionCullDescriptorSetLayout = m_vulkanManager.endCreateDescriptorSetLayout();
+}
+
+void DeferredRenderer::createDrawCullDescriptorSetLayout()
+{
+	m_vulkanManager.beginCreateDescriptorSetLayout();
+	m_vulkanManager.setLayoutAddBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT); // cascade VPs
+	m_vulkanManager.setLayoutAddBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT); // object bounds
+	m_vulkanManager.setLayoutAddBinding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT); // object meshes
+	m_vulkanManager.setLayoutAddBinding(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT); // draw counts
+	m_vulkanManager.setLayoutAddBinding(4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT); // draw commands
+	m_vulkanManager.setLayoutAddBinding(5, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT); // instance objects
+	m_drawCullDescriptorSetLayout = m_vulkanManager.endCreateDescriptorSetLayout();
+
+	m_vulkanManager.beginCreateDescriptorUpdateTemplate(m_drawCullDescriptorSetLayout);
+	m_vulkanManager.descriptorUpdateTemplateAddEntry(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, offsetof(DrawCullDescriptors, cascadeVPs));
+	m_vulkanManager.descriptorUpdateTemplateAddEntry(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, offsetof(DrawCullDescriptors, objectBounds));
+	m_vulkanManager.descriptorUpdateTemplateAddEntry(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, offsetof(DrawCullDescriptors, objectMeshes));
+	m_vulkanManager.descriptorUpdateTemplateAddEntry(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, offsetof(DrawCullDescriptors, drawCounts));
+	m_vulkanManager.descriptorUpdateTemplateAddEntry(4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, offsetof(DrawCullDescriptors, drawCommands));
+	m_vulkanManager.descriptorUpdateTemplateAddEntry(5, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, offsetof(DrawCullDescriptors, instanceObjects));
+	m_drawCullDescriptorUpdateTemplate = m_vulkanManager.endCreateDescriptorUpdateTemplate();
+}
+
 void DeferredRenderer::createSpecEnvPrefilterDescriptorSetLayout()
 {
 	m_vulkanManager.beginCreateDescriptorSetLayout();
@@ -1093,28 +2074,34 @@ void DeferredRenderer::createStaticMeshDescriptorSetLayout()
 	// Transformation matrices
 	m_vulkanManager.setLayoutAddBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_VERTEX_BIT);
 
-	// Per model information
-	m_vulkanManager.setLayoutAddBinding(1, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_VERTEX_BIT);
+	// Object transforms
+	m_vulkanManager.setLayoutAddBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT);
 
-	// Albedo map
-	m_vulkanManager.setLayoutAddBinding(2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT);
+	// Object index of each instance
+	m_vulkanManager.setLayoutAddBinding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT);
 
-	// Normal map
-	m_vulkanManager.setLayoutAddBinding(3, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT);
+	// Mesh index of each object, which is also its material index
+	m_vulkanManager.setLayoutAddBinding(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT);
 
-	// Roughness map
-	m_vulkanManager.setLayoutAddBinding(4, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT);
+	m_geomDescriptorSetLayout = m_vulkanManager.endCreateDescriptorSetLayout();
 
-	// Metalness map
-	m_vulkanManager.setLayoutAddBinding(5, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT);
+	m_vulkanManager.beginCreateDescriptorUpdateTemplate(m_geomDescriptorSetLayout);
+	m_vulkanManager.descriptorUpdateTemplateAddEntry(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, offsetof(GeomPassDescriptors, cameraVP));
+	m_vulkanManager.descriptorUpdateTemplateAddEntry(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, offsetof(GeomPassDescriptors, objectTransforms));
+	m_vulkanManager.descriptorUpdateTemplateAddEntry(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, offsetof(GeomPassDescriptors, instanceObjects));
+	m_vulkanManager.descriptorUpdateTemplateAddEntry(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, offsetof(GeomPassDescriptors, objectMeshes));
+	m_geomDescriptorUpdateTemplate = m_vulkanManager.endCreateDescriptorUpdateTemplate();
 
-	// AO map
-	m_vulkanManager.setLayoutAddBinding(6, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT);
+	m_vulkanManager.beginCreateDescriptorSetLayout();
 
-	// Emissive map
-	m_vulkanManager.setLayoutAddBinding(7, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT);
+	// Material textures, only the elements of used mesh slots are written
+	m_vulkanManager.setLayoutAddBinding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, BINDLESS_TEXTURE_COUNT, {},
+		VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT_EXT);
 
-	m_geomDescriptorSetLayout = m_vulkanManager.endCreateDescriptorSetLayout();
+	// Material table
+	m_vulkanManager.setLayoutAddBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT);
+
+	m_materialDescriptorSetLayout = m_vulkanManager.endCreateDescriptorSetLayout(VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT);
 }
 
 void DeferredRenderer::createShadowPassDescriptorSetLayout()
@@ -1125,9 +2112,20 @@ void DeferredRenderer::createShadowPassDescriptorSetLayout()
 	m_shadowDescriptorSetLayout1 = m_vulkanManager.endCreateDescriptorSetLayout();
 
 	m_vulkanManager.beginCreateDescriptorSetLayout();
-	// Per model information
-	m_vulkanManager.setLayoutAddBinding(1, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_VERTEX_BIT);
+	// Transforms of all objects
+	m_vulkanManager.setLayoutAddBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT);
+	// Object index of each instance, one list per cascade
+	m_vulkanManager.setLayoutAddBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT);
 	m_shadowDescriptorSetLayout2 = m_vulkanManager.endCreateDescriptorSetLayout();
+
+	m_vulkanManager.beginCreateDescriptorUpdateTemplate(m_shadowDescriptorSetLayout1);
+	m_vulkanManager.descriptorUpdateTemplateAddEntry(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, offsetof(ShadowPassDescriptors1, cascadeVP));
+	m_shadowDescriptorUpdateTemplate1 = m_vulkanManager.endCreateDescriptorUpdateTemplate();
+
+	m_vulkanManager.beginCreateDescriptorUpdateTemplate(m_shadowDescriptorSetLayout2);
+	m_vulkanManager.descriptorUpdateTemplateAddEntry(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, offsetof(ShadowPassDescriptors2, objectTransforms));
+	m_vulkanManager.descriptorUpdateTemplateAddEntry(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, offsetof(ShadowPassDescriptors2, instanceObjects));
+	m_shadowDescriptorUpdateTemplate2 = m_vulkanManager.endCreateDescriptorUpdateTemplate();
 }
 
 void DeferredRenderer::createLightingPassDescriptorSetLayout()
@@ -1201,6 +2199,50 @@ void DeferredRenderer::createBrdfLutPipeline()
 	m_brdfLutPipeline = m_vulkanManager.endCreateComputePipeline();
 }
 
+void DeferredRenderer::createHiZPipelines()
+{
+	// Depth resolve
+	m_vulkanManager.beginCreatePipelineLayout();
+	m_vulkanManager.pipelineLayoutAddDescriptorSetLayouts({ m_depthResolveDescriptorSetLayout });
+	m_vulkanManager.pipelineLayoutAddPushConstantRange(0, sizeof(int32_t), VK_SHADER_STAGE_COMPUTE_BIT);
+	m_depthResolvePipelineLayout = m_vulkanManager.endCreatePipelineLayout();
+
+	m_vulkanManager.beginCreateComputePipeline(m_depthResolvePipelineLayout);
+	m_vulkanManager.computePipelineAddShaderStage("../shaders/hiz_pass/depth_resolve.comp.spv");
+	m_depthResolvePipeline = m_vulkanManager.endCreateComputePipeline();
+
+	// Downsample
+	m_vulkanManager.beginCreatePipelineLayout();
+	m_vulkanManager.pipelineLayoutAddDescriptorSetLayouts({ m_hizDownsampleDescriptorSetLayout });
+	m_hizDownsamplePipelineLayout = m_vulkanManager.endCreatePipelineLayout();
+
+	m_vulkanManager.beginCreateComputePipeline(m_hizDownsamplePipelineLayout);
+	m_vulkanManager.computePipelineAddShaderStage("../shaders/hiz_pass/hiz_downsample.comp.spv");
+	m_hizDownsamplePipeline = m_vulkanManager.endCreateComputePipeline();
+
+	// Occlusion culling, push constants match occlusion_cull.comp
+	m_vulkanManager.beginCreatePipelineLayout();
+	m_vulkanManager.pipelineLayoutAddDescriptorSetLayouts({ m_occlusionCullDescriptorSetLayout });
+	m_vulkanManager.pipelineLayoutAddPushConstantRange(0, 4 * sizeof(uint32_t) + 2 * sizeof(int32_t), VK_SHADER_STAGE_COMPUTE_BIT);
+	m_occlusionCullPipelineLayout = m_vulkanManager.endCreatePipelineLayout();
+
+	m_vulkanManager.beginCreateComputePipeline(m_occlusionCullPipelineLayout);
+	m_vulkanManager.computePipelineAddShaderStage("../shaders/hiz_pass/occlusion_cull.comp.spv");
+	m_occlusionCullPipeline = m_vulkanManager.endCreateComputePipeline();
+}
+
+void DeferredRenderer::createDrawCullPipeline()
+{
+	m_vulkanManager.beginCreatePipelineLayout();
+	m_vulkanManager.pipelineLayoutAddDescriptorSetLayouts({ m_drawCullDescriptorSetLayout });
+	m_vulkanManager.pipelineLayoutAddPushConstantRange(0, 2 * sizeof(uint32_t), VK_SHADER_STAGE_COMPUTE_BIT);
+	m_drawCullPipelineLayout = m_vulkanManager.endCreatePipelineLayout();
+
+	m_vulkanManager.beginCreateComputePipeline(m_drawCullPipelineLayout);
+	m_vulkanManager.computePipelineAddShaderStage("../shaders/cull_pass/draw_cull.comp.spv");
+	m_drawCullPipeline = m_vulkanManager.endCreateComputePipeline();
+}
+
 void DeferredRenderer::createSpecEnvPrefilterPipeline()
 {
 	if (m_initialized)
@@ -1309,8 +2351,7 @@ void DeferredRenderer::createStaticMeshPipeline()
 	const std::string fsFileName = "../shaders/geom_pass/geom.frag.spv";
 
 	m_vulkanManager.beginCreatePipelineLayout();
-	m_vulkanManager.pipelineLayoutAddDescriptorSetLayouts({ m_geomDescriptorSetLayout });
-	m_vulkanManager.pipelineLayoutAddPushConstantRange(0, 3 * sizeof(uint32_t), VK_SHADER_STAGE_FRAGMENT_BIT);
+	m_vulkanManager.pipelineLayoutAddDescriptorSetLayouts({ m_geomDescriptorSetLayout, m_materialDescriptorSetLayout });
 	m_geomPipelineLayout = m_vulkanManager.endCreatePipelineLayout();
 
 	m_vulkanManager.beginCreateGraphicsPipeline(m_geomPipelineLayout, m_geomRenderPass, 0);
@@ -1368,10 +2409,10 @@ void DeferredRenderer::createShadowPassPipeline()
 
 		m_vulkanManager.graphicsPipelineAddShaderStage(VK_SHADER_STAGE_VERTEX_BIT, vsFileName);
 
-		auto bindingDesc = Vertex::getBindingDescription();
+		auto bindingDesc = Vertex::getPositionOnlyBindingDescription();
 		m_vulkanManager.graphicsPipelineAddBindingDescription(bindingDesc.binding, bindingDesc.stride, bindingDesc.inputRate);
-		auto attrDescs = Vertex::getAttributeDescriptions();
-		m_vulkanManager.graphicsPipelineAddAttributeDescription(attrDescs[0].location, attrDescs[0].binding, attrDescs[0].format, attrDescs[0].offset);
+		auto attrDesc = Vertex::getPositionOnlyAttributeDescription();
+		m_vulkanManager.graphicsPipelineAddAttributeDescription(attrDesc.location, attrDesc.binding, attrDesc.format, attrDesc.offset);
 
 		VkExtent2D swapChainExtent = { SHADOW_MAP_SIZE, SHADOW_MAP_SIZE };
 		m_vulkanManager.graphicsPipelineAddViewportAndScissor(0.f, 0.f,
@@ -1556,6 +2597,109 @@ void DeferredRenderer::createBrdfLutDescriptorSet()
 	m_vulkanManager.endUpdateDescriptorSet();
 }
 
+void DeferredRenderer::createHiZDescriptorSets()
+{
+	std::vector<rj::DescriptorSetUpdateImageInfo> imageInfos(1);
+
+	// Depth resolve
+	m_vulkanManager.beginUpdateDescriptorSet(m_depthResolveDescriptorSet);
+
+	imageInfos[0].layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	imageInfos[0].imageViewName = m_depthImage.imageViews[0];
+	imageInfos[0].samplerName = m_depthImage.samplers[0];
+	m_vulkanManager.descriptorSetAddImageDescriptor(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, imageInfos);
+
+	imageInfos[0].layout = VK_IMAGE_LAYOUT_GENERAL;
+	imageInfos[0].imageViewName = m_hizImage.imageViews[1];
+	imageInfos[0].samplerName = std::numeric_limits<uint32_t>::max();
+	m_vulkanManager.descriptorSetAddImageDescriptor(1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, imageInfos);
+
+	m_vulkanManager.endUpdateDescriptorSet();
+
+	// Downsample
+	for (uint32_t level = 1; level < m_hizImage.mipLevelCount; ++level)
+	{
+		m_vulkanManager.beginUpdateDescriptorSet(m_hizDownsampleDescriptorSets[level - 1]);
+
+		imageInfos[0].layout = VK_IMAGE_LAYOUT_GENERAL;
+		imageInfos[0].imageViewName = m_hizImage.imageViews[level];
+		imageInfos[0].samplerName = std::numeric_limits<uint32_t>::max();
+		m_vulkanManager.descriptorSetAddImageDescriptor(0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, imageInfos);
+
+		imageInfos[0].imageViewName = m_hizImage.imageViews[level + 1];
+		m_vulkanManager.descriptorSetAddImageDescriptor(1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, imageInfos);
+
+		m_vulkanManager.endUpdateDescriptorSet();
+	}
+
+	// Occlusion culling
+	std::vector<rj::DescriptorSetUpdateBufferInfo> bufferInfos(1);
+
+	for (uint32_t frameIdx = 0; frameIdx < m_perFrameDescriptorSets.size(); ++frameIdx)
+	{
+		m_vulkanManager.beginUpdateDescriptorSet(m_perFrameDescriptorSets[frameIdx].m_occlusionCullDescriptorSet);
+
+		bufferInfos[0].bufferName = m_perFrameUniformDeviceData[frameIdx].buffer;
+		bufferInfos[0].offset = m_perFrameUniformDeviceData[frameIdx].offset + m_perFrameUniformHostData.offsetOf(reinterpret_cast<const char *>(m_uCameraVP));
+		bufferInfos[0].sizeInBytes = sizeof(TransMatsUniformBuffer);
+		m_vulkanManager.descriptorSetAddBufferDescriptor(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, bufferInfos);
+
+		imageInfos[0].layout = VK_IMAGE_LAYOUT_GENERAL;
+		imageInfos[0].imageViewName = m_hizImage.imageViews[0];
+		imageInfos[0].samplerName = m_hizImage.samplers[0];
+		m_vulkanManager.descriptorSetAddImageDescriptor(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, imageInfos);
+
+		bufferInfos[0].bufferName = m_perFrameObjectBoundsDeviceData[frameIdx].buffer;
+		bufferInfos[0].offset = 0;
+		bufferInfos[0].sizeInBytes = m_perFrameObjectBoundsDeviceData[frameIdx].size;
+		m_vulkanManager.descriptorSetAddBufferDescriptor(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, bufferInfos);
+
+		bufferInfos[0].bufferName = m_objectVisibilityDeviceData.buffer;
+		bufferInfos[0].offset = 0;
+		bufferInfos[0].sizeInBytes = m_objectVisibilityDeviceData.size;
+		m_vulkanManager.descriptorSetAddBufferDescriptor(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, bufferInfos);
+
+		bufferInfos[0].bufferName = m_drawCommandDeviceData.buffer;
+		bufferInfos[0].offset = 0;
+		bufferInfos[0].sizeInBytes = m_drawCommandDeviceData.size;
+		m_vulkanManager.descriptorSetAddBufferDescriptor(4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, bufferInfos);
+
+		bufferInfos[0].bufferName = m_objectMeshDeviceData.buffer;
+		bufferInfos[0].sizeInBytes = m_objectMeshDeviceData.size;
+		m_vulkanManager.descriptorSetAddBufferDescriptor(5, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, bufferInfos);
+
+		bufferInfos[0].bufferName = m_instanceObjectDeviceData.buffer;
+		bufferInfos[0].sizeInBytes = m_instanceObjectDeviceData.size;
+		m_vulkanManager.descriptorSetAddBufferDescriptor(6, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, bufferInfos);
+
+		m_vulkanManager.endUpdateDescriptorSet();
+	}
+}
+
+void DeferredRenderer::createDrawCullDescriptorSets()
+{
+	const uint32_t frameCount = MAX_FRAMES_IN_FLIGHT;
+	std::array<DrawCullDescriptors, MAX_FRAMES_IN_FLIGHT> descriptors;
+	std::array<uint32_t, MAX_FRAMES_IN_FLIGHT> sets;
+
+	for (uint32_t frameIdx = 0; frameIdx < frameCount; ++frameIdx)
+	{
+		auto &d = descriptors[frameIdx];
+		d.cascadeVPs = m_vulkanManager.getDescriptorBufferInfo(m_perFrameUniformDeviceData[frameIdx].buffer,
+			m_perFrameUniformDeviceData[frameIdx].offset + m_perFrameUniformHostData.offsetOf(reinterpret_cast<const char *>(m_uDrawCullInfo)),
+			sizeof(DrawCullUniformBuffer));
+		d.objectBounds = m_vulkanManager.getDescriptorBufferInfo(m_perFrameObjectBoundsDeviceData[frameIdx].buffer, 0, m_perFrameObjectBoundsDeviceData[frameIdx].size);
+		d.objectMeshes = m_vulkanManager.getDescriptorBufferInfo(m_objectMeshDeviceData.buffer, 0, m_objectMeshDeviceData.size);
+		d.drawCounts = m_vulkanManager.getDescriptorBufferInfo(m_shadowDrawCountDeviceData.buffer, 0, m_shadowDrawCountDeviceData.size);
+		d.drawCommands = m_vulkanManager.getDescriptorBufferInfo(m_shadowDrawCommandDeviceData.buffer, 0, m_shadowDrawCommandDeviceData.size);
+		d.instanceObjects = m_vulkanManager.getDescriptorBufferInfo(m_shadowInstanceObjectDeviceData.buffer, 0, m_shadowInstanceObjectDeviceData.size);
+		sets[frameIdx] = m_perFrameDescriptorSets[frameIdx].m_drawCullDescriptorSet;
+	}
+
+	m_vulkanManager.updateDescriptorSetsWithTemplate(sets.data(), frameCount, m_drawCullDescriptorUpdateTemplate,
+		descriptors.data(), sizeof(DrawCullDescriptors));
+}
+
 void DeferredRenderer::createSpecEnvPrefilterDescriptorSet()
 {
 	if (m_scene.skybox.specMapReady) return;
@@ -1584,13 +2728,13 @@ void DeferredRenderer::createGeomPassDescriptorSets()
 
 void DeferredRenderer::createSkyboxDescriptorSet()
 {
-	const uint32_t swapChainImageCount = m_vulkanManager.getSwapChainSize();
+	const uint32_t frameCount = MAX_FRAMES_IN_FLIGHT;
 
-	for (uint32_t imgIdx = 0; imgIdx < swapChainImageCount; ++imgIdx)
+	for (uint32_t frameIdx = 0; frameIdx < frameCount; ++frameIdx)
 	{
 		std::vector<rj::DescriptorSetUpdateBufferInfo> bufferInfos(1);
-		bufferInfos[0].bufferName = m_perFrameUniformDeviceData[imgIdx].buffer;
-		bufferInfos[0].offset = m_perFrameUniformHostData.offsetOf(reinterpret_cast<const char *>(m_uCameraVP));
+		bufferInfos[0].bufferName = m_perFrameUniformDeviceData[frameIdx].buffer;
+		bufferInfos[0].offset = m_perFrameUniformDeviceData[frameIdx].offset + m_perFrameUniformHostData.offsetOf(reinterpret_cast<const char *>(m_uCameraVP));
 		bufferInfos[0].sizeInBytes = sizeof(DisplayInfoUniformBuffer);
 
 		std::vector<rj::DescriptorSetUpdateImageInfo> imageInfos(1);
@@ -1598,111 +2742,137 @@ void DeferredRenderer::createSkyboxDescriptorSet()
 		imageInfos[0].imageViewName = m_scene.skybox.radianceMap.imageViews[0];
 		imageInfos[0].samplerName = m_scene.skybox.radianceMap.samplers[0];
 
-		m_vulkanManager.beginUpdateDescriptorSet(m_perFrameDescriptorSets[imgIdx].m_skyboxDescriptorSet);
+		m_vulkanManager.beginUpdateDescriptorSet(m_perFrameDescriptorSets[frameIdx].m_skyboxDescriptorSet);
 		m_vulkanManager.descriptorSetAddBufferDescriptor(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, bufferInfos);
 		m_vulkanManager.descriptorSetAddImageDescriptor(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, imageInfos);
 		m_vulkanManager.endUpdateDescriptorSet();
 	}
 }
 
+GeomPassDescriptors DeferredRenderer::getGeomPassDescriptors(uint32_t frameIdx)
+{
+	GeomPassDescriptors d;
+	d.cameraVP = m_vulkanManager.getDescriptorBufferInfo(m_perFrameUniformDeviceData[frameIdx].buffer,
+		m_perFrameUniformDeviceData[frameIdx].offset + m_perFrameUniformHostData.offsetOf(reinterpret_cast<const char *>(m_uCameraVP)),
+		sizeof(TransMatsUniformBuffer));
+	d.objectTransforms = m_vulkanManager.getDescriptorBufferInfo(m_perFrameObjectTransformDeviceData[frameIdx].buffer, 0, m_perFrameObjectTransformDeviceData[frameIdx].size);
+	d.instanceObjects = m_vulkanManager.getDescriptorBufferInfo(m_instanceObjectDeviceData.buffer, 0, m_instanceObjectDeviceData.size);
+	d.objectMeshes = m_vulkanManager.getDescriptorBufferInfo(m_objectMeshDeviceData.buffer, 0, m_objectMeshDeviceData.size);
+	return d;
+}
+
 void DeferredRenderer::createStaticMeshDescriptorSet()
 {
-	const uint32_t swapChainImageCount = m_vulkanManager.getSwapChainSize();
-	for (uint32_t imgIdx = 0; imgIdx < swapChainImageCount; ++imgIdx)
+	const uint32_t frameCount = MAX_FRAMES_IN_FLIGHT;
+	std::array<GeomPassDescriptors, MAX_FRAMES_IN_FLIGHT> descriptors;
+	std::array<uint32_t, MAX_FRAMES_IN_FLIGHT> sets;
+	for (uint32_t frameIdx = 0; frameIdx < frameCount; ++frameIdx)
 	{
-		for (uint32_t i = 0; i < m_scene.meshes.size(); ++i)
-		{
-			std::vector<rj::DescriptorSetUpdateBufferInfo> bufferInfos(1);
-			std::vector<rj::DescriptorSetUpdateImageInfo> imageInfos(1);
-
-			m_vulkanManager.beginUpdateDescriptorSet(m_perFrameDescriptorSets[imgIdx].m_geomDescriptorSets[i]);
-
-			bufferInfos[0].bufferName = m_perFrameUniformDeviceData[imgIdx].buffer;
-			bufferInfos[0].offset = m_perFrameUniformHostData.offsetOf(reinterpret_cast<const char *>(m_uCameraVP));
-			bufferInfos[0].sizeInBytes = sizeof(TransMatsUniformBuffer);
-			m_vulkanManager.descriptorSetAddBufferDescriptor(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, bufferInfos);
-
-			bufferInfos[0].offset = m_perFrameUniformHostData.offsetOf(reinterpret_cast<const char *>(m_scene.meshes[i].uPerModelInfo));
-			bufferInfos[0].sizeInBytes = sizeof(PerModelUniformBuffer);
-			m_vulkanManager.descriptorSetAddBufferDescriptor(1, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, bufferInfos);
-
-			imageInfos[0].layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-			imageInfos[0].imageViewName = m_scene.meshes[i].albedoMap.imageViews[0];
-			imageInfos[0].samplerName = m_scene.meshes[i].albedoMap.samplers[0];
-			m_vulkanManager.descriptorSetAddImageDescriptor(2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, imageInfos);
+		descriptors[frameIdx] = getGeomPassDescriptors(frameIdx);
+		sets[frameIdx] = m_perFrameDescriptorSets[frameIdx].m_geomDescriptorSet;
+	}
 
-			imageInfos[0].imageViewName = m_scene.meshes[i].normalMap.imageViews[0];
-			imageInfos[0].samplerName = m_scene.meshes[i].normalMap.samplers[0];
-			m_vulkanManager.descriptorSetAddImageDescriptor(3, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, imageInfos);
+	m_vulkanManager.updateDescriptorSetsWithTemplate(sets.data(), frameCount, m_geomDescriptorUpdateTemplate,
+		descriptors.data(), sizeof(GeomPassDescriptors));
 
-			imageInfos[0].imageViewName = m_scene.meshes[i].roughnessMap.imageViews[0];
-			imageInfos[0].samplerName = m_scene.meshes[i].roughnessMap.samplers[0];
-			m_vulkanManager.descriptorSetAddImageDescriptor(4, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, imageInfos);
+	// the material set does not depend on the swap chain
+	if (m_initialized) return;
 
-			imageInfos[0].imageViewName = m_scene.meshes[i].metalnessMap.imageViews[0];
-			imageInfos[0].samplerName = m_scene.meshes[i].metalnessMap.samplers[0];
-			m_vulkanManager.descriptorSetAddImageDescriptor(5, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, imageInfos);
+	m_materialDescriptorSet = m_vulkanManager.allocateDescriptorSets(m_bindlessDescriptorPool, { m_materialDescriptorSetLayout })[0];
 
-			imageInfos[0].imageViewName = m_scene.meshes[i].aoMap.image == std::numeric_limits<uint32_t>::max() ? m_scene.meshes[i].albedoMap.imageViews[0] : m_scene.meshes[i].aoMap.imageViews[0];
-			imageInfos[0].samplerName = m_scene.meshes[i].aoMap.image == std::numeric_limits<uint32_t>::max() ? m_scene.meshes[i].albedoMap.samplers[0] : m_scene.meshes[i].aoMap.samplers[0];
-			m_vulkanManager.descriptorSetAddImageDescriptor(6, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, imageInfos);
+	std::vector<rj::DescriptorSetUpdateBufferInfo> bufferInfos(1);
+	bufferInfos[0].bufferName = m_materialTableDeviceData.buffer;
+	bufferInfos[0].offset = 0;
+	bufferInfos[0].sizeInBytes = m_materialTableDeviceData.size;
 
-			imageInfos[0].imageViewName = m_scene.meshes[i].emissiveMap.image == std::numeric_limits<uint32_t>::max() ? m_scene.meshes[i].albedoMap.imageViews[0] : m_scene.meshes[i].emissiveMap.imageViews[0];
-			imageInfos[0].samplerName = m_scene.meshes[i].emissiveMap.image == std::numeric_limits<uint32_t>::max() ? m_scene.meshes[i].albedoMap.samplers[0] : m_scene.meshes[i].emissiveMap.samplers[0];
-			m_vulkanManager.descriptorSetAddImageDescriptor(7, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, imageInfos);
+	m_vulkanManager.beginUpdateDescriptorSet(m_materialDescriptorSet);
+	m_vulkanManager.descriptorSetAddBufferDescriptor(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, bufferInfos);
+	m_vulkanManager.endUpdateDescriptorSet();
 
-			m_vulkanManager.endUpdateDescriptorSet();
-		}
+	for (uint32_t i = 0; i < m_scene.meshes.size(); ++i)
+	{
+		if (m_scene.isMeshAlive(i)) writeMeshMaterial(i);
 	}
 }
 
-void DeferredRenderer::createShadowPassDescriptorSets()
+void DeferredRenderer::writeMeshMaterial(uint32_t meshIdx)
 {
-	const uint32_t swapChainImageCount = m_vulkanManager.getSwapChainSize();
-	for (uint32_t imgIdx = 0; imgIdx < swapChainImageCount; ++imgIdx)
-	{
-		for (uint32_t i = 0; i < m_camera.getSegmentCount(); ++i)
-		{
-			std::vector<rj::DescriptorSetUpdateBufferInfo> bufferInfos(1);
+	const auto &mesh = m_scene.meshes[meshIdx];
+	const bool hasAoMap = mesh.aoMap.image != std::numeric_limits<uint32_t>::max();
+	const bool hasEmissiveMap = mesh.emissiveMap.image != std::numeric_limits<uint32_t>::max();
+
+	// missing maps are never sampled, the albedo map stands in so that every element is valid
+	const rj::helper_functions::ImageWrapper *textures[MATERIAL_TEXTURE_COUNT] = { &mesh.albedoMap, &mesh.normalMap, &mesh.roughnessMap, &mesh.metalnessMap,
+		hasAoMap ? &mesh.aoMap : &mesh.albedoMap, hasEmissiveMap ? &mesh.emissiveMap : &mesh.albedoMap };
+
+	const uint32_t firstTexture = MATERIAL_TEXTURE_COUNT * meshIdx;
+	std::vector<rj::DescriptorSetUpdateImageInfo> imageInfos(MATERIAL_TEXTURE_COUNT);
+	MaterialTableEntry material = {};
+	for (uint32_t i = 0; i < MATERIAL_TEXTURE_COUNT; ++i)
+	{
+		imageInfos[i].layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		imageInfos[i].imageViewName = textures[i]->imageViews[0];
+		imageInfos[i].samplerName = textures[i]->samplers[0];
+		material.textures[i] = firstTexture + i;
+	}
+	material.materialType = mesh.materialType;
+	material.flags = (hasAoMap ? MaterialTableEntry::hasAoMap : 0) | (hasEmissiveMap ? MaterialTableEntry::hasEmissiveMap : 0);
+
+	// update after bind, so the set may be in use by frames in flight that do not draw this slot
+	m_vulkanManager.beginUpdateDescriptorSet(m_materialDescriptorSet);
+	m_vulkanManager.descriptorSetAddImageDescriptor(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, imageInfos, firstTexture);
+	m_vulkanManager.endUpdateDescriptorSet();
 
-			m_vulkanManager.beginUpdateDescriptorSet(m_perFrameDescriptorSets[imgIdx].m_shadowDescriptorSets1[i]);
+	MaterialTableEntry *materials = reinterpret_cast<MaterialTableEntry *>(m_vulkanManager.mapBufferPersistently(m_materialTableDeviceData.buffer));
+	materials[meshIdx] = material;
+}
 
-			bufferInfos[0].bufferName = m_perFrameUniformDeviceData[imgIdx].buffer;
-			bufferInfos[0].offset = m_perFrameUniformHostData.offsetOf(reinterpret_cast<const char *>(m_uShadowLightInfos[i]));
-			bufferInfos[0].sizeInBytes = sizeof(ShadowLightUniformBuffer);
-			m_vulkanManager.descriptorSetAddBufferDescriptor(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, bufferInfos);
+void DeferredRenderer::createShadowPassDescriptorSets()
+{
+	const uint32_t frameCount = MAX_FRAMES_IN_FLIGHT;
+	const uint32_t segmentCount = m_camera.getSegmentCount();
 
-			m_vulkanManager.endUpdateDescriptorSet();
-		}
+	// the cascade sets of all frames go in one call, then the per-frame sets in another
+	std::vector<ShadowPassDescriptors1> descriptors1(frameCount * segmentCount);
+	std::vector<uint32_t> sets1(frameCount * segmentCount);
+	std::array<ShadowPassDescriptors2, MAX_FRAMES_IN_FLIGHT> descriptors2;
+	std::array<uint32_t, MAX_FRAMES_IN_FLIGHT> sets2;
 
-		for (uint32_t i = 0; i < m_scene.meshes.size(); ++i)
+	for (uint32_t frameIdx = 0; frameIdx < frameCount; ++frameIdx)
+	{
+		for (uint32_t i = 0; i < segmentCount; ++i)
 		{
-			std::vector<rj::DescriptorSetUpdateBufferInfo> bufferInfos(1);
-
-			m_vulkanManager.beginUpdateDescriptorSet(m_perFrameDescriptorSets[imgIdx].m_shadowDescriptorSets2[i]);
-
-			bufferInfos[0].bufferName = m_perFrameUniformDeviceData[imgIdx].buffer;
-			bufferInfos[0].offset = m_perFrameUniformHostData.offsetOf(reinterpret_cast<const char *>(m_scene.meshes[i].uPerModelInfo));
-			bufferInfos[0].sizeInBytes = sizeof(PerModelUniformBuffer);
-			m_vulkanManager.descriptorSetAddBufferDescriptor(1, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, bufferInfos);
-
-			m_vulkanManager.endUpdateDescriptorSet();
+			descriptors1[frameIdx * segmentCount + i].cascadeVP = m_vulkanManager.getDescriptorBufferInfo(m_perFrameUniformDeviceData[frameIdx].buffer,
+				m_perFrameUniformDeviceData[frameIdx].offset + m_perFrameUniformHostData.offsetOf(reinterpret_cast<const char *>(m_uShadowLightInfos[i])),
+				sizeof(ShadowLightUniformBuffer));
+			sets1[frameIdx * segmentCount + i] = m_perFrameDescriptorSets[frameIdx].m_shadowDescriptorSets1[i];
 		}
+
+		descriptors2[frameIdx].objectTransforms = m_vulkanManager.getDescriptorBufferInfo(m_perFrameObjectTransformDeviceData[frameIdx].buffer,
+			0, m_perFrameObjectTransformDeviceData[frameIdx].size);
+		descriptors2[frameIdx].instanceObjects = m_vulkanManager.getDescriptorBufferInfo(m_shadowInstanceObjectDeviceData.buffer,
+			0, m_shadowInstanceObjectDeviceData.size);
+		sets2[frameIdx] = m_perFrameDescriptorSets[frameIdx].m_shadowDescriptorSet2;
 	}
+
+	m_vulkanManager.updateDescriptorSetsWithTemplate(sets1.data(), frameCount * segmentCount, m_shadowDescriptorUpdateTemplate1,
+		descriptors1.data(), sizeof(ShadowPassDescriptors1));
+	m_vulkanManager.updateDescriptorSetsWithTemplate(sets2.data(), frameCount, m_shadowDescriptorUpdateTemplate2,
+		descriptors2.data(), sizeof(ShadowPassDescriptors2));
 }
 
 void DeferredRenderer::createLightingPassDescriptorSets()
 {
-	const uint32_t swapChainImageCount = m_vulkanManager.getSwapChainSize();
-	for (uint32_t imgIdx = 0; imgIdx < swapChainImageCount; ++imgIdx)
+	const uint32_t frameCount = MAX_FRAMES_IN_FLIGHT;
+	for (uint32_t frameIdx = 0; frameIdx < frameCount; ++frameIdx)
 	{
 		std::vector<rj::DescriptorSetUpdateBufferInfo> bufferInfos(1);
 		std::vector<rj::DescriptorSetUpdateImageInfo> imageInfos(1);
 
-		m_vulkanManager.beginUpdateDescriptorSet(m_perFrameDescriptorSets[imgIdx].m_lightingDescriptorSet);
+		m_vulkanManager.beginUpdateDescriptorSet(m_perFrameDescriptorSets[frameIdx].m_lightingDescriptorSet);
 
-		bufferInfos[0].bufferName = m_perFrameUniformDeviceData[imgIdx].buffer;
-		bufferInfos[0].offset = m_perFrameUniformHostData.offsetOf(reinterpret_cast<const char *>(m_uLightInfo));
+		bufferInfos[0].bufferName = m_perFrameUniformDeviceData[frameIdx].buffer;
+		bufferInfos[0].offset = m_perFrameUniformDeviceData[frameIdx].offset + m_perFrameUniformHostData.offsetOf(reinterpret_cast<const char *>(m_uLightInfo));
 		bufferInfos[0].sizeInBytes = sizeof(LightingPassUniformBuffer);
 		m_vulkanManager.descriptorSetAddBufferDescriptor(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, bufferInfos);
 
@@ -1741,25 +2911,25 @@ void DeferredRenderer::createLightingPassDescriptorSets()
 
 void DeferredRenderer::createBloomDescriptorSets()
 {
-	const uint32_t swapChainImageCount = m_vulkanManager.getSwapChainSize();
-	for (uint32_t imgIdx = 0; imgIdx < swapChainImageCount; ++imgIdx)
+	const uint32_t frameCount = MAX_FRAMES_IN_FLIGHT;
+	for (uint32_t frameIdx = 0; frameIdx < frameCount; ++frameIdx)
 	{
 		std::vector<rj::DescriptorSetUpdateImageInfo> imageInfos(1);
 
-		m_vulkanManager.beginUpdateDescriptorSet(m_perFrameDescriptorSets[imgIdx].m_bloomDescriptorSets[0]);
+		m_vulkanManager.beginUpdateDescriptorSet(m_perFrameDescriptorSets[frameIdx].m_bloomDescriptorSets[0]);
 		imageInfos[0].layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 		imageInfos[0].imageViewName = m_lightingResultImage.imageViews[0];
 		imageInfos[0].samplerName = m_lightingResultImage.samplers[0];
 		m_vulkanManager.descriptorSetAddImageDescriptor(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, imageInfos);
 		m_vulkanManager.endUpdateDescriptorSet();
 
-		m_vulkanManager.beginUpdateDescriptorSet(m_perFrameDescriptorSets[imgIdx].m_bloomDescriptorSets[1]);
+		m_vulkanManager.beginUpdateDescriptorSet(m_perFrameDescriptorSets[frameIdx].m_bloomDescriptorSets[1]);
 		imageInfos[0].imageViewName = m_postEffectImages[0].imageViews[0];
 		imageInfos[0].samplerName = m_postEffectImages[0].samplers[0];
 		m_vulkanManager.descriptorSetAddImageDescriptor(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, imageInfos);
 		m_vulkanManager.endUpdateDescriptorSet();
 
-		m_vulkanManager.beginUpdateDescriptorSet(m_perFrameDescriptorSets[imgIdx].m_bloomDescriptorSets[2]);
+		m_vulkanManager.beginUpdateDescriptorSet(m_perFrameDescriptorSets[frameIdx].m_bloomDescriptorSets[2]);
 		imageInfos[0].imageViewName = m_postEffectImages[1].imageViews[0];
 		imageInfos[0].samplerName = m_postEffectImages[1].samplers[0];
 		m_vulkanManager.descriptorSetAddImageDescriptor(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, imageInfos);
@@ -1769,16 +2939,16 @@ void DeferredRenderer::createBloomDescriptorSets()
 
 void DeferredRenderer::createFinalOutputPassDescriptorSets()
 {
-	const uint32_t swapChainImageCount = m_vulkanManager.getSwapChainSize();
-	for (uint32_t imgIdx = 0; imgIdx < swapChainImageCount; ++imgIdx)
+	const uint32_t frameCount = MAX_FRAMES_IN_FLIGHT;
+	for (uint32_t frameIdx = 0; frameIdx < frameCount; ++frameIdx)
 	{
 		std::vector<rj::DescriptorSetUpdateBufferInfo> bufferInfos(1);
 		std::vector<rj::DescriptorSetUpdateImageInfo> imageInfos(1);
 
-		m_vulkanManager.beginUpdateDescriptorSet(m_perFrameDescriptorSets[imgIdx].m_finalOutputDescriptorSet);
+		m_vulkanManager.beginUpdateDescriptorSet(m_perFrameDescriptorSets[frameIdx].m_finalOutputDescriptorSet);
 
-		bufferInfos[0].bufferName = m_perFrameUniformDeviceData[imgIdx].buffer;
-		bufferInfos[0].offset = m_perFrameUniformHostData.offsetOf(reinterpret_cast<const char *>(m_uDisplayInfo));
+		bufferInfos[0].bufferName = m_perFrameUniformDeviceData[frameIdx].buffer;
+		bufferInfos[0].offset = m_perFrameUniformDeviceData[frameIdx].offset + m_perFrameUniformHostData.offsetOf(reinterpret_cast<const char *>(m_uDisplayInfo));
 		bufferInfos[0].sizeInBytes = sizeof(DisplayInfoUniformBuffer);
 		m_vulkanManager.descriptorSetAddBufferDescriptor(5, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, bufferInfos);
 
@@ -1868,233 +3038,387 @@ void DeferredRenderer::createEnvPrefilterCommandBuffer()
 	m_vulkanManager.endCommandBuffer(m_envPrefilterCommandBuffer);
 }
 
-void DeferredRenderer::createGeomShadowLightingCommandBuffers()
+void DeferredRenderer::recordFrameCommandBuffers(uint32_t frameIdx, uint32_t imageIdx)
 {
-	const uint32_t swapChainImageCount = m_vulkanManager.getSwapChainSize();
-	for (uint32_t imgIdx = 0; imgIdx < swapChainImageCount; ++imgIdx)
+	typedef std::chrono::high_resolution_clock Clock;
+	const auto start = Clock::now();
+
+	// none of the frame's command buffers is pending, so its pools can be reset wholesale
+	// instead of resetting command buffers one by one
+	const auto &frameCommandBuffers = m_perFrameCommandBuffers[frameIdx];
+	m_vulkanManager.resetCommandPool(frameCommandBuffers.m_commandPool);
+	for (auto pool : frameCommandBuffers.m_threadCommandPools)
 	{
-		uint32_t cb = m_perFrameCommandBuffers[imgIdx].m_geomShadowLightingCommandBuffer;
-		m_vulkanManager.beginCommandBuffer(cb, VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT);
+		m_vulkanManager.resetCommandPool(pool);
+	}
 
-		m_vulkanManager.cmdResetQueryPool(cb, m_perFrameQueryPools[imgIdx], 0, TQI_QUERY_COUNT);
-		m_vulkanManager.cmdWriteTimestamp(cb, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_perFrameQueryPools[imgIdx], TQI_GEOM_START);
+	recordGeomShadowLightingCommandBuffer(frameIdx);
+	recordPostEffectCommandBuffer(frameIdx);
+	recordPresentCommandBuffer(frameIdx, imageIdx);
 
-		std::vector<VkClearValue> clearValues(4);
-		clearValues[0].depthStencil = { 1.0f, 0 };
-		clearValues[1].color = { { 0.0f, 0.0f, 0.0f, 0.0f } }; // g-buffer 1
-		clearValues[2].color = { { 0.0f, 0.0f, 0.0f, 0.0f } }; // g-buffer 2
-		clearValues[3].color = { { 0.0f, 0.0f, 0.0f, 0.0f } }; // g-buffer 3
-		m_vulkanManager.cmdBeginRenderPass(cb, m_geomRenderPass, m_geomFramebuffer, clearValues);
+	m_commandRecordTimeCalculator.addFrameTime(static_cast<float>(std::chrono::duration<double, std::milli>(Clock::now() - start).count()));
+}
 
-		// Geometry pass
+void DeferredRenderer::recordGeomShadowLightingCommandBuffer(uint32_t frameIdx)
+{
+	// commands and instance lists are laid out by mesh slot, culling only has to go over the used object slots
+	const uint32_t objectCount = static_cast<uint32_t>(m_scene.instances.size());
+	const uint32_t meshCount = m_meshCapacity;
+	const uint32_t secondPhaseFirstCommand = meshCount;
+	const uint32_t cullGroupSize = 64, hizGroupSize = 16;
+
+	struct
+	{
+		uint32_t objectCount;
+		uint32_t phase;
+		uint32_t secondPhaseFirstCommand;
+		int32_t hizLevelCount;
+		int32_t hizSize[2];
+	} cullPushConst;
+	cullPushConst.objectCount = objectCount;
+	cullPushConst.phase = 0;
+	cullPushConst.secondPhaseFirstCommand = secondPhaseFirstCommand;
+	cullPushConst.hizLevelCount = static_cast<int32_t>(m_hizImage.mipLevelCount);
+	cullPushConst.hizSize[0] = static_cast<int32_t>(m_hizImage.width);
+	cullPushConst.hizSize[1] = static_cast<int32_t>(m_hizImage.height);
+
+	// Secondary command buffers, recorded in parallel before the primary is begun (a thread must not
+	// record two command buffers at once, see VManager::beginCommandBuffer()): chunks of the geometry pass draws
+	// for each of the two culling phases, then one per shadow cascade subpass
+	const uint32_t geomChunkCount = getGeomPassSecondaryChunkCount();
+	const uint32_t cascadeCount = m_camera.getSegmentCount();
+	const uint32_t taskCount = 2 * geomChunkCount + cascadeCount;
+	const auto &drawOrder = m_frameSnapshots.getFront().geomDrawOrder;
+	const uint32_t drawCount = static_cast<uint32_t>(drawOrder.size());
+	const uint32_t drawsPerChunk = (drawCount + geomChunkCount - 1) / geomChunkCount;
+	m_secondaryTaskCommandBuffers.resize(taskCount);
+
+	// secondaries inherit no state, each one binds everything it uses
+	auto recordMeshDraws = [&](uint32_t scb, uint32_t firstCommand, uint32_t firstDraw, uint32_t lastDraw)
+	{
+		m_vulkanManager.cmdBindPipeline(scb, VK_PIPELINE_BIND_POINT_GRAPHICS, m_geomPipeline);
+
+		// meshes are ranges of the geometry pool, the draw commands carry their offsets
+		m_vulkanManager.cmdBindVertexBuffers(scb, { m_scene.geometryPool.getBuffer(GeometryPool::STREAM_VERTEX) }, { 0 });
+		m_vulkanManager.cmdBindIndexBuffer(scb, m_scene.geometryPool.getBuffer(GeometryPool::STREAM_INDEX), VK_INDEX_TYPE_UINT32);
+
+		// Objects are found through the instance lists and their materials through the object meshes,
+		// so both sets are the same for every draw
+		m_vulkanManager.cmdBindDescriptorSets(scb, VK_PIPELINE_BIND_POINT_GRAPHICS,
+			m_geomPipelineLayout, { m_perFrameDescriptorSets[frameIdx].m_geomDescriptorSet, m_materialDescriptorSet });
+
+		// one instanced draw per mesh, instances are appended by the occlusion culling shader
+		for (uint32_t d = firstDraw; d < lastDraw; ++d)
 		{
-			m_vulkanManager.cmdBindPipeline(cb, VK_PIPELINE_BIND_POINT_GRAPHICS, m_skyboxPipeline);
+			const uint32_t j = drawOrder[d];
+			m_vulkanManager.cmdDrawIndexedIndirect(scb, m_drawCommandDeviceData.buffer,
+				(firstCommand + j) * sizeof(VkDrawIndexedIndirectCommand));
+		}
+	};
+
+	auto recordSkybox = [&](uint32_t scb)
+	{
+		m_vulkanManager.cmdBindPipeline(scb, VK_PIPELINE_BIND_POINT_GRAPHICS, m_skyboxPipeline);
 
-			m_vulkanManager.cmdBindVertexBuffers(cb, { m_scene.skybox.vertexBuffer.buffer }, { 0 });
-			m_vulkanManager.cmdBindIndexBuffer(cb, m_scene.skybox.indexBuffer.buffer, VK_INDEX_TYPE_UINT32);
+		m_vulkanManager.cmdBindVertexBuffers(scb, { m_scene.skybox.vertexBuffer.buffer }, { 0 });
+		m_vulkanManager.cmdBindIndexBuffer(scb, m_scene.skybox.indexBuffer.buffer, VK_INDEX_TYPE_UINT32);
 
-			m_vulkanManager.cmdBindDescriptorSets(cb, VK_PIPELINE_BIND_POINT_GRAPHICS,
-				m_skyboxPipelineLayout, { m_perFrameDescriptorSets[imgIdx].m_skyboxDescriptorSet });
-			m_vulkanManager.cmdPushConstants(cb, m_skyboxPipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(uint32_t), &m_scene.skybox.materialType);
+		m_vulkanManager.cmdBindDescriptorSets(scb, VK_PIPELINE_BIND_POINT_GRAPHICS,
+			m_skyboxPipelineLayout, { m_perFrameDescriptorSets[frameIdx].m_skyboxDescriptorSet });
+		m_vulkanManager.cmdPushConstants(scb, m_skyboxPipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(uint32_t), &m_scene.skybox.materialType);
 
-			const uint32_t numIndices = static_cast<uint32_t>(m_scene.skybox.indexBuffer.size / sizeof(uint32_t));
-			m_vulkanManager.cmdDrawIndexed(cb, numIndices);
-		}
+		const uint32_t numIndices = static_cast<uint32_t>(m_scene.skybox.indexBuffer.size / sizeof(uint32_t));
+		m_vulkanManager.cmdDrawIndexed(scb, numIndices);
+	};
+
+	auto recordShadowCascade = [&](uint32_t scb, uint32_t cascadeIdx)
+	{
+		// all meshes share one position stream, so each cascade is a single multi-draw
+		m_vulkanManager.cmdBindVertexBuffers(scb, { m_scene.geometryPool.getBuffer(GeometryPool::STREAM_POSITION) }, { 0 });
+		m_vulkanManager.cmdBindIndexBuffer(scb, m_scene.geometryPool.getBuffer(GeometryPool::STREAM_POSITION_INDEX), VK_INDEX_TYPE_UINT32);
+
+		m_vulkanManager.cmdBindPipeline(scb, VK_PIPELINE_BIND_POINT_GRAPHICS, m_shadowPipelines[cascadeIdx]);
+		m_vulkanManager.cmdBindDescriptorSets(scb, VK_PIPELINE_BIND_POINT_GRAPHICS, m_shadowPipelineLayout,
+			{ m_perFrameDescriptorSets[frameIdx].m_shadowDescriptorSets1[cascadeIdx], m_perFrameDescriptorSets[frameIdx].m_shadowDescriptorSet2 });
+
+		m_vulkanManager.cmdDrawIndexedIndirect(scb, m_shadowDrawCommandDeviceData.buffer,
+			cascadeIdx * meshCount * sizeof(VkDrawIndexedIndirectCommand), meshCount);
+	};
 
-		m_vulkanManager.cmdBindPipeline(cb, VK_PIPELINE_BIND_POINT_GRAPHICS, m_geomPipeline);
+	m_threadPool.parallelFor(taskCount, [&](uint32_t taskIdx, uint32_t threadIdx)
+	{
+		const uint32_t scb = m_perFrameCommandBuffers[frameIdx].m_secondaryCommandBuffers[threadIdx][taskIdx];
+		m_secondaryTaskCommandBuffers[taskIdx] = scb;
 
-		const uint32_t numModels = static_cast<uint32_t>(m_scene.meshes.size());
-		for (uint32_t j = 0; j < numModels; ++j)
+		if (taskIdx < 2 * geomChunkCount)
+		{
+			const uint32_t phase = taskIdx / geomChunkCount;
+			const uint32_t chunk = taskIdx % geomChunkCount;
+			m_vulkanManager.beginSecondaryCommandBuffer(scb, phase == 0 ? m_geomRenderPass : m_geomLoadRenderPass, 0,
+				m_geomFramebuffer, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+
+			if (phase == 0 && chunk == 0) recordSkybox(scb);
+			recordMeshDraws(scb, phase == 0 ? 0 : secondPhaseFirstCommand, std::min(chunk * drawsPerChunk, drawCount),
+				std::min((chunk + 1) * drawsPerChunk, drawCount));
+		}
+		else
 		{
-			m_vulkanManager.cmdBindVertexBuffers(cb, { m_scene.meshes[j].vertexBuffer.buffer }, { 0 });
-			m_vulkanManager.cmdBindIndexBuffer(cb, m_scene.meshes[j].indexBuffer.buffer, VK_INDEX_TYPE_UINT32);
+			const uint32_t cascadeIdx = taskIdx - 2 * geomChunkCount;
+			m_vulkanManager.beginSecondaryCommandBuffer(scb, m_shadowRenderPass, cascadeIdx,
+				m_shadowFramebuffer, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
 
-			m_vulkanManager.cmdBindDescriptorSets(cb, VK_PIPELINE_BIND_POINT_GRAPHICS,
-				m_geomPipelineLayout, { m_perFrameDescriptorSets[imgIdx].m_geomDescriptorSets[j] });
+			recordShadowCascade(scb, cascadeIdx);
+		}
 
-			struct
-			{
-				uint32_t materialId;
-				uint32_t hasAoMap;
-				uint32_t hasEmissiveMap;
-			} pushConst;
-			pushConst.materialId = m_scene.meshes[j].materialType;
-			pushConst.hasAoMap = m_scene.meshes[j].aoMap.image != std::numeric_limits<uint32_t>::max();
-			pushConst.hasEmissiveMap = m_scene.meshes[j].emissiveMap.image != std::numeric_limits<uint32_t>::max();
-
-			m_vulkanManager.cmdPushConstants(cb, m_geomPipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(pushConst), &pushConst);
-
-			const uint32_t numIndices = static_cast<uint32_t>(m_scene.meshes[j].indexBuffer.size / sizeof(uint32_t));
-			m_vulkanManager.cmdDrawIndexed(cb, numIndices);
+		m_vulkanManager.endCommandBuffer(scb);
+	});
+
+	const rj::ArrayRef<uint32_t> firstPhaseCommandBuffers(m_secondaryTaskCommandBuffers.data(), geomChunkCount);
+	const rj::ArrayRef<uint32_t> secondPhaseCommandBuffers(m_secondaryTaskCommandBuffers.data() + geomChunkCount, geomChunkCount);
+
+	uint32_t cb = m_perFrameCommandBuffers[frameIdx].m_geomShadowLightingCommandBuffer;
+	m_vulkanManager.beginCommandBuffer(cb, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+
+	// Attachments, the depth pyramid and the culling buffers are shared by all frames in flight.
+	// Everything submitted before, i.e. the previous frame, has to be done with them before they are overwritten
+	m_vulkanManager.cmdPipelineBarrier(cb, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+		VK_ACCESS_MEMORY_WRITE_BIT, VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT);
+
+	m_vulkanManager.cmdResetQueryPool(cb, m_perFrameQueryPools[frameIdx], 0, TQI_QUERY_COUNT);
+	m_vulkanManager.cmdWriteTimestamp(cb, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_perFrameQueryPools[frameIdx], TQI_GEOM_START);
+
+	// Shadow caster culling, appends the casters of each cascade to the instanced draws of their meshes.
+	// The geometry pass draws are reset here as well, for the occlusion culling below
+	{
+		m_vulkanManager.cmdFillBuffer(cb, m_shadowDrawCountDeviceData.buffer, 0, VK_WHOLE_SIZE, 0);
+		m_vulkanManager.cmdCopyBuffer(cb, m_shadowDrawCommandResetDeviceData.buffer, m_shadowDrawCommandDeviceData.buffer,
+			m_shadowDrawCommandDeviceData.size);
+		m_vulkanManager.cmdCopyBuffer(cb, m_drawCommandResetDeviceData.buffer, m_drawCommandDeviceData.buffer,
+			m_drawCommandDeviceData.size);
+		m_vulkanManager.cmdPipelineBarrier(cb, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+
+		m_vulkanManager.cmdBindPipeline(cb, VK_PIPELINE_BIND_POINT_COMPUTE, m_drawCullPipeline);
+		m_vulkanManager.cmdBindDescriptorSets(cb, VK_PIPELINE_BIND_POINT_COMPUTE,
+			m_drawCullPipelineLayout, { m_perFrameDescriptorSets[frameIdx].m_drawCullDescriptorSet });
+		const uint32_t drawCullPushConst[] = { objectCount, meshCount };
+		m_vulkanManager.cmdPushConstants(cb, m_drawCullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(drawCullPushConst), drawCullPushConst);
+		m_vulkanManager.cmdDispatch(cb, (objectCount + cullGroupSize - 1) / cullGroupSize, m_camera.getSegmentCount(), 1);
+	}
+
+	// Occlusion culling first phase, only meshes that were visible last frame are drawn
+	m_vulkanManager.cmdBindPipeline(cb, VK_PIPELINE_BIND_POINT_COMPUTE, m_occlusionCullPipeline);
+	m_vulkanManager.cmdBindDescriptorSets(cb, VK_PIPELINE_BIND_POINT_COMPUTE,
+		m_occlusionCullPipelineLayout, { m_perFrameDescriptorSets[frameIdx].m_occlusionCullDescriptorSet });
+	m_vulkanManager.cmdPushConstants(cb, m_occlusionCullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(cullPushConst), &cullPushConst);
+	m_vulkanManager.cmdDispatch(cb, (objectCount + cullGroupSize - 1) / cullGroupSize, 1, 1);
+
+	// also covers the shadow draws, instance lists are read by the vertex shaders
+	m_vulkanManager.cmdPipelineBarrier(cb, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_HOST_BIT,
+		VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_HOST_READ_BIT);
+
+	// shared by the g-buffers and the shadow cascades
+	static_assert(CSM_MAX_SEG_COUNT <= 4, "too many cascades for the clear values");
+	VkClearValue clearValues[4] = {};
+	clearValues[0].depthStencil = { 1.0f, 0 };
+	clearValues[1].color = { { 0.0f, 0.0f, 0.0f, 0.0f } }; // g-buffer 1
+	clearValues[2].color = { { 0.0f, 0.0f, 0.0f, 0.0f } }; // g-buffer 2
+	clearValues[3].color = { { 0.0f, 0.0f, 0.0f, 0.0f } }; // g-buffer 3
+	// Geometry pass, skybox and the first phase draws
+	m_vulkanManager.cmdBeginRenderPass(cb, m_geomRenderPass, m_geomFramebuffer, { clearValues, 4 }, {}, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+	m_vulkanManager.cmdExecuteCommands(cb, firstPhaseCommandBuffers);
+	m_vulkanManager.cmdEndRenderPass(cb);
+
+	// Hi-Z pyramid from the depth of the first phase
+	{
+		const int32_t sampleCount = static_cast<int32_t>(SAMPLE_COUNT);
+		m_vulkanManager.cmdBindPipeline(cb, VK_PIPELINE_BIND_POINT_COMPUTE, m_depthResolvePipeline);
+		m_vulkanManager.cmdBindDescriptorSets(cb, VK_PIPELINE_BIND_POINT_COMPUTE, m_depthResolvePipelineLayout, { m_depthResolveDescriptorSet });
+		m_vulkanManager.cmdPushConstants(cb, m_depthResolvePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(sampleCount), &sampleCount);
+		m_vulkanManager.cmdDispatch(cb, (m_hizImage.width + hizGroupSize - 1) / hizGroupSize, (m_hizImage.height + hizGroupSize - 1) / hizGroupSize, 1);
+
+		m_vulkanManager.cmdBindPipeline(cb, VK_PIPELINE_BIND_POINT_COMPUTE, m_hizDownsamplePipeline);
+		for (uint32_t level = 1; level < m_hizImage.mipLevelCount; ++level)
+		{
+			m_vulkanManager.cmdPipelineBarrier(cb, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+				VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT);
+
+			const uint32_t levelWidth = std::max(m_hizImage.width >> level, 1u);
+			const uint32_t levelHeight = std::max(m_hizImage.height >> level, 1u);
+			m_vulkanManager.cmdBindDescriptorSets(cb, VK_PIPELINE_BIND_POINT_COMPUTE,
+				m_hizDownsamplePipelineLayout, { m_hizDownsampleDescriptorSets[level - 1] });
+			m_vulkanManager.cmdDispatch(cb, (levelWidth + hizGroupSize - 1) / hizGroupSize, (levelHeight + hizGroupSize - 1) / hizGroupSize, 1);
 		}
 
-		m_vulkanManager.cmdEndRenderPass(cb);
+		m_vulkanManager.cmdPipelineBarrier(cb, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT);
+	}
 
-		m_vulkanManager.cmdWriteTimestamp(cb, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_perFrameQueryPools[imgIdx], TQI_GEOM_END);
+	// Occlusion culling second phase, re-test everything in the frustum against the new pyramid
+	// and draw the meshes the first phase wrongly skipped. Visibility is also read back on the host
+	cullPushConst.phase = 1;
+	m_vulkanManager.cmdBindPipeline(cb, VK_PIPELINE_BIND_POINT_COMPUTE, m_occlusionCullPipeline);
+	m_vulkanManager.cmdBindDescriptorSets(cb, VK_PIPELINE_BIND_POINT_COMPUTE,
+		m_occlusionCullPipelineLayout, { m_perFrameDescriptorSets[frameIdx].m_occlusionCullDescriptorSet });
+	m_vulkanManager.cmdPushConstants(cb, m_occlusionCullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(cullPushConst), &cullPushConst);
+	m_vulkanManager.cmdDispatch(cb, (objectCount + cullGroupSize - 1) / cullGroupSize, 1, 1);
 
-		// Shadow pass
-		m_vulkanManager.cmdWriteTimestamp(cb, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_perFrameQueryPools[imgIdx], TQI_SHADOW_START);
+	m_vulkanManager.cmdPipelineBarrier(cb, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_HOST_BIT,
+		VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_HOST_READ_BIT);
 
-		clearValues.resize(m_camera.getSegmentCount());
-		for (uint32_t i = 0; i < m_camera.getSegmentCount(); ++i) clearValues[i].depthStencil = { 1.f, 0 };
-		m_vulkanManager.cmdBeginRenderPass(cb, m_shadowRenderPass, m_shadowFramebuffer, clearValues);
+	m_vulkanManager.cmdBeginRenderPass(cb, m_geomLoadRenderPass, m_geomFramebuffer, { clearValues, 4 }, {}, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+	m_vulkanManager.cmdExecuteCommands(cb, secondPhaseCommandBuffers);
+	m_vulkanManager.cmdEndRenderPass(cb);
 
-		for (uint32_t i = 0; i < m_camera.getSegmentCount(); ++i)
-		{
-			if (i > 0) m_vulkanManager.cmdNextSubpass(cb);
+	m_vulkanManager.cmdWriteTimestamp(cb, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_perFrameQueryPools[frameIdx], TQI_GEOM_END);
 
-			m_vulkanManager.cmdBindPipeline(cb, VK_PIPELINE_BIND_POINT_GRAPHICS, m_shadowPipelines[i]);
+	// Shadow pass
+	m_vulkanManager.cmdWriteTimestamp(cb, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_perFrameQueryPools[frameIdx], TQI_SHADOW_START);
 
-			for (uint32_t j = 0; j < numModels; ++j)
-			{
-				m_vulkanManager.cmdBindVertexBuffers(cb, { m_scene.meshes[j].vertexBuffer.buffer }, { 0 });
-				m_vulkanManager.cmdBindIndexBuffer(cb, m_scene.meshes[j].indexBuffer.buffer, VK_INDEX_TYPE_UINT32);
+	for (uint32_t i = 0; i < cascadeCount; ++i) clearValues[i].depthStencil = { 1.f, 0 };
+	m_vulkanManager.cmdBeginRenderPass(cb, m_shadowRenderPass, m_shadowFramebuffer, { clearValues, cascadeCount }, {}, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
 
-				m_vulkanManager.cmdBindDescriptorSets(cb, VK_PIPELINE_BIND_POINT_GRAPHICS, m_shadowPipelineLayout,
-					{ m_perFrameDescriptorSets[imgIdx].m_shadowDescriptorSets1[i], m_perFrameDescriptorSets[imgIdx].m_shadowDescriptorSets2[j] });
+	for (uint32_t i = 0; i < cascadeCount; ++i)
+	{
+		if (i > 0) m_vulkanManager.cmdNextSubpass(cb, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+		m_vulkanManager.cmdExecuteCommands(cb, { m_secondaryTaskCommandBuffers[2 * geomChunkCount + i] });
+	}
 
-				const uint32_t numIndices = static_cast<uint32_t>(m_scene.meshes[j].indexBuffer.size / sizeof(uint32_t));
-				m_vulkanManager.cmdDrawIndexed(cb, numIndices);
-			}
-		}
+	m_vulkanManager.cmdEndRenderPass(cb);
 
-		m_vulkanManager.cmdEndRenderPass(cb);
+	m_vulkanManager.cmdWriteTimestamp(cb, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_perFrameQueryPools[frameIdx], TQI_SHADOW_END);
 
-		m_vulkanManager.cmdWriteTimestamp(cb, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_perFrameQueryPools[imgIdx], TQI_SHADOW_END);
+	// Lighting pass
+	m_vulkanManager.cmdWriteTimestamp(cb, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_perFrameQueryPools[frameIdx], TQI_LIGHTING_START);
 
-		// Lighting pass
-		m_vulkanManager.cmdWriteTimestamp(cb, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_perFrameQueryPools[imgIdx], TQI_LIGHTING_START);
+	clearValues[0].color = { { 0.f, 0.f, 0.f, 0.f } };
+	m_vulkanManager.cmdBeginRenderPass(cb, m_lightingRenderPass, m_lightingFramebuffer, { clearValues, 1 });
 
-		clearValues.resize(1);
-		clearValues[0].color = { { 0.f, 0.f, 0.f, 0.f } };
-		m_vulkanManager.cmdBeginRenderPass(cb, m_lightingRenderPass, m_lightingFramebuffer, clearValues);
+	m_vulkanManager.cmdBindPipeline(cb, VK_PIPELINE_BIND_POINT_GRAPHICS, m_lightingPipeline);
+	m_vulkanManager.cmdBindDescriptorSets(cb, VK_PIPELINE_BIND_POINT_GRAPHICS,
+		m_lightingPipelineLayout, { m_perFrameDescriptorSets[frameIdx].m_lightingDescriptorSet });
 
-		m_vulkanManager.cmdBindPipeline(cb, VK_PIPELINE_BIND_POINT_GRAPHICS, m_lightingPipeline);
-		m_vulkanManager.cmdBindDescriptorSets(cb, VK_PIPELINE_BIND_POINT_GRAPHICS,
-			m_lightingPipelineLayout, { m_perFrameDescriptorSets[imgIdx].m_lightingDescriptorSet });
+	struct
+	{
+		uint32_t specIrradianceMapMipCount;
+		int32_t frustumSegmentCount;
+		int32_t pcfKernelSize;
+	} pushConst;
+	pushConst.specIrradianceMapMipCount = m_scene.skybox.specularIrradianceMap.mipLevelCount;
+	pushConst.frustumSegmentCount = m_camera.getSegmentCount();
+	pushConst.pcfKernelSize = m_scene.shadowLight.getPCFKernlSize();
+	m_vulkanManager.cmdPushConstants(cb, m_lightingPipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(pushConst), &pushConst);
 
-		struct
-		{
-			uint32_t specIrradianceMapMipCount;
-			int32_t frustumSegmentCount;
-			int32_t pcfKernelSize;
-		} pushConst;
-		pushConst.specIrradianceMapMipCount = m_scene.skybox.specularIrradianceMap.mipLevelCount;
-		pushConst.frustumSegmentCount = m_camera.getSegmentCount();
-		pushConst.pcfKernelSize = m_scene.shadowLight.getPCFKernlSize();
-		m_vulkanManager.cmdPushConstants(cb, m_lightingPipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(pushConst), &pushConst);
+	m_vulkanManager.cmdDraw(cb, 3);
 
-		m_vulkanManager.cmdDraw(cb, 3);
+	m_vulkanManager.cmdEndRenderPass(cb);
 
-		m_vulkanManager.cmdEndRenderPass(cb);
+	m_vulkanManager.cmdWriteTimestamp(cb, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_perFrameQueryPools[frameIdx], TQI_LIGHTING_END);
 
-		m_vulkanManager.cmdWriteTimestamp(cb, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_perFrameQueryPools[imgIdx], TQI_LIGHTING_END);
+	m_vulkanManager.endCommandBuffer(cb);
+}
 
-		m_vulkanManager.endCommandBuffer(cb);
-	}
+uint32_t DeferredRenderer::getGeomPassSecondaryChunkCount() const
+{
+	// fixed by the mesh capacity, so that the secondaries can be allocated up front
+	return std::max((m_meshCapacity + GEOM_DRAWS_PER_SECONDARY - 1) / GEOM_DRAWS_PER_SECONDARY, 1u);
 }
 
-void DeferredRenderer::createPostEffectCommandBuffers()
+void DeferredRenderer::recordPostEffectCommandBuffer(uint32_t frameIdx)
 {
-	const uint32_t swapChainImageCount = m_vulkanManager.getSwapChainSize();
-	for (uint32_t imgIdx = 0; imgIdx < swapChainImageCount; ++imgIdx)
-	{
-		uint32_t cb = m_perFrameCommandBuffers[imgIdx].m_postEffectCommandBuffer;
-		m_vulkanManager.beginCommandBuffer(cb, VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT);
+	uint32_t cb = m_perFrameCommandBuffers[frameIdx].m_postEffectCommandBuffer;
+	m_vulkanManager.beginCommandBuffer(cb, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
 
-		m_vulkanManager.cmdWriteTimestamp(cb, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_perFrameQueryPools[imgIdx], TQI_BLOOM_START);
+	m_vulkanManager.cmdWriteTimestamp(cb, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_perFrameQueryPools[frameIdx], TQI_BLOOM_START);
 
-		// brightness mask
-		std::vector<VkClearValue> clearValues(1);
-		clearValues[0].color = { { 0.0f, 0.0f, 0.0f, 0.0f } };
-		m_vulkanManager.cmdBeginRenderPass(cb, m_bloomRenderPasses[0], m_postEffectFramebuffers[0], clearValues);
+	// brightness mask
+	VkClearValue clearValues[1];
+	clearValues[0].color = { { 0.0f, 0.0f, 0.0f, 0.0f } };
+	m_vulkanManager.cmdBeginRenderPass(cb, m_bloomRenderPasses[0], m_postEffectFramebuffers[0], clearValues);
 
-		m_vulkanManager.cmdBindPipeline(cb, VK_PIPELINE_BIND_POINT_GRAPHICS, m_bloomPipelines[0]);
-		m_vulkanManager.cmdBindDescriptorSets(cb, VK_PIPELINE_BIND_POINT_GRAPHICS,
-			m_bloomPipelineLayouts[0], { m_perFrameDescriptorSets[imgIdx].m_bloomDescriptorSets[0] });
+	m_vulkanManager.cmdBindPipeline(cb, VK_PIPELINE_BIND_POINT_GRAPHICS, m_bloomPipelines[0]);
+	m_vulkanManager.cmdBindDescriptorSets(cb, VK_PIPELINE_BIND_POINT_GRAPHICS,
+		m_bloomPipelineLayouts[0], { m_perFrameDescriptorSets[frameIdx].m_bloomDescriptorSets[0] });
 
-		m_vulkanManager.cmdDraw(cb, 3);
+	m_vulkanManager.cmdDraw(cb, 3);
 
-		m_vulkanManager.cmdEndRenderPass(cb);
+	m_vulkanManager.cmdEndRenderPass(cb);
 
-		// gaussian blur
-		const uint32_t bloomPassCount = 1;
-		for (uint32_t i = 0; i < bloomPassCount; ++i)
-		{
-			// horizontal
-			m_vulkanManager.cmdBeginRenderPass(cb, m_bloomRenderPasses[0], m_postEffectFramebuffers[1], clearValues);
+	// gaussian blur
+	const uint32_t bloomPassCount = 1;
+	for (uint32_t i = 0; i < bloomPassCount; ++i)
+	{
+		// horizontal
+		m_vulkanManager.cmdBeginRenderPass(cb, m_bloomRenderPasses[0], m_postEffectFramebuffers[1], clearValues);
 
-			m_vulkanManager.cmdBindPipeline(cb, VK_PIPELINE_BIND_POINT_GRAPHICS, m_bloomPipelines[1]);
-			m_vulkanManager.cmdBindDescriptorSets(cb, VK_PIPELINE_BIND_POINT_GRAPHICS,
-				m_bloomPipelineLayouts[1], { m_perFrameDescriptorSets[imgIdx].m_bloomDescriptorSets[1] });
+		m_vulkanManager.cmdBindPipeline(cb, VK_PIPELINE_BIND_POINT_GRAPHICS, m_bloomPipelines[1]);
+		m_vulkanManager.cmdBindDescriptorSets(cb, VK_PIPELINE_BIND_POINT_GRAPHICS,
+			m_bloomPipelineLayouts[1], { m_perFrameDescriptorSets[frameIdx].m_bloomDescriptorSets[1] });
 
-			uint32_t isHorizontal = VK_TRUE;
-			m_vulkanManager.cmdPushConstants(cb, m_bloomPipelineLayouts[1], VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(uint32_t), &isHorizontal);
+		uint32_t isHorizontal = VK_TRUE;
+		m_vulkanManager.cmdPushConstants(cb, m_bloomPipelineLayouts[1], VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(uint32_t), &isHorizontal);
 
-			m_vulkanManager.cmdDraw(cb, 3);
+		m_vulkanManager.cmdDraw(cb, 3);
 
-			m_vulkanManager.cmdEndRenderPass(cb);
+		m_vulkanManager.cmdEndRenderPass(cb);
 
-			// vertical
-			m_vulkanManager.cmdBeginRenderPass(cb, m_bloomRenderPasses[0], m_postEffectFramebuffers[0], clearValues);
+		// vertical
+		m_vulkanManager.cmdBeginRenderPass(cb, m_bloomRenderPasses[0], m_postEffectFramebuffers[0], clearValues);
 
-			m_vulkanManager.cmdBindPipeline(cb, VK_PIPELINE_BIND_POINT_GRAPHICS, m_bloomPipelines[1]);
-			m_vulkanManager.cmdBindDescriptorSets(cb, VK_PIPELINE_BIND_POINT_GRAPHICS,
-				m_bloomPipelineLayouts[1], { m_perFrameDescriptorSets[imgIdx].m_bloomDescriptorSets[2] });
+		m_vulkanManager.cmdBindPipeline(cb, VK_PIPELINE_BIND_POINT_GRAPHICS, m_bloomPipelines[1]);
+		m_vulkanManager.cmdBindDescriptorSets(cb, VK_PIPELINE_BIND_POINT_GRAPHICS,
+			m_bloomPipelineLayouts[1], { m_perFrameDescriptorSets[frameIdx].m_bloomDescriptorSets[2] });
 
-			isHorizontal = VK_FALSE;
-			m_vulkanManager.cmdPushConstants(cb, m_bloomPipelineLayouts[1], VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(uint32_t), &isHorizontal);
+		isHorizontal = VK_FALSE;
+		m_vulkanManager.cmdPushConstants(cb, m_bloomPipelineLayouts[1], VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(uint32_t), &isHorizontal);
 
-			m_vulkanManager.cmdDraw(cb, 3);
+		m_vulkanManager.cmdDraw(cb, 3);
 
-			m_vulkanManager.cmdEndRenderPass(cb);
-		}
+		m_vulkanManager.cmdEndRenderPass(cb);
+	}
 
-		// merge
-		m_vulkanManager.cmdBeginRenderPass(cb, m_bloomRenderPasses[1], m_postEffectFramebuffers[2], {});
+	// merge
+	m_vulkanManager.cmdBeginRenderPass(cb, m_bloomRenderPasses[1], m_postEffectFramebuffers[2], {});
 
-		m_vulkanManager.cmdBindPipeline(cb, VK_PIPELINE_BIND_POINT_GRAPHICS, m_bloomPipelines[2]);
-		m_vulkanManager.cmdBindDescriptorSets(cb, VK_PIPELINE_BIND_POINT_GRAPHICS,
-			m_bloomPipelineLayouts[0], { m_perFrameDescriptorSets[imgIdx].m_bloomDescriptorSets[1] });
+	m_vulkanManager.cmdBindPipeline(cb, VK_PIPELINE_BIND_POINT_GRAPHICS, m_bloomPipelines[2]);
+	m_vulkanManager.cmdBindDescriptorSets(cb, VK_PIPELINE_BIND_POINT_GRAPHICS,
+		m_bloomPipelineLayouts[0], { m_perFrameDescriptorSets[frameIdx].m_bloomDescriptorSets[1] });
 
-		m_vulkanManager.cmdDraw(cb, 3);
+	m_vulkanManager.cmdDraw(cb, 3);
 
-		m_vulkanManager.cmdEndRenderPass(cb);
+	m_vulkanManager.cmdEndRenderPass(cb);
 
-		m_vulkanManager.cmdWriteTimestamp(cb, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_perFrameQueryPools[imgIdx], TQI_BLOOM_END);
+	m_vulkanManager.cmdWriteTimestamp(cb, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_perFrameQueryPools[frameIdx], TQI_BLOOM_END);
 
-		m_vulkanManager.endCommandBuffer(cb);
-	}
+	m_vulkanManager.endCommandBuffer(cb);
 }
 
-void DeferredRenderer::createPresentCommandBuffers()
+void DeferredRenderer::recordPresentCommandBuffer(uint32_t frameIdx, uint32_t imageIdx)
 {
 	// Final ouput pass
-	std::vector<VkClearValue> clearValues(1);
+	VkClearValue clearValues[1];
 	clearValues[0].color = { { 0.0f, 0.0f, 0.0f, 0.0f } };
 
-	const uint32_t swapChainImageCount = m_vulkanManager.getSwapChainSize();
-	for (uint32_t imgIdx = 0; imgIdx < swapChainImageCount; ++imgIdx)
-	{
-		uint32_t cb = m_perFrameCommandBuffers[imgIdx].m_presentCommandBuffer;
-		m_vulkanManager.beginCommandBuffer(cb, VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT);
+	uint32_t cb = m_perFrameCommandBuffers[frameIdx].m_presentCommandBuffer;
+	m_vulkanManager.beginCommandBuffer(cb, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
 
-		m_vulkanManager.cmdWriteTimestamp(cb, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_perFrameQueryPools[imgIdx], TQI_FINAL_OUTPUT_START);
+	m_vulkanManager.cmdWriteTimestamp(cb, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_perFrameQueryPools[frameIdx], TQI_FINAL_OUTPUT_START);
 
-		m_vulkanManager.cmdBeginRenderPass(cb, m_finalOutputRenderPass, m_finalOutputFramebuffers[imgIdx], clearValues);
+	m_vulkanManager.cmdBeginRenderPass(cb, m_finalOutputRenderPass, m_finalOutputFramebuffers[imageIdx], clearValues);
 
-		m_vulkanManager.cmdBindPipeline(cb, VK_PIPELINE_BIND_POINT_GRAPHICS, m_finalOutputPipeline);
-		m_vulkanManager.cmdBindDescriptorSets(cb, VK_PIPELINE_BIND_POINT_GRAPHICS,
-			m_finalOutputPipelineLayout, { m_perFrameDescriptorSets[imgIdx].m_finalOutputDescriptorSet });
+	m_vulkanManager.cmdBindPipeline(cb, VK_PIPELINE_BIND_POINT_GRAPHICS, m_finalOutputPipeline);
+	m_vulkanManager.cmdBindDescriptorSets(cb, VK_PIPELINE_BIND_POINT_GRAPHICS,
+		m_finalOutputPipelineLayout, { m_perFrameDescriptorSets[frameIdx].m_finalOutputDescriptorSet });
 
-		m_vulkanManager.cmdDraw(cb, 3);
+	m_vulkanManager.cmdDraw(cb, 3);
 
-		m_vulkanManager.cmdEndRenderPass(cb);
+	m_vulkanManager.cmdEndRenderPass(cb);
 
-		m_vulkanManager.cmdWriteTimestamp(cb, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_perFrameQueryPools[imgIdx], TQI_FINAL_OUTPUT_END);
+	m_vulkanManager.cmdWriteTimestamp(cb, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_perFrameQueryPools[frameIdx], TQI_FINAL_OUTPUT_END);
 
-		m_vulkanManager.endCommandBuffer(cb);
-	}
+	m_vulkanManager.endCommandBuffer(cb);
 }
 
 void DeferredRenderer::prefilterEnvironmentAndComputeBrdfLut()
@@ -2117,16 +3441,12 @@ void DeferredRenderer::prefilterEnvironmentAndComputeBrdfLut()
 	memcpy(mapped, m_uCubeViews, sizeof(CubeMapCameraUniformBuffer));
 	m_vulkanManager.unmapBuffer(m_oneTimeUniformDeviceData.buffer);
 
-	// Bake BRDF terms
-	std::vector<uint32_t> fences;
-
+	// Bake BRDF terms, on the compute queue while the graphics queue prefilters
 	if (!m_bakedBrdfReady)
 	{
 		m_vulkanManager.beginQueueSubmit(VK_QUEUE_COMPUTE_BIT);
 		m_vulkanManager.queueSubmitNewSubmit({ m_brdfLutCommandBuffer });
-		m_vulkanManager.endQueueSubmit(m_brdfLutFence, false);
-
-		fences.push_back(m_brdfLutFence);
+		m_vulkanManager.endQueueSubmit();
 	}
 
 	// Prefilter radiance map
@@ -2134,15 +3454,13 @@ void DeferredRenderer::prefilterEnvironmentAndComputeBrdfLut()
 	{
 		m_vulkanManager.beginQueueSubmit(VK_QUEUE_GRAPHICS_BIT);
 		m_vulkanManager.queueSubmitNewSubmit({ m_envPrefilterCommandBuffer });
-		m_vulkanManager.endQueueSubmit(m_envPrefilterFence, false);
-
-		fences.push_back(m_envPrefilterFence);
+		m_vulkanManager.endQueueSubmit();
 	}
 
-	if (fences.size() > 0)
+	if (!m_bakedBrdfReady || !m_scene.skybox.specMapReady)
 	{
-		m_vulkanManager.waitForFences(fences);
-		m_vulkanManager.resetFences(fences);
+		m_vulkanManager.waitForQueueValue(VK_QUEUE_COMPUTE_BIT, m_vulkanManager.getQueueSubmittedValue(VK_QUEUE_COMPUTE_BIT));
+		m_vulkanManager.waitForQueueValue(VK_QUEUE_GRAPHICS_BIT, m_vulkanManager.getQueueSubmittedValue(VK_QUEUE_GRAPHICS_BIT));
 
 		if (!m_bakedBrdfReady)
 		{
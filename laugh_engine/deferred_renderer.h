@@ -47,8 +47,14 @@
 #pragma once
 
 #include <array>
+#include <cstdio>
+#include <chrono>
 #include "vbase.h"
 #include "vscene.h"
+#include "culling.h"
+#include "software_occlusion.h"
+#include "draw_list.h"
+#include "free_list_allocator.h"
 
 
 #define BRDF_LUT_SIZE					256
@@ -58,6 +64,14 @@
 #define MAX_SHADOW_LIGHT_COUNT			2
 #define SHADOW_MAP_SIZE					1024
 #define SAMPLE_COUNT					VK_SAMPLE_COUNT_4_BIT
+#define MAX_OCCLUDER_COUNT				4
+#define GEOMETRY_POOL_VERTEX_COUNT		(1 << 20)
+#define GEOMETRY_POOL_INDEX_COUNT		(1 << 22)
+#define MESH_SLOT_HEADROOM				16		// mesh slots on top of the loaded scene for meshes inserted at runtime
+#define OBJECT_SLOT_HEADROOM			1024	// same for objects
+#define GEOM_DRAWS_PER_SECONDARY		32		// at most this many mesh draws per geometry pass secondary command buffer
+#define BINDLESS_TEXTURE_COUNT			4096	// size of the material texture array, MATERIAL_TEXTURE_COUNT per mesh slot
+#define MATERIAL_TEXTURE_COUNT			6
 
 #define BRDF_BASE_DIR					"../textures/BRDF_LUTs/"
 #define BRDF_NAME						"FSchlick_DGGX_GSmith.dds"
@@ -101,6 +115,11 @@ struct ShadowLightUniformBuffer
 	glm::mat4 cascadeVP;
 };
 
+struct DrawCullUniformBuffer
+{
+	glm::mat4 cascadeVPs[CSM_MAX_SEG_COUNT];
+};
+
 struct DiracLight
 {
 	glm::vec3 posOrDir;
@@ -127,33 +146,104 @@ struct DisplayInfoUniformBuffer
 	DisplayMode_t displayMode;
 };
 
+// Packed descriptors read by the descriptor update templates, one member per binding in binding order
+struct GeomPassDescriptors
+{
+	VkDescriptorBufferInfo cameraVP;
+	VkDescriptorBufferInfo objectTransforms;
+	VkDescriptorBufferInfo instanceObjects;
+	VkDescriptorBufferInfo objectMeshes;
+};
+
+struct DrawCullDescriptors
+{
+	VkDescriptorBufferInfo cascadeVPs;
+	VkDescriptorBufferInfo objectBounds;
+	VkDescriptorBufferInfo objectMeshes;
+	VkDescriptorBufferInfo drawCounts;
+	VkDescriptorBufferInfo drawCommands;
+	VkDescriptorBufferInfo instanceObjects;
+};
+
+struct ShadowPassDescriptors1
+{
+	VkDescriptorBufferInfo cascadeVP;
+};
+
+struct ShadowPassDescriptors2
+{
+	VkDescriptorBufferInfo objectTransforms;
+	VkDescriptorBufferInfo instanceObjects;
+};
+
+// One entry per mesh slot in the material table, std430
+struct MaterialTableEntry
+{
+	uint32_t textures[MATERIAL_TEXTURE_COUNT]; // albedo, normal, roughness, metalness, AO, emissive indices into the texture array
+	uint32_t materialType;
+	uint32_t flags;
+
+	static const uint32_t hasAoMap = 1;
+	static const uint32_t hasEmissiveMap = 2;
+};
+
 
 class DeferredRenderer : public VBaseGraphics
 {
 public:
-	DeferredRenderer();
+	// A non-zero @stressSceneDroneCount replaces the scene with that many drones on a large floor
+	explicit DeferredRenderer(uint32_t stressSceneDroneCount = 0);
 
 	virtual void run();
 
+	// Initializes everything, then times writing 1k, 10k and 100k geometry pass sets with vkUpdateDescriptorSets
+	// and with the update template (one call per set and all sets at once) and prints the results
+	void runDescriptorUpdateBenchmark(std::ostream &os);
+
+	// Loads ../models/@modelName.obj with its textures and adds one instance per scene graph node in @nodes
+	// (invalidNode places it at the origin). Returns the mesh index. The mesh and its objects take free slots,
+	// so only the mesh's material is written and command buffers are re-recorded as their frames come up
+	uint32_t insertMesh(const std::string &modelName, const std::vector<uint32_t> &nodes);
+
+	// Removes the mesh and its objects from the next frame on. Its resources are released
+	// once the frame in flight is done with them
+	void removeMesh(uint32_t meshIdx);
+
 protected:
 	uint32_t m_specEnvPrefilterRenderPass;
 	uint32_t m_shadowRenderPass;
 	uint32_t m_geomRenderPass;
+	uint32_t m_geomLoadRenderPass; // same as m_geomRenderPass but keeps attachment contents, used by the second culling phase
 	uint32_t m_lightingRenderPass;
 	std::vector<uint32_t> m_bloomRenderPasses;
 	uint32_t m_finalOutputRenderPass;
 
 	uint32_t m_brdfLutDescriptorSetLayout;
+	uint32_t m_depthResolveDescriptorSetLayout;
+	uint32_t m_hizDownsampleDescriptorSetLayout;
+	uint32_t m_occlusionCullDescriptorSetLayout;
+	uint32_t m_drawCullDescriptorSetLayout;
 	uint32_t m_specEnvPrefilterDescriptorSetLayout;
 	uint32_t m_skyboxDescriptorSetLayout;
-	uint32_t m_geomDescriptorSetLayout;
+	uint32_t m_geomDescriptorSetLayout; // per frame: camera, object transforms, instance lists and object meshes
+	uint32_t m_materialDescriptorSetLayout; // texture array and material table
 	uint32_t m_shadowDescriptorSetLayout1; // per segment
-	uint32_t m_shadowDescriptorSetLayout2; // per model
+	uint32_t m_shadowDescriptorSetLayout2; // object transforms and instance lists
 	uint32_t m_lightingDescriptorSetLayout;
 	uint32_t m_bloomDescriptorSetLayout;
 	uint32_t m_finalOutputDescriptorSetLayout;
 
+	// Templates of the per-frame sets that are rewritten after every swap chain recreation
+	uint32_t m_geomDescriptorUpdateTemplate;
+	uint32_t m_drawCullDescriptorUpdateTemplate;
+	uint32_t m_shadowDescriptorUpdateTemplate1;
+	uint32_t m_shadowDescriptorUpdateTemplate2;
+
 	uint32_t m_brdfLutPipelineLayout;
+	uint32_t m_depthResolvePipelineLayout;
+	uint32_t m_hizDownsamplePipelineLayout;
+	uint32_t m_occlusionCullPipelineLayout;
+	uint32_t m_drawCullPipelineLayout;
 	uint32_t m_specEnvPrefilterPipelineLayout;
 	uint32_t m_skyboxPipelineLayout;
 	uint32_t m_geomPipelineLayout;
@@ -163,6 +253,10 @@ protected:
 	uint32_t m_finalOutputPipelineLayout;
 
 	uint32_t m_brdfLutPipeline;
+	uint32_t m_depthResolvePipeline;
+	uint32_t m_hizDownsamplePipeline;
+	uint32_t m_occlusionCullPipeline;
+	uint32_t m_drawCullPipeline;
 	uint32_t m_specEnvPrefilterPipeline;
 	uint32_t m_skyboxPipeline;
 	uint32_t m_geomPipeline;
@@ -173,6 +267,9 @@ protected:
 
 	rj::helper_functions::ImageWrapper m_depthImage;
 	rj::helper_functions::ImageWrapper m_shadowImage;
+	// Min/max depth pyramid (R: closest, G: farthest) built from the resolved depth buffer
+	// View 0 covers all levels, view i + 1 is level i
+	rj::helper_functions::ImageWrapper m_hizImage;
 
 	const VkFormat m_lightingResultImageFormat = VK_FORMAT_R16G16B16A16_SFLOAT;
 	rj::helper_functions::ImageWrapper m_lightingResultImage; // VK_FORMAT_R16G16B16A16_SFLOAT
@@ -197,19 +294,90 @@ protected:
 	CubeMapCameraUniformBuffer *m_uCubeViews = nullptr;
 	TransMatsUniformBuffer *m_uCameraVP = nullptr;
 	std::vector<ShadowLightUniformBuffer *> m_uShadowLightInfos;
+	DrawCullUniformBuffer *m_uDrawCullInfo = nullptr;
 	LightingPassUniformBuffer *m_uLightInfo = nullptr;
 	DisplayInfoUniformBuffer *m_uDisplayInfo = nullptr;
 	rj::helper_functions::BufferWrapper m_oneTimeUniformDeviceData;
+	// A ring of one region per frame in flight in a single persistently mapped buffer, element i is region i.
+	// Each update only copies the blob allocations that changed since the region was last written
 	std::vector<rj::helper_functions::BufferWrapper> m_perFrameUniformDeviceData;
+	std::vector<char> m_perFrameUniformLastHostData; // the blob as of the last update, to find what changed
+	std::vector<uint64_t> m_perFrameUniformChangedUpdates; // per blob allocation, the last update that changed it
+	std::vector<uint64_t> m_perFrameUniformWrittenUpdates; // per region, the update that last wrote it
+	uint64_t m_uniformUpdateCount = 0;
+
+	// Objects are mesh instances. Every pass draws each mesh with one instanced indirect draw whose instances are
+	// appended by the culling shaders: they write the object index of each instance to an instance list at
+	// the draw's firstInstance, and the vertex shaders fetch the object transform through it.
+	// Each draw owns as many list entries as its mesh has instances (@m_meshFirstInstances)
+
+	// Geometry pass draws, layout: [geometry pass: one per mesh][geometry pass second phase: one per mesh]
+	// Reset from @m_drawCommandResetDeviceData with instance counts of 0 every frame, instances are appended
+	// by the Hi-Z occlusion culling shader
+	std::vector<VkDrawIndexedIndirectCommand> m_drawCommands;
+	rj::helper_functions::BufferWrapper m_drawCommandResetDeviceData;
+	rj::helper_functions::BufferWrapper m_drawCommandDeviceData;
+	rj::helper_functions::BufferWrapper m_instanceObjectDeviceData; // two lists of objectCount entries, one per phase
+
+	// Shadow pass draws are generated on the GPU by draw_cull.comp, one draw per mesh and cascade that is reset
+	// from @m_shadowDrawCommandResetDeviceData every frame. Caster counts are host visible for the overlay
+	std::vector<VkDrawIndexedIndirectCommand> m_shadowDrawCommands;
+	rj::helper_functions::BufferWrapper m_shadowDrawCommandResetDeviceData;
+	rj::helper_functions::BufferWrapper m_shadowDrawCommandDeviceData;
+	rj::helper_functions::BufferWrapper m_shadowDrawCountDeviceData;
+	rj::helper_functions::BufferWrapper m_shadowInstanceObjectDeviceData; // one list of objectCount entries per cascade
+
+	// Mesh index of every object, read by both culling shaders. VScene::invalidIdx for unused slots
+	std::vector<uint32_t> m_objectMeshes;
+	rj::helper_functions::BufferWrapper m_objectMeshDeviceData;
+	std::vector<uint32_t> m_meshFirstInstances; // where the instances of each mesh start in an instance list
+	std::vector<uint32_t> m_meshInstanceCounts;
+
+	// Everything sized by the mesh or object count is allocated for this many slots up front, so meshes can
+	// be inserted and removed without recreating buffers or descriptor sets. Meshes get their instance list
+	// ranges from @m_instanceRangeAllocator (in objects)
+	uint32_t m_meshCapacity = 0;
+	uint32_t m_objectCapacity = 0;
+	FreeListAllocator m_instanceRangeAllocator;
+
+	// Bumped by every scene change. The buffers above that all frames share are rewritten once no frame
+	// in flight uses the old contents
+	uint32_t m_sceneRevision = 0;
+	uint32_t m_sharedSceneDataRevision = 0;
+	std::vector<uint32_t> m_removedMeshes; // released at the next fence wait
+
+	// Toggled with the M key
+	uint32_t m_runtimeMesh = VScene::invalidIdx;
+	uint32_t m_runtimeMeshNode = SceneGraph::invalidNode;
+
+	// Transforms of every object indexed by the object index, uploaded from m_scene.transforms
+	std::vector<rj::helper_functions::BufferWrapper> m_perFrameObjectTransformDeviceData;
+
+	// World space AABBs (min, max) read by the culling shaders. The w of the min corner is 1
+	// if the object survived CPU culling and 0 otherwise
+	std::vector<glm::vec4> m_objectBoundsHostData;
+	std::vector<rj::helper_functions::BufferWrapper> m_perFrameObjectBoundsDeviceData;
+	// One uint per object written by the GPU, 1 if the object passed the occlusion test in the last frame
+	rj::helper_functions::BufferWrapper m_objectVisibilityDeviceData;
 
 	uint32_t m_brdfLutDescriptorSet;
 	uint32_t m_specEnvPrefilterDescriptorSet;
+	uint32_t m_depthResolveDescriptorSet;
+	std::vector<uint32_t> m_hizDownsampleDescriptorSets; // one per level except the first
+	// All material textures in one array that is written while frames are in flight (update after bind),
+	// so it lives in its own pool that is never reset. Mesh slot i owns the array elements starting at
+	// MATERIAL_TEXTURE_COUNT * i, and entry i of the material table
+	uint32_t m_bindlessDescriptorPool;
+	uint32_t m_materialDescriptorSet;
+	rj::helper_functions::BufferWrapper m_materialTableDeviceData;
 	typedef struct
 	{
+		uint32_t m_occlusionCullDescriptorSet;
+		uint32_t m_drawCullDescriptorSet;
 		uint32_t m_skyboxDescriptorSet;
-		std::vector<uint32_t> m_geomDescriptorSets; // one set per model
+		uint32_t m_geomDescriptorSet; // shared by all meshes
 		std::vector<uint32_t> m_shadowDescriptorSets1; // one set per segment
-		std::vector<uint32_t> m_shadowDescriptorSets2; // one per model
+		uint32_t m_shadowDescriptorSet2; // object transforms and instance lists
 		uint32_t m_lightingDescriptorSet;
 		std::vector<uint32_t> m_bloomDescriptorSets;
 		uint32_t m_finalOutputDescriptorSet;
@@ -223,25 +391,34 @@ protected:
 	std::vector<uint32_t> m_postEffectFramebuffers;
 	std::vector<uint32_t> m_finalOutputFramebuffers; // present framebuffer names
 
-	uint32_t m_imageAvailableSemaphore;
-	uint32_t m_geomAndLightingCompleteSemaphore;
-	uint32_t m_postEffectSemaphore;
-	uint32_t m_finalOutputFinishedSemaphore;
-	uint32_t m_renderFinishedSemaphore;
-
-	uint32_t m_brdfLutFence;
-	uint32_t m_envPrefilterFence;
-	uint32_t m_renderFinishedFence;
+	typedef struct
+	{
+		uint32_t m_imageAvailableSemaphore; // binary, the swap chain can't use timelines
+		uint64_t m_renderFinishedValue = 0; // graphics timeline value of the frame's last submit
+	} PerFrameSyncObjects;
+	std::vector<PerFrameSyncObjects> m_perFrameSyncObjects;
+	// Binary, per swap chain image. A present may still wait on it when the frame slot comes around again,
+	// only acquiring the same image again guarantees that its last present is done with it
+	std::vector<uint32_t> m_renderFinishedSemaphores;
+	uint32_t m_frameIdx = 0; // in [0, MAX_FRAMES_IN_FLIGHT), which per-frame resources the next frame records into
 
 	uint32_t m_brdfLutCommandBuffer;
 	uint32_t m_envPrefilterCommandBuffer;
+	// Every frame records all of its command buffers from scratch. They come from transient pools owned by the
+	// frame, which are reset as a whole once the frame's previous submission is done.
+	// The geometry and shadow passes are recorded into secondary command buffers on all threads of m_threadPool.
+	// Each thread records from its own pool, so there is one secondary per thread for every task
 	typedef struct
 	{
+		uint32_t m_commandPool = std::numeric_limits<uint32_t>::max();
+		std::vector<uint32_t> m_threadCommandPools;
 		uint32_t m_geomShadowLightingCommandBuffer;
 		uint32_t m_postEffectCommandBuffer;
 		uint32_t m_presentCommandBuffer;
+		std::vector<std::vector<uint32_t>> m_secondaryCommandBuffers; // [thread][task], from that thread's pool
 	} PerFrameCommandBuffers;
 	std::vector<PerFrameCommandBuffers> m_perFrameCommandBuffers;
+	std::vector<uint32_t> m_secondaryTaskCommandBuffers; // the one each task ended up recording
 
 	enum PassTimestampQueryIndex
 	{
@@ -260,6 +437,53 @@ protected:
 	std::vector<uint32_t> m_perFrameQueryPools;
 
 	VScene m_scene{ &m_vulkanManager };
+	uint32_t m_stressSceneDroneCount;
+
+	PackedBounds m_objectBounds; // used for camera and per-cascade caster culling
+	std::vector<uint8_t> m_objectVisibility;
+	std::vector<uint32_t> m_visibleObjects;
+	uint32_t m_drawnObjectCount = 0;
+	uint32_t m_culledObjectCount = 0;
+	uint32_t m_occludedObjectCount = 0;
+
+	// Command recording runs on m_threadPool, the update thread fans out to a pool of its own
+	ThreadPool m_threadPool;
+	ThreadPool m_updateThreadPool{ std::max(ThreadPool::defaultWorkerCount() / 2, 1u) };
+
+	// CPU occlusion culling, the largest objects are rasterized as occluders and hide the rest before any GPU work
+	SoftwareOcclusionCuller m_softwareOcclusionCuller;
+	std::vector<uint32_t> m_occluderObjects;
+	std::vector<BBox> m_objectWorldBounds;
+	std::vector<SoftwareOcclusionCuller::Occluder> m_occluders;
+	uint32_t m_softwareOccludedObjectCount = 0;
+	std::vector<uint32_t> m_shadowCasterCounts;
+
+	// Geometry pass draw order (mesh indices), sorted on every update and recorded from the frame snapshot
+	enum DrawPass
+	{
+		DRAW_PASS_GEOMETRY = 0
+	};
+	DrawList m_geomDrawList;
+	std::vector<float> m_meshViewDepths;
+	std::vector<uint32_t> m_geomDrawOrder;
+
+	// Everything a frame needs from the update thread, copied out at the end of an update.
+	// The render thread only reads the front snapshot while the update thread works on the next one
+	struct FrameSnapshot
+	{
+		std::vector<char> uniformHostData; // laid out like m_perFrameUniformHostData
+		std::vector<glm::vec4> objectBoundsHostData;
+		std::vector<ObjectTransform> objectTransforms;
+		std::vector<uint32_t> geomDrawOrder;
+		uint32_t drawnObjectCount = 0;
+		uint32_t culledObjectCount = 0;
+		uint32_t softwareOccludedObjectCount = 0;
+		SoftwareOcclusionCuller::Stats softwareOcclusionStats;
+		float updateTimeMS = 0.f;
+		size_t frameArenaUsedSize = 0;
+		size_t frameArenaCapacity = 0;
+	};
+	TripleBuffer<FrameSnapshot> m_frameSnapshots;
 
 	rj::helper_functions::FrameTimeCalculator m_frameTimeCalculator;
 	rj::helper_functions::FrameTimeCalculator m_geomPassTimeCalculator;
@@ -267,6 +491,11 @@ protected:
 	rj::helper_functions::FrameTimeCalculator m_lightingPassTimeCalculator;
 	rj::helper_functions::FrameTimeCalculator m_bloomPassTimeCalculator;
 	rj::helper_functions::FrameTimeCalculator m_finalOutputPassTimeCalculator;
+	rj::helper_functions::FrameTimeCalculator m_commandRecordTimeCalculator; // CPU time
+	rj::helper_functions::FrameTimeCalculator m_uploadTimeCalculator; // CPU time of updateUniformDeviceData
+	rj::helper_functions::FrameTimeCalculator m_updateTimeCalculator; // CPU time of updateUniformHostData, on the update thread
+	size_t m_uniformUploadBytes = 0; // written by the last updateUniformDeviceData
+	size_t m_bufferUploadBytes = 0; // same for the other per-frame buffers
 
 
 	virtual void createQueryPools();
@@ -287,11 +516,20 @@ protected:
 	virtual void createSynchronizationObjects(); // semaphores, fences, etc. go in here
 
 	virtual void updateUniformHostData();
-	virtual void updateUniformDeviceData(uint32_t imgIdx);
-	virtual void updateText(uint32_t imageIdx) override;
+	virtual void updateUniformDeviceData(uint32_t frameIdx);
+	virtual void updateDrawCommands(const glm::mat4 &VP);
+	virtual void updateRuntimeMesh(); // on the render thread, with the update thread paused
+	virtual void updateText(uint32_t frameIdx, uint32_t imageIdx) override;
 	virtual void drawFrame();
+	virtual void waitForLastFrame() override;
 
 	// Helpers
+	virtual void loadModel(VMesh &mesh, const std::string &modelName);
+	virtual void selectOccluders();
+	virtual void setMeshDrawCommands(uint32_t meshIdx);
+	virtual void updateObjectMeshes();
+	virtual void releaseRemovedMeshes();
+
 	virtual void createSpecEnvPrefilterRenderPass();
 	virtual void createGeometryRenderPass();
 	virtual void createShadowRenderPass();
@@ -300,6 +538,8 @@ protected:
 	virtual void createFinalOutputRenderPass();
 
 	virtual void createBrdfLutDescriptorSetLayout();
+	virtual void createHiZDescriptorSetLayouts();
+	virtual void createDrawCullDescriptorSetLayout();
 	virtual void createSpecEnvPrefilterDescriptorSetLayout();
 	virtual void createSkyboxDescriptorSetLayout();
 	virtual void createStaticMeshDescriptorSetLayout();
@@ -310,6 +550,8 @@ protected:
 	virtual void createFinalOutputDescriptorSetLayout();
 
 	virtual void createBrdfLutPipeline();
+	virtual void createHiZPipelines();
+	virtual void createDrawCullPipeline();
 	virtual void createSpecEnvPrefilterPipeline();
 	virtual void createSkyboxPipeline();
 	virtual void createStaticMeshPipeline();
@@ -323,9 +565,13 @@ protected:
 	// commands complete. So each model will need a different descriptor set because they use
 	// different textures
 	virtual void createBrdfLutDescriptorSet();
+	virtual void createHiZDescriptorSets();
+	virtual void createDrawCullDescriptorSets();
 	virtual void createSpecEnvPrefilterDescriptorSet();
 	virtual void createSkyboxDescriptorSet();
 	virtual void createStaticMeshDescriptorSet();
+	virtual void writeMeshMaterial(uint32_t meshIdx);
+	GeomPassDescriptors getGeomPassDescriptors(uint32_t frameIdx);
 	virtual void createGeomPassDescriptorSets();
 	virtual void createShadowPassDescriptorSets();
 	virtual void createLightingPassDescriptorSets();
@@ -334,9 +580,11 @@ protected:
 
 	virtual void createBrdfLutCommandBuffer();
 	virtual void createEnvPrefilterCommandBuffer();
-	virtual void createGeomShadowLightingCommandBuffers();
-	virtual void createPostEffectCommandBuffers();
-	virtual void createPresentCommandBuffers();
+	virtual void recordFrameCommandBuffers(uint32_t frameIdx, uint32_t imageIdx);
+	virtual void recordGeomShadowLightingCommandBuffer(uint32_t frameIdx);
+	uint32_t getGeomPassSecondaryChunkCount() const;
+	virtual void recordPostEffectCommandBuffer(uint32_t frameIdx);
+	virtual void recordPresentCommandBuffer(uint32_t frameIdx, uint32_t imageIdx);
 
 	virtual void prefilterEnvironmentAndComputeBrdfLut();
 	virtual void savePrecomputationResults();
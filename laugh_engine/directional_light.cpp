@@ -19,8 +19,8 @@ DirectionalLight::DirectionalLight(
 }
 
 void DirectionalLight::computeCascadeScalesAndOffsets(
-	const std::vector<glm::vec3>& frustumCorners, const std::vector<float> &cascadeDepths,
-	const glm::vec3 &sceneAABBMin, const glm::vec3 &sceneAABBMax, uint32_t shadowMapDim)
+	rj::ArrayRef<glm::vec3> frustumCorners, rj::ArrayRef<float> cascadeDepths,
+	const PackedBounds &casterBounds, uint32_t shadowMapDim)
 {
 	assert(frustumCorners.size() >= 8 && (frustumCorners.size() - 4) % 4 == 0);
 	
@@ -28,27 +28,12 @@ void DirectionalLight::computeCascadeScalesAndOffsets(
 	const uint32_t cascadeCount = (frustumCorners.size() - 4) >> 2;
 	cascadeScales.resize(cascadeCount);
 	cascadeOffsets.resize(cascadeCount);
+	cascadeCasters.resize(cascadeCount);
 	assert(cascadeDepths.size() == cascadeCount);
 
-	glm::vec4 worldSpaceSceneAABBCorners[8] =
-	{
-		glm::vec4(sceneAABBMax.x, sceneAABBMax.y, sceneAABBMin.z, 1.f),
-		glm::vec4(sceneAABBMin.x, sceneAABBMax.y, sceneAABBMin.z, 1.f),
-		glm::vec4(sceneAABBMin.x, sceneAABBMin.y, sceneAABBMin.z, 1.f),
-		glm::vec4(sceneAABBMax.x, sceneAABBMin.y, sceneAABBMin.z, 1.f),
-		glm::vec4(sceneAABBMax.x, sceneAABBMax.y, sceneAABBMax.z, 1.f),
-		glm::vec4(sceneAABBMin.x, sceneAABBMax.y, sceneAABBMax.z, 1.f),
-		glm::vec4(sceneAABBMin.x, sceneAABBMin.y, sceneAABBMax.z, 1.f),
-		glm::vec4(sceneAABBMax.x, sceneAABBMin.y, sceneAABBMax.z, 1.f)
-	};
-
-	// Make sure near plane doesn't clip shadow casters
-	float fZNear = -std::numeric_limits<float>::max();
-	for (uint32_t i = 0; i < 8; ++i)
-	{
-		auto sceneAABBCornerLVS = V * worldSpaceSceneAABBCorners[i];
-		fZNear = fmax(fZNear, sceneAABBCornerLVS.z);
-	}
+	// Planes transform from light view space to world space by V^T
+	const glm::mat4 Vt = glm::transpose(V);
+	const glm::vec4 lightViewSpaceZPlane = Vt * glm::vec4(0.f, 0.f, 1.f, 0.f);
 
 	for (uint32_t cascadeIdx = 0; cascadeIdx < cascadeCount; ++cascadeIdx)
 	{
@@ -92,7 +77,26 @@ void DirectionalLight::computeCascadeScalesAndOffsets(
 			lightViewSpaceMin.z);
 		lightViewSpaceMax = glm::vec3(
 			glm::floor(glm::vec2(lightViewSpaceMax) / worldUnitsPerTexel) * worldUnitsPerTexel,
-			fZNear);
+			lightViewSpaceMax.z);
+
+		// Anything between the light and the far end of the cascade can cast shadows into it,
+		// so the caster volume is left open towards the light
+		const glm::vec4 casterVolumePlanes[5] =
+		{
+			Vt * glm::vec4(1.f, 0.f, 0.f, -lightViewSpaceMin.x),
+			Vt * glm::vec4(-1.f, 0.f, 0.f, lightViewSpaceMax.x),
+			Vt * glm::vec4(0.f, 1.f, 0.f, -lightViewSpaceMin.y),
+			Vt * glm::vec4(0.f, -1.f, 0.f, lightViewSpaceMax.y),
+			Vt * glm::vec4(0.f, 0.f, 1.f, -lightViewSpaceMin.z)
+		};
+		auto &casters = cascadeCasters[cascadeIdx];
+		casterBounds.cullAgainstPlanes(casterVolumePlanes, 5, casters);
+
+		// Make sure near plane doesn't clip the surviving casters. Receivers closer to the light
+		// than every caster are lit anyway so they don't need to be covered
+		float fZNear = casterBounds.maxSignedDistance(lightViewSpaceZPlane, casters);
+		if (fZNear <= lightViewSpaceMin.z) fZNear = lightViewSpaceMax.z; // no casters
+		lightViewSpaceMax.z = fZNear;
 
 		auto &scale = cascadeScales[cascadeIdx];
 		auto &offset = cascadeOffsets[cascadeIdx];
@@ -4,6 +4,8 @@
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
 #include "glm/glm.hpp"
+#include "culling.h"
+#include "array_ref.h"
 
 
 class DirectionalLight
@@ -15,12 +17,13 @@ public:
 		const glm::vec3 &pos, const glm::vec3 &dir,
 		const glm::vec3 &clr, bool castShadow = false, uint32_t pcfSize = 3);
 
-	// @frustumCorners, @sceneAABBMin, and @sceneAABBMax are in world space
+	// @frustumCorners and @casterBounds are in world space
 	// In @frustumCorners, corners of a far plane are reused as corners of the near
 	// plane of the next cascade.
+	// Casters are culled per cascade and the near plane of each cascade is fit to its surviving casters
 	void computeCascadeScalesAndOffsets(
-		const std::vector<glm::vec3> &frustumCorners, const std::vector<float> &cascadeDepths,
-		const glm::vec3 &sceneAABBMin, const glm::vec3 &sceneAABBMax, uint32_t shadowMapDim);
+		rj::ArrayRef<glm::vec3> frustumCorners, rj::ArrayRef<float> cascadeDepths,
+		const PackedBounds &casterBounds, uint32_t shadowMapDim);
 
 	void setPosition(const glm::vec3 &newPos);
 	void setDirection(const glm::vec3 &newDir);
@@ -31,6 +34,8 @@ public:
 
 	const glm::mat4 &getViewMatrix() const { return V; }
 	void getCascadeViewProjMatrix(uint32_t cascadeIdx, glm::mat4 *lightVP) const;
+	// Element i is 1 if caster i needs to be drawn into the cascade
+	const std::vector<uint8_t> &getCascadeCasters(uint32_t cascadeIdx) const { return cascadeCasters[cascadeIdx]; }
 	const glm::vec3 &getColor() const { return color; }
 	const glm::vec3 &getDirection() const { return direction; }
 	bool castShadow() const { return bCastShadow; }
@@ -46,6 +51,7 @@ protected:
 
 	std::vector<glm::vec3> cascadeScales;
 	std::vector<glm::vec3> cascadeOffsets;
+	std::vector<std::vector<uint8_t>> cascadeCasters;
 
 	void recomputeViewMatrix();
 };
\ No newline at end of file
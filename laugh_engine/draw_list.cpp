@@ -0,0 +1,46 @@
+#include <cassert>
+#include <cstring>
+#include "draw_list.h"
+
+
+uint64_t DrawList::makeKey(uint32_t pass, float depth)
+{
+	assert(pass < (1u << passBits));
+	assert(depth >= 0.f);
+
+	uint32_t depthBits;
+	std::memcpy(&depthBits, &depth, sizeof(depthBits));
+
+	return static_cast<uint64_t>(pass) << 60 | depthBits;
+}
+
+void DrawList::sort()
+{
+	const size_t count = items.size();
+	if (count < 2) return;
+
+	scratch.resize(count);
+
+	// digits all keys agree on would only copy the list around
+	uint64_t differingBits = 0;
+	for (const auto &item : items) differingBits |= item.key ^ items[0].key;
+
+	for (uint32_t shift = 0; shift < 64; shift += 8)
+	{
+		if ((differingBits >> shift & 0xff) == 0) continue;
+
+		size_t offsets[256] = {};
+		for (const auto &item : items) ++offsets[item.key >> shift & 0xff];
+
+		size_t sum = 0;
+		for (auto &offset : offsets)
+		{
+			size_t digitCount = offset;
+			offset = sum;
+			sum += digitCount;
+		}
+
+		for (const auto &item : items) scratch[offsets[item.key >> shift & 0xff]++] = item;
+		items.swap(scratch);
+	}
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+
+// Draws of a frame ordered by 64-bit sort keys, grouped by pass and front to back within a pass.
+// Key layout from the most significant bit:
+//   [63, 60] pass, [31, 0] view depth
+class DrawList
+{
+public:
+	struct Item
+	{
+		uint64_t key;
+		uint32_t drawIdx; // whatever the caller uses to find the draw again
+	};
+
+	static const uint32_t passBits = 4;
+
+	// @depth must be >= 0. Non-negative floats order like their bit patterns, so the depth is stored exactly
+	static uint64_t makeKey(uint32_t pass, float depth);
+
+	void clear() { items.clear(); }
+	void reserve(size_t count) { items.reserve(count); scratch.reserve(count); }
+	void add(uint64_t key, uint32_t drawIdx) { items.push_back({ key, drawIdx }); }
+
+	// Stable LSD radix sort on 8-bit digits, digits that are the same for every key are skipped
+	void sort();
+
+	const std::vector<Item> &getItems() const { return items; }
+
+protected:
+	std::vector<Item> items;
+	std::vector<Item> scratch;
+};
@@ -0,0 +1,50 @@
+#include <cassert>
+#include <algorithm>
+#include "frame_arena.h"
+
+
+FrameArena::FrameArena(size_t capacity) :
+	buffer(new char[capacity]), capacity(capacity)
+{
+}
+
+FrameArena::~FrameArena()
+{
+	reset();
+}
+
+void *FrameArena::allocate(size_t size, size_t alignment)
+{
+	assert(alignment > 0 && (alignment & (alignment - 1)) == 0);
+
+	const uintptr_t base = reinterpret_cast<uintptr_t>(buffer.get());
+	const size_t alignedOffset = ((base + offset + alignment - 1) & ~(alignment - 1)) - base;
+	if (alignedOffset + size <= capacity)
+	{
+		offset = alignedOffset + size;
+		return buffer.get() + alignedOffset;
+	}
+
+	// too large for what is left, the block is freed and the buffer grown on the next reset
+	char *block = static_cast<char *>(::operator new(size + alignment));
+	overflowBlocks.push_back(block);
+	overflowSize += size + alignment;
+
+	const uintptr_t address = reinterpret_cast<uintptr_t>(block);
+	return block + (((address + alignment - 1) & ~(alignment - 1)) - address);
+}
+
+void FrameArena::reset()
+{
+	if (!overflowBlocks.empty())
+	{
+		for (void *block : overflowBlocks) ::operator delete(block);
+		overflowBlocks.clear();
+
+		capacity = std::max(2 * capacity, offset + overflowSize);
+		buffer.reset(new char[capacity]);
+		overflowSize = 0;
+	}
+
+	offset = 0;
+}
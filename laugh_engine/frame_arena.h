@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <memory>
+
+
+// Linear allocator for data that only lives for one frame. Allocating bumps an offset, nothing is freed on its own
+// and reset() drops everything at once. Requests that don't fit go to the heap, and the next reset() grows the buffer
+// to what the frame needed, so a frame loop that has settled never touches the heap. Not thread safe
+class FrameArena
+{
+public:
+	explicit FrameArena(size_t capacity = 64 * 1024);
+	~FrameArena();
+
+	FrameArena(const FrameArena &) = delete;
+	FrameArena &operator=(const FrameArena &) = delete;
+
+	// @alignment must be a power of 2
+	void *allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+
+	// Everything allocated since the last reset becomes invalid
+	void reset();
+
+	size_t getCapacity() const { return capacity; }
+	size_t getUsedSize() const { return offset + overflowSize; }
+
+protected:
+	std::unique_ptr<char[]> buffer;
+	size_t capacity = 0;
+	size_t offset = 0;
+
+	std::vector<void *> overflowBlocks;
+	size_t overflowSize = 0;
+};
+
+// Lets standard containers draw from a FrameArena. Deallocation does nothing, the memory comes back with the
+// arena's reset, so containers using it must not outlive the frame
+template <typename T>
+class ArenaAllocator
+{
+public:
+	typedef T value_type;
+
+	explicit ArenaAllocator(FrameArena *arena) : pArena(arena) {}
+
+	template <typename U>
+	ArenaAllocator(const ArenaAllocator<U> &other) : pArena(other.pArena) {}
+
+	T *allocate(size_t n) { return static_cast<T *>(pArena->allocate(n * sizeof(T), alignof(T))); }
+	void deallocate(T *, size_t) {}
+
+	template <typename U>
+	bool operator==(const ArenaAllocator<U> &other) const { return pArena == other.pArena; }
+	template <typename U>
+	bool operator!=(const ArenaAllocator<U> &other) const { return pArena != other.pArena; }
+
+private:
+	template <typename U> friend class ArenaAllocator;
+
+	FrameArena *pArena;
+};
+
+template <typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
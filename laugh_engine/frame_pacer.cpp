@@ -0,0 +1,108 @@
+#include <thread>
+#include <algorithm>
+#include "frame_pacer.h"
+
+
+FramePacer::FramePacer() :
+	epoch(Clock::now()), nextFrameStart(epoch)
+{
+}
+
+const char *FramePacer::getModeName(FramePacingMode m)
+{
+	switch (m)
+	{
+	case FRAME_PACING_THROUGHPUT: return "throughput";
+	case FRAME_PACING_LOW_LATENCY: return "low latency";
+	case FRAME_PACING_CAPPED: return "capped";
+	default: return "unknown";
+	}
+}
+
+void FramePacer::waitForFrameStart()
+{
+	if (mode != FRAME_PACING_CAPPED || targetFrameRate <= 0.f) return;
+
+	const auto interval = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / targetFrameRate));
+
+	// Sleeping overshoots by up to the scheduler's granularity, so the last 2 ms are spent yielding instead
+	const auto spinTime = std::chrono::milliseconds(2);
+	auto t = Clock::now();
+	if (nextFrameStart - t > spinTime) std::this_thread::sleep_for(nextFrameStart - t - spinTime);
+	while ((t = Clock::now()) < nextFrameStart) std::this_thread::yield();
+
+	// a frame that ran late moves the schedule instead of being caught up with a burst of frames
+	nextFrameStart = std::max(nextFrameStart + interval, t);
+}
+
+uint64_t FramePacer::beginFrame()
+{
+	++frameId;
+
+	auto &frame = markers[frameId % markerCount];
+	frame = {};
+	frame.frameId = frameId;
+	frame.inputMS = now();
+
+	return frameId;
+}
+
+void FramePacer::markPresented()
+{
+	markers[frameId % markerCount].presentMS = now();
+	lastPresentedId = frameId;
+}
+
+void FramePacer::markDisplayed(uint64_t id)
+{
+	if (id <= lastDisplayedId) return;
+
+	// Frames in between may have been replaced in a mailbox queue and never shown, so only @id gets a time
+	auto &frame = markers[id % markerCount];
+	if (frame.frameId == id) frame.displayMS = now();
+	lastDisplayedId = id;
+}
+
+const FramePacer::FrameMarkers *FramePacer::getMarkers(uint64_t id) const
+{
+	const auto &frame = markers[id % markerCount];
+	return id != 0 && frame.frameId == id ? &frame : nullptr;
+}
+
+FramePacer::Stats FramePacer::getStats() const
+{
+	Stats stats = {};
+	double presentTotal = 0.0, displayTotal = 0.0;
+	uint32_t presentCount = 0, displayCount = 0;
+	double firstInput = 0.0, lastInput = 0.0;
+
+	for (const auto &frame : markers)
+	{
+		if (frame.frameId == 0) continue;
+
+		if (stats.frameCount == 0 || frame.inputMS < firstInput) firstInput = frame.inputMS;
+		if (stats.frameCount == 0 || frame.inputMS > lastInput) lastInput = frame.inputMS;
+		++stats.frameCount;
+
+		if (frame.presentMS >= 0.0)
+		{
+			presentTotal += frame.presentMS - frame.inputMS;
+			++presentCount;
+		}
+		if (frame.displayMS >= 0.0)
+		{
+			displayTotal += frame.displayMS - frame.inputMS;
+			++displayCount;
+		}
+	}
+
+	stats.frameIntervalMS = stats.frameCount > 1 ? (lastInput - firstInput) / (stats.frameCount - 1) : -1.0;
+	stats.inputToPresentMS = presentCount > 0 ? presentTotal / presentCount : -1.0;
+	stats.inputToDisplayMS = displayCount > 0 ? displayTotal / displayCount : -1.0;
+	return stats;
+}
+
+void FramePacer::clearStats()
+{
+	for (auto &frame : markers) frame = {};
+}
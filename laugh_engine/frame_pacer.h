@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstdint>
+#include <chrono>
+
+
+enum FramePacingMode
+{
+	FRAME_PACING_THROUGHPUT = 0, // as many frames in flight as there are resources for, never waits on the display
+	FRAME_PACING_LOW_LATENCY,    // input is sampled once the last frame is done, on the display if present wait is available
+	FRAME_PACING_CAPPED,         // frames start no faster than the target frame rate
+	FRAME_PACING_MODE_COUNT
+};
+
+// When frames start, and latency markers of the last frames for measuring it. The caller owns the actual wait points
+// on the GPU and the display, see VBaseGraphics::waitForFramePacing(). Not thread safe, used by the render thread only
+class FramePacer
+{
+public:
+	// Milliseconds since the pacer was created, negative until the frame got that far
+	struct FrameMarkers
+	{
+		uint64_t frameId = 0;
+		double inputMS = -1.0;   // input sampled
+		double submitMS = -1.0;  // last queue submission of the frame
+		double presentMS = -1.0; // queued for presentation
+		double displayMS = -1.0; // known to be on screen, only with present wait
+	};
+
+	// Averages over the frames still kept, negative if no frame has the markers
+	struct Stats
+	{
+		uint32_t frameCount;
+		double frameIntervalMS;
+		double inputToPresentMS;
+		double inputToDisplayMS;
+	};
+
+	static const uint32_t markerCount = 64;
+
+	FramePacer();
+
+	void setMode(FramePacingMode m) { mode = m; }
+	FramePacingMode getMode() const { return mode; }
+	void setTargetFrameRate(float fps) { targetFrameRate = fps; }
+	float getTargetFrameRate() const { return targetFrameRate; }
+	static const char *getModeName(FramePacingMode m);
+
+	// Sleeps until the next frame may start, only capped mode ever waits here
+	void waitForFrameStart();
+
+	// Markers of the frame being built, in the order they happen. Frame ids start at 1 and double as present ids
+	uint64_t beginFrame();
+	void markSubmitted() { markers[frameId % markerCount].submitMS = now(); }
+	void markPresented();
+	uint64_t getFrameId() const { return frameId; }
+
+	// The last frame queued for presentation and the last one known to be on screen. Every frame up to the
+	// displayed one has left the presentation queue
+	uint64_t getLastPresentedId() const { return lastPresentedId; }
+	uint64_t getLastDisplayedId() const { return lastDisplayedId; }
+	void markDisplayed(uint64_t id);
+	// Presents of a retired swap chain can't be waited for anymore
+	void discardPendingPresents() { lastDisplayedId = lastPresentedId = frameId; }
+
+	// nullptr if the frame is too old to be kept
+	const FrameMarkers *getMarkers(uint64_t id) const;
+	Stats getStats() const;
+	void clearStats();
+
+protected:
+	typedef std::chrono::steady_clock Clock;
+
+	double now() const { return std::chrono::duration<double, std::milli>(Clock::now() - epoch).count(); }
+
+	FramePacingMode mode = FRAME_PACING_THROUGHPUT;
+	float targetFrameRate = 60.f;
+
+	Clock::time_point epoch;
+	Clock::time_point nextFrameStart;
+
+	uint64_t frameId = 0;
+	uint64_t lastPresentedId = 0;
+	uint64_t lastDisplayedId = 0;
+	FrameMarkers markers[markerCount];
+};
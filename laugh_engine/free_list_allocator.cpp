@@ -0,0 +1,80 @@
+#include <cassert>
+#include <algorithm>
+#include <iterator>
+#include "free_list_allocator.h"
+
+
+FreeListAllocator::FreeListAllocator(uint64_t capacity)
+{
+	reset(capacity);
+}
+
+void FreeListAllocator::reset(uint64_t newCapacity)
+{
+	capacity = newCapacity;
+	usedSize = 0;
+	freeBlocks.clear();
+	if (capacity > 0) freeBlocks[0] = capacity;
+}
+
+uint64_t FreeListAllocator::allocate(uint64_t size, uint64_t alignment)
+{
+	assert(alignment > 0 && (alignment & (alignment - 1)) == 0);
+	if (size == 0) return invalidOffset;
+
+	for (auto it = freeBlocks.begin(); it != freeBlocks.end(); ++it)
+	{
+		const uint64_t blockOffset = it->first;
+		const uint64_t blockEnd = blockOffset + it->second;
+		const uint64_t offset = (blockOffset + alignment - 1) & ~(alignment - 1);
+		if (offset + size > blockEnd) continue;
+
+		// the alignment padding in front stays free
+		freeBlocks.erase(it);
+		if (offset > blockOffset) freeBlocks[blockOffset] = offset - blockOffset;
+		if (offset + size < blockEnd) freeBlocks[offset + size] = blockEnd - offset - size;
+
+		usedSize += size;
+		return offset;
+	}
+
+	return invalidOffset;
+}
+
+void FreeListAllocator::free(uint64_t offset, uint64_t size)
+{
+	assert(size > 0 && offset + size <= capacity);
+	assert(usedSize >= size);
+	usedSize -= size;
+
+	auto next = freeBlocks.lower_bound(offset);
+	assert(next == freeBlocks.end() || offset + size <= next->first);
+
+	// merge with the following range
+	if (next != freeBlocks.end() && next->first == offset + size)
+	{
+		size += next->second;
+		next = freeBlocks.erase(next);
+	}
+
+	// merge with the preceding range
+	if (next != freeBlocks.begin())
+	{
+		auto prev = std::prev(next);
+		assert(prev->first + prev->second <= offset);
+		if (prev->first + prev->second == offset)
+		{
+			prev->second += size;
+			return;
+		}
+	}
+
+	freeBlocks[offset] = size;
+}
+
+uint64_t FreeListAllocator::getLargestFreeBlockSize() const
+{
+	uint64_t largest = 0;
+	for (const auto &block : freeBlocks) largest = std::max(largest, block.second);
+	return largest;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <map>
+
+
+// Hands out ranges of an abstract address space [0, capacity). Free ranges are kept sorted by offset
+// and merged with their neighbours on free, allocation is first fit. Units are up to the caller (bytes, elements...)
+class FreeListAllocator
+{
+public:
+	static const uint64_t invalidOffset = std::numeric_limits<uint64_t>::max();
+
+	explicit FreeListAllocator(uint64_t capacity = 0);
+
+	// Frees everything
+	void reset(uint64_t capacity);
+
+	// Returns the offset of the new range or invalidOffset if no free range is large enough.
+	// @alignment must be a power of 2
+	uint64_t allocate(uint64_t size, uint64_t alignment = 1);
+
+	// @offset and @size must be exactly what was allocated
+	void free(uint64_t offset, uint64_t size);
+
+	uint64_t getCapacity() const { return capacity; }
+	uint64_t getUsedSize() const { return usedSize; }
+	uint64_t getLargestFreeBlockSize() const;
+	uint32_t getFreeBlockCount() const { return static_cast<uint32_t>(freeBlocks.size()); }
+
+protected:
+	uint64_t capacity = 0;
+	uint64_t usedSize = 0;
+	std::map<uint64_t, uint64_t> freeBlocks; // offset -> size
+};
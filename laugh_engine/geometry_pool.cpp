@@ -0,0 +1,46 @@
+#include "geometry_pool.h"
+
+
+GeometryPool::GeometryPool(rj::VManager *pManager)
+	: pVulkanManager(pManager)
+{
+}
+
+void GeometryPool::initStream(Stream stream, VkDeviceSize elementSize, uint32_t elementCount, VkBufferUsageFlags usage)
+{
+	auto &data = streams[stream];
+	assert(data.buffer == invalidBuffer);
+
+	data.elementSize = elementSize;
+	data.allocator.reset(elementCount);
+	data.buffer = pVulkanManager->createBuffer(elementSize * elementCount,
+		usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+}
+
+bool GeometryPool::allocate(Stream stream, uint32_t elementCount, rj::helper_functions::BufferWrapper &range)
+{
+	auto &data = streams[stream];
+	assert(data.buffer != invalidBuffer);
+
+	uint64_t first = data.allocator.allocate(elementCount);
+	if (first == FreeListAllocator::invalidOffset) return false;
+
+	range.buffer = data.buffer;
+	range.offset = first * data.elementSize;
+	range.size = elementCount * data.elementSize;
+	return true;
+}
+
+void GeometryPool::upload(const rj::helper_functions::BufferWrapper &range, const void *hostData)
+{
+	pVulkanManager->transferHostDataToBuffer(range.buffer, range.size, hostData, range.offset);
+}
+
+void GeometryPool::free(Stream stream, const rj::helper_functions::BufferWrapper &range)
+{
+	auto &data = streams[stream];
+	assert(range.buffer == data.buffer);
+	assert(range.offset % data.elementSize == 0 && range.size % data.elementSize == 0);
+
+	data.allocator.free(range.offset / data.elementSize, range.size / data.elementSize);
+}
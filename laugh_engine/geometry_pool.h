@@ -0,0 +1,55 @@
+#pragma once
+
+#include "VManager.h"
+#include "free_list_allocator.h"
+
+
+// One device local buffer per geometry stream that meshes suballocate their vertices and indices from,
+// so a pass can bind a stream once and draw any mesh through firstIndex/vertexOffset.
+// Ranges are handed out in whole elements, so a range's byte offset divided by the element size is the
+// firstIndex or vertexOffset of the mesh
+class GeometryPool
+{
+public:
+	enum Stream
+	{
+		STREAM_VERTEX = 0,
+		STREAM_INDEX,
+		STREAM_POSITION,
+		STREAM_POSITION_INDEX,
+		STREAM_COUNT
+	};
+
+	explicit GeometryPool(rj::VManager *pManager);
+
+	// Creates the buffer of @stream with room for @elementCount elements. TRANSFER_DST is added to @usage
+	void initStream(Stream stream, VkDeviceSize elementSize, uint32_t elementCount, VkBufferUsageFlags usage);
+
+	bool isInitialized(Stream stream) const { return streams[stream].buffer != invalidBuffer; }
+
+	// Fills @range with a slice of the stream buffer, returns false if the stream is full
+	bool allocate(Stream stream, uint32_t elementCount, rj::helper_functions::BufferWrapper &range);
+
+	// Uploads @hostData into a range returned by allocate()
+	void upload(const rj::helper_functions::BufferWrapper &range, const void *hostData);
+
+	// The caller must make sure no pending command buffer still reads @range
+	void free(Stream stream, const rj::helper_functions::BufferWrapper &range);
+
+	uint32_t getBuffer(Stream stream) const { return streams[stream].buffer; }
+	VkDeviceSize getElementSize(Stream stream) const { return streams[stream].elementSize; }
+	const FreeListAllocator &getAllocator(Stream stream) const { return streams[stream].allocator; }
+
+protected:
+	static const uint32_t invalidBuffer = std::numeric_limits<uint32_t>::max();
+
+	struct StreamData
+	{
+		uint32_t buffer = invalidBuffer;
+		VkDeviceSize elementSize = 0;
+		FreeListAllocator allocator; // in elements
+	};
+
+	rj::VManager *pVulkanManager;
+	StreamData streams[STREAM_COUNT];
+};
@@ -99,7 +99,7 @@ namespace rj
 		uint32_t emissiveTexture = std::numeric_limits<uint32_t>::max();
 	};
 
-	// GLTFMesh is defined as an aggregate of all the geometry of the same material
+	// GLTFMesh is defined as an aggregate of all the geometry of a glTF mesh with the same material
 	struct GLTFMesh
 	{
 		std::vector<float> positions;
@@ -119,12 +119,25 @@ namespace rj
 	{
 		std::vector<uint32_t> children;
 		uint32_t mesh = std::numeric_limits<uint32_t>::max();
-		glm::mat4 local2parent;
+		glm::vec3 translation;
+		glm::quat rotation;
+		glm::vec3 scale;
+	};
+
+	// Node of the flattened hierarchy, parents come before their children (depth first)
+	struct GLTFSceneNode
+	{
+		uint32_t parent = std::numeric_limits<uint32_t>::max();
+		glm::vec3 translation;
+		glm::quat rotation;
+		glm::vec3 scale;
+		std::vector<uint32_t> meshes; // indices into GLTFScene::meshes
 	};
 
 	struct GLTFScene
 	{
 		std::vector<GLTFMesh> meshes;
+		std::vector<GLTFSceneNode> nodes;
 	};
 
 	class GLTFLoader
@@ -174,25 +187,25 @@ namespace rj
 			std::vector<GLTFMaterial> materials;
 			parseMaterial(materials, rootNode.get("materials").get<picojson::array>());
 
-			// Parse scene hierarchy
-			if (!rootNode.contains("nodes") || !rootNode.get("nodes").is<picojson::array>()) throw std::runtime_error("Invalid nodes");
-			std::unordered_map<uint32_t, glm::mat4> meshId2Transform;
-			parseSceneHierarchy(meshId2Transform, rootNode.get("nodes").get<picojson::array>());
-
 			// Parse meshes
 			if (!rootNode.contains("meshes") || !rootNode.get("meshes").is<picojson::array>()) throw std::runtime_error("Invalid meshes");
-			parseMeshes(scene->meshes, rootNode.get("meshes").get<picojson::array>(),
-				accessors, bufferViews, buffers, images, textures, materials, meshId2Transform);
+			std::vector<std::vector<uint32_t>> meshId2Meshes;
+			parseMeshes(scene->meshes, meshId2Meshes, rootNode.get("meshes").get<picojson::array>(),
+				accessors, bufferViews, buffers, images, textures, materials);
+
+			// Parse scene hierarchy
+			if (!rootNode.contains("nodes") || !rootNode.get("nodes").is<picojson::array>()) throw std::runtime_error("Invalid nodes");
+			parseSceneHierarchy(scene->nodes, scene->meshes, rootNode.get("nodes").get<picojson::array>(), meshId2Meshes);
 		}
 
 	private:
-		void parseSceneHierarchy(std::unordered_map<uint32_t, glm::mat4> &meshId2Transform, const picojson::array &nodes) const
+		// Node transforms are kept instead of being baked into the vertices, so meshes referenced by several nodes are shared.
+		// Subtrees under a node with non-uniform scale are the exception, those are baked and may add meshes to @meshes
+		void parseSceneHierarchy(std::vector<GLTFSceneNode> &sceneNodes, std::vector<GLTFMesh> &meshes, const picojson::array &nodes,
+			const std::vector<std::vector<uint32_t>> &meshId2Meshes) const
 		{
-			std::unordered_set<uint32_t> rootCandidates;
-			for (uint32_t i = 0; i < static_cast<uint32_t>(nodes.size()); ++i)
-			{
-				rootCandidates.insert(i);
-			}
+			std::vector<bool> isRoot(nodes.size(), true);
+			std::vector<uint32_t> meshRefCounts(meshId2Meshes.size(), 0);
 
 			std::vector<GLTFNode> ns(nodes.size());
 			uint32_t p = 0;
@@ -202,7 +215,11 @@ namespace rj
 				const auto &fields = node.get<picojson::object>();
 
 				GLTFNode &n = ns[p++];
-				if (fields.find("mesh") != fields.end()) n.mesh = static_cast<uint32_t>(fields.at("mesh").get<int64_t>());
+				if (fields.find("mesh") != fields.end())
+				{
+					n.mesh = static_cast<uint32_t>(fields.at("mesh").get<int64_t>());
+					++meshRefCounts.at(n.mesh);
+				}
 				
 				glm::vec3 trans(0.f);
 				if (fields.find("translation") != fields.end())
@@ -225,8 +242,9 @@ namespace rj
 					scale = glm::vec3(v3[0].get<double>(), v3[1].get<double>(), v3[2].get<double>());
 				}
 
-				glm::mat4 I; // identity
-				n.local2parent = glm::translate(I, trans) * glm::mat4_cast(rot) * glm::scale(I, scale);
+				n.translation = trans;
+				n.rotation = rot;
+				n.scale = scale;
 
 				if (fields.find("children") != fields.end())
 				{
@@ -234,46 +252,108 @@ namespace rj
 					for (const auto &childId : children)
 					{
 						n.children.push_back(static_cast<uint32_t>(childId.get<int64_t>()));
+						isRoot[n.children.back()] = false;
+					}
+				}
+			}
+
+			auto localTransform = [](const GLTFNode &n)
+			{
+				glm::mat4 I; // identity
+				return glm::translate(I, n.translation) * glm::mat4_cast(n.rotation) * glm::scale(I, n.scale);
+			};
 
-						if (rootCandidates.find(n.children.back()) != rootCandidates.end())
+			// A node with non-uniform scale is kept with an identity transform, its own transform and everything below it are
+			// baked into the vertices. Meshes no other node uses are transformed in place, shared ones are copied
+			std::function<void (uint32_t, const glm::mat4 &, uint32_t)> bake =
+				[&bake, &sceneNodes, &meshes, &ns, &meshId2Meshes, &meshRefCounts, &localTransform](uint32_t nodeId, const glm::mat4 &T, uint32_t sceneNodeIdx)
+			{
+				const auto &n = ns[nodeId];
+				if (n.mesh != std::numeric_limits<uint32_t>::max())
+				{
+					for (uint32_t meshIdx : meshId2Meshes.at(n.mesh))
+					{
+						if (meshRefCounts[n.mesh] > 1)
 						{
-							rootCandidates.erase(n.children.back());
+							GLTFMesh copy = meshes[meshIdx];
+							meshIdx = static_cast<uint32_t>(meshes.size());
+							meshes.push_back(std::move(copy));
 						}
+						transformMesh(meshes[meshIdx], T);
+						sceneNodes[sceneNodeIdx].meshes.push_back(meshIdx);
 					}
 				}
-			}
 
-			std::function<void (uint32_t, glm::mat4)> visit = [&visit, &meshId2Transform, &ns](uint32_t root, glm::mat4 T)
+				for (auto childId : n.children)
+				{
+					bake(childId, T * localTransform(ns[childId]), sceneNodeIdx);
+				}
+			};
+
+			std::function<void (uint32_t, uint32_t)> visit = [&visit, &bake, &sceneNodes, &ns, &meshId2Meshes, &localTransform](uint32_t nodeId, uint32_t parent)
 			{
-				const auto &n = ns[root];
-				T *= n.local2parent;
-				if (n.mesh != std::numeric_limits<uint32_t>::max()) meshId2Transform[n.mesh] = T;
+				const auto &n = ns[nodeId];
+				const uint32_t sceneNodeIdx = static_cast<uint32_t>(sceneNodes.size());
+				sceneNodes.emplace_back();
+				auto &sceneNode = sceneNodes.back();
+				sceneNode.parent = parent;
+
+				// the scene graph and instances only support uniform scale
+				const float scaleTolerance = 1e-4f * glm::max(glm::abs(n.scale.x), 1.f);
+				if (glm::abs(n.scale.y - n.scale.x) > scaleTolerance || glm::abs(n.scale.z - n.scale.x) > scaleTolerance)
+				{
+					sceneNode.translation = glm::vec3(0.f);
+					sceneNode.rotation = glm::quat(1.f, 0.f, 0.f, 0.f);
+					sceneNode.scale = glm::vec3(1.f);
+					bake(nodeId, localTransform(n), sceneNodeIdx);
+					return;
+				}
+
+				sceneNode.translation = n.translation;
+				sceneNode.rotation = n.rotation;
+				sceneNode.scale = n.scale;
+				if (n.mesh != std::numeric_limits<uint32_t>::max()) sceneNode.meshes = meshId2Meshes.at(n.mesh);
+
 				for (auto childId : n.children)
 				{
-					visit(childId, T);
+					visit(childId, sceneNodeIdx);
 				}
 			};
 
-			for (auto rc : rootCandidates)
+			for (uint32_t i = 0; i < static_cast<uint32_t>(ns.size()); ++i)
 			{
-				visit(rc, glm::mat4());
+				if (isRoot[i]) visit(i, std::numeric_limits<uint32_t>::max());
 			}
 		}
 
-		void parseMeshes(std::vector<GLTFMesh> &ms, const picojson::array &meshes,
+		static void transformMesh(GLTFMesh &m, const glm::mat4 &T)
+		{
+			glm::mat4 Tit = glm::transpose(glm::inverse(T));
+			for (size_t i = 0; i + 2 < m.positions.size(); i += 3)
+			{
+				glm::vec3 p = glm::vec3(T * glm::vec4(m.positions[i], m.positions[i + 1], m.positions[i + 2], 1.f));
+				m.positions[i] = p.x; m.positions[i + 1] = p.y; m.positions[i + 2] = p.z;
+			}
+			for (size_t i = 0; i + 2 < m.normals.size(); i += 3)
+			{
+				glm::vec3 n = glm::normalize(glm::vec3(Tit * glm::vec4(m.normals[i], m.normals[i + 1], m.normals[i + 2], 0.f)));
+				m.normals[i] = n.x; m.normals[i + 1] = n.y; m.normals[i + 2] = n.z;
+			}
+		}
+
+		// Primitives of a mesh that share a material are merged, @meshId2Meshes lists the results of each glTF mesh
+		void parseMeshes(std::vector<GLTFMesh> &ms, std::vector<std::vector<uint32_t>> &meshId2Meshes, const picojson::array &meshes,
 			const std::vector<GLTFAccessor> &accessors, const std::vector<GLTFBufferView> &bufferViews,
 			const std::vector<GLTFBuffer> &buffers, const std::vector<GLTFImage> &images,
-			const std::vector<GLTFTexture> &textures, const std::vector<GLTFMaterial> &materials,
-			const std::unordered_map<uint32_t, glm::mat4> &meshId2Transform) const
+			const std::vector<GLTFTexture> &textures, const std::vector<GLTFMaterial> &materials) const
 		{
-			std::unordered_map<uint32_t, uint32_t> mat2mesh;
+			meshId2Meshes.resize(meshes.size());
 
 			for (uint32_t meshId = 0; meshId < meshes.size(); ++meshId)
 			{
 				const auto &mesh = meshes[meshId];
+				std::unordered_map<uint32_t, uint32_t> mat2mesh;
 
-				glm::mat4 T = meshId2Transform.find(meshId) != meshId2Transform.end() ? meshId2Transform.at(meshId) : glm::mat4();
-				glm::mat4 Tit = glm::transpose(glm::inverse(T));
 				const auto &prims = mesh.get<picojson::object>().at("primitives").get<picojson::array>();
 
 				for (const auto &prim : prims)
@@ -284,10 +364,10 @@ namespace rj
 					if (mat2mesh.find(matId) == mat2mesh.end())
 					{
 						mat2mesh[matId] = static_cast<uint32_t>(ms.size());
+						meshId2Meshes[meshId].push_back(static_cast<uint32_t>(ms.size()));
 						ms.resize(ms.size() + 1);
 					}
-					uint32_t meshId = mat2mesh[matId];
-					auto &m = ms[meshId];
+					auto &m = ms[mat2mesh[matId]];
 
 					const auto &attributes = fields.at("attributes").get<picojson::object>();
 					uint32_t posAccId = static_cast<uint32_t>(attributes.at("POSITION").get<int64_t>());
@@ -309,12 +389,6 @@ namespace rj
 						uint32_t posStart = static_cast<uint32_t>(m.positions.size());
 						m.positions.resize(m.positions.size() + compCount);
 						memcpy(&m.positions[posStart], &buff[offset], size);
-
-						glm::vec3 *positions = reinterpret_cast<glm::vec3 *>(&m.positions[posStart]);
-						for (uint32_t i = 0; i < acc.count; ++i)
-						{
-							positions[i] = glm::vec3(T * glm::vec4(positions[i], 1.f));
-						}
 					}
 					// Normals
 					{
@@ -329,12 +403,6 @@ namespace rj
 						uint32_t nrmStart = static_cast<uint32_t>(m.normals.size());
 						m.normals.resize(m.normals.size() + compCount);
 						memcpy(&m.normals[nrmStart], &buff[offset], size);
-
-						glm::vec3 *normals = reinterpret_cast<glm::vec3 *>(&m.normals[nrmStart]);
-						for (uint32_t i = 0; i < acc.count; ++i)
-						{
-							normals[i] = glm::normalize(glm::vec3(Tit * glm::vec4(normals[i], 0.f)));
-						}
 					}
 					// Texture coordinates
 					{
@@ -1,6 +1,7 @@
 #define TINYGLTF_LOADER_IMPLEMENTATION
 #define STB_IMAGE_IMPLEMENTATION
 #include "deferred_renderer.h"
+#include "bvh.h"
 
 #ifdef USE_GLTF
 std::string GLTF_VERSION;
@@ -9,6 +10,56 @@ std::string GLTF_NAME;
 
 int main(int argc, char *argv[])
 {
+	if (argc > 1 && strcmp(argv[1], "--bvh_benchmark") == 0)
+	{
+		runBVHBenchmark(std::cout);
+		return EXIT_SUCCESS;
+	}
+
+	if (argc > 1 && strcmp(argv[1], "--occlusion_benchmark") == 0)
+	{
+		runSoftwareOcclusionBenchmark(std::cout);
+		return EXIT_SUCCESS;
+	}
+
+	if (argc > 1 && strcmp(argv[1], "--transform_benchmark") == 0)
+	{
+		runTransformBenchmark(std::cout);
+		return EXIT_SUCCESS;
+	}
+
+	// needs a device, so it runs with the default scene loaded
+	if (argc > 1 && strcmp(argv[1], "--descriptor_benchmark") == 0)
+	{
+		DeferredRenderer renderer;
+		try
+		{
+			renderer.runDescriptorUpdateBenchmark(std::cout);
+		}
+		catch (const std::runtime_error& e)
+		{
+			std::cerr << e.what() << std::endl;
+			return EXIT_FAILURE;
+		}
+		return EXIT_SUCCESS;
+	}
+
+	// runs the default scene in a window for a fixed number of frames per pacing mode
+	if (argc > 1 && strcmp(argv[1], "--frame_pacing_benchmark") == 0)
+	{
+		DeferredRenderer renderer;
+		try
+		{
+			renderer.runFramePacingBenchmark(std::cout);
+		}
+		catch (const std::runtime_error& e)
+		{
+			std::cerr << e.what() << std::endl;
+			return EXIT_FAILURE;
+		}
+		return EXIT_SUCCESS;
+	}
+
 #ifdef USE_GLTF
 	if (argc < 2 || (argc > 2 && strcmp(argv[1], "--gltf_version") != 0))
 	{
@@ -17,9 +68,20 @@ int main(int argc, char *argv[])
 	
 	GLTF_VERSION = argc > 2 ? argv[2] : "2.0";
 	GLTF_NAME = argv[argc - 1];
+#else
+	// instances of the drone scene laid out on a grid
+	uint32_t stressSceneDroneCount = 0;
+	if (argc > 2 && strcmp(argv[1], "--drone_stress_scene") == 0)
+	{
+		stressSceneDroneCount = static_cast<uint32_t>(std::stoul(argv[2]));
+	}
 #endif
 
+#ifdef USE_GLTF
 	DeferredRenderer renderer;
+#else
+	DeferredRenderer renderer(stressSceneDroneCount);
+#endif
 
 	try
 	{
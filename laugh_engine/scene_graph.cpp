@@ -0,0 +1,124 @@
+#include <cassert>
+#include <algorithm>
+#include "scene_graph.h"
+
+
+uint32_t SceneGraph::addNode(uint32_t parent, const glm::vec3 &position, const glm::quat &rotation, float scale)
+{
+	const uint32_t node = size();
+
+	// depth first order keeps every subtree contiguous, which only holds if the parent's subtree ends here
+	assert(parent == invalidNode || (parent < node && subtreeEnds[parent] == node));
+
+	parents.push_back(parent);
+	subtreeEnds.push_back(node + 1);
+	localPositions.push_back(position);
+	localRotations.push_back(rotation);
+	localScales.push_back(scale);
+	worldPositions.push_back(position);
+	worldRotations.push_back(rotation);
+	worldScales.push_back(scale);
+	nodeObjects.emplace_back();
+	dirtyFlags.push_back(0);
+
+	for (uint32_t ancestor = parent; ancestor != invalidNode; ancestor = parents[ancestor])
+	{
+		subtreeEnds[ancestor] = node + 1;
+	}
+
+	markDirty(node);
+	return node;
+}
+
+void SceneGraph::clear()
+{
+	parents.clear();
+	subtreeEnds.clear();
+	localPositions.clear();
+	localRotations.clear();
+	localScales.clear();
+	worldPositions.clear();
+	worldRotations.clear();
+	worldScales.clear();
+	nodeObjects.clear();
+	dirtyFlags.clear();
+	dirtyNodes.clear();
+	updatedNodes.clear();
+}
+
+void SceneGraph::setLocalPosition(uint32_t node, const glm::vec3 &position)
+{
+	localPositions[node] = position;
+	markDirty(node);
+}
+
+void SceneGraph::setLocalRotation(uint32_t node, const glm::quat &rotation)
+{
+	localRotations[node] = rotation;
+	markDirty(node);
+}
+
+void SceneGraph::setLocalScale(uint32_t node, float scale)
+{
+	assert(scale != 0.f);
+	localScales[node] = scale;
+	markDirty(node);
+}
+
+void SceneGraph::attachObject(uint32_t node, uint32_t objectIdx)
+{
+	nodeObjects[node].push_back(objectIdx);
+	markDirty(node);
+}
+
+void SceneGraph::detachObject(uint32_t node, uint32_t objectIdx)
+{
+	auto &objects = nodeObjects[node];
+	auto it = std::find(objects.begin(), objects.end(), objectIdx);
+	assert(it != objects.end());
+	objects.erase(it);
+}
+
+void SceneGraph::markDirty(uint32_t node)
+{
+	if (dirtyFlags[node]) return;
+	dirtyFlags[node] = 1;
+	dirtyNodes.push_back(node);
+}
+
+const std::vector<uint32_t> &SceneGraph::update()
+{
+	updatedNodes.clear();
+
+	// a dirty node inside a subtree that is updated anyway needs no pass of its own
+	std::sort(dirtyNodes.begin(), dirtyNodes.end());
+	uint32_t updatedEnd = 0;
+	for (uint32_t dirtyNode : dirtyNodes)
+	{
+		dirtyFlags[dirtyNode] = 0;
+		if (dirtyNode < updatedEnd) continue;
+
+		// parents come first, so the world transform of a node's parent is always final when it is reached
+		updatedEnd = subtreeEnds[dirtyNode];
+		for (uint32_t node = dirtyNode; node < updatedEnd; ++node)
+		{
+			const uint32_t parent = parents[node];
+			if (parent == invalidNode)
+			{
+				worldPositions[node] = localPositions[node];
+				worldRotations[node] = localRotations[node];
+				worldScales[node] = localScales[node];
+			}
+			else
+			{
+				worldPositions[node] = worldPositions[parent] + worldRotations[parent] * (worldScales[parent] * localPositions[node]);
+				worldRotations[node] = worldRotations[parent] * localRotations[node];
+				worldScales[node] = worldScales[parent] * localScales[node];
+			}
+			updatedNodes.push_back(node);
+		}
+	}
+	dirtyNodes.clear();
+
+	return updatedNodes;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <vector>
+#include "glm/glm.hpp"
+#include "glm/gtc/quaternion.hpp"
+
+
+// Node hierarchy with local TRS (uniform scale) stored in flat arrays in depth first order, so the
+// subtree of node i is the contiguous range [i, getSubtreeEnd(i)). World transforms are only recomputed
+// for the subtrees of nodes that changed, each in one linear pass over its range.
+// Objects attached to a node follow its world transform, see VScene::updateSceneGraph()
+class SceneGraph
+{
+public:
+	static const uint32_t invalidNode = std::numeric_limits<uint32_t>::max();
+
+	// Nodes must be added depth first: @parent is invalidNode or an ancestor of (or) the last added node.
+	// Returns the index of the new node, which starts dirty
+	uint32_t addNode(uint32_t parent, const glm::vec3 &position = glm::vec3(0.f), const glm::quat &rotation = glm::quat(), float scale = 1.f);
+	void clear();
+
+	void setLocalPosition(uint32_t node, const glm::vec3 &position);
+	void setLocalRotation(uint32_t node, const glm::quat &rotation);
+	void setLocalScale(uint32_t node, float scale);
+
+	uint32_t size() const { return static_cast<uint32_t>(parents.size()); }
+	uint32_t getParent(uint32_t node) const { return parents[node]; }
+	uint32_t getSubtreeEnd(uint32_t node) const { return subtreeEnds[node]; }
+
+	const glm::vec3 &getLocalPosition(uint32_t node) const { return localPositions[node]; }
+	const glm::quat &getLocalRotation(uint32_t node) const { return localRotations[node]; }
+	float getLocalScale(uint32_t node) const { return localScales[node]; }
+
+	// Valid after update()
+	const glm::vec3 &getWorldPosition(uint32_t node) const { return worldPositions[node]; }
+	const glm::quat &getWorldRotation(uint32_t node) const { return worldRotations[node]; }
+	float getWorldScale(uint32_t node) const { return worldScales[node]; }
+
+	// The node is marked dirty so that the object takes its world transform on the next update()
+	void attachObject(uint32_t node, uint32_t objectIdx);
+	void detachObject(uint32_t node, uint32_t objectIdx);
+	const std::vector<uint32_t> &getObjects(uint32_t node) const { return nodeObjects[node]; }
+
+	// Recomputes the world transforms of the dirty subtrees and returns the nodes that were updated
+	const std::vector<uint32_t> &update();
+
+protected:
+	std::vector<uint32_t> parents;
+	std::vector<uint32_t> subtreeEnds;
+	std::vector<glm::vec3> localPositions;
+	std::vector<glm::quat> localRotations;
+	std::vector<float> localScales;
+	std::vector<glm::vec3> worldPositions;
+	std::vector<glm::quat> worldRotations;
+	std::vector<float> worldScales;
+	std::vector<std::vector<uint32_t>> nodeObjects;
+
+	std::vector<uint8_t> dirtyFlags;
+	std::vector<uint32_t> dirtyNodes;
+	std::vector<uint32_t> updatedNodes;
+
+	void markDirty(uint32_t node);
+};
@@ -0,0 +1,367 @@
+#include <cassert>
+#include <cmath>
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <limits>
+#include <random>
+#include <xmmintrin.h>
+#include "glm/gtc/matrix_transform.hpp"
+#include "software_occlusion.h"
+
+
+SoftwareOcclusionCuller::SoftwareOcclusionCuller()
+	: depthBuffer(width * height, 1.f), tileMaxDepth(tileCountX * tileCountY, 1.f)
+{
+	static_assert(width % tileWidth == 0 && height % tileHeight == 0, "buffer must be made of whole tiles");
+	static_assert(tileWidth % 4 == 0, "tiles are processed 4 pixels at a time");
+}
+
+void SoftwareOcclusionCuller::reserve(uint32_t maxTriangleCount, uint32_t maxObjectCount)
+{
+	// any thread may end up setting up all of the triangles
+	perThreadTriangles.resize(pThreadPool ? pThreadPool->getThreadCount() : 1);
+	for (auto &triangles : perThreadTriangles) triangles.reserve(maxTriangleCount);
+	occluded.reserve(maxObjectCount);
+}
+
+void SoftwareOcclusionCuller::renderOccluders(const glm::mat4 &newVP, const std::vector<Occluder> &occluders)
+{
+	typedef std::chrono::high_resolution_clock Clock;
+	auto start = Clock::now();
+
+	VP = newVP;
+	const uint32_t threadCount = pThreadPool ? pThreadPool->getThreadCount() : 1;
+	perThreadTriangles.resize(threadCount);
+	for (auto &triangles : perThreadTriangles) triangles.clear();
+
+	// transform and set up triangles, one occluder per task
+	auto setupTask = [&](uint32_t occluderIdx, uint32_t threadIdx)
+	{
+		setupTriangles(occluders[occluderIdx], perThreadTriangles[threadIdx]);
+	};
+	if (pThreadPool)
+	{
+		pThreadPool->parallelFor(static_cast<uint32_t>(occluders.size()), setupTask);
+	}
+	else
+	{
+		for (uint32_t i = 0; i < occluders.size(); ++i) setupTask(i, 0);
+	}
+
+	// each tile row is owned by one task, so no two threads write the same pixels
+	auto rasterTask = [this](uint32_t tileRow, uint32_t)
+	{
+		rasterizeTileRow(tileRow);
+	};
+	if (pThreadPool)
+	{
+		pThreadPool->parallelFor(tileCountY, rasterTask);
+	}
+	else
+	{
+		for (uint32_t i = 0; i < tileCountY; ++i) rasterTask(i, 0);
+	}
+
+	stats.occluderTriangleCount = 0;
+	for (const auto &triangles : perThreadTriangles)
+	{
+		stats.occluderTriangleCount += static_cast<uint32_t>(triangles.size());
+	}
+	stats.rasterizeTimeMS = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+void SoftwareOcclusionCuller::cullObjects(const std::vector<BBox> &objectBounds, std::vector<uint32_t> &objects)
+{
+	typedef std::chrono::high_resolution_clock Clock;
+	auto start = Clock::now();
+
+	const uint32_t objectCount = static_cast<uint32_t>(objects.size());
+	const uint32_t batchSize = 64;
+	const uint32_t batchCount = (objectCount + batchSize - 1) / batchSize;
+	occluded.resize(objectCount);
+
+	auto testTask = [&](uint32_t batchIdx, uint32_t)
+	{
+		uint32_t end = std::min((batchIdx + 1) * batchSize, objectCount);
+		for (uint32_t i = batchIdx * batchSize; i < end; ++i)
+		{
+			occluded[i] = isOccluded(objectBounds[objects[i]]) ? 1 : 0;
+		}
+	};
+	if (pThreadPool)
+	{
+		pThreadPool->parallelFor(batchCount, testTask);
+	}
+	else
+	{
+		for (uint32_t i = 0; i < batchCount; ++i) testTask(i, 0);
+	}
+
+	uint32_t visibleCount = 0;
+	for (uint32_t i = 0; i < objectCount; ++i)
+	{
+		if (!occluded[i]) objects[visibleCount++] = objects[i];
+	}
+	objects.resize(visibleCount);
+
+	stats.testedCount = objectCount;
+	stats.occludedCount = objectCount - visibleCount;
+	stats.testTimeMS = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+void SoftwareOcclusionCuller::setupTriangles(const Occluder &occluder, std::vector<ScreenTriangle> &triangles) const
+{
+	const glm::mat4 MVP = VP * occluder.M;
+	const glm::vec2 screenScale(0.5f * width, 0.5f * height);
+
+	for (uint32_t i = 0; i + 2 < occluder.indexCount; i += 3)
+	{
+		ScreenTriangle tri;
+		tri.maxDepth = 0.f;
+		bool clipped = false;
+
+		for (uint32_t k = 0; k < 3; ++k)
+		{
+			glm::vec4 clipPos = MVP * glm::vec4(occluder.positions[occluder.indices[i + k]], 1.f);
+
+			// dropping occluders that cross the near plane is conservative
+			if (clipPos.w <= 1e-5f)
+			{
+				clipped = true;
+				break;
+			}
+
+			float invW = 1.f / clipPos.w;
+			tri.v[k] = (glm::vec2(clipPos) * invW + 1.f) * screenScale;
+			tri.maxDepth = std::max(tri.maxDepth, clipPos.z * invW);
+		}
+		if (clipped || tri.maxDepth > 1.f) continue;
+
+		// counter-clockwise in pixel space so that the interior has positive edge functions
+		glm::vec2 e0 = tri.v[1] - tri.v[0], e1 = tri.v[2] - tri.v[0];
+		float area = e0.x * e1.y - e0.y * e1.x;
+		if (area == 0.f) continue;
+		if (area < 0.f) std::swap(tri.v[1], tri.v[2]);
+
+		glm::vec2 minV = glm::min(glm::min(tri.v[0], tri.v[1]), tri.v[2]);
+		glm::vec2 maxV = glm::max(glm::max(tri.v[0], tri.v[1]), tri.v[2]);
+		if (maxV.x < 0.f || maxV.y < 0.f || minV.x >= width || minV.y >= height) continue;
+
+		tri.minX = std::max(static_cast<int32_t>(minV.x), 0);
+		tri.minY = std::max(static_cast<int32_t>(minV.y), 0);
+		tri.maxX = std::min(static_cast<int32_t>(maxV.x), static_cast<int32_t>(width) - 1);
+		tri.maxY = std::min(static_cast<int32_t>(maxV.y), static_cast<int32_t>(height) - 1);
+
+		triangles.push_back(tri);
+	}
+}
+
+void SoftwareOcclusionCuller::rasterizeTileRow(uint32_t tileRow)
+{
+	const int32_t rowBegin = static_cast<int32_t>(tileRow * tileHeight);
+	const int32_t rowEnd = rowBegin + static_cast<int32_t>(tileHeight) - 1;
+
+	std::fill(depthBuffer.begin() + rowBegin * width, depthBuffer.begin() + (rowEnd + 1) * width, 1.f);
+
+	const __m128 laneOffsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+	const __m128 zero = _mm_setzero_ps();
+
+	for (const auto &triangles : perThreadTriangles)
+	{
+		for (const auto &tri : triangles)
+		{
+			if (tri.maxY < rowBegin || tri.minY > rowEnd) continue;
+
+			// edge i goes from v[i] to v[i + 1], E(p) = A * p.x + B * p.y + C
+			float A[3], B[3], C[3];
+			for (uint32_t k = 0; k < 3; ++k)
+			{
+				const glm::vec2 &a = tri.v[k];
+				const glm::vec2 &b = tri.v[(k + 1) % 3];
+				A[k] = a.y - b.y;
+				B[k] = b.x - a.x;
+				C[k] = -(A[k] * a.x + B[k] * a.y);
+			}
+
+			const __m128 triDepth = _mm_set1_ps(tri.maxDepth);
+			const int32_t yBegin = std::max(tri.minY, rowBegin);
+			const int32_t yEnd = std::min(tri.maxY, rowEnd);
+			const int32_t xBegin = tri.minX & ~3;
+
+			for (int32_t y = yBegin; y <= yEnd; ++y)
+			{
+				const float py = static_cast<float>(y) + 0.5f;
+				float *row = &depthBuffer[y * width];
+
+				for (int32_t x = xBegin; x <= tri.maxX; x += 4)
+				{
+					__m128 px = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), laneOffsets);
+					__m128 inside = _mm_cmpeq_ps(zero, zero);
+					for (uint32_t k = 0; k < 3; ++k)
+					{
+						__m128 e = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(A[k]), px), _mm_set1_ps(B[k] * py + C[k]));
+						inside = _mm_and_ps(inside, _mm_cmpge_ps(e, zero));
+					}
+					if (_mm_movemask_ps(inside) == 0) continue;
+
+					__m128 depth = _mm_loadu_ps(row + x);
+					__m128 closer = _mm_min_ps(depth, triDepth);
+					_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, closer), _mm_andnot_ps(inside, depth)));
+				}
+			}
+		}
+	}
+
+	// farthest depth of each tile in this row
+	for (uint32_t tx = 0; tx < tileCountX; ++tx)
+	{
+		__m128 tileMax = zero;
+		for (int32_t y = rowBegin; y <= rowEnd; ++y)
+		{
+			const float *row = &depthBuffer[y * width + tx * tileWidth];
+			for (uint32_t x = 0; x < tileWidth; x += 4)
+			{
+				tileMax = _mm_max_ps(tileMax, _mm_loadu_ps(row + x));
+			}
+		}
+
+		float lanes[4];
+		_mm_storeu_ps(lanes, tileMax);
+		tileMaxDepth[tileRow * tileCountX + tx] = std::max(std::max(lanes[0], lanes[1]), std::max(lanes[2], lanes[3]));
+	}
+}
+
+bool SoftwareOcclusionCuller::isOccluded(const BBox &bounds) const
+{
+	glm::vec2 minV(std::numeric_limits<float>::max());
+	glm::vec2 maxV(-std::numeric_limits<float>::max());
+	float minDepth = 1.f;
+
+	for (uint32_t i = 0; i < 8; ++i)
+	{
+		glm::vec3 corner((i & 1) ? bounds.max.x : bounds.min.x, (i & 2) ? bounds.max.y : bounds.min.y, (i & 4) ? bounds.max.z : bounds.min.z);
+		glm::vec4 clipPos = VP * glm::vec4(corner, 1.f);
+
+		// boxes crossing the near plane are always visible
+		if (clipPos.w <= 1e-5f) return false;
+
+		float invW = 1.f / clipPos.w;
+		glm::vec2 screenPos = (glm::vec2(clipPos) * invW + 1.f) * glm::vec2(0.5f * width, 0.5f * height);
+		minV = glm::min(minV, screenPos);
+		maxV = glm::max(maxV, screenPos);
+		minDepth = std::min(minDepth, clipPos.z * invW);
+	}
+
+	if (maxV.x < 0.f || maxV.y < 0.f || minV.x >= width || minV.y >= height) return false;
+
+	const int32_t x0 = std::max(static_cast<int32_t>(minV.x), 0);
+	const int32_t y0 = std::max(static_cast<int32_t>(minV.y), 0);
+	const int32_t x1 = std::min(static_cast<int32_t>(maxV.x), static_cast<int32_t>(width) - 1);
+	const int32_t y1 = std::min(static_cast<int32_t>(maxV.y), static_cast<int32_t>(height) - 1);
+
+	const __m128 boxDepth = _mm_set1_ps(minDepth);
+
+	for (int32_t ty = y0 / tileHeight; ty <= y1 / static_cast<int32_t>(tileHeight); ++ty)
+	{
+		for (int32_t tx = x0 / tileWidth; tx <= x1 / static_cast<int32_t>(tileWidth); ++tx)
+		{
+			if (minDepth > tileMaxDepth[ty * tileCountX + tx]) continue;
+
+			// the tile is not fully in front of the box, check the covered pixels.
+			// Rows are widened to multiples of 4 pixels, which can only make the box more visible
+			const int32_t rowBegin = std::max(y0, ty * static_cast<int32_t>(tileHeight));
+			const int32_t rowEnd = std::min(y1, (ty + 1) * static_cast<int32_t>(tileHeight) - 1);
+			const int32_t colBegin = std::max(x0, tx * static_cast<int32_t>(tileWidth)) & ~3;
+			const int32_t colEnd = std::min(x1, (tx + 1) * static_cast<int32_t>(tileWidth) - 1);
+
+			for (int32_t y = rowBegin; y <= rowEnd; ++y)
+			{
+				const float *row = &depthBuffer[y * width];
+				for (int32_t x = colBegin; x <= colEnd; x += 4)
+				{
+					if (_mm_movemask_ps(_mm_cmpge_ps(_mm_loadu_ps(row + x), boxDepth)) != 0) return false;
+				}
+			}
+		}
+	}
+
+	return true;
+}
+
+void runSoftwareOcclusionBenchmark(std::ostream &os)
+{
+	typedef std::chrono::high_resolution_clock Clock;
+	auto elapsedMS = [](Clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	};
+
+	const uint32_t wallCount = 2000;
+	const uint32_t objectCount = 10000;
+	const uint32_t frameCount = 50;
+
+	std::mt19937 rng(1234);
+	std::uniform_real_distribution<float> posDist(-50.f, 50.f);
+	std::uniform_real_distribution<float> depthDist(5.f, 100.f);
+	std::uniform_real_distribution<float> sizeDist(0.5f, 4.f);
+
+	// a unit quad in the xy plane instanced as camera facing walls
+	const std::vector<glm::vec3> quad = { glm::vec3(-1.f, -1.f, 0.f), glm::vec3(1.f, -1.f, 0.f), glm::vec3(1.f, 1.f, 0.f), glm::vec3(-1.f, 1.f, 0.f) };
+	const std::vector<uint32_t> quadIndices = { 0, 1, 2, 0, 2, 3 };
+
+	std::vector<SoftwareOcclusionCuller::Occluder> occluders(wallCount);
+	for (auto &occluder : occluders)
+	{
+		occluder.positions = quad.data();
+		occluder.indices = quadIndices.data();
+		occluder.indexCount = static_cast<uint32_t>(quadIndices.size());
+		occluder.M = glm::scale(glm::translate(glm::mat4(), glm::vec3(posDist(rng), 0.2f * posDist(rng), -depthDist(rng))),
+			glm::vec3(sizeDist(rng) * 2.f, sizeDist(rng), 1.f));
+	}
+
+	std::vector<BBox> bounds(objectCount);
+	for (auto &b : bounds)
+	{
+		glm::vec3 c(posDist(rng), 0.2f * posDist(rng), -depthDist(rng));
+		glm::vec3 e(0.25f * sizeDist(rng));
+		b = BBox(c - e, c + e);
+	}
+
+	const glm::mat4 P = glm::perspective(glm::radians(60.f), 2.f, 1.f, 200.f);
+	const glm::mat4 V = glm::lookAt(glm::vec3(0.f), glm::vec3(0.f, 0.f, -1.f), glm::vec3(0.f, 1.f, 0.f));
+
+	os << std::fixed << std::setprecision(3);
+
+	std::vector<uint32_t> workerCounts = { 0 };
+	if (ThreadPool::defaultWorkerCount() > 0) workerCounts.push_back(ThreadPool::defaultWorkerCount());
+
+	for (uint32_t workerCount : workerCounts)
+	{
+		ThreadPool pool(workerCount);
+		SoftwareOcclusionCuller culler;
+		culler.setThreadPool(&pool);
+
+		double rasterMS = 0.0, testMS = 0.0, totalMS = 0.0;
+		std::vector<uint32_t> objects;
+		for (uint32_t frame = 0; frame < frameCount; ++frame)
+		{
+			objects.resize(objectCount);
+			for (uint32_t i = 0; i < objectCount; ++i) objects[i] = i;
+
+			auto start = Clock::now();
+			culler.renderOccluders(P * V, occluders);
+			culler.cullObjects(bounds, objects);
+			totalMS += elapsedMS(start);
+			rasterMS += culler.getStats().rasterizeTimeMS;
+			testMS += culler.getStats().testTimeMS;
+		}
+
+		const auto &stats = culler.getStats();
+		os << "threads " << pool.getThreadCount() << ": " << stats.occluderTriangleCount << " occluder triangles, "
+			<< stats.occludedCount << " / " << stats.testedCount << " boxes culled ("
+			<< 100.0 * stats.occludedCount / stats.testedCount << "%)\n"
+			<< "  rasterize " << rasterMS / frameCount << " ms, test " << testMS / frameCount << " ms, total "
+			<< totalMS / frameCount << " ms per frame\n";
+	}
+}
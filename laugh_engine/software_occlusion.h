@@ -0,0 +1,80 @@
+#pragma once
+
+#include <ostream>
+#include "culling.h"
+#include "thread_pool.h"
+
+
+// CPU occlusion culling against a small depth buffer. Occluders must not cover more than the real surface,
+// so they are the meshes' own triangles rather than simplified proxies. Occluder triangles are rasterized with a flat depth equal to
+// their farthest vertex, so the buffer holds, per pixel, a depth that all occluders covering it are in front of.
+// The buffer is split into tiles that also store their farthest depth, so most occludee tests never touch pixels.
+// Rasterization is split by tile rows across the thread pool and uses SSE to process 4 pixels at a time
+class SoftwareOcclusionCuller
+{
+public:
+	static const uint32_t width = 256;
+	static const uint32_t height = 128;
+	static const uint32_t tileWidth = 32;
+	static const uint32_t tileHeight = 8;
+	static const uint32_t tileCountX = width / tileWidth;
+	static const uint32_t tileCountY = height / tileHeight;
+
+	struct Occluder
+	{
+		const glm::vec3 *positions;
+		const uint32_t *indices;
+		uint32_t indexCount;
+		glm::mat4 M;
+	};
+
+	struct Stats
+	{
+		uint32_t occluderTriangleCount = 0;
+		uint32_t testedCount = 0;
+		uint32_t occludedCount = 0;
+		double rasterizeTimeMS = 0.0;
+		double testTimeMS = 0.0;
+	};
+
+	SoftwareOcclusionCuller();
+
+	void setThreadPool(ThreadPool *pPool) { pThreadPool = pPool; }
+
+	// Makes room for @maxTriangleCount occluder triangles and @maxObjectCount tested objects,
+	// so that neither renderOccluders() nor cullObjects() allocates as long as they fit
+	void reserve(uint32_t maxTriangleCount, uint32_t maxObjectCount);
+
+	// Clears the depth buffer and rasterizes @occluders as seen through @VP
+	void renderOccluders(const glm::mat4 &VP, const std::vector<Occluder> &occluders);
+
+	// Removes the objects whose bounds are hidden behind the occluders from @objects
+	void cullObjects(const std::vector<BBox> &objectBounds, std::vector<uint32_t> &objects);
+
+	const Stats &getStats() const { return stats; }
+	const float *getDepthBuffer() const { return depthBuffer.data(); }
+
+protected:
+	struct ScreenTriangle
+	{
+		glm::vec2 v[3];
+		float maxDepth;
+		int32_t minX, maxX, minY, maxY; // pixel bounds, inclusive
+	};
+
+	ThreadPool *pThreadPool = nullptr;
+
+	glm::mat4 VP;
+	std::vector<float> depthBuffer; // row major
+	std::vector<float> tileMaxDepth;
+	std::vector<std::vector<ScreenTriangle>> perThreadTriangles;
+	std::vector<uint8_t> occluded;
+	Stats stats;
+
+	void setupTriangles(const Occluder &occluder, std::vector<ScreenTriangle> &triangles) const;
+	void rasterizeTileRow(uint32_t tileRow);
+	bool isOccluded(const BBox &bounds) const;
+};
+
+// Rasterizes a few thousand random occluders and culls 10k boxes behind them, then prints the timings
+void runSoftwareOcclusionBenchmark(std::ostream &os);
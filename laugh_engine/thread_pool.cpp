@@ -0,0 +1,95 @@
+#include "thread_pool.h"
+
+
+ThreadPool::ThreadPool(uint32_t workerCount)
+{
+	workers.reserve(workerCount);
+	for (uint32_t i = 0; i < workerCount; ++i)
+	{
+		workers.emplace_back(&ThreadPool::workerLoop, this, i + 1);
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(jobMutex);
+		quit = true;
+	}
+	jobStarted.notify_all();
+
+	for (auto &worker : workers)
+	{
+		worker.join();
+	}
+}
+
+uint32_t ThreadPool::defaultWorkerCount()
+{
+	uint32_t hwThreads = std::thread::hardware_concurrency();
+	return hwThreads > 1 ? hwThreads - 1 : 0;
+}
+
+void ThreadPool::parallelFor(uint32_t taskCount, TaskFunc func, const void *context)
+{
+	if (taskCount == 0) return;
+
+	if (workers.empty() || taskCount == 1)
+	{
+		for (uint32_t i = 0; i < taskCount; ++i) func(context, i, 0);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(jobMutex);
+		jobFunc = func;
+		jobContext = context;
+		jobTaskCount = taskCount;
+		nextTask = 0;
+		busyWorkerCount = static_cast<uint32_t>(workers.size());
+		++jobId;
+	}
+	jobStarted.notify_all();
+
+	runTasks(0);
+
+	// workers still reference @context, so wait for all of them to leave the job
+	std::unique_lock<std::mutex> lock(jobMutex);
+	jobFinished.wait(lock, [this]() { return busyWorkerCount == 0; });
+	jobFunc = nullptr;
+	jobContext = nullptr;
+}
+
+void ThreadPool::workerLoop(uint32_t threadIdx)
+{
+	uint64_t lastJobId = 0;
+
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(jobMutex);
+			jobStarted.wait(lock, [&]() { return quit || jobId != lastJobId; });
+			if (quit) return;
+			lastJobId = jobId;
+		}
+
+		runTasks(threadIdx);
+
+		bool last;
+		{
+			std::lock_guard<std::mutex> lock(jobMutex);
+			last = --busyWorkerCount == 0;
+		}
+		if (last) jobFinished.notify_one();
+	}
+}
+
+void ThreadPool::runTasks(uint32_t threadIdx)
+{
+	while (true)
+	{
+		uint32_t task = nextTask.fetch_add(1);
+		if (task >= jobTaskCount) break;
+		jobFunc(jobContext, task, threadIdx);
+	}
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+
+// Fixed set of worker threads for data parallel loops. The calling thread takes part in every job,
+// so a pool with 0 workers simply runs jobs inline
+class ThreadPool
+{
+public:
+	// @workerCount excludes the calling thread
+	explicit ThreadPool(uint32_t workerCount = defaultWorkerCount());
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool &) = delete;
+	ThreadPool &operator=(const ThreadPool &) = delete;
+
+	typedef void (*TaskFunc)(const void *context, uint32_t taskIdx, uint32_t threadIdx);
+
+	// Calls @func(taskIdx, threadIdx) for every task in [0, @taskCount) and returns once all are done.
+	// threadIdx is in [0, getThreadCount()) and can be used to index per-thread scratch data
+	template <typename Func>
+	void parallelFor(uint32_t taskCount, const Func &func)
+	{
+		// the callable stays where it is, so no std::function has to be built per job
+		parallelFor(taskCount, [](const void *context, uint32_t taskIdx, uint32_t threadIdx)
+		{
+			(*static_cast<const Func *>(context))(taskIdx, threadIdx);
+		}, &func);
+	}
+
+	void parallelFor(uint32_t taskCount, TaskFunc func, const void *context);
+
+	uint32_t getThreadCount() const { return static_cast<uint32_t>(workers.size()) + 1; }
+
+	static uint32_t defaultWorkerCount();
+
+protected:
+	std::vector<std::thread> workers;
+
+	std::mutex jobMutex;
+	std::condition_variable jobStarted;
+	std::condition_variable jobFinished;
+	uint64_t jobId = 0;
+	bool quit = false;
+
+	TaskFunc jobFunc = nullptr;
+	const void *jobContext = nullptr;
+	uint32_t jobTaskCount = 0;
+	std::atomic<uint32_t> nextTask{ 0 };
+	uint32_t busyWorkerCount = 0;
+
+	void workerLoop(uint32_t threadIdx);
+	void runTasks(uint32_t threadIdx);
+};
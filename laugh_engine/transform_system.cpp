@@ -0,0 +1,304 @@
+#include <cassert>
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <random>
+#include <xmmintrin.h>
+#include "glm/gtc/matrix_transform.hpp"
+#include "glm/gtc/constants.hpp"
+#include "transform_system.h"
+
+
+uint32_t TransformSystem::add(const glm::vec3 &position, const glm::quat &rotation, float scale)
+{
+	const uint32_t idx = count++;
+
+	if (idx == posX.size())
+	{
+		// grow by a whole SSE batch of identity transforms
+		const size_t paddedSize = posX.size() + 4;
+		posX.resize(paddedSize, 0.f);
+		posY.resize(paddedSize, 0.f);
+		posZ.resize(paddedSize, 0.f);
+		rotX.resize(paddedSize, 0.f);
+		rotY.resize(paddedSize, 0.f);
+		rotZ.resize(paddedSize, 0.f);
+		rotW.resize(paddedSize, 1.f);
+		scales.resize(paddedSize, 1.f);
+		transforms.resize(paddedSize);
+		dirtyBits.resize((paddedSize + 63) / 64, 0);
+	}
+
+	posX[idx] = position.x;
+	posY[idx] = position.y;
+	posZ[idx] = position.z;
+	rotX[idx] = rotation.x;
+	rotY[idx] = rotation.y;
+	rotZ[idx] = rotation.z;
+	rotW[idx] = rotation.w;
+	scales[idx] = scale;
+	markDirty(idx);
+
+	return idx;
+}
+
+void TransformSystem::clear()
+{
+	count = 0;
+	posX.clear();
+	posY.clear();
+	posZ.clear();
+	rotX.clear();
+	rotY.clear();
+	rotZ.clear();
+	rotW.clear();
+	scales.clear();
+	dirtyBits.clear();
+	transforms.clear();
+}
+
+void TransformSystem::setPosition(uint32_t idx, const glm::vec3 &position)
+{
+	assert(idx < count);
+	posX[idx] = position.x;
+	posY[idx] = position.y;
+	posZ[idx] = position.z;
+	markDirty(idx);
+}
+
+void TransformSystem::setRotation(uint32_t idx, const glm::quat &rotation)
+{
+	assert(idx < count);
+	rotX[idx] = rotation.x;
+	rotY[idx] = rotation.y;
+	rotZ[idx] = rotation.z;
+	rotW[idx] = rotation.w;
+	markDirty(idx);
+}
+
+void TransformSystem::setScale(uint32_t idx, float scale)
+{
+	assert(idx < count && scale != 0.f);
+	scales[idx] = scale;
+	markDirty(idx);
+}
+
+glm::mat4 TransformSystem::computeModelMatrix(uint32_t idx) const
+{
+	glm::mat4 M = glm::mat4_cast(getRotation(idx));
+	M[0] *= scales[idx];
+	M[1] *= scales[idx];
+	M[2] *= scales[idx];
+	M[3] = glm::vec4(getPosition(idx), 1.f);
+	return M;
+}
+
+uint32_t TransformSystem::getDirtyCount() const
+{
+	uint32_t dirtyCount = 0;
+	forEachDirty([&dirtyCount](uint32_t) { ++dirtyCount; });
+	return dirtyCount;
+}
+
+void TransformSystem::update(ThreadPool *pThreadPool)
+{
+	const uint32_t taskCount = (count + objectsPerTask - 1) / objectsPerTask;
+	auto task = [this](uint32_t taskIdx, uint32_t)
+	{
+		updateRange(taskIdx * objectsPerTask, std::min((taskIdx + 1) * objectsPerTask, count));
+	};
+
+	if (pThreadPool)
+	{
+		pThreadPool->parallelFor(taskCount, task);
+	}
+	else
+	{
+		for (uint32_t i = 0; i < taskCount; ++i) task(i, 0);
+	}
+}
+
+void TransformSystem::clearDirty()
+{
+	std::fill(dirtyBits.begin(), dirtyBits.end(), 0);
+}
+
+void TransformSystem::updateRange(uint32_t first, uint32_t last)
+{
+	assert(first % 4 == 0);
+
+	const __m128 one = _mm_set1_ps(1.f);
+	const __m128 two = _mm_set1_ps(2.f);
+	const __m128 zero = _mm_setzero_ps();
+
+	for (uint32_t i = first; i < last; i += 4)
+	{
+		// batches without dirty objects keep their transforms
+		if ((dirtyBits[i / 64] >> (i % 64) & 0xf) == 0) continue;
+
+		const __m128 qx = _mm_loadu_ps(&rotX[i]);
+		const __m128 qy = _mm_loadu_ps(&rotY[i]);
+		const __m128 qz = _mm_loadu_ps(&rotZ[i]);
+		const __m128 qw = _mm_loadu_ps(&rotW[i]);
+		const __m128 s = _mm_loadu_ps(&scales[i]);
+		const __m128 px = _mm_loadu_ps(&posX[i]);
+		const __m128 py = _mm_loadu_ps(&posY[i]);
+		const __m128 pz = _mm_loadu_ps(&posZ[i]);
+
+		// rotation matrix, same layout as glm::mat3_cast: r[column][row]
+		const __m128 xx = _mm_mul_ps(qx, qx), yy = _mm_mul_ps(qy, qy), zz = _mm_mul_ps(qz, qz);
+		const __m128 xy = _mm_mul_ps(qx, qy), xz = _mm_mul_ps(qx, qz), yz = _mm_mul_ps(qy, qz);
+		const __m128 wx = _mm_mul_ps(qw, qx), wy = _mm_mul_ps(qw, qy), wz = _mm_mul_ps(qw, qz);
+
+		__m128 r[3][3];
+		r[0][0] = _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz)));
+		r[0][1] = _mm_mul_ps(two, _mm_add_ps(xy, wz));
+		r[0][2] = _mm_mul_ps(two, _mm_sub_ps(xz, wy));
+		r[1][0] = _mm_mul_ps(two, _mm_sub_ps(xy, wz));
+		r[1][1] = _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz)));
+		r[1][2] = _mm_mul_ps(two, _mm_add_ps(yz, wx));
+		r[2][0] = _mm_mul_ps(two, _mm_add_ps(xz, wy));
+		r[2][1] = _mm_mul_ps(two, _mm_sub_ps(yz, wx));
+		r[2][2] = _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy)));
+
+		// M = T * R * S and, since R is orthonormal, inverse(M)^T = [R / s, 0; -(R^T t)^T / s, 1]
+		const __m128 invS = _mm_div_ps(one, s);
+		__m128 M[4][4], invTrans[4][4];
+		for (int c = 0; c < 3; ++c)
+		{
+			for (int row = 0; row < 3; ++row)
+			{
+				M[c][row] = _mm_mul_ps(r[c][row], s);
+				invTrans[c][row] = _mm_mul_ps(r[c][row], invS);
+			}
+			M[c][3] = zero;
+
+			const __m128 dotRt = _mm_add_ps(_mm_add_ps(_mm_mul_ps(r[c][0], px), _mm_mul_ps(r[c][1], py)), _mm_mul_ps(r[c][2], pz));
+			invTrans[c][3] = _mm_sub_ps(zero, _mm_mul_ps(dotRt, invS));
+		}
+		M[3][0] = px;
+		M[3][1] = py;
+		M[3][2] = pz;
+		M[3][3] = one;
+		invTrans[3][0] = zero;
+		invTrans[3][1] = zero;
+		invTrans[3][2] = zero;
+		invTrans[3][3] = one;
+
+		// lanes hold one object each, transposing turns the rows of a column into the columns of 4 objects
+		ObjectTransform *out = &transforms[i];
+		for (int c = 0; c < 4; ++c)
+		{
+			_MM_TRANSPOSE4_PS(M[c][0], M[c][1], M[c][2], M[c][3]);
+			_mm_storeu_ps(&out[0].M[c][0], M[c][0]);
+			_mm_storeu_ps(&out[1].M[c][0], M[c][1]);
+			_mm_storeu_ps(&out[2].M[c][0], M[c][2]);
+			_mm_storeu_ps(&out[3].M[c][0], M[c][3]);
+
+			_MM_TRANSPOSE4_PS(invTrans[c][0], invTrans[c][1], invTrans[c][2], invTrans[c][3]);
+			_mm_storeu_ps(&out[0].M_invTrans[c][0], invTrans[c][0]);
+			_mm_storeu_ps(&out[1].M_invTrans[c][0], invTrans[c][1]);
+			_mm_storeu_ps(&out[2].M_invTrans[c][0], invTrans[c][2]);
+			_mm_storeu_ps(&out[3].M_invTrans[c][0], invTrans[c][3]);
+		}
+	}
+}
+
+void runTransformBenchmark(std::ostream &os)
+{
+	typedef std::chrono::high_resolution_clock Clock;
+	auto elapsedMS = [](Clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	};
+
+	const uint32_t objectCount = 100000;
+	const uint32_t frameCount = 20;
+
+	std::mt19937 rng(1234);
+	std::uniform_real_distribution<float> posDist(-500.f, 500.f);
+	std::uniform_real_distribution<float> angleDist(-glm::pi<float>(), glm::pi<float>());
+	std::uniform_real_distribution<float> scaleDist(0.5f, 2.f);
+
+	std::vector<glm::vec3> positions(objectCount);
+	std::vector<glm::quat> rotations(objectCount);
+	std::vector<float> scales(objectCount);
+	for (uint32_t i = 0; i < objectCount; ++i)
+	{
+		positions[i] = glm::vec3(posDist(rng), posDist(rng), posDist(rng));
+		rotations[i] = glm::quat(glm::vec3(angleDist(rng), angleDist(rng), angleDist(rng)));
+		scales[i] = scaleDist(rng);
+	}
+
+	os << std::fixed << std::setprecision(3);
+
+	// what every object used to go through: full matrix products and a general inverse
+	std::vector<ObjectTransform> reference(objectCount);
+	{
+		auto start = Clock::now();
+		for (uint32_t frame = 0; frame < frameCount; ++frame)
+		{
+			for (uint32_t i = 0; i < objectCount; ++i)
+			{
+				reference[i].M = glm::translate(glm::mat4(), positions[i]) * glm::mat4_cast(rotations[i]) * glm::scale(glm::mat4(), glm::vec3(scales[i]));
+				reference[i].M_invTrans = glm::transpose(glm::inverse(reference[i].M));
+			}
+		}
+		os << "glm, all objects: " << elapsedMS(start) / frameCount << " ms per frame\n";
+	}
+
+	TransformSystem system;
+	for (uint32_t i = 0; i < objectCount; ++i) system.add(positions[i], rotations[i], scales[i]);
+
+	std::vector<uint32_t> workerCounts = { 0 };
+	if (ThreadPool::defaultWorkerCount() > 0) workerCounts.push_back(ThreadPool::defaultWorkerCount());
+
+	for (uint32_t workerCount : workerCounts)
+	{
+		ThreadPool pool(workerCount);
+
+		for (uint32_t dirtyPercent : { 100u, 10u, 1u })
+		{
+			std::uniform_int_distribution<uint32_t> objectDist(0, objectCount - 1);
+			const uint32_t dirtyCount = objectCount / 100 * dirtyPercent;
+
+			double updateMS = 0.0;
+			for (uint32_t frame = 0; frame < frameCount; ++frame)
+			{
+				// moving objects is part of the frame, but generating which ones is not
+				std::vector<uint32_t> moved(dirtyCount);
+				if (dirtyCount == objectCount)
+				{
+					for (uint32_t i = 0; i < objectCount; ++i) moved[i] = i;
+				}
+				else
+				{
+					for (auto &idx : moved) idx = objectDist(rng);
+				}
+
+				auto start = Clock::now();
+				for (uint32_t idx : moved) system.setPosition(idx, positions[idx]);
+				system.update(&pool);
+				system.clearDirty();
+				updateMS += elapsedMS(start);
+			}
+
+			os << "threads " << pool.getThreadCount() << ", " << dirtyPercent << "% dirty: " << updateMS / frameCount << " ms per frame\n";
+		}
+	}
+
+	// the batched path has to agree with glm
+	float maxError = 0.f;
+	for (uint32_t i = 0; i < objectCount; ++i)
+	{
+		const ObjectTransform &t = system.getTransforms()[i];
+		for (int c = 0; c < 4; ++c)
+		{
+			const glm::vec4 dM = glm::abs(t.M[c] - reference[i].M[c]) / (glm::abs(reference[i].M[c]) + 1.f);
+			const glm::vec4 dInv = glm::abs(t.M_invTrans[c] - reference[i].M_invTrans[c]) / (glm::abs(reference[i].M_invTrans[c]) + 1.f);
+			maxError = glm::max(maxError, glm::max(glm::max(dM.x, dM.y), glm::max(dM.z, dM.w)));
+			maxError = glm::max(maxError, glm::max(glm::max(dInv.x, dInv.y), glm::max(dInv.z, dInv.w)));
+		}
+	}
+	os << std::scientific << std::setprecision(2) << "max relative error vs glm: " << maxError << "\n";
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <ostream>
+#include "glm/glm.hpp"
+#include "glm/gtc/quaternion.hpp"
+#include "thread_pool.h"
+
+
+// Per object data read through the instance index by geom.vert and shadow.vert
+struct ObjectTransform
+{
+	glm::mat4 M;
+	glm::mat4 M_invTrans;
+};
+
+// Position, rotation and uniform scale of every object, stored as one array per component so that
+// 4 objects can be updated at once with SSE. Setters only mark the object dirty, update() rebuilds the
+// matrices of dirty objects into a contiguous array that can be uploaded as is.
+// Rotations must be unit quaternions, which lets M_invTrans skip the general inverse
+class TransformSystem
+{
+public:
+	// Returns the index of the new object, which starts dirty
+	uint32_t add(const glm::vec3 &position = glm::vec3(0.f), const glm::quat &rotation = glm::quat(), float scale = 1.f);
+	void clear();
+
+	void setPosition(uint32_t idx, const glm::vec3 &position);
+	void setRotation(uint32_t idx, const glm::quat &rotation);
+	void setScale(uint32_t idx, float scale);
+
+	glm::vec3 getPosition(uint32_t idx) const { return glm::vec3(posX[idx], posY[idx], posZ[idx]); }
+	glm::quat getRotation(uint32_t idx) const { return glm::quat(rotW[idx], rotX[idx], rotY[idx], rotZ[idx]); }
+	float getScale(uint32_t idx) const { return scales[idx]; }
+
+	// T * R * S, computed on the spot from the components
+	glm::mat4 computeModelMatrix(uint32_t idx) const;
+
+	uint32_t size() const { return count; }
+	bool isDirty(uint32_t idx) const { return (dirtyBits[idx / 64] >> (idx % 64) & 1) != 0; }
+	uint32_t getDirtyCount() const;
+
+	// Rebuilds the transforms of all dirty objects, split across @pThreadPool if given.
+	// Dirty bits stay set so that callers can refresh data derived from the transforms, see clearDirty()
+	void update(ThreadPool *pThreadPool = nullptr);
+	void clearDirty();
+
+	// Calls @func(idx) for every dirty object in increasing order
+	template <typename Func>
+	void forEachDirty(Func func) const
+	{
+		for (uint32_t w = 0; w < dirtyBits.size(); ++w)
+		{
+			uint32_t idx = w * 64;
+			for (uint64_t bits = dirtyBits[w]; bits != 0; bits >>= 1, ++idx)
+			{
+				if (bits & 1) func(idx);
+			}
+		}
+	}
+
+	// Valid for the objects updated since they were last changed, size() entries
+	const ObjectTransform *getTransforms() const { return transforms.data(); }
+
+protected:
+	// objects per update task, a multiple of 64 so that tasks never share a dirty word
+	static const uint32_t objectsPerTask = 4096;
+
+	uint32_t count = 0;
+
+	// padded to a multiple of 4 with identity transforms
+	std::vector<float> posX, posY, posZ;
+	std::vector<float> rotX, rotY, rotZ, rotW;
+	std::vector<float> scales;
+	std::vector<uint64_t> dirtyBits;
+	std::vector<ObjectTransform> transforms;
+
+	void markDirty(uint32_t idx) { dirtyBits[idx / 64] |= uint64_t(1) << (idx % 64); }
+	void updateRange(uint32_t first, uint32_t last);
+};
+
+// Updates 100k transforms with the scalar glm path and with TransformSystem at several dirty ratios
+// and thread counts, then prints the timings
+void runTransformBenchmark(std::ostream &os);
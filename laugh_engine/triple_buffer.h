@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <atomic>
+
+
+// Lock-free handoff of the latest value from one producer thread to one consumer thread. The producer fills the back
+// slot and publishes it, the consumer picks up whatever was published last. Neither side ever waits for the other,
+// values the consumer didn't get to in time are overwritten by newer ones
+template <typename T>
+class TripleBuffer
+{
+public:
+	TripleBuffer() = default;
+	explicit TripleBuffer(const T &initial) : slots{ initial, initial, initial } {}
+
+	TripleBuffer(const TripleBuffer &) = delete;
+	TripleBuffer &operator=(const TripleBuffer &) = delete;
+
+	// Producer side. The back slot holds an old value, so it has to be written in full before publish()
+	T &getBack() { return slots[backIdx]; }
+	void publish()
+	{
+		backIdx = middle.exchange(backIdx | freshBit, std::memory_order_acq_rel) & indexMask;
+	}
+
+	// Consumer side. Makes the latest published value the front, returns false if there was nothing new.
+	// The front stays untouched until the next acquire()
+	bool acquire()
+	{
+		if (!hasNew()) return false;
+		frontIdx = middle.exchange(frontIdx, std::memory_order_acq_rel) & indexMask;
+		return true;
+	}
+	const T &getFront() const { return slots[frontIdx]; }
+
+	bool hasNew() const { return (middle.load(std::memory_order_acquire) & freshBit) != 0; }
+
+protected:
+	static const uint32_t indexMask = 3;
+	static const uint32_t freshBit = 4;
+
+	T slots[3];
+	uint32_t backIdx = 0;
+	uint32_t frontIdx = 1;
+	std::atomic<uint32_t> middle{ 2 }; // index of the slot in between, with freshBit set once it was published
+};
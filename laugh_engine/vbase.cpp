@@ -9,6 +9,12 @@ float VBaseGraphics::lastX;
 float VBaseGraphics::lastY;
 
 
+VBaseGraphics::~VBaseGraphics()
+{
+	// too late to stop it here, the derived class it calls into is already gone
+	assert(!m_updateThread.joinable());
+}
+
 void VBaseGraphics::run()
 {
 	initVulkan();
@@ -33,19 +39,23 @@ void VBaseGraphics::initVulkan()
 	createDescriptorSets();
 	createCommandBuffers();
 	createSynchronizationObjects();
-	m_textOverlay.prepareResources();
+	m_textOverlay.prepareResources(MAX_FRAMES_IN_FLIGHT);
 
 	m_initialized = true;
 }
 
 void VBaseGraphics::mainLoop()
 {
-	while (!m_vulkanManager.windowShouldClose())
+	// the first frame has nothing to render from otherwise
+	publishUpdateInput();
+	runUpdate();
+
 	{
-		m_vulkanManager.windowPollEvents();
-		
-		updateUniformHostData();
-		drawFrame();
+		UpdateThreadScope updateThread(*this);
+		while (!m_vulkanManager.windowShouldClose())
+		{
+			runFrame();
+		}
 	}
 
 	// When the main loop terminate, some commands may still being executed on
@@ -54,6 +64,192 @@ void VBaseGraphics::mainLoop()
 	m_vulkanManager.deviceWaitIdle();
 }
 
+void VBaseGraphics::runFramePacingBenchmark(std::ostream &os, uint32_t framesPerMode)
+{
+	initVulkan();
+
+	publishUpdateInput();
+	runUpdate();
+	UpdateThreadScope updateThread(*this);
+
+	os << "Frame pacing benchmark - " << framesPerMode << " frames per mode, present wait " <<
+		(m_vulkanManager.isPresentWaitEnabled() ? "on" : "off") << ", capped at " << m_framePacer.getTargetFrameRate() << " fps\n";
+	for (uint32_t mode = 0; mode < FRAME_PACING_MODE_COUNT; ++mode)
+	{
+		applyFramePacingMode(static_cast<FramePacingMode>(mode));
+		m_framePacer.clearStats();
+		for (uint32_t i = 0; i < framesPerMode && !m_vulkanManager.windowShouldClose(); ++i)
+		{
+			runFrame();
+		}
+
+		// averages over the last frames only, the first ones after the swap chain change are left out
+		const auto stats = m_framePacer.getStats();
+		os << "  " << std::left << std::setw(12) << FramePacer::getModeName(static_cast<FramePacingMode>(mode)) <<
+			" : frame interval " << stats.frameIntervalMS << " ms, input to present " << stats.inputToPresentMS << " ms";
+		if (stats.inputToDisplayMS >= 0.0) os << ", input to display " << stats.inputToDisplayMS << " ms";
+		os << "\n";
+	}
+
+	m_vulkanManager.deviceWaitIdle();
+}
+
+void VBaseGraphics::runFrame()
+{
+	if (m_framePacingMode != m_framePacer.getMode()) applyFramePacingMode(m_framePacingMode);
+	waitForFramePacing();
+
+	m_vulkanManager.windowPollEvents();
+	m_framePacer.beginFrame();
+
+	const uint64_t heapAllocationCount = getHeapAllocationCount();
+
+	// The update thread starts on the next frame while this one renders the latest finished update.
+	// For low latency, this frame waits for the update of the input it just sampled
+	publishUpdateInput();
+	if (m_framePacer.getMode() == FRAME_PACING_LOW_LATENCY) waitForUpdate();
+	drawFrame();
+
+	// containers keep their capacity, so once the loop has settled a frame must not allocate
+	m_frameHeapAllocationCount = getHeapAllocationCount() - heapAllocationCount;
+	assert(m_steadyFrameCount < HEAP_ALLOCATION_WARMUP_FRAMES || m_frameHeapAllocationCount == 0);
+	++m_steadyFrameCount;
+}
+
+void VBaseGraphics::applyFramePacingMode(FramePacingMode mode)
+{
+	// Mailbox never blocks and always shows the newest frame. FIFO doesn't render frames that are never shown,
+	// and with present wait a frame is known to be on screen, so mailbox has nothing left to offer for low latency
+	VkPresentModeKHR presentMode = VK_PRESENT_MODE_FIFO_KHR;
+	if (mode == FRAME_PACING_THROUGHPUT || (mode == FRAME_PACING_LOW_LATENCY && !m_vulkanManager.isPresentWaitEnabled()))
+	{
+		presentMode = VK_PRESENT_MODE_MAILBOX_KHR;
+	}
+
+	m_framePacingMode = mode;
+	m_framePacer.setMode(mode);
+	m_vulkanManager.setSwapChainPresentMode(presentMode);
+	recreateSwapChain();
+}
+
+void VBaseGraphics::waitForFramePacing()
+{
+	m_framePacer.waitForFrameStart();
+
+	const uint64_t lastId = m_framePacer.getLastPresentedId();
+	if (m_vulkanManager.isPresentWaitEnabled())
+	{
+		if (m_framePacer.getMode() == FRAME_PACING_LOW_LATENCY)
+		{
+			// nothing queued at the display once input is sampled. The timeout covers presents that never complete,
+			// like those to a minimized window
+			if (lastId > m_framePacer.getLastDisplayedId() && m_vulkanManager.waitForPresent(lastId, 100000000) == VK_SUCCESS)
+			{
+				m_framePacer.markDisplayed(lastId);
+			}
+		}
+		else
+		{
+			// only checks, so the display time is when it was noticed
+			while (m_framePacer.getLastDisplayedId() < lastId &&
+				m_vulkanManager.waitForPresent(m_framePacer.getLastDisplayedId() + 1, 0) == VK_SUCCESS)
+			{
+				m_framePacer.markDisplayed(m_framePacer.getLastDisplayedId() + 1);
+			}
+		}
+	}
+	else if (m_framePacer.getMode() == FRAME_PACING_LOW_LATENCY)
+	{
+		waitForLastFrame();
+	}
+}
+
+void VBaseGraphics::publishUpdateInput()
+{
+	auto &input = m_updateInput.getBack();
+	input.camera = m_camera;
+	input.displayMode = m_displayMode;
+	input.softwareOcclusionCulling = m_softwareOcclusionCulling;
+	input.sortDraws = m_sortDraws;
+	m_updateInput.publish();
+
+	// taking the lock once makes sure the update thread either sees the new input or is already waiting
+	{
+		std::lock_guard<std::mutex> lock(m_updateMutex);
+	}
+	m_updateWake.notify_one();
+}
+
+void VBaseGraphics::runUpdate()
+{
+	m_updateInput.acquire();
+	m_frameArena.reset();
+	updateUniformHostData();
+}
+
+void VBaseGraphics::startUpdateThread()
+{
+	assert(!m_updateThread.joinable());
+	m_updateThreadQuit = false;
+	m_updateThread = std::thread(&VBaseGraphics::updateLoop, this);
+}
+
+void VBaseGraphics::stopUpdateThread()
+{
+	if (!m_updateThread.joinable()) return;
+
+	{
+		std::lock_guard<std::mutex> lock(m_updateMutex);
+		m_updateThreadQuit = true;
+	}
+	m_updateWake.notify_one();
+	m_updateThread.join();
+}
+
+void VBaseGraphics::pauseUpdateThread()
+{
+	std::unique_lock<std::mutex> lock(m_updateMutex);
+	m_updatePaused = true;
+	m_updateIdle.wait(lock, [this]() { return !m_updateBusy; });
+}
+
+void VBaseGraphics::resumeUpdateThread()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_updateMutex);
+		m_updatePaused = false;
+	}
+	m_updateWake.notify_one();
+}
+
+void VBaseGraphics::waitForUpdate()
+{
+	std::unique_lock<std::mutex> lock(m_updateMutex);
+	m_updateIdle.wait(lock, [this]() { return !m_updateBusy && !m_updateInput.hasNew(); });
+}
+
+void VBaseGraphics::updateLoop()
+{
+	while (true)
+	{
+		// one update per published input, so the thread sleeps once it has caught up with the render thread
+		{
+			std::unique_lock<std::mutex> lock(m_updateMutex);
+			m_updateWake.wait(lock, [this]() { return m_updateThreadQuit || (!m_updatePaused && m_updateInput.hasNew()); });
+			if (m_updateThreadQuit) return;
+			m_updateBusy = true;
+		}
+
+		runUpdate();
+
+		{
+			std::lock_guard<std::mutex> lock(m_updateMutex);
+			m_updateBusy = false;
+		}
+		m_updateIdle.notify_all();
+	}
+}
+
 void VBaseGraphics::recreateSwapChain()
 {
 	auto updateCamera = [this]()
@@ -63,6 +259,8 @@ void VBaseGraphics::recreateSwapChain()
 	};
 
 	m_vulkanManager.deviceWaitIdle();
+	m_steadyFrameCount = 0;
+	m_framePacer.discardPendingPresents();
 
 	m_vulkanManager.recreateSwapChain();
 	updateCamera();
@@ -77,6 +275,7 @@ void VBaseGraphics::recreateSwapChain()
 	// recreation of descriptor sets is necessary
 	createDescriptorSets();
 	createCommandBuffers();
+	createSynchronizationObjects();
 }
 
 const std::string &VBaseGraphics::getWindowTitle()
@@ -89,6 +288,40 @@ const VkPhysicalDeviceFeatures &VBaseGraphics::getEnabledPhysicalDeviceFeatures(
 	m_physicalDeviceFeatures = {};
 	m_physicalDeviceFeatures.shaderStorageImageExtendedFormats = VK_TRUE;
 	m_physicalDeviceFeatures.geometryShader = VK_TRUE;
+	m_physicalDeviceFeatures.multiDrawIndirect = VK_TRUE; // one indirect call per shadow cascade
+	m_physicalDeviceFeatures.drawIndirectFirstInstance = VK_TRUE; // object index of GPU generated draws
+	m_physicalDeviceFeatures.shaderSampledImageArrayDynamicIndexing = VK_TRUE; // material texture indices of the geometry pass
 
 	return m_physicalDeviceFeatures;
 }
+
+const void *VBaseGraphics::getEnabledDeviceFeaturesNext()
+{
+	// bindless material textures: one texture array that is only partially written and
+	// can be written while command buffers using it are pending
+	m_descriptorIndexingFeatures = {};
+	m_descriptorIndexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+	m_descriptorIndexingFeatures.runtimeDescriptorArray = VK_TRUE;
+	m_descriptorIndexingFeatures.descriptorBindingPartiallyBound = VK_TRUE;
+	m_descriptorIndexingFeatures.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+	m_descriptorIndexingFeatures.pNext = &m_timelineSemaphoreFeatures;
+
+	// one timeline per queue instead of fences and most binary semaphores, see VManager::QueueTimeline
+	m_timelineSemaphoreFeatures = {};
+	m_timelineSemaphoreFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR;
+	m_timelineSemaphoreFeatures.timelineSemaphore = VK_TRUE;
+
+	return &m_descriptorIndexingFeatures;
+}
+
+const std::vector<const char *> &VBaseGraphics::getOptionalDeviceExtensions()
+{
+	// frame pacing waits for frames to be on screen with these
+	m_optionalDeviceExtensions.clear();
+#ifdef VK_KHR_present_wait
+	m_optionalDeviceExtensions.push_back(VK_KHR_PRESENT_ID_EXTENSION_NAME);
+	m_optionalDeviceExtensions.push_back(VK_KHR_PRESENT_WAIT_EXTENSION_NAME);
+#endif
+
+	return m_optionalDeviceExtensions;
+}
@@ -4,10 +4,23 @@
 #include <algorithm>
 #include <sstream>
 #include <iomanip>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 #include "camera.h"
 #include "vtextoverlay.h"
+#include "frame_arena.h"
+#include "allocation_counter.h"
+#include "triple_buffer.h"
+#include "frame_pacer.h"
 
+// Frames the CPU may record ahead of the GPU. Each one owns its uniform buffers, command buffers and descriptor sets
+#define MAX_FRAMES_IN_FLIGHT 2
+
+// Frames after a scene, settings or swap chain change during which the frame loop may still grow its containers.
+// After that, a frame must not allocate from the heap
+#define HEAP_ALLOCATION_WARMUP_FRAMES 8
 
 enum DisplayMode
 {
@@ -33,7 +46,11 @@ public:
 	std::string m_windowTitle = "VBaseGraphics";
 
 	DisplayMode m_displayMode = DISPLAY_MODE_FULL;
+	bool m_softwareOcclusionCulling = true;
+	bool m_sortDraws = true;
+	bool m_showRuntimeMesh = false;
 	float m_distEnvLightStrength = .5f;
+	FramePacingMode m_framePacingMode = FRAME_PACING_THROUGHPUT; // applied at the start of the next frame
 
 	static bool leftMBDown, middleMBDown;
 	static float lastX, lastY;
@@ -117,19 +134,55 @@ public:
 	static void keyCB(GLFWwindow* window, int key, int scancode, int action, int mods)
 	{
 		VBaseGraphics *app = reinterpret_cast<VBaseGraphics *>(glfwGetWindowUserPointer(window));
+		if (action == GLFW_PRESS) app->m_steadyFrameCount = 0;
 
 		if (key == GLFW_KEY_SPACE && action == GLFW_PRESS)
 		{
 			app->m_displayMode = static_cast<DisplayMode>((app->m_displayMode + 1) % DISPLAY_MODE_COUNT);
 		}
+		else if (key == GLFW_KEY_O && action == GLFW_PRESS)
+		{
+			app->m_softwareOcclusionCulling = !app->m_softwareOcclusionCulling;
+		}
+		else if (key == GLFW_KEY_S && action == GLFW_PRESS)
+		{
+			app->m_sortDraws = !app->m_sortDraws;
+		}
+		else if (key == GLFW_KEY_M && action == GLFW_PRESS)
+		{
+			app->m_showRuntimeMesh = !app->m_showRuntimeMesh;
+		}
+		else if (key == GLFW_KEY_P && action == GLFW_PRESS)
+		{
+			app->m_framePacingMode = static_cast<FramePacingMode>((app->m_framePacingMode + 1) % FRAME_PACING_MODE_COUNT);
+		}
 	}
 
+	virtual ~VBaseGraphics();
+
 	virtual void run();
 
+	// Runs @framesPerMode frames in each pacing mode and writes their latency markers to @os
+	void runFramePacingBenchmark(std::ostream &os, uint32_t framesPerMode = 300);
+
 protected:
+	// What the update thread sees of the input callbacks, copied over once per frame
+	struct UpdateInput
+	{
+		Camera camera;
+		DisplayMode displayMode;
+		bool softwareOcclusionCulling;
+		bool sortDraws;
+	};
+
 	VkPhysicalDeviceFeatures m_physicalDeviceFeatures;
+	VkPhysicalDeviceDescriptorIndexingFeaturesEXT m_descriptorIndexingFeatures;
+	VkPhysicalDeviceTimelineSemaphoreFeaturesKHR m_timelineSemaphoreFeatures;
+	std::vector<const char *> m_optionalDeviceExtensions;
 
-	rj::VManager m_vulkanManager{ this, keyCB, mouseButtonCB, cursorPositionCB, scrollCB, onWindowResized, m_width, m_height, getWindowTitle(), getEnabledPhysicalDeviceFeatures() };
+	rj::VManager m_vulkanManager{ this, keyCB, mouseButtonCB, cursorPositionCB, scrollCB, onWindowResized, m_width, m_height, getWindowTitle(),
+		getEnabledPhysicalDeviceFeatures(), { VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME, VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME }, getEnabledDeviceFeaturesNext(),
+		getOptionalDeviceExtensions() };
 
 	uint32_t m_descriptorPool;
 
@@ -143,18 +196,71 @@ protected:
 
 	VTextOverlay m_textOverlay{ &m_vulkanManager };
 
+	// Simulation runs on its own thread and prepares the next frame while the current one is rendered.
+	// Input and results go through triple buffers, the mutex only lets the update thread sleep and be paused
+	std::thread m_updateThread;
+	std::mutex m_updateMutex;
+	std::condition_variable m_updateWake;
+	std::condition_variable m_updateIdle;
+	bool m_updateThreadQuit = false;
+	bool m_updatePaused = false;
+	bool m_updateBusy = false;
+	TripleBuffer<UpdateInput> m_updateInput{ UpdateInput{ m_camera, m_displayMode, m_softwareOcclusionCulling, m_sortDraws } };
+
+	FramePacer m_framePacer;
+
+	// temporary data of the update being run, reset at the start of every update
+	FrameArena m_frameArena;
+	uint32_t m_steadyFrameCount = 0; // frames since the last change that may grow per-frame containers
+	uint64_t m_frameHeapAllocationCount = 0; // of the last frame
+
 	bool m_initialized = false;
 
 
 	virtual void initVulkan();
 
 	virtual void mainLoop();
+	void runFrame();
+
+	// CPU side wait points of the pacing mode, before input is sampled
+	void applyFramePacingMode(FramePacingMode mode);
+	void waitForFramePacing();
+	virtual void waitForLastFrame() = 0; // until the GPU is done with the last submitted frame
+
+	void publishUpdateInput();
+	void runUpdate(); // on whichever thread, as long as the update thread is paused or it is the update thread
+	const UpdateInput &getUpdateInput() const { return m_updateInput.getFront(); }
+	void startUpdateThread();
+	void stopUpdateThread();
+	// Returns once the update thread is idle, it stays idle until resumeUpdateThread()
+	void pauseUpdateThread();
+	void resumeUpdateThread();
+	// Returns once the update thread has caught up with the published input
+	void waitForUpdate();
+	void updateLoop();
+
+	// Runs the update thread for as long as it lives, so that it is stopped when a frame throws as well.
+	// The thread calls into the derived class, it must be gone before the derived class is destroyed
+	class UpdateThreadScope
+	{
+	public:
+		explicit UpdateThreadScope(VBaseGraphics &app) : app(app) { app.startUpdateThread(); }
+		~UpdateThreadScope() { app.stopUpdateThread(); }
+
+		UpdateThreadScope(const UpdateThreadScope &) = delete;
+		UpdateThreadScope &operator=(const UpdateThreadScope &) = delete;
+
+	protected:
+		VBaseGraphics &app;
+	};
 
 	virtual void recreateSwapChain();
 
 	// Let the app pick the queue families they need
 	virtual const std::string &getWindowTitle();
 	virtual const VkPhysicalDeviceFeatures &getEnabledPhysicalDeviceFeatures();
+	virtual const void *getEnabledDeviceFeaturesNext(); // chain of extension feature structs
+	virtual const std::vector<const char *> &getOptionalDeviceExtensions(); // enabled if the device supports them
 
 	virtual void createQueryPools() = 0;
 	virtual void createRenderPasses() = 0;
@@ -173,9 +279,9 @@ protected:
 	virtual void createCommandBuffers() = 0;
 	virtual void createSynchronizationObjects() = 0; // semaphores, fences, etc. go in here
 
-	virtual void updateUniformHostData() = 0;
-	virtual void updateUniformDeviceData(uint32_t imageIdx) = 0;
-	virtual void updateText(uint32_t imageIdx) {};
+	virtual void updateUniformHostData() = 0; // runs on the update thread, reads getUpdateInput() instead of the members it copies
+	virtual void updateUniformDeviceData(uint32_t frameIdx) = 0;
+	virtual void updateText(uint32_t frameIdx, uint32_t imageIdx) {};
 	virtual void drawFrame() = 0;
 };
 
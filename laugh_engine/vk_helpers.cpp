@@ -170,9 +170,8 @@ namespace rj
 		}
 
 		void createImage(
-			VDeleter<VkImage>& image, VDeleter<VkDeviceMemory>& imageMemory,
-			VkPhysicalDevice physicalDevice, VkDevice device,
-			VkFormat format, VkImageType imageType, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties,
+			VDeleter<VkImage>& image, VkDevice device,
+			VkFormat format, VkImageType imageType, VkImageTiling tiling, VkImageUsageFlags usage,
 			uint32_t width, uint32_t height, uint32_t depth, uint32_t mipLevels, uint32_t arrayLayers, VkImageCreateFlags flags,
 			VkSampleCountFlagBits sampleCount, VkImageLayout initialLayout,
 			VkSharingMode sharingMode, const std::vector<uint32_t> &queueFamilyIndices)
@@ -199,21 +198,6 @@ namespace rj
 			{
 				throw std::runtime_error("failed to create image!");
 			}
-
-			VkMemoryRequirements memRequirements;
-			vkGetImageMemoryRequirements(device, image, &memRequirements);
-
-			VkMemoryAllocateInfo allocInfo = {};
-			allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-			allocInfo.allocationSize = memRequirements.size;
-			allocInfo.memoryTypeIndex = findMemoryType(physicalDevice, memRequirements.memoryTypeBits, properties);
-
-			if (vkAllocateMemory(device, &allocInfo, nullptr, imageMemory.replace()) != VK_SUCCESS)
-			{
-				throw std::runtime_error("failed to allocate image memory!");
-			}
-
-			vkBindImageMemory(device, image, imageMemory, 0);
 		}
 
 		void recordImageLayoutTransitionCommands(VkCommandBuffer commandBuffer,
@@ -313,9 +297,8 @@ namespace rj
 			);
 		}
 
-		void createBuffer(VDeleter<VkBuffer>& buffer, VDeleter<VkDeviceMemory>& bufferMemory,
-			VkPhysicalDevice physicalDevice, VkDevice device,
-			VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBufferCreateFlags flags,
+		void createBuffer(VDeleter<VkBuffer>& buffer, VkDevice device,
+			VkDeviceSize size, VkBufferUsageFlags usage, VkBufferCreateFlags flags,
 			VkSharingMode sharingMode, const std::vector<uint32_t> &queueFamilyIndices)
 		{
 			VkBufferCreateInfo bufferInfo = {};
@@ -331,21 +314,6 @@ namespace rj
 			{
 				throw std::runtime_error("failed to create buffer!");
 			}
-
-			VkMemoryRequirements memRequirements;
-			vkGetBufferMemoryRequirements(device, buffer, &memRequirements);
-
-			VkMemoryAllocateInfo allocInfo = {};
-			allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-			allocInfo.allocationSize = memRequirements.size;
-			allocInfo.memoryTypeIndex = findMemoryType(physicalDevice, memRequirements.memoryTypeBits, properties);
-
-			if (vkAllocateMemory(device, &allocInfo, nullptr, bufferMemory.replace()) != VK_SUCCESS)
-			{
-				throw std::runtime_error("failed to allocate buffer memory!");
-			}
-
-			vkBindBufferMemory(device, buffer, bufferMemory, 0);
 		}
 
 		SwapChainSupportDetails querySwapChainSupport(VkPhysicalDevice device, VkSurfaceKHR surface)
@@ -75,10 +75,17 @@ namespace rj
 				if (nextStartingByte + actualSize > maxSizeInBytes) throw std::runtime_error("UniformBlob::alloc - out of memory.");
 
 				char *ret = &memory[nextStartingByte];
+				allocations.push_back({ nextStartingByte, size });
 				nextStartingByte += actualSize;
 				return ret;
 			}
 
+			// (offset, size) of every alloc in allocation order, without the padding between them
+			const std::vector<std::pair<size_t, size_t>> &getAllocations() const
+			{
+				return allocations;
+			}
+
 			size_t size() const
 			{
 				return currentSizeInBytes;
@@ -104,6 +111,7 @@ namespace rj
 				size_t nextStartingByte = 0;
 				size_t currentSizeInBytes;
 			};
+			std::vector<std::pair<size_t, size_t>> allocations;
 		};
 
 		class FrameTimeCalculator
@@ -211,10 +219,10 @@ namespace rj
 		// --- Image view creation ---
 
 		// --- Image creation ---
+		// Memory is left to the caller, see VMemoryAllocator
 		void createImage(
-			VDeleter<VkImage>& image, VDeleter<VkDeviceMemory>& imageMemory,
-			VkPhysicalDevice physicalDevice, VkDevice device,
-			VkFormat format, VkImageType imageType, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties,
+			VDeleter<VkImage>& image, VkDevice device,
+			VkFormat format, VkImageType imageType, VkImageTiling tiling, VkImageUsageFlags usage,
 			uint32_t width, uint32_t height, uint32_t depth = 1, uint32_t mipLevels = 1, uint32_t arrayLayers = 1, VkImageCreateFlags flags = 0,
 			VkSampleCountFlagBits sampleCount = VK_SAMPLE_COUNT_1_BIT, VkImageLayout initialLayout = VK_IMAGE_LAYOUT_PREINITIALIZED,
 			VkSharingMode sharingMode = VK_SHARING_MODE_EXCLUSIVE, const std::vector<uint32_t> &queueFamilyIndices = {});
@@ -228,9 +236,9 @@ namespace rj
 		// --- Image layout transition ---
 
 		// --- Buffer creation ---
-		void createBuffer(VDeleter<VkBuffer>& buffer, VDeleter<VkDeviceMemory>& bufferMemory,
-			VkPhysicalDevice physicalDevice, VkDevice device,
-			VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBufferCreateFlags flags = 0,
+		// Memory is left to the caller, see VMemoryAllocator
+		void createBuffer(VDeleter<VkBuffer>& buffer, VkDevice device,
+			VkDeviceSize size, VkBufferUsageFlags usage, VkBufferCreateFlags flags = 0,
 			VkSharingMode sharingMode = VK_SHARING_MODE_EXCLUSIVE, const std::vector<uint32_t> &queueFamilyIndices = {});
 		// --- Buffer creation ---
 
@@ -107,6 +107,34 @@ namespace rj
 			}
 		}
 
+		void extractUniquePositions(const std::vector<Vertex> &hostVerts, const std::vector<uint32_t> &hostIndices,
+			std::vector<glm::vec3> &hostPositions, std::vector<uint32_t> &hostPositionIndices)
+		{
+			std::unordered_map<glm::vec3, uint32_t> pos2IdxLut;
+			hostPositions.clear();
+			hostPositionIndices.clear();
+			hostPositionIndices.reserve(hostIndices.size());
+
+			// Positions are emitted in the order they are first referenced so fetches stay local
+			for (uint32_t idx : hostIndices)
+			{
+				const glm::vec3 &pos = hostVerts[idx].pos;
+
+				const auto searchResult = pos2IdxLut.find(pos);
+				if (searchResult == pos2IdxLut.end())
+				{
+					uint32_t newIdx = static_cast<uint32_t>(hostPositions.size());
+					pos2IdxLut[pos] = newIdx;
+					hostPositionIndices.emplace_back(newIdx);
+					hostPositions.emplace_back(pos);
+				}
+				else
+				{
+					hostPositionIndices.emplace_back(searchResult->second);
+				}
+			}
+		}
+
 		void loadTexture2DFromBinaryData(ImageWrapper *pTexRet, VManager *pManager, const void *pixels,
 			uint32_t width, uint32_t height, gli::format gliformat, uint32_t mipLevels, bool createSampler)
 		{
@@ -249,35 +277,10 @@ namespace rj
 	}
 }
 
-BBox BBox::getTransformedAABB(const glm::mat4 & T) const
-{
-	glm::vec4 corners[8] =
-	{
-		glm::vec4(max.x, max.y, min.z, 1.f),
-		glm::vec4(min.x, max.y, min.z, 1.f),
-		glm::vec4(min.x, min.y, min.z, 1.f),
-		glm::vec4(max.x, min.y, min.z, 1.f),
-		glm::vec4(max.x, max.y, max.z, 1.f),
-		glm::vec4(min.x, max.y, max.z, 1.f),
-		glm::vec4(min.x, min.y, max.z, 1.f),
-		glm::vec4(max.x, min.y, max.z, 1.f)
-	};
-	
-	BBox result;
-	for (uint32_t i = 0; i < 8; ++i)
-	{
-		auto c = glm::vec3(T * corners[i]);
-		result.min = glm::min(result.min, c);
-		result.max = glm::max(result.max, c);
-	}
-
-	return result;
-}
-
-VMesh::VMesh(rj::VManager * pManager)
+VMesh::VMesh(rj::VManager * pManager, GeometryPool *pPool)
 	:
 	pVulkanManager(pManager),
-	scale(1.f)
+	pGeometryPool(pPool)
 {
 	albedoMap.image = std::numeric_limits<uint32_t>::max();
 	normalMap.image = std::numeric_limits<uint32_t>::max();
@@ -287,27 +290,122 @@ VMesh::VMesh(rj::VManager * pManager)
 	emissiveMap.image = std::numeric_limits<uint32_t>::max();
 }
 
-void VMesh::setPosition(const glm::vec3 & newPos)
+void VMesh::releaseGeometry()
+{
+	// in GeometryPool::Stream order
+	rj::helper_functions::BufferWrapper *buffers[] = { &vertexBuffer, &indexBuffer, &positionBuffer, &positionIndexBuffer };
+
+	for (uint32_t i = 0; i < GeometryPool::STREAM_COUNT; ++i)
+	{
+		if (buffers[i]->size == 0) continue;
+
+		if (pGeometryPool)
+		{
+			pGeometryPool->free(static_cast<GeometryPool::Stream>(i), *buffers[i]);
+		}
+		else
+		{
+			pVulkanManager->destroyBuffer(buffers[i]->buffer);
+		}
+		*buffers[i] = {};
+	}
+
+	occluderPositions.clear();
+	occluderIndices.clear();
+}
+
+void VMesh::releaseTextures()
+{
+	rj::helper_functions::ImageWrapper *maps[] = { &albedoMap, &normalMap, &roughnessMap, &metalnessMap, &aoMap, &emissiveMap };
+
+	for (auto *map : maps)
+	{
+		if (map->image == std::numeric_limits<uint32_t>::max()) continue;
+
+		for (uint32_t sampler : map->samplers) pVulkanManager->destroySampler(sampler);
+		for (uint32_t view : map->imageViews) pVulkanManager->destroyImageView(view);
+		pVulkanManager->destroyImage(map->image);
+
+		*map = {};
+		map->image = std::numeric_limits<uint32_t>::max();
+	}
+}
+
+void VMesh::createGeometryBuffers(const std::vector<Vertex> &hostVerts, const std::vector<uint32_t> &hostIndices)
+{
+	using namespace rj::helper_functions;
+
+	std::vector<glm::vec3> hostPositions;
+	std::vector<uint32_t> hostPositionIndices;
+	extractUniquePositions(hostVerts, hostIndices, hostPositions, hostPositionIndices);
+
+	createGeometryBuffer(GeometryPool::STREAM_VERTEX, vertexBuffer, hostVerts.data(),
+		sizeof(hostVerts[0]), hostVerts.size(), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+	createGeometryBuffer(GeometryPool::STREAM_INDEX, indexBuffer, hostIndices.data(),
+		sizeof(hostIndices[0]), hostIndices.size(), VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
+	createGeometryBuffer(GeometryPool::STREAM_POSITION, positionBuffer, hostPositions.data(),
+		sizeof(hostPositions[0]), hostPositions.size(), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+	createGeometryBuffer(GeometryPool::STREAM_POSITION_INDEX, positionIndexBuffer, hostPositionIndices.data(),
+		sizeof(hostPositionIndices[0]), hostPositionIndices.size(), VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
+
+	// the real surface, a simplified one could hide objects that are visible
+	occluderPositions = std::move(hostPositions);
+	occluderIndices = std::move(hostPositionIndices);
+}
+
+void VMesh::createGeometryBuffer(GeometryPool::Stream stream, rj::helper_functions::BufferWrapper &buffer, const void *hostData,
+	VkDeviceSize elementSize, size_t elementCount, VkBufferUsageFlags usage)
+{
+	buffer = {};
+
+	// nothing to store, and neither the pool nor Vulkan hand out empty ranges. A size of 0 marks it unused
+	if (elementCount == 0) return;
+
+	if (pGeometryPool)
+	{
+		assert(pGeometryPool->getElementSize(stream) == elementSize);
+		if (!pGeometryPool->allocate(stream, static_cast<uint32_t>(elementCount), buffer))
+		{
+			throw std::runtime_error("geometry pool is out of space");
+		}
+		pGeometryPool->upload(buffer, hostData);
+	}
+	else
+	{
+		buffer.size = elementSize * elementCount;
+		buffer.buffer = pVulkanManager->createBuffer(buffer.size, usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		pVulkanManager->transferHostDataToBuffer(buffer.buffer, buffer.size, hostData);
+	}
+}
+
+VMeshInstance::VMeshInstance(uint32_t meshIdx, const BBox &meshBounds, TransformSystem *pTransforms, uint32_t transformIdx)
+	: meshIdx(meshIdx), pTransforms(pTransforms), transformIdx(transformIdx), meshBounds(meshBounds)
+{
+}
+
+void VMeshInstance::setPosition(const glm::vec3 & newPos)
+{
+	pTransforms->setPosition(transformIdx, newPos);
+}
+
+void VMeshInstance::setRotation(const glm::quat & newRot)
 {
-	worldPosition = newPos;
+	pTransforms->setRotation(transformIdx, newRot);
 }
 
-void VMesh::setRotation(const glm::quat & newRot)
+void VMeshInstance::setScale(float newScale)
 {
-	worldRotation = newRot;
+	pTransforms->setScale(transformIdx, newScale);
 }
 
-void VMesh::setScale(float newScale)
+void VMeshInstance::setTransform(const glm::vec3 &newPos, const glm::quat &newRot, float newScale)
 {
-	scale = newScale;
+	pTransforms->setPosition(transformIdx, newPos);
+	pTransforms->setRotation(transformIdx, newRot);
+	pTransforms->setScale(transformIdx, newScale);
 }
 
-BBox VMesh::getAABBWorldSpace() const
+BBox VMeshInstance::getAABBWorldSpace() const
 {
-	auto T = glm::mat4_cast(worldRotation);
-	T[0] *= scale;
-	T[1] *= scale;
-	T[2] *= scale;
-	T[3] = glm::vec4(worldPosition, 1.f);
-	return bounds.getTransformedAABB(T);
+	return meshBounds.getTransformedAABB(getModelMatrix());
 }
@@ -11,6 +11,9 @@
 #include "assimp/postprocess.h"
 #include "assimp/cimport.h"
 #include "VManager.h"
+#include "culling.h"
+#include "geometry_pool.h"
+#include "transform_system.h"
 
 #include "tiny_gltf_loader.h"
 #include "gltf_loader.h"
@@ -63,20 +66,28 @@ struct Vertex
 
 		return attributeDescriptions;
 	}
-};
 
-// Actually AABB
-struct BBox
-{
-	glm::vec3 min;
-	glm::vec3 max;
+	// Depth-only passes only read positions, so they fetch from a tightly packed vec3 stream
+	static VkVertexInputBindingDescription getPositionOnlyBindingDescription()
+	{
+		VkVertexInputBindingDescription bindingDescription = {};
+		bindingDescription.binding = 0;
+		bindingDescription.stride = sizeof(glm::vec3);
+		bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
 
-	BBox() : min(std::numeric_limits<float>::max()), max(-std::numeric_limits<float>::max()) {}
+		return bindingDescription;
+	}
 
-	BBox(const glm::vec3 &_min, const glm::vec3 &_max)
-		: min(_min), max(_max) {}
+	static VkVertexInputAttributeDescription getPositionOnlyAttributeDescription()
+	{
+		VkVertexInputAttributeDescription attributeDescription = {};
+		attributeDescription.binding = 0;
+		attributeDescription.location = 0;
+		attributeDescription.format = VK_FORMAT_R32G32B32_SFLOAT;
+		attributeDescription.offset = 0;
 
-	BBox getTransformedAABB(const glm::mat4 &T) const;
+		return attributeDescription;
+	}
 };
 
 namespace std
@@ -107,6 +118,11 @@ namespace rj
 			std::vector<Vertex> &hostVerts, std::vector<uint32_t> &hostIndices,
 			glm::vec3 *minPos = nullptr, glm::vec3 *maxPos = nullptr);
 
+		// Vertices that only differ in normal or uv are merged so that the position stream
+		// can be deduplicated further than the interleaved one
+		void extractUniquePositions(const std::vector<Vertex> &hostVerts, const std::vector<uint32_t> &hostIndices,
+			std::vector<glm::vec3> &hostPositions, std::vector<uint32_t> &hostPositionIndices);
+
 		void loadTexture2DFromBinaryData(ImageWrapper *pTexRet, VManager *pManager, const void *pixels,
 			uint32_t width, uint32_t height, gli::format gliformat, uint32_t mipLevels = 1, bool createSampler = true);
 
@@ -125,25 +141,37 @@ enum MaterialType
 
 typedef uint32_t MaterialType_t;
 
-struct PerModelUniformBuffer
+// Node of an imported scene hierarchy, parents come before their children (depth first)
+struct VMeshNode
 {
-	glm::mat4 M;
-	glm::mat4 M_invTrans;
+	uint32_t parent = std::numeric_limits<uint32_t>::max();
+	glm::vec3 position;
+	glm::quat rotation;
+	float scale = 1.f;
+	std::vector<uint32_t> meshes; // indices into the loaded meshes
 };
 
+// Geometry and material shared by all instances of a model
 class VMesh
 {
 public:
 	const static uint32_t numMapsPerMesh = 6;
 
 	rj::VManager *pVulkanManager;
+	GeometryPool *pGeometryPool; // geometry goes into dedicated buffers when null
 
-	PerModelUniformBuffer *uPerModelInfo = nullptr;
-	bool uniformDataChanged = true;
-
+	// Ranges of the geometry pool streams, or whole dedicated buffers without a pool
 	rj::helper_functions::BufferWrapper vertexBuffer;
 	rj::helper_functions::BufferWrapper indexBuffer;
 
+	// Position-only stream used by depth-only passes (e.g. shadow pass)
+	rj::helper_functions::BufferWrapper positionBuffer;
+	rj::helper_functions::BufferWrapper positionIndexBuffer;
+
+	// Model space copy of the position-only stream kept on the host for CPU occlusion culling
+	std::vector<glm::vec3> occluderPositions;
+	std::vector<uint32_t> occluderIndices;
+
 	rj::helper_functions::ImageWrapper albedoMap;
 	rj::helper_functions::ImageWrapper normalMap;
 	rj::helper_functions::ImageWrapper roughnessMap;
@@ -154,11 +182,15 @@ public:
 	MaterialType_t materialType = MATERIAL_TYPE_FSCHLICK_DGGX_GSMITH;
 
 
-	static void loadFromGLTF(std::vector<VMesh> &retMeshes, rj::VManager *pManager, const std::string &gltfFileName,
-		const std::string &version = "1.0")
+	// Appends the meshes of the file to @retMeshes and its node hierarchy to @retNodes
+	static void loadFromGLTF(std::vector<VMesh> &retMeshes, std::vector<VMeshNode> &retNodes, rj::VManager *pManager,
+		const std::string &gltfFileName, const std::string &version = "1.0", GeometryPool *pGeometryPool = nullptr)
 	{
 		using namespace rj::helper_functions;
 
+		const uint32_t firstMesh = static_cast<uint32_t>(retMeshes.size());
+		const uint32_t firstNode = static_cast<uint32_t>(retNodes.size());
+
 		if (version == "1.0")
 		{
 			// Parse glTF
@@ -207,7 +239,7 @@ public:
 
 			for (const auto &matMeshes : mat2meshes)
 			{
-				retMeshes.emplace_back(pManager);
+				retMeshes.emplace_back(pManager, pGeometryPool);
 				auto &retMesh = retMeshes.back();
 
 				// Textures
@@ -352,21 +384,14 @@ public:
 					indexOffset += numIndices;
 				}
 
-				// create vertex buffer
-				retMesh.vertexBuffer = {};
-				retMesh.vertexBuffer.size = sizeof(hostVertices[0]) * hostVertices.size();
-				retMesh.vertexBuffer.buffer = pManager->createBuffer(retMesh.vertexBuffer.size,
-					VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-
-				pManager->transferHostDataToBuffer(retMesh.vertexBuffer.buffer, retMesh.vertexBuffer.size, hostVertices.data());
-
-				// create index buffer
-				retMesh.indexBuffer = {};
-				retMesh.indexBuffer.size = sizeof(hostIndices[0]) * hostIndices.size();
-				retMesh.indexBuffer.buffer = pManager->createBuffer(retMesh.indexBuffer.size,
-					VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+				retMesh.createGeometryBuffers(hostVertices, hostIndices);
+			}
 
-				pManager->transferHostDataToBuffer(retMesh.indexBuffer.buffer, retMesh.indexBuffer.size, hostIndices.data());
+			// nodes are not parsed for glTF 1.0, every mesh is placed at the origin
+			for (uint32_t i = firstMesh; i < retMeshes.size(); ++i)
+			{
+				retNodes.emplace_back();
+				retNodes.back().meshes.push_back(i);
 			}
 		}
 		else
@@ -377,7 +402,7 @@ public:
 
 			for (const auto &mesh : scene.meshes)
 			{
-				retMeshes.emplace_back(pManager);
+				retMeshes.emplace_back(pManager, pGeometryPool);
 				auto &retMesh = retMeshes.back();
 				auto gliFormat = gli::FORMAT_RGBA8_UNORM_PACK8;
 
@@ -421,27 +446,25 @@ public:
 					retMesh.bounds.min = glm::min(retMesh.bounds.min, vert.pos);
 				}
 
-				// create vertex buffer
-				retMesh.vertexBuffer = {};
-				retMesh.vertexBuffer.size = sizeof(hostVertices[0]) * hostVertices.size();
-				retMesh.vertexBuffer.buffer = pManager->createBuffer(retMesh.vertexBuffer.size,
-					VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-
-				pManager->transferHostDataToBuffer(retMesh.vertexBuffer.buffer, retMesh.vertexBuffer.size, hostVertices.data());
-
-				// create index buffer
-				retMesh.indexBuffer = {};
-				retMesh.indexBuffer.size = sizeof(mesh.indices[0]) * mesh.indices.size();
-				retMesh.indexBuffer.buffer = pManager->createBuffer(retMesh.indexBuffer.size,
-					VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+				retMesh.createGeometryBuffers(hostVertices, mesh.indices);
+			}
 
-				pManager->transferHostDataToBuffer(retMesh.indexBuffer.buffer, retMesh.indexBuffer.size, mesh.indices.data());
+			for (const auto &node : scene.nodes)
+			{
+				// the loader bakes non-uniformly scaled subtrees into the vertices, what is left is scaled uniformly
+				retNodes.emplace_back();
+				auto &retNode = retNodes.back();
+				retNode.parent = node.parent == std::numeric_limits<uint32_t>::max() ? node.parent : firstNode + node.parent;
+				retNode.position = node.translation;
+				retNode.rotation = node.rotation;
+				retNode.scale = node.scale.x;
+				for (uint32_t meshIdx : node.meshes) retNode.meshes.push_back(firstMesh + meshIdx);
 			}
 		}
 	}
 
 
-	VMesh(rj::VManager *pManager);
+	VMesh(rj::VManager *pManager, GeometryPool *pPool = nullptr);
 
 	void load(
 		const std::string &modelFileName,
@@ -488,46 +511,56 @@ public:
 		bounds.min = minPos;
 		bounds.max = maxPos;
 
-		// create vertex buffer
-		vertexBuffer = {};
-		vertexBuffer.size = sizeof(hostVerts[0]) * hostVerts.size();
-		vertexBuffer.buffer = pVulkanManager->createBuffer(vertexBuffer.size,
-			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		createGeometryBuffers(hostVerts, hostIndices);
+	}
 
-		pVulkanManager->transferHostDataToBuffer(vertexBuffer.buffer, vertexBuffer.size, hostVerts.data());
+	// Model space bounds
+	const BBox &getBounds() const { return bounds; }
 
-		// create index buffer
-		indexBuffer = {};
-		indexBuffer.size = sizeof(hostIndices[0]) * hostIndices.size();
-		indexBuffer.buffer = pVulkanManager->createBuffer(indexBuffer.size,
-			VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	// Returns the vertex and index ranges to the geometry pool (or destroys the dedicated buffers).
+	// Command buffers that draw the mesh must have finished
+	void releaseGeometry();
 
-		pVulkanManager->transferHostDataToBuffer(indexBuffer.buffer, indexBuffer.size, hostIndices.data());
-	}
+	// Destroys the material maps. Command buffers that sample them must have finished
+	void releaseTextures();
 
-	virtual void updateHostUniformBuffer()
-	{
-		assert(uPerModelInfo);
-		if (!uniformDataChanged) return;
-		uPerModelInfo->M = glm::translate(glm::mat4_cast(worldRotation) * glm::scale(glm::mat4(), glm::vec3(scale)), worldPosition);
-		uPerModelInfo->M_invTrans = glm::transpose(glm::inverse(uPerModelInfo->M));
-		uniformDataChanged = false;
-	}
+protected:
+	// Uploads the interleaved and position-only streams and keeps the latter for occlusion culling
+	void createGeometryBuffers(const std::vector<Vertex> &hostVerts, const std::vector<uint32_t> &hostIndices);
+	void createGeometryBuffer(GeometryPool::Stream stream, rj::helper_functions::BufferWrapper &buffer, const void *hostData,
+		VkDeviceSize elementSize, size_t elementCount, VkBufferUsageFlags usage);
+
+	BBox bounds;
+};
+
+// A placement of a mesh in the scene, the unit of culling. Instances of the same mesh are drawn
+// by one instanced draw that fetches each instance's transform through the instance index.
+// The transform itself lives in a TransformSystem, which tracks what changed
+class VMeshInstance
+{
+public:
+	uint32_t meshIdx;
+
+	VMeshInstance(uint32_t meshIdx, const BBox &meshBounds, TransformSystem *pTransforms, uint32_t transformIdx);
 
 	void setPosition(const glm::vec3 &newPos);
 	void setRotation(const glm::quat &newRot);
 	void setScale(float newScale);
-
-	const glm::vec3 &getPostion() const { return worldPosition; }
-	const glm::quat &getRotation() const { return worldRotation; }
-	float getScale() const { return scale; }
+	void setTransform(const glm::vec3 &newPos, const glm::quat &newRot, float newScale);
+
+	glm::vec3 getPostion() const { return pTransforms->getPosition(transformIdx); }
+	glm::quat getRotation() const { return pTransforms->getRotation(transformIdx); }
+	float getScale() const { return pTransforms->getScale(transformIdx); }
+	uint32_t getTransformIdx() const { return transformIdx; }
+	glm::mat4 getModelMatrix() const { return pTransforms->computeModelMatrix(transformIdx); }
+	const BBox &getMeshBounds() const { return meshBounds; }
 	BBox getAABBWorldSpace() const;
 
 protected:
-	glm::vec3 worldPosition;
-	glm::quat worldRotation;
-	float scale;
-	BBox bounds;
+	TransformSystem *pTransforms;
+	uint32_t transformIdx;
+
+	BBox meshBounds;
 };
 
 class Skybox : public VMesh
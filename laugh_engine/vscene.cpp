@@ -2,17 +2,119 @@
 
 
 VScene::VScene(rj::VManager *pManager)
-	: skybox(pManager)
+	: skybox(pManager), geometryPool(pManager), pVulkanManager(pManager)
 {
 }
 
+uint32_t VScene::addMesh()
+{
+	if (freeMeshSlots.empty())
+	{
+		meshes.emplace_back(pVulkanManager, &geometryPool);
+		return static_cast<uint32_t>(meshes.size() - 1);
+	}
+
+	const uint32_t meshIdx = freeMeshSlots.back();
+	freeMeshSlots.pop_back();
+	meshes[meshIdx] = VMesh(pVulkanManager, &geometryPool);
+	deadMeshFlags[meshIdx] = 0;
+	return meshIdx;
+}
+
+VMeshInstance &VScene::addInstance(uint32_t meshIdx, uint32_t node)
+{
+	assert(isMeshAlive(meshIdx));
+	const BBox &meshBounds = meshes.at(meshIdx).getBounds();
+
+	// an object and its transform share the index
+	uint32_t objectIdx;
+	if (freeInstanceSlots.empty())
+	{
+		objectIdx = transforms.add();
+		instances.emplace_back(meshIdx, meshBounds, &transforms, objectIdx);
+		instanceNodes.push_back(node);
+	}
+	else
+	{
+		objectIdx = freeInstanceSlots.back();
+		freeInstanceSlots.pop_back();
+		instances[objectIdx] = VMeshInstance(meshIdx, meshBounds, &transforms, objectIdx);
+		instances[objectIdx].setTransform(glm::vec3(0.f), glm::quat(), 1.f);
+		instanceNodes[objectIdx] = node;
+	}
+
+	if (node != SceneGraph::invalidNode)
+	{
+		sceneGraph.attachObject(node, objectIdx);
+	}
+	return instances[objectIdx];
+}
+
+void VScene::removeMesh(uint32_t meshIdx)
+{
+	assert(isMeshAlive(meshIdx));
+
+	for (uint32_t i = 0; i < instances.size(); ++i)
+	{
+		if (instances[i].meshIdx != meshIdx) continue;
+
+		if (instanceNodes[i] != SceneGraph::invalidNode)
+		{
+			sceneGraph.detachObject(instanceNodes[i], i);
+		}
+		instances[i].meshIdx = invalidIdx;
+		removedInstances.push_back(i);
+	}
+
+	deadMeshFlags.resize(meshes.size(), 0);
+	deadMeshFlags[meshIdx] = 1;
+	removedMeshes.push_back(meshIdx);
+}
+
+void VScene::releaseRemovedMeshes()
+{
+	for (uint32_t meshIdx : removedMeshes)
+	{
+		meshes[meshIdx].releaseGeometry();
+		meshes[meshIdx].releaseTextures();
+		freeMeshSlots.push_back(meshIdx);
+	}
+	freeInstanceSlots.insert(freeInstanceSlots.end(), removedInstances.begin(), removedInstances.end());
+
+	removedMeshes.clear();
+	removedInstances.clear();
+}
+
+uint32_t VScene::getAliveMeshCount() const
+{
+	return static_cast<uint32_t>(meshes.size() - freeMeshSlots.size() - removedMeshes.size());
+}
+
+uint32_t VScene::getAliveInstanceCount() const
+{
+	return static_cast<uint32_t>(instances.size() - freeInstanceSlots.size() - removedInstances.size());
+}
+
+void VScene::updateSceneGraph()
+{
+	for (uint32_t node : sceneGraph.update())
+	{
+		for (uint32_t objectIdx : sceneGraph.getObjects(node))
+		{
+			instances[objectIdx].setTransform(sceneGraph.getWorldPosition(node), sceneGraph.getWorldRotation(node), sceneGraph.getWorldScale(node));
+		}
+	}
+}
+
 void VScene::computeAABBWorldSpace()
 {
 	aabbWorldSpace = BBox();
-	for (const auto &mesh : meshes)
+	for (uint32_t i = 0; i < instances.size(); ++i)
 	{
-		auto meshAABB = mesh.getAABBWorldSpace();
-		aabbWorldSpace.min = glm::min(aabbWorldSpace.min, meshAABB.min);
-		aabbWorldSpace.max = glm::max(aabbWorldSpace.max, meshAABB.max);
+		if (!isInstanceAlive(i)) continue;
+
+		auto instanceAABB = instances[i].getAABBWorldSpace();
+		aabbWorldSpace.min = glm::min(aabbWorldSpace.min, instanceAABB.min);
+		aabbWorldSpace.max = glm::max(aabbWorldSpace.max, instanceAABB.max);
 	}
 }
@@ -2,18 +2,64 @@
 
 #include "vmesh.h"
 #include "directional_light.h"
+#include "scene_graph.h"
 
 
+// Meshes and instances live in slots. Removing a mesh frees its slot and the slots of its instances for
+// later additions, so indices stay stable and the slots in between can be dead (see isMeshAlive(), isInstanceAlive())
 class VScene
 {
 public:
+	static const uint32_t invalidIdx = std::numeric_limits<uint32_t>::max();
+
 	Skybox skybox;
 	DirectionalLight shadowLight;
-	std::vector<VMesh> meshes;
+	std::vector<VMesh> meshes; // meshes appended directly (e.g. by VMesh::loadFromGLTF) are alive
+	std::vector<VMeshInstance> instances; // the objects of the scene, any number per mesh. Dead ones have meshIdx invalidIdx
+	TransformSystem transforms; // of the instances, in the same order
+	SceneGraph sceneGraph; // instances attached to a node follow it
+
+	BBox aabbWorldSpace; // of the alive instances as of the last computeAABBWorldSpace()
 
-	BBox aabbWorldSpace;
+	// Vertex and index streams of all meshes, so that one bind serves every draw of a pass
+	// and a single multi-draw can render any subset of meshes. The skybox keeps its own buffers
+	GeometryPool geometryPool;
 
 	VScene(rj::VManager *pManager);
 
+	// Returns the slot of a new mesh that uses the geometry pool, the caller loads it
+	uint32_t addMesh();
+
+	// Returns the new instance, which is only valid until the next call.
+	// An instance attached to @node takes the node's world transform on the next updateSceneGraph()
+	VMeshInstance &addInstance(uint32_t meshIdx, uint32_t node = SceneGraph::invalidNode);
+
+	// Removes the mesh and its instances from the scene right away. Frames in flight may still draw them,
+	// so geometry, textures and slots are only released by releaseRemovedMeshes()
+	void removeMesh(uint32_t meshIdx);
+	void releaseRemovedMeshes();
+
+	bool isMeshAlive(uint32_t meshIdx) const { return meshIdx >= deadMeshFlags.size() || !deadMeshFlags[meshIdx]; }
+	bool isInstanceAlive(uint32_t objectIdx) const { return instances[objectIdx].meshIdx != invalidIdx; }
+	uint32_t getAliveMeshCount() const;
+	uint32_t getAliveInstanceCount() const;
+	// Slots that are neither free nor waiting for releaseRemovedMeshes()
+	uint32_t getUsedMeshSlotCount() const { return static_cast<uint32_t>(meshes.size() - freeMeshSlots.size()); }
+	uint32_t getUsedInstanceSlotCount() const { return static_cast<uint32_t>(instances.size() - freeInstanceSlots.size()); }
+
+	// Propagates scene graph changes to the attached instances
+	void updateSceneGraph();
+
+	// Call after instances are placed, or when instances are added or removed
 	void computeAABBWorldSpace();
+
+protected:
+	rj::VManager *pVulkanManager;
+
+	std::vector<uint8_t> deadMeshFlags;
+	std::vector<uint32_t> instanceNodes;
+	std::vector<uint32_t> freeMeshSlots;
+	std::vector<uint32_t> freeInstanceSlots;
+	std::vector<uint32_t> removedMeshes;
+	std::vector<uint32_t> removedInstances;
 };
\ No newline at end of file
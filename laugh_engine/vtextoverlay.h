@@ -30,24 +30,26 @@ public:
 	{}
 
 	// load in font descriptors and 
-	void prepareResources()
+	// every one of @frameCount frames in flight gets its own command buffer and vertex buffer region
+	void prepareResources(uint32_t frameCount)
 	{
-		createCommandPools();
+		createCommandPools(frameCount);
 		createFontTexture();
-		createVertexBuffer();
+		createVertexBuffer(frameCount);
 		createDescriptorPoolAndSetLayouts();
 		createDescriptorSets();
 		createRenderPasses();
 		createPipelines();
 	}
 
-	void beginTextUpdate()
+	void beginTextUpdate(uint32_t frameIdx)
 	{
-		mapped = reinterpret_cast<glm::vec4 *>(pManager->mapBuffer(fontQuadVertexBuffer.buffer));
+		mapped = reinterpret_cast<glm::vec4 *>(pManager->mapBuffer(fontQuadVertexBuffer.buffer,
+			frameIdx * frameVertexBufferSize, frameVertexBufferSize));
 		numLetters = 0;
 	}
 
-	void addText(std::string text, float x, float y, TextAlign align = alignLeft)
+	void addText(const char *text, float x, float y, TextAlign align = alignLeft)
 	{
 		assert(mapped != nullptr);
 
@@ -63,9 +65,9 @@ public:
 
 		// Calculate text width
 		float textWidth = 0;
-		for (auto letter : text)
+		for (const char *letter = text; *letter; ++letter)
 		{
-			stb_fontchar *charData = &fontDescriptors[(uint32_t)letter - STB_FIRST_CHAR];
+			stb_fontchar *charData = &fontDescriptors[(uint32_t)*letter - STB_FIRST_CHAR];
 			textWidth += charData->advance * charW;
 		}
 
@@ -80,9 +82,9 @@ public:
 		}
 
 		// Generate a uv mapped quad per char in the new text
-		for (auto letter : text)
+		for (const char *letter = text; *letter && numLetters < MAX_CHAR_COUNT; ++letter)
 		{
-			stb_fontchar *charData = &fontDescriptors[(uint32_t)letter - STB_FIRST_CHAR];
+			stb_fontchar *charData = &fontDescriptors[(uint32_t)*letter - STB_FIRST_CHAR];
 
 			mapped->x = (x + (float)charData->x0 * charW);
 			mapped->y = (y + (float)charData->y0 * charH);
@@ -114,51 +116,53 @@ public:
 		}
 	}
 
-	void endTextUpdate(uint32_t imageIdx)
+	// the command buffer of @frameIdx must not be pending anymore
+	void endTextUpdate(uint32_t frameIdx, uint32_t imageIdx)
 	{
 		pManager->unmapBuffer(fontQuadVertexBuffer.buffer);
 		mapped = nullptr;
-		updateCommandBuffers(imageIdx);
+		updateCommandBuffers(frameIdx, imageIdx);
 	}
 
-	void updateCommandBuffers(uint32_t imageIdx)
+	void updateCommandBuffers(uint32_t frameIdx, uint32_t imageIdx)
 	{
-		pManager->beginCommandBuffer(commandBuffers[imageIdx]);
+		const uint32_t cb = commandBuffers[frameIdx];
+		pManager->beginCommandBuffer(cb);
 
-		auto framebuffers = pManager->getSwapChainFramebuffers();
-		pManager->cmdBeginRenderPass(commandBuffers[imageIdx], renderPass, framebuffers[imageIdx], {});
+		const auto &framebuffers = pManager->getSwapChainFramebuffers();
+		pManager->cmdBeginRenderPass(cb, renderPass, framebuffers[imageIdx], {});
 
-		pManager->cmdBindPipeline(commandBuffers[imageIdx], VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+		pManager->cmdBindPipeline(cb, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
 
-		pManager->cmdSetViewport(commandBuffers[imageIdx], framebuffers[imageIdx]);
-		pManager->cmdSetScissor(commandBuffers[imageIdx], framebuffers[imageIdx]);
+		pManager->cmdSetViewport(cb, framebuffers[imageIdx]);
+		pManager->cmdSetScissor(cb, framebuffers[imageIdx]);
 
-		pManager->cmdBindDescriptorSets(commandBuffers[imageIdx], VK_PIPELINE_BIND_POINT_GRAPHICS,
+		pManager->cmdBindDescriptorSets(cb, VK_PIPELINE_BIND_POINT_GRAPHICS,
 			pipelineLayout, { descriptorSet });
 
-		pManager->cmdBindVertexBuffers(commandBuffers[imageIdx], { fontQuadVertexBuffer.buffer }, { 0 });
+		pManager->cmdBindVertexBuffers(cb, { fontQuadVertexBuffer.buffer }, { frameIdx * frameVertexBufferSize });
 
 		for (uint32_t j = 0; j < numLetters; j++)
 		{
-			pManager->cmdDraw(commandBuffers[imageIdx], 4, 1, j * 4, 0);
+			pManager->cmdDraw(cb, 4, 1, j * 4, 0);
 		}
 
-		pManager->cmdEndRenderPass(commandBuffers[imageIdx]);
+		pManager->cmdEndRenderPass(cb);
 
-		pManager->endCommandBuffer(commandBuffers[imageIdx]);
+		pManager->endCommandBuffer(cb);
 	}
 
-	void submit(
-		uint32_t bufferindex, 
-		const std::vector<uint32_t> &waitSemaphores,
-		const std::vector<VkPipelineStageFlags> &waitStages, 
-		const std::vector<uint32_t> &signalSemaphores,
-		uint32_t fence = std::numeric_limits<uint32_t>::max(),
-		bool waitFence = false) const
+	// Returns the graphics timeline value that signals the overlay is drawn
+	uint64_t submit(
+		uint32_t frameIdx, 
+		rj::ArrayRef<uint32_t> waitSemaphores,
+		rj::ArrayRef<VkPipelineStageFlags> waitStages,
+		rj::ArrayRef<uint32_t> signalSemaphores,
+		rj::ArrayRef<rj::TimelineWait> timelineWaits = {}) const
 	{
 		pManager->beginQueueSubmit(VK_QUEUE_GRAPHICS_BIT);
-		pManager->queueSubmitNewSubmit({ commandBuffers[bufferindex] }, waitSemaphores, waitStages, signalSemaphores);
-		pManager->endQueueSubmit(fence, waitFence);
+		pManager->queueSubmitNewSubmit({ commandBuffers[frameIdx] }, waitSemaphores, waitStages, signalSemaphores, timelineWaits);
+		return pManager->endQueueSubmit();
 	}
 
 	uint32_t getCommandBuffer(uint32_t bufferIdx) const { return commandBuffers[bufferIdx]; }
@@ -171,6 +175,7 @@ private:
 	const VkFormat fontDeviceTextureFormat = VK_FORMAT_R8_UNORM;
 	rj::helper_functions::ImageWrapper fontDeviceTexture;
 	rj::helper_functions::BufferWrapper fontQuadVertexBuffer;
+	VkDeviceSize frameVertexBufferSize;
 	uint32_t descriptorSetLayout;
 	uint32_t descriptorPool;
 	uint32_t descriptorSet;
@@ -216,13 +221,12 @@ private:
 		}
 	};
 
-	void createCommandPools()
+	void createCommandPools(uint32_t frameCount)
 	{
 		// Each command buffer can be reset individually
 		commandPool = pManager->createCommandPool(VK_QUEUE_GRAPHICS_BIT, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
 
-		uint32_t count = pManager->getSwapChainSize();
-		commandBuffers = pManager->allocateCommandBuffers(commandPool, count);
+		commandBuffers = pManager->allocateCommandBuffers(commandPool, frameCount);
 	}
 
 	void createFontTexture()
@@ -255,10 +259,12 @@ private:
 			VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE);
 	}
 
-	void createVertexBuffer()
+	void createVertexBuffer(uint32_t frameCount)
 	{
+		// a quad of 4 vertices (x, y, s, t) per char. The buffer shares its memory block with others, so writes must not run past it
+		frameVertexBufferSize = MAX_CHAR_COUNT * 4 * sizeof(glm::vec4);
 		fontQuadVertexBuffer.offset = 0;
-		fontQuadVertexBuffer.size = MAX_CHAR_COUNT * sizeof(glm::vec4); // (x, y, s, t)
+		fontQuadVertexBuffer.size = frameCount * frameVertexBufferSize;
 		
 		fontQuadVertexBuffer.buffer = pManager->createBuffer(fontQuadVertexBuffer.size,
 			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
@@ -1,29 +1,35 @@
-C:/VulkanSDK/1.0.39.1/Bin/glslangValidator.exe -V geom_pass/geom.vert -o geom_pass/geom.vert.spv
-C:/VulkanSDK/1.0.39.1/Bin/glslangValidator.exe -V geom_pass/geom.frag -o geom_pass/geom.frag.spv
-C:/VulkanSDK/1.0.39.1/Bin/glslangValidator.exe -V geom_pass/skybox.vert -o geom_pass/skybox.vert.spv
-C:/VulkanSDK/1.0.39.1/Bin/glslangValidator.exe -V geom_pass/skybox.frag -o geom_pass/skybox.frag.spv
+C:/VulkanSDK/1.2.198.1/Bin/glslangValidator.exe -V geom_pass/geom.vert -o geom_pass/geom.vert.spv
+C:/VulkanSDK/1.2.198.1/Bin/glslangValidator.exe -V geom_pass/geom.frag -o geom_pass/geom.frag.spv
+C:/VulkanSDK/1.2.198.1/Bin/glslangValidator.exe -V geom_pass/skybox.vert -o geom_pass/skybox.vert.spv
+C:/VulkanSDK/1.2.198.1/Bin/glslangValidator.exe -V geom_pass/skybox.frag -o geom_pass/skybox.frag.spv
 
-C:/VulkanSDK/1.0.39.1/Bin/glslangValidator.exe -V final_output_pass/final_output.frag -o final_output_pass/final_output.frag.spv
+C:/VulkanSDK/1.2.198.1/Bin/glslangValidator.exe -V final_output_pass/final_output.frag -o final_output_pass/final_output.frag.spv
 
-C:/VulkanSDK/1.0.39.1/Bin/glslangValidator.exe -V lighting_pass/lighting.vert -o lighting_pass/lighting.vert.spv
-C:/VulkanSDK/1.0.39.1/Bin/glslangValidator.exe -V lighting_pass/lighting.frag -o lighting_pass/lighting.frag.spv
+C:/VulkanSDK/1.2.198.1/Bin/glslangValidator.exe -V lighting_pass/lighting.vert -o lighting_pass/lighting.vert.spv
+C:/VulkanSDK/1.2.198.1/Bin/glslangValidator.exe -V lighting_pass/lighting.frag -o lighting_pass/lighting.frag.spv
 
-C:/VulkanSDK/1.0.39.1/Bin/glslangValidator.exe -V text_pass/text.vert -o text_pass/text.vert.spv
-C:/VulkanSDK/1.0.39.1/Bin/glslangValidator.exe -V text_pass/text.frag -o text_pass/text.frag.spv
+C:/VulkanSDK/1.2.198.1/Bin/glslangValidator.exe -V text_pass/text.vert -o text_pass/text.vert.spv
+C:/VulkanSDK/1.2.198.1/Bin/glslangValidator.exe -V text_pass/text.frag -o text_pass/text.frag.spv
 
-C:/VulkanSDK/1.0.39.1/Bin/glslangValidator.exe -V fullscreen.vert -o fullscreen.vert.spv
+C:/VulkanSDK/1.2.198.1/Bin/glslangValidator.exe -V fullscreen.vert -o fullscreen.vert.spv
 
-C:/VulkanSDK/1.0.39.1/Bin/glslangValidator.exe -V brdf_lut_pass/brdf_lut.comp -o brdf_lut_pass/brdf_lut.comp.spv
+C:/VulkanSDK/1.2.198.1/Bin/glslangValidator.exe -V brdf_lut_pass/brdf_lut.comp -o brdf_lut_pass/brdf_lut.comp.spv
 
-C:/VulkanSDK/1.0.39.1/Bin/glslangValidator.exe -V env_prefilter_pass/env_prefilter.vert -o env_prefilter_pass/env_prefilter.vert.spv
-C:/VulkanSDK/1.0.39.1/Bin/glslangValidator.exe -V env_prefilter_pass/env_prefilter.geom -o env_prefilter_pass/env_prefilter.geom.spv
-C:/VulkanSDK/1.0.39.1/Bin/glslangValidator.exe -V env_prefilter_pass/spec_env_prefilter.frag -o env_prefilter_pass/spec_env_prefilter.frag.spv
-C:/VulkanSDK/1.0.39.1/Bin/glslangValidator.exe -V env_prefilter_pass/diff_env_prefilter.frag -o env_prefilter_pass/diff_env_prefilter.frag.spv
+C:/VulkanSDK/1.2.198.1/Bin/glslangValidator.exe -V hiz_pass/depth_resolve.comp -o hiz_pass/depth_resolve.comp.spv
+C:/VulkanSDK/1.2.198.1/Bin/glslangValidator.exe -V hiz_pass/hiz_downsample.comp -o hiz_pass/hiz_downsample.comp.spv
+C:/VulkanSDK/1.2.198.1/Bin/glslangValidator.exe -V hiz_pass/occlusion_cull.comp -o hiz_pass/occlusion_cull.comp.spv
 
-C:/VulkanSDK/1.0.39.1/Bin/glslangValidator.exe -V bloom_pass/brightness_mask.frag -o bloom_pass/brightness_mask.frag.spv
-C:/VulkanSDK/1.0.39.1/Bin/glslangValidator.exe -V bloom_pass/gaussian_blur.frag -o bloom_pass/gaussian_blur.frag.spv
-C:/VulkanSDK/1.0.39.1/Bin/glslangValidator.exe -V bloom_pass/merge.frag -o bloom_pass/merge.frag.spv
+C:/VulkanSDK/1.2.198.1/Bin/glslangValidator.exe -V cull_pass/draw_cull.comp -o cull_pass/draw_cull.comp.spv
 
-C:/VulkanSDK/1.0.39.1/Bin/glslangValidator.exe -V shadow_pass/shadow.vert -o shadow_pass/shadow.vert.spv
+C:/VulkanSDK/1.2.198.1/Bin/glslangValidator.exe -V env_prefilter_pass/env_prefilter.vert -o env_prefilter_pass/env_prefilter.vert.spv
+C:/VulkanSDK/1.2.198.1/Bin/glslangValidator.exe -V env_prefilter_pass/env_prefilter.geom -o env_prefilter_pass/env_prefilter.geom.spv
+C:/VulkanSDK/1.2.198.1/Bin/glslangValidator.exe -V env_prefilter_pass/spec_env_prefilter.frag -o env_prefilter_pass/spec_env_prefilter.frag.spv
+C:/VulkanSDK/1.2.198.1/Bin/glslangValidator.exe -V env_prefilter_pass/diff_env_prefilter.frag -o env_prefilter_pass/diff_env_prefilter.frag.spv
 
-pause
\ No newline at end of file
+C:/VulkanSDK/1.2.198.1/Bin/glslangValidator.exe -V bloom_pass/brightness_mask.frag -o bloom_pass/brightness_mask.frag.spv
+C:/VulkanSDK/1.2.198.1/Bin/glslangValidator.exe -V bloom_pass/gaussian_blur.frag -o bloom_pass/gaussian_blur.frag.spv
+C:/VulkanSDK/1.2.198.1/Bin/glslangValidator.exe -V bloom_pass/merge.frag -o bloom_pass/merge.frag.spv
+
+C:/VulkanSDK/1.2.198.1/Bin/glslangValidator.exe -V shadow_pass/shadow.vert -o shadow_pass/shadow.vert.spv
+
+pause
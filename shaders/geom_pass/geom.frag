@@ -1,24 +1,36 @@
 #version 450
 
 #extension GL_ARB_separate_shader_objects : enable
+#extension GL_EXT_nonuniform_qualifier : enable
 
-layout (binding = 2) uniform sampler2D samplerAlbedo;
-layout (binding = 3) uniform sampler2D samplerNormal;
-layout (binding = 4) uniform sampler2D samplerRoughness;
-layout (binding = 5) uniform sampler2D samplerMetalness;
-layout (binding = 6) uniform sampler2D samplerAO;
-layout (binding = 7) uniform sampler2D samplerEmissive;
+#define MATERIAL_HAS_AO_MAP			1
+#define MATERIAL_HAS_EMISSIVE_MAP	2
 
-layout (push_constant) uniform pushConstants
+// set 0 is per frame, set 1 holds the textures of all meshes and the material table
+layout (set = 1, binding = 0) uniform sampler2D textures[];
+
+struct Material
+{
+	uint albedoMap;
+	uint normalMap;
+	uint roughnessMap;
+	uint metalnessMap;
+	uint aoMap;
+	uint emissiveMap;
+	uint materialType;
+	uint flags;
+};
+
+layout (std430, set = 1, binding = 1) readonly buffer Materials
 {
-	uint materialId;
-	uint hasAoMap;
-	uint hasEmissiveMap;
-} pcs;
+	Material materials[];
+};
 
 layout (location = 0) in vec3 inWorldPos;
 layout (location = 1) in vec3 inWorldNormal;
 layout (location = 2) in vec2 inTexcoord;
+// all instances of a draw share their mesh, so the index is uniform within a draw
+layout (location = 3) flat in uint inMaterialIdx;
 
 layout (location = 0) out vec4 outGbuffer1;
 layout (location = 1) out vec4 outGbuffer2;
@@ -50,22 +62,24 @@ mat3 computeTBN(vec3 n)
 
 void main() 
 {
+	Material material = materials[inMaterialIdx];
+
 	vec3 emissiveColor = vec3(0.0);
-	if (pcs.hasEmissiveMap > 0)
+	if ((material.flags & MATERIAL_HAS_EMISSIVE_MAP) != 0)
 	{
-		emissiveColor = texture(samplerEmissive, inTexcoord).rgb;
+		emissiveColor = texture(textures[material.emissiveMap], inTexcoord).rgb;
 	}
-	vec4 albedo = texture(samplerAlbedo, inTexcoord);
+	vec4 albedo = texture(textures[material.albedoMap], inTexcoord);
 	float emissiveness = min(dot(emissiveColor, vec3(0.2126, 0.7152, 0.0722)) * 2.0, 1.0);
 	
 	albedo = vec4(mix(albedo.rgb, emissiveColor, emissiveness), 0.0);
-	vec3 nrmmap = texture(samplerNormal, inTexcoord).rgb;
-	float roughness = texture(samplerRoughness, inTexcoord).g;
-	float metalness = texture(samplerMetalness, inTexcoord).r;
+	vec3 nrmmap = texture(textures[material.normalMap], inTexcoord).rgb;
+	float roughness = texture(textures[material.roughnessMap], inTexcoord).g;
+	float metalness = texture(textures[material.metalnessMap], inTexcoord).r;
 	float aoVal = 1.0;
-	if (pcs.hasAoMap > 0)
+	if ((material.flags & MATERIAL_HAS_AO_MAP) != 0)
 	{
-		aoVal = texture(samplerAO, inTexcoord).r;
+		aoVal = texture(textures[material.aoMap], inTexcoord).r;
 	}
 
 	vec3 surfnrm = normalize(inWorldNormal);
@@ -73,7 +87,7 @@ void main()
 	
 	float packedAlbedo = packRGBA(albedo);
 	vec3 nrm = normalize(tbn * (2.0 * nrmmap - 1.0));
-	vec4 RMAI = vec4(roughness, metalness, aoVal, float(pcs.materialId) / 255.0);
+	vec4 RMAI = vec4(roughness, metalness, aoVal, float(material.materialType) / 255.0);
 	
 	outGbuffer1 = vec4(nrm, packedAlbedo);
 	outGbuffer2 = vec4(inWorldPos, emissiveness);
@@ -11,15 +11,33 @@ layout (std140, set = 0, binding = 0) uniform UBO
 	mat4 VP;
 };
 
-layout (std140, set = 0, binding = 1) uniform UBO_per_model
+struct ObjectTransform
 {
 	mat4 M;
 	mat4 M_invTrans;
 };
 
+layout (std430, set = 0, binding = 1) readonly buffer ObjectTransforms
+{
+	ObjectTransform objects[];
+};
+
+// object index of each instance, written by occlusion_cull.comp
+layout (std430, set = 0, binding = 2) readonly buffer InstanceObjects
+{
+	uint instanceObjects[];
+};
+
+// mesh index of each object, which is also the index into the material table
+layout (std430, set = 0, binding = 3) readonly buffer ObjectMeshes
+{
+	uint objectMeshes[];
+};
+
 layout (location = 0) out vec3 outWorldPos;
 layout (location = 1) out vec3 outWorldNormal;
 layout (location = 2) out vec2 outTexcoord;
+layout (location = 3) flat out uint outMaterialIdx;
 
 out gl_PerVertex
 {
@@ -29,9 +47,14 @@ out gl_PerVertex
 
 void main() 
 {
+	uint objIdx = instanceObjects[gl_InstanceIndex];
+	mat4 M = objects[objIdx].M;
+	mat4 M_invTrans = objects[objIdx].M_invTrans;
+
 	gl_Position = VP * M * vec4(inPosition, 1.0);
 	
 	outWorldPos = vec3(M * vec4(inPosition, 1.0));
 	outWorldNormal = normalize(vec3(M_invTrans * vec4(inNormal, 0.0)));
 	outTexcoord = inTexcoord;
+	outMaterialIdx = objectMeshes[objIdx];
 }
\ No newline at end of file
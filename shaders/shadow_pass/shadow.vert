@@ -9,12 +9,23 @@ layout (std140, set = 0, binding = 0) uniform UBO
 	mat4 cascadeVP;
 };
 
-layout (std140, set = 1, binding = 1) uniform UBO_per_model
+struct ObjectTransform
 {
 	mat4 M;
 	mat4 M_invTrans;
 };
 
+layout (std430, set = 1, binding = 0) readonly buffer ObjectTransforms
+{
+	ObjectTransform objects[];
+};
+
+// object index of each instance, written by draw_cull.comp
+layout (std430, set = 1, binding = 1) readonly buffer InstanceObjects
+{
+	uint instanceObjects[];
+};
+
 out gl_PerVertex
 {
 	vec4 gl_Position;
@@ -23,5 +34,6 @@ out gl_PerVertex
 
 void main() 
 {
+	mat4 M = objects[instanceObjects[gl_InstanceIndex]].M;
 	gl_Position = cascadeVP * (M * vec4(inPosition, 1.0));
 }
\ No newline at end of file
@@ -0,0 +1 @@
+..\x64\Release\laugh_engine.exe --drone_stress_scene 4096
\ No newline at end of file
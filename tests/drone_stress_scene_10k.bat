@@ -0,0 +1 @@
+..\x64\Release\laugh_engine.exe --drone_stress_scene 5000
\ No newline at end of file
@@ -0,0 +1 @@
+..\x64\Release\laugh_engine.exe --frame_pacing_benchmark
\ No newline at end of file
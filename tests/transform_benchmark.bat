@@ -0,0 +1 @@
+..\x64\Release\laugh_engine.exe --transform_benchmark
\ No newline at end of file